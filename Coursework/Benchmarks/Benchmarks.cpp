@@ -0,0 +1,88 @@
+// Benchmark runner
+// Usage: Benchmarks.exe [resource path] [benchmark name]
+// Runs every benchmark when no name is given, the resource path defaults to the Coursework res folder.
+#include "Benchmarks.h"
+#include <cstdio>
+#include <cstring>
+
+struct Benchmark
+{
+	const char* name;
+	void (*run)(const std::string& resourcePath);
+};
+
+static const Benchmark benchmarks[] =
+{
+	{ "objloader", RunObjLoaderBenchmark },
+	{ "meshoptimizer", RunMeshOptimizerBenchmark },
+	{ "vertexpacking", RunVertexPackingBenchmark },
+	{ "meshlets", RunMeshletBenchmark },
+	{ "renderqueue", RunRenderQueueBenchmark },
+	{ "frustumculling", RunFrustumCullerBenchmark },
+	{ "lightclustering", RunLightClustererBenchmark },
+	{ "terrainquadtree", RunTerrainQuadtreeBenchmark },
+};
+
+BenchmarkTiming TimeFunction(const std::function<void()>& function, int iterations)
+{
+	// Warm up run, gets the file into the OS cache so every timed run is equal
+	function();
+
+	BenchmarkTiming timing = { 0.0, 0.0 };
+	for (int i = 0; i < iterations; i++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		function();
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count();
+		if (i == 0 || ms < timing.bestMs) timing.bestMs = ms;
+		timing.averageMs += ms;
+	}
+	if (iterations > 0) timing.averageMs /= iterations;
+
+	return timing;
+}
+
+void PrintTiming(const std::string& label, const BenchmarkTiming& timing, const BenchmarkTiming* baseline)
+{
+	if (baseline && timing.bestMs > 0.0)
+	{
+		printf("  %-32s best %9.3f ms  avg %9.3f ms  (%.2fx)\n", label.c_str(), timing.bestMs, timing.averageMs, baseline->bestMs / timing.bestMs);
+	}
+	else
+	{
+		printf("  %-32s best %9.3f ms  avg %9.3f ms\n", label.c_str(), timing.bestMs, timing.averageMs);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string resourcePath = (argc > 1) ? argv[1] : "../Coursework/res/";
+	if (!resourcePath.empty() && resourcePath.back() != '/' && resourcePath.back() != '\\')
+	{
+		resourcePath += '/';
+	}
+	const char* only = (argc > 2) ? argv[2] : nullptr;
+
+	bool ranAny = false;
+	for (const Benchmark& benchmark : benchmarks)
+	{
+		if (only && strcmp(only, benchmark.name) != 0) continue;
+
+		printf("== %s ==\n", benchmark.name);
+		benchmark.run(resourcePath);
+		printf("\n");
+		ranAny = true;
+	}
+
+	if (!ranAny)
+	{
+		printf("Unknown benchmark '%s'. Available:", only);
+		for (const Benchmark& benchmark : benchmarks) printf(" %s", benchmark.name);
+		printf("\n");
+		return 1;
+	}
+
+	return 0;
+}
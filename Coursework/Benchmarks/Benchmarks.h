@@ -0,0 +1,36 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <string>
+
+/// <summary>
+/// Best and average wall clock time of a timed function, in milliseconds
+/// </summary>
+struct BenchmarkTiming
+{
+	double bestMs;
+	double averageMs;
+};
+
+/// <summary>
+/// Runs a function a number of times and times each run
+/// </summary>
+/// <param name="function">Function to time</param>
+/// <param name="iterations">Number of timed runs, one extra untimed run warms the caches first</param>
+/// <returns>Best and average time of the runs</returns>
+BenchmarkTiming TimeFunction(const std::function<void()>& function, int iterations);
+
+/// <summary>
+/// Prints a labelled timing line, with the speedup over a baseline if one is given
+/// </summary>
+void PrintTiming(const std::string& label, const BenchmarkTiming& timing, const BenchmarkTiming* baseline = nullptr);
+
+// Benchmarks, each takes the path to the res folder (with a trailing slash)
+void RunObjLoaderBenchmark(const std::string& resourcePath);
+void RunMeshOptimizerBenchmark(const std::string& resourcePath);
+void RunVertexPackingBenchmark(const std::string& resourcePath);
+void RunMeshletBenchmark(const std::string& resourcePath);
+void RunRenderQueueBenchmark(const std::string& resourcePath);
+void RunFrustumCullerBenchmark(const std::string& resourcePath);
+void RunLightClustererBenchmark(const std::string& resourcePath);
+void RunTerrainQuadtreeBenchmark(const std::string& resourcePath);
@@ -0,0 +1,162 @@
+// Frustum culler benchmark
+// Scatters random boxes through a large scene and culls them with FrustumCuller from a perspective camera, a slice of its
+// depth range as a DOF layer sees it, and an orthographic shadow view. Times the SSE cull against the scalar one, checks
+// they agree, and reports how many objects each view culls.
+#include "Benchmarks.h"
+#include "FrustumCuller.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const int ITERATIONS = 50;
+	const float SCENE_SIZE = 400.0f;
+	const float FIELD_OF_VIEW = 3.14159265f / 4.0f;
+	const float ASPECT = 16.0f / 9.0f;
+
+	// Row vector matrices as DirectXMath lays them out, so the benchmark runs without it
+	struct Matrix
+	{
+		float m[16];
+	};
+
+	Matrix Multiply(const Matrix& a, const Matrix& b)
+	{
+		Matrix result;
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				float sum = 0.0f;
+				for (int i = 0; i < 4; i++) sum += a.m[row * 4 + i] * b.m[i * 4 + column];
+				result.m[row * 4 + column] = sum;
+			}
+		}
+		return result;
+	}
+
+	void Normalise(float v[3])
+	{
+		float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int i = 0; i < 3; i++) v[i] /= length;
+	}
+
+	// Left handed look at, as XMMatrixLookAtLH
+	Matrix LookAt(const float eye[3], const float target[3])
+	{
+		float forward[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+		Normalise(forward);
+		float right[3] = { forward[2], 0.0f, -forward[0] };
+		Normalise(right);
+		float up[3] = { forward[1] * right[2] - forward[2] * right[1], forward[2] * right[0] - forward[0] * right[2], forward[0] * right[1] - forward[1] * right[0] };
+
+		Matrix view = { {
+			right[0], up[0], forward[0], 0.0f,
+			right[1], up[1], forward[1], 0.0f,
+			right[2], up[2], forward[2], 0.0f,
+			-(right[0] * eye[0] + right[1] * eye[1] + right[2] * eye[2]), -(up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2]), -(forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2]), 1.0f
+		} };
+		return view;
+	}
+
+	// Left handed perspective, as XMMatrixPerspectiveFovLH
+	Matrix Perspective(float nearPlane, float farPlane)
+	{
+		float yScale = 1.0f / tanf(FIELD_OF_VIEW * 0.5f);
+		float range = farPlane / (farPlane - nearPlane);
+		Matrix projection = { {
+			yScale / ASPECT, 0.0f, 0.0f, 0.0f,
+			0.0f, yScale, 0.0f, 0.0f,
+			0.0f, 0.0f, range, 1.0f,
+			0.0f, 0.0f, -range * nearPlane, 0.0f
+		} };
+		return projection;
+	}
+
+	// Left handed orthographic, as XMMatrixOrthographicLH
+	Matrix Orthographic(float width, float height, float nearPlane, float farPlane)
+	{
+		float range = 1.0f / (farPlane - nearPlane);
+		Matrix projection = { {
+			2.0f / width, 0.0f, 0.0f, 0.0f,
+			0.0f, 2.0f / height, 0.0f, 0.0f,
+			0.0f, 0.0f, range, 0.0f,
+			0.0f, 0.0f, -range * nearPlane, 1.0f
+		} };
+		return projection;
+	}
+
+	// Boxes from 0.5 to 8 units across, turned about the vertical by a world matrix as WorldObject builds them
+	void BuildScene(FrustumCuller& culler, size_t count)
+	{
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> place(-SCENE_SIZE * 0.5f, SCENE_SIZE * 0.5f), size(0.25f, 4.0f), angle(0.0f, 6.2831853f);
+
+		culler.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			float boxMin[3] = { -size(random), -size(random), -size(random) };
+			float boxMax[3] = { -boxMin[0], -boxMin[1], -boxMin[2] };
+			float yaw = angle(random);
+			float world[16] = {
+				cosf(yaw), 0.0f, -sinf(yaw), 0.0f,
+				0.0f, 1.0f, 0.0f, 0.0f,
+				sinf(yaw), 0.0f, cosf(yaw), 0.0f,
+				place(random), place(random) * 0.1f, place(random), 1.0f
+			};
+			float centre[3], extents[3], radius;
+			FrustumCuller::transformBounds(boxMin, boxMax, world, centre, extents, radius);
+			culler.add(centre, extents, radius);
+		}
+	}
+
+	void BenchmarkView(const char* label, const FrustumCuller& culler, const Matrix& viewProjection, float minDepth, float maxDepth)
+	{
+		FrustumCuller::Frustum frustum;
+		FrustumCuller::computeFrustum(viewProjection.m, frustum, minDepth, maxDepth);
+
+		std::vector<unsigned int> visible, scalarVisible;
+		FrustumCuller::Stats stats;
+		culler.cull(frustum, visible, &stats);
+		culler.cullScalar(frustum, scalarVisible);
+		printf("  %-32s %u of %u culled (%.1f%%)%s\n", label, stats.culled, stats.tested, 100.0 * stats.culled / stats.tested,
+			(visible == scalarVisible) ? "" : ", SSE and scalar DISAGREE");
+
+		BenchmarkTiming scalarTiming = TimeFunction([&]() { culler.cullScalar(frustum, scalarVisible); }, ITERATIONS);
+		PrintTiming("FrustumCuller::cullScalar", scalarTiming);
+		BenchmarkTiming sseTiming = TimeFunction([&]() { culler.cull(frustum, visible); }, ITERATIONS);
+		PrintTiming("FrustumCuller::cull (SSE)", sseTiming, &scalarTiming);
+	}
+
+	void BenchmarkCount(size_t count)
+	{
+		printf("%zu objects\n", count);
+		FrustumCuller culler;
+		BenchmarkTiming timing = TimeFunction([&]() { BuildScene(culler, count); }, 5);
+		PrintTiming("transformBounds and add", timing);
+
+		// A camera at the edge of the scene looking across it, its 9 DOF layers split the depth buffer as App1 does around the focus
+		float eye[3] = { 0.0f, 10.0f, -SCENE_SIZE * 0.5f };
+		float target[3] = { 0.0f, 0.0f, 0.0f };
+		Matrix camera = Multiply(LookAt(eye, target), Perspective(0.1f, 200.0f));
+		BenchmarkView("camera", culler, camera, 0.0f, 1.0f);
+		BenchmarkView("DOF layer", culler, camera, 0.995f, 0.996f);
+
+		// A sun looking down at an angle over a part of the scene
+		float sunEye[3] = { 50.0f, 100.0f, 50.0f };
+		float sunTarget[3] = { 0.0f, 0.0f, 0.0f };
+		Matrix sun = Multiply(LookAt(sunEye, sunTarget), Orthographic(100.0f, 100.0f, 0.1f, 300.0f));
+		BenchmarkView("shadow view", culler, sun, 0.0f, 1.0f);
+	}
+}
+
+void RunFrustumCullerBenchmark(const std::string& resourcePath)
+{
+	const size_t counts[] = { 100, 1000, 10000, 100000 };
+	for (size_t count : counts)
+	{
+		BenchmarkCount(count);
+	}
+}
@@ -0,0 +1,76 @@
+// Light clusterer benchmark
+// Scatters point lights through the view of a camera as App1 sets it up, a 16 x 9 x 24 grid from 0.1 to 200, and bins them
+// with LightClusterer. Times the scalar build against the SSE build on one thread and on every core, checks they agree,
+// and reports how many lights each cluster ends up with, from a handful of lights to many thousands.
+#include "Benchmarks.h"
+#include "LightClusterer.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+namespace
+{
+	const int ITERATIONS = 50;
+	const unsigned int TILE_COUNT_X = 16;
+	const unsigned int TILE_COUNT_Y = 9;
+	const unsigned int SLICE_COUNT = 24;
+	const float FIELD_OF_VIEW = 3.14159265f / 4.0f;
+	const float ASPECT = 16.0f / 9.0f;
+	const float NEAR_PLANE = 0.1f;
+	const float FAR_PLANE = 200.0f;
+	// Lights fade to this much of their intensity at their radius, as App1 bins them
+	const float LIGHT_CUTOFF = 1.0f / 256.0f;
+
+	// Lights in view space, spread evenly through the frustum's volume, a little past its sides and ends
+	void BuildLights(LightClusterer& clusterer, size_t count)
+	{
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f), side(-1.2f, 1.2f), linear(0.05f, 0.7f), quadratic(0.02f, 1.8f);
+		float tanHalfY = tanf(FIELD_OF_VIEW * 0.5f);
+		float tanHalfX = tanHalfY * ASPECT;
+
+		clusterer.clear();
+		for (size_t i = 0; i < count; i++)
+		{
+			// Cube root, so there are as many lights far away as the volume there holds
+			float depth = FAR_PLANE * 1.1f * cbrtf(unit(random));
+			float centre[3] = { side(random) * depth * tanHalfX, side(random) * depth * tanHalfY, depth };
+			clusterer.add(centre, LightClusterer::attenuationRange(1.0f, linear(random), quadratic(random), 1.0f, LIGHT_CUTOFF));
+		}
+	}
+
+	void BenchmarkCount(size_t count)
+	{
+		LightClusterer clusterer(TILE_COUNT_X, TILE_COUNT_Y, SLICE_COUNT);
+		float projectionScaleY = 1.0f / tanf(FIELD_OF_VIEW * 0.5f);
+		clusterer.setProjection(projectionScaleY / ASPECT, projectionScaleY, NEAR_PLANE, FAR_PLANE);
+		BuildLights(clusterer, count);
+
+		clusterer.buildScalar();
+		std::vector<unsigned int> scalarRanges = clusterer.getClusterRanges(), scalarIndices = clusterer.getLightIndices();
+		clusterer.build();
+		bool agree = scalarRanges == clusterer.getClusterRanges() && scalarIndices == clusterer.getLightIndices();
+
+		LightClusterer::Stats stats = clusterer.getStats();
+		printf("%zu lights, %u in view, %u references, %.2f per cluster, %u in the fullest%s\n", count, stats.binned, stats.references,
+			(double)stats.references / clusterer.getClusterCount(), stats.largestCluster, agree ? "" : ", SSE and scalar DISAGREE");
+
+		BenchmarkTiming scalarTiming = TimeFunction([&]() { clusterer.buildScalar(); }, ITERATIONS);
+		PrintTiming("LightClusterer::buildScalar", scalarTiming);
+		BenchmarkTiming sseTiming = TimeFunction([&]() { clusterer.build(1); }, ITERATIONS);
+		PrintTiming("LightClusterer::build (SSE)", sseTiming, &scalarTiming);
+		BenchmarkTiming threadedTiming = TimeFunction([&]() { clusterer.build(); }, ITERATIONS);
+		PrintTiming("LightClusterer::build (threads)", threadedTiming, &scalarTiming);
+	}
+}
+
+void RunLightClustererBenchmark(const std::string& resourcePath)
+{
+	printf("%u cores\n", std::thread::hardware_concurrency());
+	const size_t counts[] = { 8, 64, 512, 4096, 16384 };
+	for (size_t count : counts)
+	{
+		BenchmarkCount(count);
+	}
+}
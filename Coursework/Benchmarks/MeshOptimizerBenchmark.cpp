@@ -0,0 +1,94 @@
+// Mesh optimizer benchmark
+// Loads and welds the OBJ models the same way Model does, then reports the vertex cache statistics
+// of each MeshOptimizer pass and how long the passes take.
+#include "Benchmarks.h"
+#include "ObjLoader.h"
+#include "MeshOptimizer.h"
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	const int ITERATIONS = 10;
+
+	struct Vertex
+	{
+		XMFLOAT3 position;
+		XMFLOAT2 texture;
+		XMFLOAT3 normal;
+	};
+
+	bool LoadWelded(const std::string& path, std::vector<Vertex>& vertices, std::vector<unsigned long>& indices)
+	{
+		ObjLoader::ObjData obj;
+		if (!ObjLoader::load(path.c_str(), obj))
+		{
+			return false;
+		}
+
+		std::vector<ObjLoader::Corner> uniqueCorners;
+		std::vector<unsigned int> cornerIndices;
+		ObjLoader::weld(obj.corners, uniqueCorners, cornerIndices);
+
+		vertices.resize(uniqueCorners.size());
+		for (size_t i = 0; i < uniqueCorners.size(); i++)
+		{
+			const ObjLoader::Corner& corner = uniqueCorners[i];
+			vertices[i].position = obj.positions[corner.position];
+			vertices[i].texture = (corner.texture != ObjLoader::NO_INDEX) ? obj.texCoords[corner.texture] : XMFLOAT2(0.0f, 0.0f);
+			vertices[i].normal = (corner.normal != ObjLoader::NO_INDEX) ? obj.normals[corner.normal] : XMFLOAT3(0.0f, 1.0f, 0.0f);
+		}
+		indices.assign(cornerIndices.begin(), cornerIndices.end());
+		return true;
+	}
+
+	void PrintStats(const char* label, const std::vector<unsigned long>& indices, size_t vertexCount)
+	{
+		MeshOptimizer::CacheStats stats = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+		printf("  %-32s ACMR %.3f  ATVR %.3f\n", label, stats.acmr, stats.atvr);
+	}
+
+	void BenchmarkFile(const std::string& path)
+	{
+		printf("%s\n", path.c_str());
+
+		std::vector<Vertex> sourceVertices;
+		std::vector<unsigned long> sourceIndices;
+		if (!LoadWelded(path, sourceVertices, sourceIndices))
+		{
+			printf("  Failed to load\n");
+			return;
+		}
+		printf("  %zu vertices, %zu triangles\n", sourceVertices.size(), sourceIndices.size() / 3);
+
+		// Statistics after each pass
+		std::vector<Vertex> vertices = sourceVertices;
+		std::vector<unsigned long> indices = sourceIndices;
+		PrintStats("source order", indices, vertices.size());
+
+		MeshOptimizer::optimizeVertexCache(indices.data(), indices.size(), vertices.size());
+		PrintStats("+ vertex cache", indices, vertices.size());
+
+		MeshOptimizer::optimizeOverdraw(indices.data(), indices.size(), &vertices[0].position.x, &vertices[0].normal.x, sizeof(Vertex), vertices.size());
+		PrintStats("+ overdraw", indices, vertices.size());
+
+		MeshOptimizer::optimizeVertexFetch(vertices.data(), sizeof(Vertex), vertices.size(), indices.data(), indices.size());
+		PrintStats("+ vertex fetch", indices, vertices.size());
+
+		// Time the whole optimization, every run starts from the source order
+		BenchmarkTiming timing = TimeFunction([&]()
+		{
+			vertices = sourceVertices;
+			indices = sourceIndices;
+			MeshOptimizer::optimizeMesh(vertices.data(), sizeof(Vertex), vertices.size(), offsetof(Vertex, normal), indices.data(), indices.size());
+		}, ITERATIONS);
+		PrintTiming("MeshOptimizer::optimizeMesh", timing);
+	}
+}
+
+void RunMeshOptimizerBenchmark(const std::string& resourcePath)
+{
+	BenchmarkFile(resourcePath + "temple.obj");
+	BenchmarkFile(resourcePath + "SausageRoll/model.obj");
+}
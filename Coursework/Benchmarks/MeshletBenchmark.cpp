@@ -0,0 +1,220 @@
+// Meshlet benchmark
+// Loads, welds and optimizes the OBJ models as the renderer does, then splits them into meshlets with MeshletBuilder.
+// Reports how long building takes, the size of the meshlets, and how many meshlets and triangles culling rejects
+// from cameras circling each model and from close up cameras inside its bounds.
+#include "Benchmarks.h"
+#include "ObjLoader.h"
+#include "MeshOptimizer.h"
+#include "MeshletBuilder.h"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	const int ITERATIONS = 10;
+	const int ORBIT_VIEWS = 16;
+	const float FIELD_OF_VIEW = 3.14159265f / 4.0f;
+	const float ASPECT = 16.0f / 9.0f;
+
+	struct Vertex
+	{
+		XMFLOAT3 position;
+		XMFLOAT3 normal;
+	};
+
+	// Row vector matrices as DirectXMath lays them out, so the benchmark runs without it
+	struct Matrix
+	{
+		float m[16];
+	};
+
+	Matrix Multiply(const Matrix& a, const Matrix& b)
+	{
+		Matrix result;
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				float sum = 0.0f;
+				for (int i = 0; i < 4; i++) sum += a.m[row * 4 + i] * b.m[i * 4 + column];
+				result.m[row * 4 + column] = sum;
+			}
+		}
+		return result;
+	}
+
+	XMFLOAT3 Normalise(const XMFLOAT3& v)
+	{
+		float length = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+		return XMFLOAT3(v.x / length, v.y / length, v.z / length);
+	}
+
+	// Left handed look at, as XMMatrixLookAtLH
+	Matrix LookAt(const XMFLOAT3& eye, const XMFLOAT3& target)
+	{
+		XMFLOAT3 forward = Normalise(XMFLOAT3(target.x - eye.x, target.y - eye.y, target.z - eye.z));
+		XMFLOAT3 up(0.0f, 1.0f, 0.0f);
+		XMFLOAT3 right = Normalise(XMFLOAT3(up.y * forward.z - up.z * forward.y, up.z * forward.x - up.x * forward.z, up.x * forward.y - up.y * forward.x));
+		up = XMFLOAT3(forward.y * right.z - forward.z * right.y, forward.z * right.x - forward.x * right.z, forward.x * right.y - forward.y * right.x);
+
+		Matrix view = { {
+			right.x, up.x, forward.x, 0.0f,
+			right.y, up.y, forward.y, 0.0f,
+			right.z, up.z, forward.z, 0.0f,
+			-(right.x * eye.x + right.y * eye.y + right.z * eye.z), -(up.x * eye.x + up.y * eye.y + up.z * eye.z), -(forward.x * eye.x + forward.y * eye.y + forward.z * eye.z), 1.0f
+		} };
+		return view;
+	}
+
+	// Left handed perspective, as XMMatrixPerspectiveFovLH
+	Matrix Perspective(float nearPlane, float farPlane)
+	{
+		float yScale = 1.0f / tanf(FIELD_OF_VIEW * 0.5f);
+		float range = farPlane / (farPlane - nearPlane);
+		Matrix projection = { {
+			yScale / ASPECT, 0.0f, 0.0f, 0.0f,
+			0.0f, yScale, 0.0f, 0.0f,
+			0.0f, 0.0f, range, 1.0f,
+			0.0f, 0.0f, -range * nearPlane, 0.0f
+		} };
+		return projection;
+	}
+
+	bool LoadOptimized(const std::string& path, std::vector<Vertex>& vertices, std::vector<unsigned long>& indices)
+	{
+		ObjLoader::ObjData obj;
+		if (!ObjLoader::load(path.c_str(), obj))
+		{
+			return false;
+		}
+
+		std::vector<ObjLoader::Corner> uniqueCorners;
+		std::vector<unsigned int> welded;
+		ObjLoader::weld(obj.corners, uniqueCorners, welded);
+
+		vertices.resize(uniqueCorners.size());
+		for (size_t i = 0; i < uniqueCorners.size(); i++)
+		{
+			const ObjLoader::Corner& corner = uniqueCorners[i];
+			vertices[i].position = obj.positions[corner.position];
+			vertices[i].normal = (corner.normal != ObjLoader::NO_INDEX) ? obj.normals[corner.normal] : XMFLOAT3(0.0f, 1.0f, 0.0f);
+		}
+		indices.assign(welded.begin(), welded.end());
+
+		MeshOptimizer::optimizeMesh(vertices.data(), sizeof(Vertex), vertices.size(), offsetof(Vertex, normal), indices.data(), indices.size());
+		return true;
+	}
+
+	struct CullTotals
+	{
+		unsigned long long meshlets, frustumCulled, backfaceCulled, draws, trianglesDrawn, triangles;
+	};
+
+	void CullFrom(const std::vector<MeshletBuilder::Meshlet>& meshlets, const XMFLOAT3& eye, const XMFLOAT3& target, float nearPlane, float farPlane, CullTotals& totals)
+	{
+		// The model sits at the origin with no transform, so world space is object space
+		Matrix viewProjection = Multiply(LookAt(eye, target), Perspective(nearPlane, farPlane));
+		const float objectEye[4] = { eye.x, eye.y, eye.z, 1.0f };
+		MeshletBuilder::View view;
+		MeshletBuilder::computeView(viewProjection.m, objectEye, true, view);
+
+		std::vector<MeshletBuilder::DrawRange> draws;
+		MeshletBuilder::CullStats stats;
+		MeshletBuilder::cull(meshlets.data(), meshlets.size(), view, draws, &stats);
+
+		totals.meshlets += stats.tested;
+		totals.frustumCulled += stats.frustumCulled;
+		totals.backfaceCulled += stats.backfaceCulled;
+		totals.draws += stats.draws;
+		for (const MeshletBuilder::DrawRange& draw : draws) totals.trianglesDrawn += draw.indexCount / 3;
+		for (const MeshletBuilder::Meshlet& meshlet : meshlets) totals.triangles += meshlet.indexCount / 3;
+	}
+
+	void PrintTotals(const char* label, const CullTotals& totals, int views)
+	{
+		printf("  %-12s frustum culled %5.1f%%  backface culled %5.1f%%  triangles drawn %5.1f%%  %.1f draws per view\n", label,
+			100.0 * totals.frustumCulled / totals.meshlets, 100.0 * totals.backfaceCulled / totals.meshlets,
+			100.0 * totals.trianglesDrawn / totals.triangles, (double)totals.draws / views);
+	}
+
+	void BenchmarkFile(const std::string& path)
+	{
+		printf("%s\n", path.c_str());
+
+		std::vector<Vertex> vertices;
+		std::vector<unsigned long> indices;
+		if (!LoadOptimized(path, vertices, indices))
+		{
+			printf("  Failed to load\n");
+			return;
+		}
+
+		std::vector<MeshletBuilder::Meshlet> meshlets;
+		std::vector<unsigned long> meshletIndices = indices;
+		MeshletBuilder::buildMeshlets(meshletIndices.data(), 0, (unsigned int)meshletIndices.size(), &vertices[0].position.x, &vertices[0].normal.x, sizeof(Vertex), vertices.size(), meshlets);
+
+		// Size and spread of the meshlets
+		XMFLOAT3 boundsMin = vertices[0].position, boundsMax = vertices[0].position;
+		for (const Vertex& vertex : vertices)
+		{
+			boundsMin = XMFLOAT3(fminf(boundsMin.x, vertex.position.x), fminf(boundsMin.y, vertex.position.y), fminf(boundsMin.z, vertex.position.z));
+			boundsMax = XMFLOAT3(fmaxf(boundsMax.x, vertex.position.x), fmaxf(boundsMax.y, vertex.position.y), fmaxf(boundsMax.z, vertex.position.z));
+		}
+		XMFLOAT3 centre((boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f);
+		XMFLOAT3 extent(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z);
+		float radius = 0.5f * sqrtf(extent.x * extent.x + extent.y * extent.y + extent.z * extent.z);
+
+		size_t conesUsable = 0;
+		double meshletRadius = 0.0;
+		for (const MeshletBuilder::Meshlet& meshlet : meshlets)
+		{
+			if (meshlet.coneCutoff <= 1.0f) conesUsable++;
+			meshletRadius += meshlet.radius;
+		}
+		printf("  %zu vertices, %zu triangles -> %zu meshlets, %.1f triangles each\n", vertices.size(), indices.size() / 3, meshlets.size(), (double)indices.size() / 3 / meshlets.size());
+		printf("  mean meshlet radius %.2f%% of the model's, %.1f%% have a normal cone that can cull\n", 100.0 * meshletRadius / meshlets.size() / radius, 100.0 * conesUsable / meshlets.size());
+
+		BenchmarkTiming timing = TimeFunction([&]()
+		{
+			meshletIndices = indices;
+			meshlets.clear();
+			MeshletBuilder::buildMeshlets(meshletIndices.data(), 0, (unsigned int)meshletIndices.size(), &vertices[0].position.x, &vertices[0].normal.x, sizeof(Vertex), vertices.size(), meshlets);
+		}, ITERATIONS);
+		PrintTiming("MeshletBuilder::buildMeshlets", timing);
+
+		// Cameras circling the model take in all of it, so only the normal cones cull.
+		// Close up cameras sit inside the bounds looking across, where the frustum rejects most of the model.
+		CullTotals orbit = {}, closeUp = {};
+		for (int i = 0; i < ORBIT_VIEWS; i++)
+		{
+			float angle = 6.2831853f * i / ORBIT_VIEWS;
+			XMFLOAT3 orbitEye(centre.x + cosf(angle) * radius * 2.5f, centre.y + radius * 0.5f, centre.z + sinf(angle) * radius * 2.5f);
+			CullFrom(meshlets, orbitEye, centre, 0.1f, radius * 10.0f, orbit);
+
+			XMFLOAT3 closeEye(centre.x + cosf(angle) * radius * 0.6f, centre.y, centre.z + sinf(angle) * radius * 0.6f);
+			XMFLOAT3 closeTarget(closeEye.x - sinf(angle) * radius, closeEye.y, closeEye.z + cosf(angle) * radius);
+			CullFrom(meshlets, closeEye, closeTarget, radius * 0.01f, radius * 10.0f, closeUp);
+		}
+		PrintTotals("orbit", orbit, ORBIT_VIEWS);
+		PrintTotals("close up", closeUp, ORBIT_VIEWS);
+
+		XMFLOAT3 eye(centre.x, centre.y + radius * 0.5f, centre.z - radius * 2.5f);
+		Matrix viewProjection = Multiply(LookAt(eye, centre), Perspective(0.1f, radius * 10.0f));
+		const float objectEye[4] = { eye.x, eye.y, eye.z, 1.0f };
+		MeshletBuilder::View view;
+		MeshletBuilder::computeView(viewProjection.m, objectEye, true, view);
+		std::vector<MeshletBuilder::DrawRange> draws;
+		timing = TimeFunction([&]()
+		{
+			MeshletBuilder::cull(meshlets.data(), meshlets.size(), view, draws);
+		}, ITERATIONS * 10);
+		PrintTiming("MeshletBuilder::cull", timing);
+	}
+}
+
+void RunMeshletBenchmark(const std::string& resourcePath)
+{
+	BenchmarkFile(resourcePath + "temple.obj");
+	BenchmarkFile(resourcePath + "SausageRoll/model.obj");
+}
@@ -0,0 +1,181 @@
+// OBJ loader benchmark
+// Times the mapped, multithreaded ObjLoader against the fscanf_s parser Model used previously.
+// Both produce the same unrolled triangle list, which Model then welds into an indexed mesh.
+#include "Benchmarks.h"
+#include "ObjLoader.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const int ITERATIONS = 10;
+
+	struct ModelType
+	{
+		float x, y, z;
+		float tu, tv;
+		float nx, ny, nz;
+	};
+
+	// Previous Model::loadModel, kept as the baseline
+	bool LegacyLoad(const char* filename, std::vector<ModelType>& model)
+	{
+		std::vector<XMFLOAT3> verts;
+		std::vector<XMFLOAT3> norms;
+		std::vector<XMFLOAT2> texCs;
+		std::vector<unsigned int> faces;
+
+		FILE* file;
+		errno_t err;
+		err = fopen_s(&file, filename, "r");
+		if (err != 0)
+		{
+			return false;
+		}
+
+		while (true)
+		{
+			char lineHeader[128];
+
+			// Read first word of the line
+			int res = fscanf_s(file, "%s", lineHeader, (int)sizeof(lineHeader));
+			if (res == EOF)
+			{
+				break; // exit loop
+			}
+			else // Parse
+			{
+				if (strcmp(lineHeader, "v") == 0) // Vertex
+				{
+					XMFLOAT3 vertex;
+					fscanf_s(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
+					verts.push_back(vertex);
+				}
+				else if (strcmp(lineHeader, "vt") == 0) // Tex Coord
+				{
+					XMFLOAT2 uv;
+					fscanf_s(file, "%f %f\n", &uv.x, &uv.y);
+					texCs.push_back(uv);
+				}
+				else if (strcmp(lineHeader, "vn") == 0) // Normal
+				{
+					XMFLOAT3 normal;
+					fscanf_s(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
+					norms.push_back(normal);
+				}
+				else if (strcmp(lineHeader, "f") == 0) // Face
+				{
+					unsigned int face[9];
+					int matches = fscanf_s(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &face[0], &face[1], &face[2],
+																				&face[3], &face[4], &face[5],
+																				&face[6], &face[7], &face[8]);
+					if (matches != 9)
+					{
+						// Parser error, or not triangle faces
+						fclose(file);
+						return false;
+					}
+
+					for (int i = 0; i < 9; i++)
+					{
+						faces.push_back(face[i]);
+					}
+				}
+			}
+		}
+		fclose(file);
+
+		// "Unroll" the loaded obj information into a list of triangles.
+		model.resize(faces.size() / 3);
+		for (size_t f = 0, vIndex = 0; f < faces.size(); f += 3, vIndex++)
+		{
+			model[vIndex].x = verts[(faces[f + 0] - 1)].x;
+			model[vIndex].y = verts[(faces[f + 0] - 1)].y;
+			model[vIndex].z = verts[(faces[f + 0] - 1)].z;
+			model[vIndex].tu = texCs[(faces[f + 1] - 1)].x;
+			model[vIndex].tv = texCs[(faces[f + 1] - 1)].y;
+			model[vIndex].nx = norms[(faces[f + 2] - 1)].x;
+			model[vIndex].ny = norms[(faces[f + 2] - 1)].y;
+			model[vIndex].nz = norms[(faces[f + 2] - 1)].z;
+		}
+
+		return true;
+	}
+
+	// ObjLoader followed by the same unroll Model::loadModel does
+	bool MappedLoad(const char* filename, std::vector<ModelType>& model, unsigned int threadCount)
+	{
+		ObjLoader::ObjData obj;
+		if (!ObjLoader::load(filename, obj, threadCount))
+		{
+			return false;
+		}
+
+		model.resize(obj.corners.size());
+		for (size_t i = 0; i < obj.corners.size(); i++)
+		{
+			const ObjLoader::Corner& corner = obj.corners[i];
+			const XMFLOAT3& position = obj.positions[corner.position];
+			XMFLOAT2 uv = (corner.texture != ObjLoader::NO_INDEX) ? obj.texCoords[corner.texture] : XMFLOAT2(0.0f, 0.0f);
+			XMFLOAT3 normal = (corner.normal != ObjLoader::NO_INDEX) ? obj.normals[corner.normal] : XMFLOAT3(0.0f, 0.0f, 0.0f);
+			model[i] = { position.x, position.y, position.z, uv.x, uv.y, normal.x, normal.y, normal.z };
+		}
+
+		return true;
+	}
+
+	void BenchmarkFile(const std::string& path)
+	{
+		printf("%s\n", path.c_str());
+
+		std::vector<ModelType> legacyModel, mappedModel;
+		if (!LegacyLoad(path.c_str(), legacyModel) || !MappedLoad(path.c_str(), mappedModel, 0))
+		{
+			printf("  Failed to load\n");
+			return;
+		}
+
+		// Both loaders must agree before their timings mean anything.
+		// Float parsing can round differently in the last bit to the CRT, so compare with a tolerance.
+		bool match = legacyModel.size() == mappedModel.size();
+		const float* legacyFloats = (const float*)legacyModel.data();
+		const float* mappedFloats = (const float*)mappedModel.data();
+		for (size_t i = 0; match && i < legacyModel.size() * 8; i++)
+		{
+			float scale = fabsf(legacyFloats[i]) > 1.0f ? fabsf(legacyFloats[i]) : 1.0f;
+			match = fabsf(legacyFloats[i] - mappedFloats[i]) <= 1e-6f * scale;
+		}
+		printf("  %zu triangles, outputs %s\n", mappedModel.size() / 3, match ? "match" : "DIFFER");
+
+		BenchmarkTiming legacy = TimeFunction([&]() { LegacyLoad(path.c_str(), legacyModel); }, ITERATIONS);
+		BenchmarkTiming singleThread = TimeFunction([&]() { MappedLoad(path.c_str(), mappedModel, 1); }, ITERATIONS);
+		BenchmarkTiming multiThread = TimeFunction([&]() { MappedLoad(path.c_str(), mappedModel, 0); }, ITERATIONS);
+
+		PrintTiming("fscanf_s (previous)", legacy);
+		PrintTiming("ObjLoader, 1 thread", singleThread, &legacy);
+		PrintTiming("ObjLoader, all cores", multiThread, &legacy);
+
+		// Welding, Model builds an indexed mesh from the unique corners
+		ObjLoader::ObjData obj;
+		ObjLoader::load(path.c_str(), obj);
+		std::vector<ObjLoader::Corner> uniqueCorners;
+		std::vector<unsigned int> indices;
+		BenchmarkTiming weld = TimeFunction([&]() { ObjLoader::weld(obj.corners, uniqueCorners, indices); }, ITERATIONS);
+		PrintTiming("ObjLoader::weld", weld);
+
+		// 56 bytes is the size of BaseMesh::VertexType
+		const size_t vertexSize = 56;
+		printf("  %zu corners welded to %zu vertices, vertex buffer %.1f KB -> %.1f KB (%.2fx smaller)\n",
+			obj.corners.size(), uniqueCorners.size(),
+			obj.corners.size() * vertexSize / 1024.0, uniqueCorners.size() * vertexSize / 1024.0,
+			uniqueCorners.empty() ? 0.0 : (double)obj.corners.size() / uniqueCorners.size());
+	}
+}
+
+void RunObjLoaderBenchmark(const std::string& resourcePath)
+{
+	BenchmarkFile(resourcePath + "temple.obj");
+	BenchmarkFile(resourcePath + "SausageRoll/model.obj");
+}
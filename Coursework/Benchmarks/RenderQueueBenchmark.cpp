@@ -0,0 +1,73 @@
+// Render queue benchmark
+// Builds frames of random draw keys, shaped like a scene with a few shaders and many materials and meshes,
+// then times RenderQueue's radix sort against std::sort and reports the state changes sorting saves.
+#include "Benchmarks.h"
+#include "RenderQueue.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const int ITERATIONS = 20;
+	const unsigned int PASSES = 4;
+	const unsigned int SHADERS = 8;
+	const unsigned int MATERIALS = 64;
+	const unsigned int MESHES = 256;
+
+	std::vector<unsigned long long> BuildKeys(size_t count)
+	{
+		std::mt19937 random(1234);
+		std::uniform_int_distribution<unsigned int> pass(0, PASSES - 1), shader(0, SHADERS - 1), material(0, MATERIALS - 1), mesh(0, MESHES - 1);
+		std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+
+		std::vector<unsigned long long> keys(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			// One draw in ten is blended
+			keys[i] = RenderQueue::makeKey(pass(random), i % 10 == 0, shader(random), material(random), mesh(random), depth(random));
+		}
+		return keys;
+	}
+
+	void BenchmarkCount(size_t count)
+	{
+		printf("%zu draws\n", count);
+		std::vector<unsigned long long> keys = BuildKeys(count);
+
+		std::vector<unsigned long long> radixKeys;
+		std::vector<unsigned int> order;
+		BenchmarkTiming radix = TimeFunction([&]()
+		{
+			radixKeys = keys;
+			RenderQueue::radixSort(radixKeys, order);
+		}, ITERATIONS);
+
+		// The same work with a comparison sort, keys paired with their draw
+		std::vector<std::pair<unsigned long long, unsigned int>> pairs;
+		BenchmarkTiming comparison = TimeFunction([&]()
+		{
+			pairs.resize(keys.size());
+			for (size_t i = 0; i < keys.size(); i++) pairs[i] = std::make_pair(keys[i], (unsigned int)i);
+			std::sort(pairs.begin(), pairs.end());
+		}, ITERATIONS);
+
+		PrintTiming("std::sort", comparison);
+		PrintTiming("RenderQueue::radixSort", radix, &comparison);
+
+		unsigned int shaders, materials, meshes, sortedShaders, sortedMaterials, sortedMeshes;
+		RenderQueue::countStateChanges(keys.data(), nullptr, keys.size(), shaders, materials, meshes);
+		RenderQueue::countStateChanges(keys.data(), order.data(), keys.size(), sortedShaders, sortedMaterials, sortedMeshes);
+		printf("  %-32s shader %u -> %u, material %u -> %u, mesh %u -> %u\n", "state changes", shaders, sortedShaders, materials, sortedMaterials, meshes, sortedMeshes);
+	}
+}
+
+void RunRenderQueueBenchmark(const std::string& resourcePath)
+{
+	const size_t counts[] = { 100, 1000, 10000, 100000 };
+	for (size_t count : counts)
+	{
+		BenchmarkCount(count);
+	}
+}
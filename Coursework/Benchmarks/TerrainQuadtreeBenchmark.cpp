@@ -0,0 +1,186 @@
+// Terrain quadtree benchmark
+// Builds a TerrainQuadtree over a 1024 x 1024 sum of sines, the island's 199 x 199 plane and 40 amplitude, and times picking
+// the patches from cameras on the terrain, above it, and off its edge, at a few screen-space errors, in the camera's own frustum
+// and an orthographic shadow view's. Reports the nodes visited and culled, the patches of each level, and the vertices drawn
+// against the 39,601 quads of the tessellated plane it replaces.
+#include "Benchmarks.h"
+#include "TerrainQuadtree.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	const int ITERATIONS = 200;
+	const unsigned int HEIGHT_SAMPLES = 1024;
+	const unsigned int PATCH_RESOLUTION = 16;
+	const float TERRAIN_SIZE = 199.0f;
+	const float TERRAIN_ORIGIN[3] = { -100.0f, -10.5f, -100.0f };
+	const float AMPLITUDE = 40.0f;
+	const float FIELD_OF_VIEW = 3.14159265f / 4.0f;
+	const float ASPECT = 16.0f / 9.0f;
+	const float VIEWPORT_HEIGHT = 1080.0f;
+
+	// Row vector matrices as DirectXMath lays them out, so the benchmark runs without it
+	struct Matrix
+	{
+		float m[16];
+	};
+
+	Matrix Multiply(const Matrix& a, const Matrix& b)
+	{
+		Matrix result;
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				float sum = 0.0f;
+				for (int i = 0; i < 4; i++) sum += a.m[row * 4 + i] * b.m[i * 4 + column];
+				result.m[row * 4 + column] = sum;
+			}
+		}
+		return result;
+	}
+
+	void Normalise(float v[3])
+	{
+		float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int i = 0; i < 3; i++) v[i] /= length;
+	}
+
+	// Left handed look at, as XMMatrixLookAtLH
+	Matrix LookAt(const float eye[3], const float target[3])
+	{
+		float forward[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+		Normalise(forward);
+		float right[3] = { forward[2], 0.0f, -forward[0] };
+		Normalise(right);
+		float up[3] = { forward[1] * right[2] - forward[2] * right[1], forward[2] * right[0] - forward[0] * right[2], forward[0] * right[1] - forward[1] * right[0] };
+
+		Matrix view = { {
+			right[0], up[0], forward[0], 0.0f,
+			right[1], up[1], forward[1], 0.0f,
+			right[2], up[2], forward[2], 0.0f,
+			-(right[0] * eye[0] + right[1] * eye[1] + right[2] * eye[2]), -(up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2]), -(forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2]), 1.0f
+		} };
+		return view;
+	}
+
+	// Left handed perspective, as XMMatrixPerspectiveFovLH
+	Matrix Perspective(float nearPlane, float farPlane)
+	{
+		float yScale = 1.0f / tanf(FIELD_OF_VIEW * 0.5f);
+		float range = farPlane / (farPlane - nearPlane);
+		Matrix projection = { {
+			yScale / ASPECT, 0.0f, 0.0f, 0.0f,
+			0.0f, yScale, 0.0f, 0.0f,
+			0.0f, 0.0f, range, 1.0f,
+			0.0f, 0.0f, -range * nearPlane, 0.0f
+		} };
+		return projection;
+	}
+
+	// Left handed orthographic, as XMMatrixOrthographicLH
+	Matrix Orthographic(float width, float height, float nearPlane, float farPlane)
+	{
+		float range = 1.0f / (farPlane - nearPlane);
+		Matrix projection = { {
+			2.0f / width, 0.0f, 0.0f, 0.0f,
+			0.0f, 2.0f / height, 0.0f, 0.0f,
+			0.0f, 0.0f, range, 0.0f,
+			0.0f, 0.0f, -range * nearPlane, 1.0f
+		} };
+		return projection;
+	}
+
+	// Rolling hills with finer ripples, from -1 to 1, an island falling off to the border's -1 at the edges
+	std::vector<float> BuildHeights()
+	{
+		std::vector<float> heights(HEIGHT_SAMPLES * HEIGHT_SAMPLES);
+		for (unsigned int z = 0; z < HEIGHT_SAMPLES; z++)
+		{
+			for (unsigned int x = 0; x < HEIGHT_SAMPLES; x++)
+			{
+				float u = (x + 0.5f) / HEIGHT_SAMPLES, v = (z + 0.5f) / HEIGHT_SAMPLES;
+				float hills = 0.5f * sinf(u * 9.0f) * cosf(v * 7.0f) + 0.2f * sinf(u * 41.0f + v * 23.0f) + 0.05f * sinf(u * 173.0f) * sinf(v * 211.0f);
+				float island = 1.0f - 2.0f * sqrtf((u - 0.5f) * (u - 0.5f) + (v - 0.5f) * (v - 0.5f));
+				heights[z * HEIGHT_SAMPLES + x] = (std::max)(-1.0f, (std::min)(1.0f, island + hills * 0.5f - 0.2f));
+			}
+		}
+		return heights;
+	}
+
+	struct View
+	{
+		const char* name;
+		float eye[3];
+		float target[3];
+	};
+
+	void PrintStats(const TerrainQuadtree& quadtree, const TerrainQuadtree::Stats& stats)
+	{
+		unsigned int gridVertices = (PATCH_RESOLUTION + 1) * (PATCH_RESOLUTION + 1);
+		printf("  %u nodes visited, %u culled, %u patches, %u vertices, levels", stats.nodesVisited, stats.nodesCulled, stats.patches, stats.patches * gridVertices);
+		for (unsigned int level = 0; level < quadtree.getLevelCount(); level++)
+		{
+			printf(" %u", stats.levelPatches[level]);
+		}
+		printf("\n");
+	}
+
+	void BenchmarkView(TerrainQuadtree& quadtree, const View& view)
+	{
+		printf("%s\n", view.name);
+		Matrix viewMatrix = LookAt(view.eye, view.target);
+		Matrix viewProjection = Multiply(viewMatrix, Perspective(0.1f, 200.0f));
+		FrustumCuller::Frustum frustum;
+		FrustumCuller::computeFrustum(viewProjection.m, frustum);
+
+		// The sun's shadow view, looking down over the whole island, picking with the camera's levels
+		float sunEye[3] = { 60.0f, 100.0f, -60.0f }, sunTarget[3] = { 0.0f, 0.0f, 0.0f };
+		Matrix shadowProjection = Multiply(LookAt(sunEye, sunTarget), Orthographic(300.0f, 300.0f, 1.0f, 300.0f));
+		FrustumCuller::Frustum shadowFrustum;
+		FrustumCuller::computeFrustum(shadowProjection.m, shadowFrustum);
+
+		float projectionScaleY = 1.0f / tanf(FIELD_OF_VIEW * 0.5f);
+		const float pixelErrors[] = { 0.5f, 2.0f, 8.0f };
+		std::vector<TerrainQuadtree::Patch> patches;
+		for (float pixelError : pixelErrors)
+		{
+			quadtree.setLodRanges(VIEWPORT_HEIGHT, projectionScaleY, pixelError);
+			TerrainQuadtree::Stats stats;
+			quadtree.select(view.eye, frustum, patches, &stats);
+			printf(" %.1f pixel error\n", pixelError);
+			PrintStats(quadtree, stats);
+
+			PrintTiming("  TerrainQuadtree::select (camera)", TimeFunction([&]() { quadtree.select(view.eye, frustum, patches); }, ITERATIONS));
+
+			quadtree.select(view.eye, shadowFrustum, patches, &stats);
+			PrintStats(quadtree, stats);
+			PrintTiming("  TerrainQuadtree::select (shadow view)", TimeFunction([&]() { quadtree.select(view.eye, shadowFrustum, patches); }, ITERATIONS));
+		}
+	}
+}
+
+void RunTerrainQuadtreeBenchmark(const std::string& resourcePath)
+{
+	std::vector<float> heights = BuildHeights();
+	TerrainQuadtree quadtree(PATCH_RESOLUTION);
+	quadtree.setTransform(TERRAIN_ORIGIN, TERRAIN_SIZE, TERRAIN_SIZE, AMPLITUDE);
+
+	// Height bounds from the samples, then grown by the reach of the terrain shader's smoothing
+	PrintTiming("TerrainQuadtree::build", TimeFunction([&]() { quadtree.build(heights.data(), HEIGHT_SAMPLES, HEIGHT_SAMPLES); }, 10));
+	PrintTiming("TerrainQuadtree::setFilterRadius", TimeFunction([&]() { quadtree.setFilterRadius(0); quadtree.setFilterRadius(65); }, 10));
+	printf("%u levels of %u x %u cell patches, the tessellated plane was 39601 quads\n", quadtree.getLevelCount(), PATCH_RESOLUTION, PATCH_RESOLUTION);
+
+	const View views[] = {
+		{ "On the terrain, looking across it", { -20.0f, 15.0f, -60.0f }, { 20.0f, 0.0f, 40.0f } },
+		{ "High above, looking down", { 0.0f, 150.0f, -40.0f }, { 0.0f, 0.0f, 0.0f } },
+		{ "Off the edge, looking away", { 0.0f, 5.0f, -140.0f }, { 0.0f, 5.0f, -300.0f } },
+	};
+	for (const View& view : views)
+	{
+		BenchmarkView(quadtree, view);
+	}
+}
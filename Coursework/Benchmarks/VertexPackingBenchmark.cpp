@@ -0,0 +1,132 @@
+// Vertex packing benchmark
+// Loads and welds the OBJ models, builds a tangent frame from the texture coordinates, then packs them with VertexPacking.
+// Reports the vertex and index buffer sizes, the precision lost by packing and how long encoding takes.
+#include "Benchmarks.h"
+#include "ObjLoader.h"
+#include "VertexPacking.h"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	const int ITERATIONS = 10;
+
+	XMFLOAT3 Subtract(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	XMFLOAT3 Normalise(const XMFLOAT3& v, const XMFLOAT3& fallback)
+	{
+		float length = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+		if (length < 1e-12f) return fallback;
+		return XMFLOAT3(v.x / length, v.y / length, v.z / length);
+	}
+
+	// Per vertex tangent and bitangent from the texture coordinate gradients of the surrounding triangles
+	void BuildTangents(std::vector<VertexPacking::FullVertex>& vertices, const std::vector<unsigned int>& indices)
+	{
+		std::vector<XMFLOAT3> tangents(vertices.size(), XMFLOAT3(0.0f, 0.0f, 0.0f));
+		std::vector<XMFLOAT3> bitangents(vertices.size(), XMFLOAT3(0.0f, 0.0f, 0.0f));
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			const VertexPacking::FullVertex& v0 = vertices[indices[i]];
+			const VertexPacking::FullVertex& v1 = vertices[indices[i + 1]];
+			const VertexPacking::FullVertex& v2 = vertices[indices[i + 2]];
+
+			XMFLOAT3 edge1 = Subtract(v1.position, v0.position);
+			XMFLOAT3 edge2 = Subtract(v2.position, v0.position);
+			float du1 = v1.texture.x - v0.texture.x, dv1 = v1.texture.y - v0.texture.y;
+			float du2 = v2.texture.x - v0.texture.x, dv2 = v2.texture.y - v0.texture.y;
+			float determinant = du1 * dv2 - du2 * dv1;
+			if (fabsf(determinant) < 1e-12f) continue;
+			float r = 1.0f / determinant;
+
+			XMFLOAT3 tangent((edge1.x * dv2 - edge2.x * dv1) * r, (edge1.y * dv2 - edge2.y * dv1) * r, (edge1.z * dv2 - edge2.z * dv1) * r);
+			XMFLOAT3 bitangent((edge2.x * du1 - edge1.x * du2) * r, (edge2.y * du1 - edge1.y * du2) * r, (edge2.z * du1 - edge1.z * du2) * r);
+			for (int corner = 0; corner < 3; corner++)
+			{
+				XMFLOAT3& t = tangents[indices[i + corner]];
+				XMFLOAT3& b = bitangents[indices[i + corner]];
+				t.x += tangent.x; t.y += tangent.y; t.z += tangent.z;
+				b.x += bitangent.x; b.y += bitangent.y; b.z += bitangent.z;
+			}
+		}
+
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			vertices[i].tangent = Normalise(tangents[i], XMFLOAT3(1.0f, 0.0f, 0.0f));
+			vertices[i].bitangent = Normalise(bitangents[i], XMFLOAT3(0.0f, 0.0f, 1.0f));
+		}
+	}
+
+	bool LoadWelded(const std::string& path, std::vector<VertexPacking::FullVertex>& vertices, std::vector<unsigned int>& indices)
+	{
+		ObjLoader::ObjData obj;
+		if (!ObjLoader::load(path.c_str(), obj))
+		{
+			return false;
+		}
+
+		std::vector<ObjLoader::Corner> uniqueCorners;
+		ObjLoader::weld(obj.corners, uniqueCorners, indices);
+
+		vertices.resize(uniqueCorners.size());
+		for (size_t i = 0; i < uniqueCorners.size(); i++)
+		{
+			const ObjLoader::Corner& corner = uniqueCorners[i];
+			vertices[i].position = obj.positions[corner.position];
+			vertices[i].texture = (corner.texture != ObjLoader::NO_INDEX) ? obj.texCoords[corner.texture] : XMFLOAT2(0.0f, 0.0f);
+			vertices[i].normal = (corner.normal != ObjLoader::NO_INDEX) ? Normalise(obj.normals[corner.normal], XMFLOAT3(0.0f, 1.0f, 0.0f)) : XMFLOAT3(0.0f, 1.0f, 0.0f);
+		}
+		BuildTangents(vertices, indices);
+		return true;
+	}
+
+	void BenchmarkFile(const std::string& path)
+	{
+		printf("%s\n", path.c_str());
+
+		std::vector<VertexPacking::FullVertex> vertices;
+		std::vector<unsigned int> indices;
+		if (!LoadWelded(path, vertices, indices))
+		{
+			printf("  Failed to load\n");
+			return;
+		}
+
+		// Buffer sizes, indices drop to 16 bit whenever the vertex count allows it
+		size_t fullBytes = vertices.size() * sizeof(VertexPacking::FullVertex);
+		size_t packedBytes = vertices.size() * sizeof(VertexPacking::PackedVertex);
+		size_t indexSize = (vertices.size() <= 65536) ? sizeof(unsigned short) : sizeof(unsigned int);
+		printf("  %zu vertices, %zu triangles\n", vertices.size(), indices.size() / 3);
+		printf("  vertex buffer  %8zu -> %8zu bytes (%zu -> %zu per vertex, %.2fx)\n", fullBytes, packedBytes,
+			sizeof(VertexPacking::FullVertex), sizeof(VertexPacking::PackedVertex), (double)fullBytes / packedBytes);
+		printf("  index buffer   %8zu -> %8zu bytes\n", indices.size() * sizeof(unsigned int), indices.size() * indexSize);
+
+		VertexPacking::PositionDecode decode = VertexPacking::computePositionDecode(vertices.data(), vertices.size());
+		std::vector<VertexPacking::PackedVertex> packed(vertices.size());
+		VertexPacking::encode(vertices.data(), vertices.size(), decode, packed.data());
+
+		// Precision lost, position errors are also given relative to the largest bounds extent
+		VertexPacking::PackingError error = VertexPacking::measureError(vertices.data(), packed.data(), vertices.size(), decode);
+		float extent = decode.scale > 0.0f ? decode.scale : 1.0f;
+		printf("  position error max %.6f (%.5f%% of extent)  rms %.6f\n", error.maxPosition, 100.0f * error.maxPosition / extent, error.rmsPosition);
+		printf("  texture error max %.6f\n", error.maxTexture);
+		printf("  normal error max %.4f deg  tangent error max %.4f deg  handedness flips %u\n", error.maxNormalDegrees, error.maxTangentDegrees, error.handednessFlips);
+
+		BenchmarkTiming timing = TimeFunction([&]()
+		{
+			VertexPacking::encode(vertices.data(), vertices.size(), decode, packed.data());
+		}, ITERATIONS);
+		PrintTiming("VertexPacking::encode", timing);
+	}
+}
+
+void RunVertexPackingBenchmark(const std::string& resourcePath)
+{
+	BenchmarkFile(resourcePath + "temple.obj");
+	BenchmarkFile(resourcePath + "SausageRoll/model.obj");
+}
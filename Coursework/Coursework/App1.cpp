@@ -3,6 +3,11 @@
 #include "App1.h"
 #include "UVSphereMesh.h"
 #include "TessPlaneMesh.h"
+#include "TerrainPatchMesh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <random>
 App1::App1()
 {
 
@@ -20,7 +25,7 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	// Setup scene shaders
 	pbrShader = new PBRShader(renderer->getDevice(), hwnd);
 	pbrShader->SetRenderer(renderer);
-	pbrShader->SetCurrentCamera(camera);
+	pbrShader->SetTextureManager(textureMgr);
 
 	heightMapShader = new HeightMapShader(renderer->getDevice(), hwnd);
 	heightMapShader->SetRenderer(renderer);
@@ -30,21 +35,34 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	wavesShader->SetRenderer(renderer);
 	wavesShader->SetCurrentCamera(camera);
 
+	shadowDepthShader = new ShadowDepthShader(renderer->getDevice(), hwnd);
+	shadowDepthShader->SetRenderer(renderer);
+
+	// Projection, camera, lights and DOF range shared by the scene shaders
+	frameConstants = new FrameConstants(renderer);
+	// Point and spot lights, clustered so each pixel only lights with those that reach it
+	clusteredLights = new ClusteredLights(renderer);
+
 	// Initalise scene objects.
 	temple.SetRenderer(renderer);
 	temple.SetShader(static_cast<BaseShader*>(pbrShader));
-	temple.SetMesh(new AModel(renderer->getDevice(), "./res/temple.obj"));
+	// Models load in the background, the objects draw nothing until their mesh arrives
+	assetLoader->loadModel("./res/temple.obj", true, [this](AModel* model) { temple.SetMesh(model); });
 	temple.SetPosition(XMFLOAT3(0, -10.5, -5));
+	temple.SetStatic(true);
 
-	// Setup terrain plane, use the TessPlaneMesh which is designed for patches of 4 control points (quads)
+	// Setup terrain, drawn as the quadtree's patches, each an instance of one grid over the unit square scaled to the terrain
 	groundPlane.SetRenderer(renderer);
 	groundPlane.SetShader(static_cast<BaseShader*>(heightMapShader));
-	groundPlane.SetMesh(new TessPlaneMesh(renderer->getDevice(), renderer->getDeviceContext(), 200));
-	groundPlane.SetScale(XMFLOAT3(1, 1, 1));
+	groundPlane.SetMesh(new TerrainPatchMesh(renderer->getDevice(), renderer->getDeviceContext(), terrainQuadtree.getPatchResolution()));
+	groundPlane.SetScale(XMFLOAT3(terrainSize, 1, terrainSize));
 	groundPlane.SetPosition(XMFLOAT3(-100, -10.5, -100));
-	// Load height map textures
-	textureMgr->loadTexture(L"IslandHeightMap", L"res/IslandHeight.png"); // (Demes, 2020)
-	textureMgr->loadTexture(L"IslandTextureMap", L"res/IslandColor.jpg"); // (Demes, 2020)
+	groundPlane.SetStatic(true);
+	// Load height map textures, the quadtree's height bounds are built from the decoded heights
+	assetLoader->loadTexture(L"IslandHeightMap", L"res/IslandHeight.png", [this](const AssetLoader::Image& image) { buildTerrainQuadtree(image); }); // (Demes, 2020)
+	assetLoader->loadTexture(L"IslandTextureMap", L"res/IslandColor.jpg"); // (Demes, 2020)
+	islandHeightMap = textureMgr->getHandle(L"IslandHeightMap");
+	islandTextureMap = textureMgr->getHandle(L"IslandTextureMap");
 
 
 	// Setup water 
@@ -59,20 +77,37 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	lightSphere.SetShader(static_cast<BaseShader*>(pbrShader));
 	lightSphere.SetMesh(new SphereMesh(renderer->getDevice(), renderer->getDeviceContext()));
 	lightSphere.SetScale(XMFLOAT3(0.2, 0.2, 0.2));
+	lightSphere.SetCastsShadows(false); // Sits on the lights, it would shadow everything
+	lightSphereMaterials[0] = &templeMaterial;
 
 	// Setup PBR Sphere
 	PBRSphere.SetRenderer(renderer);
 	PBRSphere.SetShader(static_cast<BaseShader*>(pbrShader));
 	PBRSphere.SetMesh(new UVSphereMesh(renderer->getDevice(), renderer->getDeviceContext(), 40));
-	PBRSphere.SetPosition(XMFLOAT3(0, -9, 10));
+	PBRSphere.SetPosition(XMFLOAT3(0, -9, -5));
+	// One instance per material, drawn together
+	sphereMaterials[0] = &BrushedMetalMaterial;
+	sphereMaterials[1] = &WoorFloorMaterial;
+	sphereMaterials[2] = &GreyBricksMaterial;
+	PBRSphere.AddInstance(XMFLOAT3(0, -9, -2), XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1), 0);
+	PBRSphere.AddInstance(XMFLOAT3(0, -9, -5), XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1), 1);
+	PBRSphere.AddInstance(XMFLOAT3(0, -9, -8), XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1), 2);
+	PBRSphere.SetStatic(true);
 
 	// Setup Sausage roll mesh
 	SausageRoll.SetRenderer(renderer);
 	SausageRoll.SetShader(static_cast<BaseShader*>(pbrShader));
-	SausageRoll.SetMesh(new AModel(renderer->getDevice(), "./res/SausageRoll/model.obj")); // (Demes, 2021 b)
+	assetLoader->loadModel("./res/SausageRoll/model.obj", true, [this](AModel* model) { SausageRoll.SetMesh(model); }); // (Demes, 2021 b)
 	SausageRoll.SetPosition(XMFLOAT3(0, -9, -5));
 	SausageRoll.SetScale(XMFLOAT3(50, 50, 50));
+	SausageRoll.SetStatic(true);
+
+	// Objects culled against each pass's frustum, their bounds are refitted every frame
+	cullObjects = { &temple, &lightSphere, &PBRSphere, &SausageRoll, &groundPlane, &water };
 	
+	// Point and spot lights' shadow views share one atlas
+	shadowAtlas = new ShadowAtlas(renderer);
+
 	//Setup lights
 	lights.push_back(WorldLight()); // Sun
 	lights[0].setPosition(1.7, 1.7, 0);
@@ -81,7 +116,7 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	lights[0].setDiffuseColour(0.8, 0.8, 0.75, 1);
 	lights[0].SetLightType(0);
 	lights[0].GenerateShadowMatrices();
-	lights[0].CreateShadowMaps(renderer);
+	lights[0].CreateShadowMaps(renderer, shadowAtlas);
 	lights[0].SetLightPower(0.5);
 
 	lights.push_back(WorldLight()); // Spotlight 1
@@ -91,7 +126,7 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	lights[1].setDiffuseColour(0.0, 0.8, 0.75, 1);
 	lights[1].SetLightType(2);
 	lights[1].GenerateShadowMatrices();
-	lights[1].CreateShadowMaps(renderer);
+	lights[1].CreateShadowMaps(renderer, shadowAtlas);
 	lights[1].SetLightPower(0.3);
 	lights[1].SetSpotlightAngles(23, 25);
 
@@ -102,7 +137,7 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	lights[2].setDiffuseColour(0.9, 0.8, 0.0, 1);
 	lights[2].SetLightType(2);
 	lights[2].GenerateShadowMatrices();
-	lights[2].CreateShadowMaps(renderer);
+	lights[2].CreateShadowMaps(renderer, shadowAtlas);
 	lights[2].SetLightPower(0.3);
 	lights[2].SetSpotlightAngles(15, 25);
 
@@ -113,7 +148,7 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	lights[3].setDiffuseColour(0.5, 0.2, 0.75, 1);
 	lights[3].SetLightType(2);
 	lights[3].GenerateShadowMatrices();
-	lights[3].CreateShadowMaps(renderer);
+	lights[3].CreateShadowMaps(renderer, shadowAtlas);
 	lights[3].SetLightPower(0.3);
 	lights[3].SetSpotlightAngles(25, 30);
 
@@ -124,7 +159,7 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	lights[4].setDiffuseColour(0.5, 0.1, 0.1, 1);
 	lights[4].SetLightType(1);
 	lights[4].GenerateShadowMatrices();
-	lights[4].CreateShadowMaps(renderer);
+	lights[4].CreateShadowMaps(renderer, shadowAtlas);
 	lights[4].SetLightPower(0.3);
 
 	// Post processing
@@ -148,62 +183,62 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 	dofShader->SetRenderer(renderer);
 
 	// Material Setup for PBR Shader
-	// First load all textures
-	textureMgr->loadTexture(L"PBRSphereColorMap", L"./res/BrickPBR/Color.png"); // (Demes, 2021 a) 
-	textureMgr->loadTexture(L"PBRSphereNormalMap", L"./res/BrickPBR/Normal.png"); // (Demes, 2021 a)
-	textureMgr->loadTexture(L"PBRSphereAOMap", L"./res/BrickPBR/AmbientOcclusion.png"); // (Demes, 2021 a)
-	textureMgr->loadTexture(L"PBRSphereRoughnessMap", L"./res/BrickPBR/Roughness.png"); // (Demes, 2021 a)
+	// First queue all textures, their handles show the default white texture until loaded
+	assetLoader->loadTexture(L"PBRSphereColorMap", L"./res/BrickPBR/Color.png"); // (Demes, 2021 a) 
+	assetLoader->loadTexture(L"PBRSphereNormalMap", L"./res/BrickPBR/Normal.png"); // (Demes, 2021 a)
+	assetLoader->loadTexture(L"PBRSphereAOMap", L"./res/BrickPBR/AmbientOcclusion.png"); // (Demes, 2021 a)
+	assetLoader->loadTexture(L"PBRSphereRoughnessMap", L"./res/BrickPBR/Roughness.png"); // (Demes, 2021 a)
 
-	textureMgr->loadTexture(L"BrushedMetalColorMap", L"./res/BrushedMetal/Color.png"); // (Demes, 2018)
-	textureMgr->loadTexture(L"BrushedMetalNormalMap", L"./res/BrushedMetal/Normal.png"); // (Demes, 2018)
-	textureMgr->loadTexture(L"BrushedMetalRoughnessMap", L"./res/BrushedMetal/Roughness.png"); // (Demes, 2018)
+	assetLoader->loadTexture(L"BrushedMetalColorMap", L"./res/BrushedMetal/Color.png"); // (Demes, 2018)
+	assetLoader->loadTexture(L"BrushedMetalNormalMap", L"./res/BrushedMetal/Normal.png"); // (Demes, 2018)
+	assetLoader->loadTexture(L"BrushedMetalRoughnessMap", L"./res/BrushedMetal/Roughness.png"); // (Demes, 2018)
 
-	textureMgr->loadTexture(L"WoodFloorColorMap", L"./res/WoodFloor/Color.png"); // (Demes, 2022)
-	textureMgr->loadTexture(L"WoodFloorNormalMap", L"./res/WoodFloor/Normal.png"); // (Demes, 2022)
-	textureMgr->loadTexture(L"WoodFloorAOMap", L"./res/WoodFloor/AmbientOcclusion.png"); // (Demes, 2022)
-	textureMgr->loadTexture(L"WoodFloorRoughnessMap", L"./res/WoodFloor/Roughness.png"); // (Demes, 2022)
+	assetLoader->loadTexture(L"WoodFloorColorMap", L"./res/WoodFloor/Color.png"); // (Demes, 2022)
+	assetLoader->loadTexture(L"WoodFloorNormalMap", L"./res/WoodFloor/Normal.png"); // (Demes, 2022)
+	assetLoader->loadTexture(L"WoodFloorAOMap", L"./res/WoodFloor/AmbientOcclusion.png"); // (Demes, 2022)
+	assetLoader->loadTexture(L"WoodFloorRoughnessMap", L"./res/WoodFloor/Roughness.png"); // (Demes, 2022)
 
-	textureMgr->loadTexture(L"SausageRollColorMap", L"./res/SausageRoll/Color.png"); // (Demes, 2021 b)
-	textureMgr->loadTexture(L"SausageRollNormalMap", L"./res/SausageRoll/Normal.png"); // (Demes, 2021 b)
-	textureMgr->loadTexture(L"SausageRollAOMap", L"./res/SausageRoll/AmbientOcclusion.png"); // (Demes, 2021 b)
+	assetLoader->loadTexture(L"SausageRollColorMap", L"./res/SausageRoll/Color.png"); // (Demes, 2021 b)
+	assetLoader->loadTexture(L"SausageRollNormalMap", L"./res/SausageRoll/Normal.png"); // (Demes, 2021 b)
+	assetLoader->loadTexture(L"SausageRollAOMap", L"./res/SausageRoll/AmbientOcclusion.png"); // (Demes, 2021 b)
 
 	// Then setup material defaults
 	templeMaterial = PBRShader::PBRMaterial{
 		XMFLOAT4(0.98, 0.98, 0.90, 1),
 		XMFLOAT4(1, 1, 1, 1),
-		64, 0.2, 0, 0, nullptr
+		64, 0.2, 0, 0
 	};
 	
 	GreyBricksMaterial = PBRShader::PBRMaterial{
 		XMFLOAT4(1, 1, 1, 1),
 		XMFLOAT4(1, 1, 1, 1),
 		64, 0.2, 0, (int)PBRShader::TextureFlag::NORMAL | (int)PBRShader::TextureFlag::COLOR| (int)PBRShader::TextureFlag::AO| (int)PBRShader::TextureFlag::ROUGHNESS,
-		textureMgr->getTexture(L"PBRSphereColorMap"), textureMgr->getTexture(L"PBRSphereNormalMap"),
-		textureMgr->getTexture(L"PBRSphereAOMap"), textureMgr->getTexture(L"PBRSphereRoughnessMap")
+		textureMgr->getHandle(L"PBRSphereColorMap"), textureMgr->getHandle(L"PBRSphereNormalMap"),
+		textureMgr->getHandle(L"PBRSphereAOMap"), textureMgr->getHandle(L"PBRSphereRoughnessMap")
 	};
 
 	BrushedMetalMaterial = PBRShader::PBRMaterial{
 		XMFLOAT4(1, 1, 1, 1),
 		XMFLOAT4(1, 1, 1, 1),
 		64, 0.2, 1, (int)PBRShader::TextureFlag::NORMAL | (int)PBRShader::TextureFlag::COLOR | (int)PBRShader::TextureFlag::ROUGHNESS,
-		textureMgr->getTexture(L"BrushedMetalColorMap"), textureMgr->getTexture(L"BrushedMetalNormalMap"),
-		nullptr, textureMgr->getTexture(L"BrushedMetalRoughnessMap")
+		textureMgr->getHandle(L"BrushedMetalColorMap"), textureMgr->getHandle(L"BrushedMetalNormalMap"),
+		TextureManager::DEFAULT_TEXTURE, textureMgr->getHandle(L"BrushedMetalRoughnessMap")
 	};
 
 	WoorFloorMaterial = PBRShader::PBRMaterial{
 		XMFLOAT4(1, 1, 1, 1),
 		XMFLOAT4(1, 1, 1, 1),
 		64, 0.2, 0, (int)PBRShader::TextureFlag::NORMAL | (int)PBRShader::TextureFlag::COLOR | (int)PBRShader::TextureFlag::AO | (int)PBRShader::TextureFlag::ROUGHNESS,
-		textureMgr->getTexture(L"WoodFloorColorMap"), textureMgr->getTexture(L"WoodFloorNormalMap"),
-		textureMgr->getTexture(L"WoodFloorAOMap"), textureMgr->getTexture(L"WoodFloorRoughnessMap")
+		textureMgr->getHandle(L"WoodFloorColorMap"), textureMgr->getHandle(L"WoodFloorNormalMap"),
+		textureMgr->getHandle(L"WoodFloorAOMap"), textureMgr->getHandle(L"WoodFloorRoughnessMap")
 	};
 
 	SausageRollMaterial = PBRShader::PBRMaterial{
 		XMFLOAT4(1, 1, 1, 1),
 		XMFLOAT4(1, 1, 1, 1),
 		64, 0.1, 0, (int)PBRShader::TextureFlag::NORMAL | (int)PBRShader::TextureFlag::COLOR | (int)PBRShader::TextureFlag::AO,
-		textureMgr->getTexture(L"SausageRollColorMap"), textureMgr->getTexture(L"SausageRollNormalMap"),
-		textureMgr->getTexture(L"SausageRollAOMap"), nullptr
+		textureMgr->getHandle(L"SausageRollColorMap"), textureMgr->getHandle(L"SausageRollNormalMap"),
+		textureMgr->getHandle(L"SausageRollAOMap"), TextureManager::DEFAULT_TEXTURE
 	};
 
 	// Setup height map parameters
@@ -255,6 +290,9 @@ bool App1::frame()
 	{
 		return false;
 	}
+
+	// Upload any assets the loader finished, material handles then resolve to the real textures in place of the defaults
+	assetLoader->update();
 	
 	// Render the graphics.
 	result = render();
@@ -286,18 +324,57 @@ bool App1::frame()
 
 bool App1::render()
 {
+	// Light spheres follow the lights, so their instances are rebuilt every frame
+	lightSphere.ClearInstances();
+	for (int lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
+		lightSphere.AddInstance(lights[lightIndex].getPosition(), XMFLOAT3(0, 0, 0), XMFLOAT3(0.2, 0.2, 0.2), 0);
+	}
+	pbrShader->ResetInstancingStats();
+	frameConstants->ResetUploadStats();
+
+	// Generate the view matrix based on the camera's position, the draw keys need it.
+	camera->update();
+	// Directional lights' cascades follow the camera
+	for (int lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
+		lights[lightIndex].FitShadowCascades(camera->getViewMatrix(), renderer->getProjectionMatrix(), SCREEN_NEAR, SCREEN_DEPTH);
+	}
+
+	// Cluster the lights first, the atlas sizes their views by the spheres they reach
+	clusteredLights->Build(lights.data(), lights.size(), extraLights, camera->getViewMatrix(), renderer->getProjectionMatrix(), SCREEN_NEAR, SCREEN_DEPTH, screenWidth, screenHeight);
+
+	// Place the point and spot lights' views, before their regions are packed with the lights
+	allocateShadowAtlas();
+
+	// Lights are packed once for every pass, they only upload if they moved or were edited
+	frameConstants->SetLights(lights.data(), lights.size());
+
+	// Every pass submits its draws, then the queue sorts and draws them all
+	renderQueue.clear();
+
+	// Passes cull against the bounds as they submit, and objects are lit by the lights reaching them
+	updateCullBounds();
+	selectObjectLights();
+	for (unsigned int pass = 0; pass < PASS_COUNT; ++pass) {
+		passCulled[pass] = false;
+		passDraws[pass] = 0;
+		passDrawsSkipped[pass] = 0;
+	}
+
 	// Shadow passes first
 	shadowDepthPasses();
 
-	// If no DOF do normal scene render
+	// If no DOF do normal scene render, otherwise do DOF specific render
 	if (!DOFEnabled) sceneRenderPass();
+	else depthOfFieldPass();
+
+	renderQueue.execute();
 
 	// TURN OFF WIREFRAME BEFORE POST PROCESSING
 	// This means we can still see the wireframe of the world. Not the ortho quad.
 	renderer->setWireframeMode(false);
 
-	// If DOF then do DOF specific render
-	if (DOFEnabled) depthOfFieldPass();
+	// Blur and combine the DOF layers
+	if (DOFEnabled) depthOfFieldBlurPass();
 
 	// Bloom post processing
 	bloomPass();
@@ -308,213 +385,428 @@ bool App1::render()
 	return true;
 }
 
+void App1::allocateShadowAtlas()
+{
+	ShadowAtlasAllocator& allocator = shadowAtlas->GetAllocator();
+	allocator.beginFrame();
+
+	// A light's views span the sphere it reaches, the same one it is clustered by, so they need as many texels across as the
+	// sphere covers pixels on screen. Its projected diameter grows as the camera nears it, and fills the screen from inside it.
+	// A light whose sphere is off screen lights nothing seen, its views get no region and are unshadowed until it is back.
+	XMFLOAT4X4 cameraProjection, cameraViewProjection;
+	XMStoreFloat4x4(&cameraProjection, renderer->getProjectionMatrix());
+	XMStoreFloat4x4(&cameraViewProjection, camera->getViewMatrix() * renderer->getProjectionMatrix());
+	FrustumCuller::Frustum cameraFrustum;
+	FrustumCuller::computeFrustum(&cameraViewProjection._11, cameraFrustum);
+	XMFLOAT3 cameraPosition = camera->getPosition();
+	std::vector<std::pair<int, int>> lightSizes; // Size and light index
+	for (int lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
+		if (lights[lightIndex].GetLightType() == 0) continue;
+		XMFLOAT3 centre;
+		float radius;
+		bool onScreen = clusteredLights->GetLightBounds(lightIndex, centre, radius);
+		for (int plane = 0; plane < 6 && onScreen; ++plane) {
+			const float* p = cameraFrustum.planes[plane];
+			onScreen = p[0] * centre.x + p[1] * centre.y + p[2] * centre.z + p[3] >= -radius;
+		}
+		if (!onScreen) {
+			for (int f = 0; f < lights[lightIndex].GetShadowFaceCount(); ++f) lights[lightIndex].SetShadowAtlasRegion(f, ShadowAtlasAllocator::Region{});
+			shadowAtlasViewSizes[lightIndex] = 0;
+			continue;
+		}
+
+		// The projection's _22 is 1 / tan of half the field of view, a sphere's silhouette is tan of its angular radius across
+		XMFLOAT3 offset(centre.x - cameraPosition.x, centre.y - cameraPosition.y, centre.z - cameraPosition.z);
+		float distanceSquared = offset.x * offset.x + offset.y * offset.y + offset.z * offset.z;
+		float idealSize = (float)ShadowAtlas::MAX_VIEW_SIZE;
+		if (distanceSquared > radius * radius) {
+			idealSize = screenHeight * cameraProjection._22 * radius / sqrtf(distanceSquared - radius * radius);
+		}
+		int size = ShadowAtlasAllocator::chooseSize(idealSize, shadowAtlasViewSizes[lightIndex], ShadowAtlas::MIN_VIEW_SIZE, ShadowAtlas::MAX_VIEW_SIZE);
+		shadowAtlasViewSizes[lightIndex] = size;
+		lightSizes.push_back(std::make_pair(size, lightIndex));
+	}
+
+	// Largest first, all of a point light's faces together, so a full atlas shrinks the smallest views
+	std::sort(lightSizes.begin(), lightSizes.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+		return a.first > b.first || (a.first == b.first && a.second < b.second);
+	});
+	for (const std::pair<int, int>& lightSize : lightSizes) {
+		WorldLight& light = lights[lightSize.second];
+		for (int f = 0; f < light.GetShadowFaceCount(); ++f) {
+			light.SetShadowAtlasRegion(f, allocator.request(lightSize.second * 6 + f, lightSize.first));
+		}
+	}
+
+	// A view left without a region loses its depth, another view can be given the same region before it gets it back
+	for (int lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
+		if (lights[lightIndex].GetLightType() == 0) continue;
+		for (int f = 0; f < lights[lightIndex].GetShadowFaceCount(); ++f) {
+			if (lights[lightIndex].GetShadowAtlasRegion(f).size == 0) shadowViews[lightIndex * 6 + f].staticInputs.clear();
+		}
+	}
+
+	allocator.endFrame();
+	shadowAtlasStats = allocator.getStats();
+}
+
+void App1::generateExtraLights(int count)
+{
+	// Seeded, so moving the slider back gives the same lights
+	std::mt19937 random(5678);
+	std::uniform_real_distribution<float> across(-100.0f, 100.0f), height(-10.0f, -4.0f), channel(0.0f, 1.0f);
+	extraLights.clear();
+	for (int i = 0; i < count; ++i) {
+		ClusterLightData light = {};
+		XMFLOAT3 colour(channel(random), channel(random), channel(random));
+		light.diffuseColor = XMFLOAT4(colour.x, colour.y, colour.z, 1);
+		light.ambientColor = XMFLOAT4(colour.x * 0.1f, colour.y * 0.1f, colour.z * 0.1f, 1);
+		light.position = XMFLOAT3(across(random), height(random), across(random));
+		light.direction = XMFLOAT3(0, -1, 0);
+		light.lightType = 1;
+		// Fades out in around 12 units, ClusteredLights works out the range
+		light.constantAttenuation = 1;
+		light.linearAttenuation = 0.7f;
+		light.quadraticAttenuation = 1.8f;
+		light.lightPower = 1;
+		extraLights.push_back(light);
+	}
+}
+
 bool App1::shadowDepthPasses()
 {
+	// Build the caster list from the objects' flags, with whichever of the spheres or sausage roll is shown
+	// The terrain's quadtree patches are displaced in their vertex shader, so it keeps its own shader, drawn depth only
+	shadowCasters.clear();
+	ShadowCaster candidates[] = {
+		{ &temple, QUEUE_MESH_TEMPLE },
+		{ &lightSphere, QUEUE_MESH_LIGHT_SPHERE },
+		sausageRollReplaceSpheres ? ShadowCaster{ &SausageRoll, QUEUE_MESH_SAUSAGE_ROLL } : ShadowCaster{ &PBRSphere, QUEUE_MESH_SPHERE },
+		{ &groundPlane, QUEUE_MESH_TERRAIN }
+	};
+	for (const ShadowCaster& candidate : candidates) {
+		if (candidate.object->CastsShadows()) shadowCasters.push_back(candidate);
+	}
+
+	// Receivers the camera sees, shadow views no receiver is in can never be sampled
+	XMFLOAT4X4 cameraViewProjection;
+	XMStoreFloat4x4(&cameraViewProjection, camera->getViewMatrix() * renderer->getProjectionMatrix());
+	FrustumCuller::Frustum cameraFrustum;
+	FrustumCuller::computeFrustum(&cameraViewProjection._11, cameraFrustum);
+	frustumCuller.cull(cameraFrustum, cameraVisible);
+	memset(shadowViewStats, 0, sizeof(shadowViewStats));
+
+	// Point and spot lights reaching none of them light no pixel, so their shadows are never sampled
+	unsigned int receiverLights = 0;
+	for (unsigned int index : cameraVisible) receiverLights |= clusteredLights->GetObjectShadowLights(index);
+
 	// To do loop over all lights
 	for (int lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
 		// For all the faces to map on this light
-		int facesToMap = (lights[lightIndex].GetLightType() != 0) ? 6 : 1;
-		if (lights[lightIndex].GetLightType() != 0) lights[lightIndex].GetTCubeShadowMap()->ClearDSV(renderer->getDeviceContext());
+		int facesToMap = lights[lightIndex].GetShadowFaceCount();
+		if (lights[lightIndex].GetLightType() != 0 && (receiverLights & (1u << lightIndex)) == 0) {
+			// Its views keep their depth and inputs, as unseen views do
+			shadowViewStats[lightIndex].outOfReach += facesToMap;
+			continue;
+		}
 		for (int f = 0; f < facesToMap; ++f) {
-			// Set this face's shadow map to be rendered on to 
-			if (lights[lightIndex].GetLightType() == 0) lights[lightIndex].GetDirectionalShadowMap()->BindDsvAndSetNullRenderTarget(renderer->getDeviceContext());
-			else lights[lightIndex].GetTCubeShadowMap()->BindDsvAndSetNullRenderTarget(renderer->getDeviceContext(), f);
+			unsigned int view = lightIndex * 6 + f;
 
-			// Get lights view and projection matrix
+			// Get lights view and projection matrix, for the draw keys and culling
 			XMMATRIX lightViewMatrix = lights[lightIndex].GetViewMatrix(f);
 			XMMATRIX lightProjMatrix = lights[lightIndex].GetProjMatrix(f);
+			// A view the atlas had no room for is unshadowed
+			if (lights[lightIndex].GetLightType() != 0 && lights[lightIndex].GetShadowAtlasRegion(f).size == 0) continue;
+			ShadowViewPlan plan;
+			if (!planShadowView(view, lightIndex, lightViewMatrix, lightProjMatrix, plan)) continue;
+
+			// Static casters first, cleared onto the map, every caster when caching is off
+			if (plan.drawStatic) {
+				unsigned int pass = SHADOW_PASS + view;
+				cullPass(pass, lightViewMatrix, lightProjMatrix);
+				renderQueue.setPassSetup(pass, [this, pass, lightIndex, f]() {
+					setupShadowPass(pass, lightIndex, f, true);
+				});
+				submitShadowCasters(pass, lightViewMatrix, lightProjMatrix, plan.drawDynamic ? SHADOW_CASTERS_STATIC : SHADOW_CASTERS_ALL);
+			}
 
-			// Temp pointer while loop is incomplete. 
-			WorldLight* temp = &lights[lightIndex];
+			// Then the moving casters over the static depth, just drawn and now saved, or restored from the cache
+			if (plan.drawDynamic) {
+				unsigned int pass = SHADOW_DYNAMIC_PASS + view;
+				cullPass(pass, lightViewMatrix, lightProjMatrix);
+				bool saveCache = plan.saveCache;
+				renderQueue.setPassSetup(pass, [this, pass, lightIndex, f, saveCache]() {
+					ShadowMap* shadowMap = lights[lightIndex].GetShadowMap();
+					if (saveCache) shadowMap->SaveStaticCache(renderer->getDeviceContext(), f);
+					else shadowMap->RestoreStaticCache(renderer->getDeviceContext(), f);
+					setupShadowPass(pass, lightIndex, f, false);
+				});
+				submitShadowCasters(pass, lightViewMatrix, lightProjMatrix, SHADOW_CASTERS_DYNAMIC);
+			}
+		}
+	}
+	return true;
+}
+
+void App1::setupShadowPass(unsigned int pass, int lightIndex, int face, bool clear)
+{
+	// Set this cascade's shadow map, or this face's region of the atlas, to be rendered on to 
+	if (lights[lightIndex].GetLightType() == 0) lights[lightIndex].GetShadowMap()->BindDsvAndSetNullRenderTarget(renderer->getDeviceContext(), face, clear);
+	else shadowAtlas->BindDsvAndSetNullRenderTarget(renderer->getDeviceContext(), lights[lightIndex].GetShadowAtlasRegion(face), clear);
+
+	// Get lights view and projection matrix
+	XMMATRIX lightViewMatrix = lights[lightIndex].GetViewMatrix(face);
+	XMMATRIX lightProjMatrix = lights[lightIndex].GetProjMatrix(face);
 
-			// Set light as camera for PBR shader and draw test sphere
-			pbrShader->SetLightAsCamera(&lights[lightIndex], f);
-			pbrShader->SetShaderParameters(temple.GetWorldMatrix(), &templeMaterial, lights.data(), lights.size());
-			temple.Render();
+	// Models are seen from the light at the shadow map's resolution, with the coarser shadow bias
+	selectLods(lightViewMatrix, lightProjMatrix, (float)lights[lightIndex].GetShadowMapResolution(face), lodPixelError * shadowLodBias);
+	cullClusters(lightViewMatrix, lightProjMatrix);
 
-			// Draw PBR Spheres or sausage roll
-			if (!sausageRollReplaceSpheres) {
-				PBRSphere.SetPosition(XMFLOAT3(0, -9, -2));
-				pbrShader->SetShaderParameters(PBRSphere.GetWorldMatrix(), &BrushedMetalMaterial, lights.data(), lights.size());
-				PBRSphere.Render();
+	// Set light as camera, a still light's faces upload nothing. Only depth is written, so no pixel shaders run.
+	heightMapShader->setDepthOnly(true);
+	frameConstants->SetPass(pass, lightProjMatrix, lightViewMatrix, lights[lightIndex].getPosition());
+}
 
-				PBRSphere.SetPosition(XMFLOAT3(0, -9, -5));
-				pbrShader->SetShaderParameters(PBRSphere.GetWorldMatrix(), &WoorFloorMaterial, lights.data(), lights.size());
-				PBRSphere.Render();
+void App1::submitShadowCasters(unsigned int pass, const XMMATRIX& lightViewMatrix, const XMMATRIX& lightProjMatrix, ShadowCasterFilter filter)
+{
+	for (const ShadowCaster& caster : shadowCasters) {
+		WorldObject* object = caster.object;
+		if ((filter == SHADOW_CASTERS_STATIC && !object->IsStatic()) || (filter == SHADOW_CASTERS_DYNAMIC && object->IsStatic())) continue;
+
+		// Draw the terrain
+		// Its patches are still picked at the user camera's levels so to cast correct shadows, only culled by the light's view.
+		if (object == &groundPlane) {
+			submitTerrain(pass, lightViewMatrix, lightProjMatrix);
+			continue;
+		}
 
-				PBRSphere.SetPosition(XMFLOAT3(0, -9, -8));
-				pbrShader->SetShaderParameters(PBRSphere.GetWorldMatrix(), &GreyBricksMaterial, lights.data(), lights.size());
-				PBRSphere.Render();
+		// Draw the casters' positions only, with no materials
+		submitDraw(pass, false, QUEUE_SHADER_SHADOW_DEPTH, QUEUE_MATERIAL_NONE, caster.mesh, *object, lightViewMatrix, [this, object]() {
+			if (object->GetInstanceCount() > 0) {
+				shadowDepthShader->SetInstanceParameters(object->GetInstances());
+				object->RenderInstancedDepth(shadowDepthShader);
 			}
 			else {
-				pbrShader->SetShaderParameters(SausageRoll.GetWorldMatrix(), &SausageRollMaterial, lights.data(), lights.size());
-				SausageRoll.Render();
+				shadowDepthShader->SetShaderParameters(object->GetWorldMatrix());
+				object->RenderDepth(shadowDepthShader);
 			}
-			// Set light as camera for height map shader and draw terrain
-			heightMapShader->SetLightAsCamera(&lights[lightIndex], f);
-			heightMapShader->SetLightAsCamera();
-			HeightMapShader::HeightMapBufferData heightMapSettings{
-			amplitude, XMFLOAT2(200, 200), (isSmoothingOn) ? 1 : 0
-			};
-
-			// Tessellation will still tessellate at user camera so to cast correct shadows. 
-			heightMapShader->SetShaderParameters(groundPlane.GetWorldMatrix(), &heightMapSettings, lights.data(), lights.size(), textureMgr->getTexture(L"IslandHeightMap"), textureMgr->getTexture(L"IslandTextureMap"), terrainTessellationMinAndMaxTesselation, terrainTessellationMinAndMaxDistance);
-			groundPlane.Render(D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
-		}
+		});
 	}
-	return true;
 }
 
-bool App1::sceneRenderPass()
+void App1::appendShadowInputs(std::vector<unsigned int>& inputs, const void* data, size_t size)
 {
-	// Clear the scene. (default blue colour)
-	fullSceneNoPP->clearRenderTarget(renderer->getDeviceContext(), 0.39f, 0.58f, 0.92f, 1.0f);
-	fullSceneNoPP->setRenderTarget(renderer->getDeviceContext());
-
-	// Generate the view matrix based on the camera's position.
-	camera->update();
-
-	// Render objects
+	size_t first = inputs.size();
+	inputs.resize(first + (size + sizeof(unsigned int) - 1) / sizeof(unsigned int), 0);
+	memcpy(&inputs[first], data, size);
+}
 
-	// Set the camera to be the camera for the PBR Shader
-	pbrShader->SetCameraAsCamera();
+bool App1::planShadowView(unsigned int view, int lightIndex, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, ShadowViewPlan& plan)
+{
+	ShadowViewStats& stats = shadowViewStats[lightIndex];
+	ShadowViewCache& cache = shadowViews[view];
+	if (!shadowCaching) {
+		// Forget every view, they are all redrawn when caching is turned back on
+		cache.staticInputs.clear();
+		cache.dynamicInputs.clear();
+		cache.cacheValid = false;
+		plan = ShadowViewPlan{ true, false, false };
+		stats.staticDrawn++;
+		return true;
+	}
 
-	// Draw the test sphere
-	pbrShader->SetShaderParameters(temple.GetWorldMatrix(), &templeMaterial, lights.data(), lights.size());
-	temple.Render();
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, viewMatrix * projectionMatrix);
+	FrustumCuller::Frustum frustum;
+	FrustumCuller::computeFrustum(&viewProjection._11, frustum);
+	frustumCuller.cull(frustum, viewVisible);
+
+	// Both lists are in index order, so a merge finds a receiver in both
+	bool seen = false;
+	for (size_t a = 0, b = 0; a < viewVisible.size() && b < cameraVisible.size() && !seen;) {
+		if (viewVisible[a] == cameraVisible[b]) seen = true;
+		else if (viewVisible[a] < cameraVisible[b]) a++;
+		else b++;
+	}
+	if (!seen) {
+		// Its depth is left as it was, and still matches the inputs it was drawn with
+		stats.unseen++;
+		return false;
+	}
 
-	// Draw the light sphere
-	for (int lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
-		lightSphere.SetPosition(lights[lightIndex].getPosition());
-		pbrShader->SetShaderParameters(lightSphere.GetWorldMatrix(), &templeMaterial, lights.data(), lights.size());
-		lightSphere.Render();
+	// Everything the view's depth comes from, the casters in it, static and moving apart, the light's view and the settings they are drawn with
+	// The first value is if there are any casters, so an empty set's inputs are the same wherever the light is
+	staticInputs.assign(1, 0);
+	dynamicInputs.assign(1, 0);
+	for (unsigned int index : viewVisible) {
+		WorldObject* object = cullObjects[index];
+		if (!std::any_of(shadowCasters.begin(), shadowCasters.end(), [object](const ShadowCaster& caster) { return caster.object == object; })) continue;
+		std::vector<unsigned int>& inputs = object->IsStatic() ? staticInputs : dynamicInputs;
+		inputs[0] = 1;
+
+		// Bounds change as a mesh arrives, the matrices as it or any instance moves
+		XMFLOAT3 centre(0, 0, 0), extents(0, 0, 0);
+		float radius = 0;
+		bool hasMesh = object->GetWorldBounds(centre, extents, radius);
+		XMMATRIX world = object->GetWorldMatrix();
+		appendShadowInputs(inputs, &index, sizeof(index));
+		appendShadowInputs(inputs, &hasMesh, sizeof(hasMesh));
+		appendShadowInputs(inputs, &centre, sizeof(centre));
+		appendShadowInputs(inputs, &extents, sizeof(extents));
+		appendShadowInputs(inputs, &world, sizeof(world));
+		for (const InstanceBufferData& instance : object->GetInstances()) appendShadowInputs(inputs, &instance.worldMatrix, sizeof(XMMATRIX));
+
+		if (object == &groundPlane) {
+			// The terrain is displaced by its height map, and its patches' levels and morphs are picked from the camera's position
+			ID3D11ShaderResourceView* heightMap = textureMgr->getTexture(islandHeightMap);
+			XMFLOAT3 cameraPosition = camera->getPosition();
+			unsigned int terrainLevels = terrainQuadtree.getLevelCount();
+			appendShadowInputs(inputs, &heightMap, sizeof(heightMap));
+			appendShadowInputs(inputs, &amplitude, sizeof(amplitude));
+			appendShadowInputs(inputs, &isSmoothingOn, sizeof(isSmoothingOn));
+			appendShadowInputs(inputs, &terrainLevels, sizeof(terrainLevels));
+			appendShadowInputs(inputs, &terrainPixelError, sizeof(terrainPixelError));
+			appendShadowInputs(inputs, &cameraPosition, sizeof(cameraPosition));
+		}
+	}
+	for (std::vector<unsigned int>* inputs : { &staticInputs, &dynamicInputs }) {
+		if ((*inputs)[0] == 0) continue;
+		// Levels of detail and meshlets are picked for the light's view, with these settings
+		appendShadowInputs(*inputs, &viewMatrix, sizeof(XMMATRIX));
+		appendShadowInputs(*inputs, &projectionMatrix, sizeof(XMMATRIX));
+		appendShadowInputs(*inputs, &lodPixelError, sizeof(lodPixelError));
+		appendShadowInputs(*inputs, &shadowLodBias, sizeof(shadowLodBias));
+		appendShadowInputs(*inputs, &clusterCulling, sizeof(clusterCulling));
 	}
 
-	// Draw PBR Spheres or sausage roll
-	if (!sausageRollReplaceSpheres) {
-		PBRSphere.SetPosition(XMFLOAT3(0, -9, -2));
-		pbrShader->SetShaderParameters(PBRSphere.GetWorldMatrix(), &BrushedMetalMaterial, lights.data(), lights.size());
-		PBRSphere.Render();
+	if (lights[lightIndex].GetLightType() != 0) {
+		// An atlas view moved to another region has none of its depth there, even with no casters, it has to be cleared
+		ShadowAtlasAllocator::Region region = lights[lightIndex].GetShadowAtlasRegion(view % 6);
+		appendShadowInputs(staticInputs, &region, sizeof(region));
+	}
 
-		PBRSphere.SetPosition(XMFLOAT3(0, -9, -5));
-		pbrShader->SetShaderParameters(PBRSphere.GetWorldMatrix(), &WoorFloorMaterial, lights.data(), lights.size());
-		PBRSphere.Render();
+	bool staticChanged = (staticInputs != cache.staticInputs);
+	if (!staticChanged && dynamicInputs == cache.dynamicInputs) {
+		stats.unchanged++;
+		return false;
+	}
 
-		PBRSphere.SetPosition(XMFLOAT3(0, -9, -8));
-		pbrShader->SetShaderParameters(PBRSphere.GetWorldMatrix(), &GreyBricksMaterial, lights.data(), lights.size());
-		PBRSphere.Render();
+	bool hasDynamic = (dynamicInputs[0] != 0);
+	if (hasDynamic && lights[lightIndex].GetLightType() != 0) {
+		// Depth can only be copied a whole texture at a time, so atlas views have no cache and draw every caster again
+		plan = ShadowViewPlan{ true, false, false };
+		cache.cacheValid = false;
+	}
+	else if (hasDynamic) {
+		// The static depth has to be in the cache to draw moving casters over, drawn and saved if the cache is out of date
+		bool redraw = staticChanged || !cache.cacheValid;
+		plan = ShadowViewPlan{ redraw, true, redraw };
+		cache.cacheValid = true;
+	}
+	else if (staticChanged || !cache.cacheValid) {
+		// Only static casters, drawn straight onto the map, which the cache no longer matches
+		plan = ShadowViewPlan{ true, false, false };
+		cache.cacheValid = false;
 	}
 	else {
-		pbrShader->SetShaderParameters(SausageRoll.GetWorldMatrix(), &SausageRollMaterial, lights.data(), lights.size());
-		SausageRoll.Render();
+		// The moving casters have left, restoring the cache is all it takes
+		plan = ShadowViewPlan{ false, true, false };
 	}
-	HeightMapShader::HeightMapBufferData heightMapSettings{
-			amplitude, XMFLOAT2(200, 200), (isSmoothingOn) ? 1 : 0
-	};
-
-	// Setup height map shader to now use camera and draw terrain
-	heightMapShader->SetCameraAsCamera();
-	heightMapShader->SetShaderParameters(groundPlane.GetWorldMatrix(), &heightMapSettings, lights.data(), lights.size(), textureMgr->getTexture(L"IslandHeightMap"), textureMgr->getTexture(L"IslandTextureMap"), terrainTessellationMinAndMaxTesselation, terrainTessellationMinAndMaxDistance);
-	groundPlane.Render(D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+	if (plan.drawStatic) stats.staticDrawn++;
+	else stats.restored++;
 
-	// Draw the water test plane
-	renderer->setAlphaBlending(true);
-	wavesShader->SetCameraAsCamera();
-	wavesShader->SetShaderParameters(water.GetWorldMatrix(), waveData, lights.data(), lights.size(), terrainTessellationMinAndMaxTesselation, terrainTessellationMinAndMaxDistance);
-	water.Render(D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
-	renderer->setAlphaBlending(false);
+	cache.staticInputs = staticInputs;
+	cache.dynamicInputs = dynamicInputs;
+	return true;
+}
 
+bool App1::sceneRenderPass()
+{
+	renderQueue.setPassSetup(SCENE_PASS, [this]() {
+		// Clear the scene. (default blue colour)
+		fullSceneNoPP->clearRenderTarget(renderer->getDeviceContext(), 0.39f, 0.58f, 0.92f, 1.0f);
+		fullSceneNoPP->setRenderTarget(renderer->getDeviceContext());
+
+		selectLods(camera->getViewMatrix(), renderer->getProjectionMatrix(), (float)screenHeight, lodPixelError);
+		cullClusters(camera->getViewMatrix(), renderer->getProjectionMatrix());
+
+		// Set the camera to be the camera for every shader, and the terrain back to shading
+		heightMapShader->setDepthOnly(false);
+		frameConstants->SetPass(SCENE_PASS, renderer->getProjectionMatrix(), camera->getViewMatrix(), camera->getPosition());
+		clusteredLights->Bind();
+	});
+
+	cullPass(SCENE_PASS, camera->getViewMatrix(), renderer->getProjectionMatrix());
+	submitScene(SCENE_PASS);
 	return true;
 }
 
 bool App1::depthOfFieldPass()
 {
 	// Setup the depth layers based on plane in focus
-	float maxDepths[DOF_LAYER_COUNT];
-	float minDepths[DOF_LAYER_COUNT];
 	float fullDepthRange = 0.009;
 	float focusPlaneStep = fullDepthRange / DOF_LAYER_COUNT;
 	float currentEdge = focusPlane + fullDepthRange / 2.0f;
 	for (int i = 0; i < DOF_LAYER_COUNT; ++i) {
-		maxDepths[i] = currentEdge;
+		dofMaxDepths[i] = currentEdge;
 		currentEdge -= focusPlaneStep;
-		minDepths[i] = currentEdge;
+		dofMinDepths[i] = currentEdge;
 	}
 	// Make sure we start at depth 1 and end at 0
-	maxDepths[0] = 1;
-	minDepths[DOF_LAYER_COUNT - 1] = 0;
+	dofMaxDepths[0] = 1;
+	dofMinDepths[DOF_LAYER_COUNT - 1] = 0;
 
-	// Array for easy sending of SRVs.
-	ID3D11ShaderResourceView* layerSRVs[DOF_LAYER_COUNT];
 	// For every layer
 	for (int i = 0; i < DOF_LAYER_COUNT; ++i) {
 		// ================================
 		// Render the scene's render but using the depth map to clip pixels not in the layer
 		// ================================
-		dofShader->ReadyPart1();
-		if(i == 0) depthOfFieldLayers[i]->clearRenderTarget(renderer->getDeviceContext(), 0.39f, 0.58f, 0.92f, 1.0f);
-		else depthOfFieldLayers[i]->clearRenderTarget(renderer->getDeviceContext(), 0, 0, 0, 0);
-		depthOfFieldLayers[i]->setRenderTarget(renderer->getDeviceContext());
-		
-		// Draw the test sphere
-		pbrShader->SetCameraAsCamera();
-		pbrShader->SetShaderParameters(temple.GetWorldMatrix(), &templeMaterial, lights.data(), lights.size(), XMFLOAT2(minDepths[i], maxDepths[i]));
-		temple.Render();
-
-		// Draw the light sphere
-		for (int lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
-			lightSphere.SetPosition(lights[lightIndex].getPosition());
-			pbrShader->SetShaderParameters(lightSphere.GetWorldMatrix(), &templeMaterial, lights.data(), lights.size(), XMFLOAT2(minDepths[i], maxDepths[i]));
-			lightSphere.Render();
-		}
-
-		// Draw PBR Spheres or sausage roll
-		if (!sausageRollReplaceSpheres) {
-			PBRSphere.SetPosition(XMFLOAT3(0, -9, -2));
-			pbrShader->SetShaderParameters(PBRSphere.GetWorldMatrix(), &BrushedMetalMaterial, lights.data(), lights.size(), XMFLOAT2(minDepths[i], maxDepths[i]));
-			PBRSphere.Render();
+		renderQueue.setPassSetup(SCENE_PASS + i, [this, i]() {
+			// DOF layers are never drawn in wireframe
+			if (i == 0) {
+				renderer->setWireframeMode(false);
+
+				// Every layer is drawn from the camera, so the levels of detail are picked once
+				selectLods(camera->getViewMatrix(), renderer->getProjectionMatrix(), (float)screenHeight, lodPixelError);
+				cullClusters(camera->getViewMatrix(), renderer->getProjectionMatrix());
+				heightMapShader->setDepthOnly(false);
+			}
 
-			PBRSphere.SetPosition(XMFLOAT3(0, -9, -5));
-			pbrShader->SetShaderParameters(PBRSphere.GetWorldMatrix(), &WoorFloorMaterial, lights.data(), lights.size(), XMFLOAT2(minDepths[i], maxDepths[i]));
-			PBRSphere.Render();
+			dofShader->ReadyPart1();
+			if (i == 0) depthOfFieldLayers[i]->clearRenderTarget(renderer->getDeviceContext(), 0.39f, 0.58f, 0.92f, 1.0f);
+			else depthOfFieldLayers[i]->clearRenderTarget(renderer->getDeviceContext(), 0, 0, 0, 0);
+			depthOfFieldLayers[i]->setRenderTarget(renderer->getDeviceContext());
 
-			PBRSphere.SetPosition(XMFLOAT3(0, -9, -8));
-			pbrShader->SetShaderParameters(PBRSphere.GetWorldMatrix(), &GreyBricksMaterial, lights.data(), lights.size(), XMFLOAT2(minDepths[i], maxDepths[i]));
-			PBRSphere.Render();
-		}
-		else {
-			pbrShader->SetShaderParameters(SausageRoll.GetWorldMatrix(), &SausageRollMaterial, lights.data(), lights.size(), XMFLOAT2(minDepths[i], maxDepths[i]));
-			SausageRoll.Render();
-		}
-		// Draw the water test plane
-		renderer->setAlphaBlending(true);
-		wavesShader->SetCameraAsCamera();
-		wavesShader->SetShaderParameters(water.GetWorldMatrix(), waveData, lights.data(), lights.size(), terrainTessellationMinAndMaxTesselation, terrainTessellationMinAndMaxDistance, XMFLOAT2(minDepths[i], maxDepths[i]));
-		water.Render(D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
-		renderer->setAlphaBlending(false);
+			// Every layer keeps its own depth range
+			frameConstants->SetPass(SCENE_PASS + i, renderer->getProjectionMatrix(), camera->getViewMatrix(), camera->getPosition(), XMFLOAT2(dofMinDepths[i], dofMaxDepths[i]));
+			clusteredLights->Bind();
+		});
 
-		HeightMapShader::HeightMapBufferData heightMapSettings{
-			amplitude, XMFLOAT2(200, 200), (isSmoothingOn) ? 1 : 0
-		};
+		// Each layer only draws what is in its slice of the depth range
+		cullPass(SCENE_PASS + i, camera->getViewMatrix(), renderer->getProjectionMatrix(), dofMinDepths[i], dofMaxDepths[i]);
+		submitScene(SCENE_PASS + i);
+	}
+	return true;
+}
 
-		// Setup height map shader to now use camera and draw terrain
-		heightMapShader->SetCameraAsCamera();
-		heightMapShader->SetShaderParameters(groundPlane.GetWorldMatrix(), &heightMapSettings, lights.data(), lights.size(), textureMgr->getTexture(L"IslandHeightMap"), textureMgr->getTexture(L"IslandTextureMap"), terrainTessellationMinAndMaxTesselation, terrainTessellationMinAndMaxDistance, XMFLOAT2(minDepths[i], maxDepths[i]));
-		groundPlane.Render(D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
-		// ================================
-		
+bool App1::depthOfFieldBlurPass()
+{
+	// Array for easy sending of SRVs.
+	ID3D11ShaderResourceView* layerSRVs[DOF_LAYER_COUNT];
+	// For every layer
+	for (int i = 0; i < DOF_LAYER_COUNT; ++i) {
 		// Blur the layer, with a gausian blur. Horizontal and vertical are seperated. 
 		dofShader->ReadyPart2();
 
 		depthOfFieldLayersHBlur[i]->clearRenderTarget(renderer->getDeviceContext(), 0, 0, 0, 0);
 		depthOfFieldLayersHBlur[i]->setRenderTarget(renderer->getDeviceContext());
-		dofShader->SetShaderParametersPart2(depthOfFieldLayers[i]->getShaderResourceView(), depthOfFieldLayers[i]->getDepthShaderResourceView(), screenWidth, screenHeight, maxDepths, minDepths, true, i);
+		dofShader->SetShaderParametersPart2(depthOfFieldLayers[i]->getShaderResourceView(), depthOfFieldLayers[i]->getDepthShaderResourceView(), screenWidth, screenHeight, dofMaxDepths, dofMinDepths, true, i);
 		fullScreenOrthoMesh.SetShader(dofShader);
 		fullScreenOrthoMesh.Render();
 
 		depthOfFieldLayersVBlur[i]->clearRenderTarget(renderer->getDeviceContext(), 0, 0, 0, 0);
 		depthOfFieldLayersVBlur[i]->setRenderTarget(renderer->getDeviceContext());
-		dofShader->SetShaderParametersPart2(depthOfFieldLayersHBlur[i]->getShaderResourceView(), depthOfFieldLayers[i]->getDepthShaderResourceView(), screenWidth, screenHeight, maxDepths, minDepths, false, i);
+		dofShader->SetShaderParametersPart2(depthOfFieldLayersHBlur[i]->getShaderResourceView(), depthOfFieldLayers[i]->getDepthShaderResourceView(), screenWidth, screenHeight, dofMaxDepths, dofMinDepths, false, i);
 		fullScreenOrthoMesh.SetShader(dofShader);
 		fullScreenOrthoMesh.Render();
 
@@ -534,6 +826,195 @@ bool App1::depthOfFieldPass()
 	return true;
 }
 
+void App1::submitScene(unsigned int pass)
+{
+	XMMATRIX viewMatrix = camera->getViewMatrix();
+
+	// Draw the temple
+	submitDraw(pass, false, QUEUE_SHADER_PBR, QUEUE_MATERIAL_TEMPLE, QUEUE_MESH_TEMPLE, temple, viewMatrix, [this]() {
+		pbrShader->SetShaderParameters(temple.GetWorldMatrix(), &templeMaterial, lights.data(), lights.size());
+		temple.Render();
+	});
+
+	// Draw the light spheres
+	submitDraw(pass, false, QUEUE_SHADER_PBR, QUEUE_MATERIAL_LIGHT_SPHERES, QUEUE_MESH_LIGHT_SPHERE, lightSphere, viewMatrix, [this]() {
+		pbrShader->SetInstanceParameters(lightSphere.GetInstances(), lightSphereMaterials, 1, lights.data(), lights.size());
+		lightSphere.RenderInstanced();
+	});
+
+	// Draw PBR Spheres or sausage roll
+	if (!sausageRollReplaceSpheres) {
+		submitDraw(pass, false, QUEUE_SHADER_PBR, QUEUE_MATERIAL_SPHERES, QUEUE_MESH_SPHERE, PBRSphere, viewMatrix, [this]() {
+			pbrShader->SetInstanceParameters(PBRSphere.GetInstances(), sphereMaterials, 3, lights.data(), lights.size());
+			PBRSphere.RenderInstanced();
+		});
+	}
+	else {
+		submitDraw(pass, false, QUEUE_SHADER_PBR, QUEUE_MATERIAL_SAUSAGE_ROLL, QUEUE_MESH_SAUSAGE_ROLL, SausageRoll, viewMatrix, [this]() {
+			pbrShader->SetShaderParameters(SausageRoll.GetWorldMatrix(), &SausageRollMaterial, lights.data(), lights.size());
+			SausageRoll.Render();
+		});
+	}
+
+	// Draw terrain, DOF layers only pick the patches in their slice
+	float minDepth = DOFEnabled ? dofMinDepths[pass - SCENE_PASS] : 0.0f;
+	float maxDepth = DOFEnabled ? dofMaxDepths[pass - SCENE_PASS] : 1.0f;
+	submitTerrain(pass, viewMatrix, renderer->getProjectionMatrix(), minDepth, maxDepth);
+
+	// Draw the water plane, blended so after everything opaque
+	submitDraw(pass, true, QUEUE_SHADER_WAVES, QUEUE_MATERIAL_WATER, QUEUE_MESH_WATER, water, viewMatrix, [this]() {
+		renderer->setAlphaBlending(true);
+		wavesShader->SetShaderParameters(water.GetWorldMatrix(), waveData, lights.data(), lights.size(), terrainTessellationMinAndMaxTesselation, terrainTessellationMinAndMaxDistance);
+		water.Render(D3D_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+		renderer->setAlphaBlending(false);
+	});
+}
+
+void App1::submitTerrain(unsigned int pass, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, float minDepth, float maxDepth)
+{
+	// Patches are culled against the pass's view, or all kept when frustum culling is off
+	FrustumCuller::Frustum frustum;
+	if (frustumCulling) {
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, viewMatrix * projectionMatrix);
+		FrustumCuller::computeFrustum(&viewProjection._11, frustum, minDepth, maxDepth);
+	}
+	else {
+		for (float* plane : frustum.planes) {
+			plane[0] = plane[1] = plane[2] = 0;
+			plane[3] = 1;
+		}
+	}
+
+	submitDraw(pass, false, QUEUE_SHADER_HEIGHT_MAP, QUEUE_MATERIAL_TERRAIN, QUEUE_MESH_TERRAIN, groundPlane, viewMatrix, [this, pass, frustum]() {
+		// Levels are always picked at the user camera, shadow passes included
+		XMFLOAT3 cameraPosition = camera->getPosition();
+		TerrainQuadtree::Stats stats;
+		terrainQuadtree.select(&cameraPosition.x, frustum, terrainPatches, &stats);
+		if (pass == SCENE_PASS) terrainStats = stats;
+		if (terrainPatches.empty()) return;
+
+		HeightMapShader::HeightMapBufferData heightMapSettings{
+			amplitude, XMFLOAT2(terrainSize, terrainSize), (isSmoothingOn) ? 1 : 0
+		};
+		heightMapShader->SetPatchParameters(terrainPatches, terrainQuadtree.getPatchResolution());
+		heightMapShader->SetShaderParameters(groundPlane.GetWorldMatrix(), &heightMapSettings, lights.data(), lights.size(), textureMgr->getTexture(islandHeightMap), textureMgr->getTexture(islandTextureMap));
+		groundPlane.RenderInstances((int)terrainPatches.size());
+	});
+}
+
+void App1::buildTerrainQuadtree(const AssetLoader::Image& image)
+{
+	// The shaders read the first channel from 0 to 1 as heights from -1 to 1
+	std::vector<float> heights(image.width * image.height);
+	for (unsigned int y = 0; y < image.height; ++y) {
+		const unsigned char* row = image.pixels + y * image.rowPitch;
+		const unsigned short* row16 = reinterpret_cast<const unsigned short*>(row);
+		for (unsigned int x = 0; x < image.width; ++x) {
+			float value;
+			switch (image.format) {
+			case DXGI_FORMAT_R8_UNORM: value = row[x] / 255.0f; break;
+			case DXGI_FORMAT_R16_UNORM: value = row16[x] / 65535.0f; break;
+			case DXGI_FORMAT_R16G16B16A16_UNORM: value = row16[x * 4] / 65535.0f; break;
+			default: value = row[x * 4] / 255.0f; break; // R8G8B8A8
+			}
+			heights[y * image.width + x] = value * 2 - 1;
+		}
+	}
+
+	// The height map sampler's border is black, the lowest height
+	terrainQuadtree.build(heights.data(), image.width, image.height, isSmoothingOn ? TERRAIN_SMOOTHING_RADIUS : 0, -1.0f);
+}
+
+void App1::submitDraw(unsigned int pass, bool translucent, unsigned int shader, unsigned int material, unsigned int mesh, WorldObject& object, const XMMATRIX& viewMatrix, RenderQueue::DrawFunction draw)
+{
+	// Skip objects the pass's frustum culled, objects without bounds were never culled
+	auto found = std::find(cullObjects.begin(), cullObjects.end(), &object);
+	if (passCulled[pass]) {
+		if (found != cullObjects.end() && !std::binary_search(passVisible[pass].begin(), passVisible[pass].end(), (unsigned int)(found - cullObjects.begin()))) {
+			passDrawsSkipped[pass]++;
+			return;
+		}
+	}
+	passDraws[pass]++;
+
+	// Camera passes light the object with the lights reaching it
+	if (pass >= SCENE_PASS && found != cullObjects.end()) {
+		unsigned int index = (unsigned int)(found - cullObjects.begin());
+		RenderQueue::DrawFunction objectDraw = draw;
+		draw = [this, index, objectDraw]() {
+			clusteredLights->BindObjectLights(index);
+			objectDraw();
+		};
+	}
+
+	// View depth of the object's origin across the camera's depth range
+	XMFLOAT3 position = object.GetPosition();
+	float depth = XMVectorGetZ(XMVector3TransformCoord(XMLoadFloat3(&position), viewMatrix)) / SCREEN_DEPTH;
+	renderQueue.submit(RenderQueue::makeKey(pass, translucent, shader, material, mesh, depth), draw);
+}
+
+void App1::updateCullBounds()
+{
+	// The shaders displace the terrain up by the height map and the water by its waves, so their bounds are padded to cover it
+	groundPlane.SetBoundsPadding(XMFLOAT3(0, amplitude, 0));
+	// The terrain's quadtree boxes its patches with the same transform, and picks their levels for the camera's projection
+	XMFLOAT3 terrainOrigin = groundPlane.GetPosition();
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, renderer->getProjectionMatrix());
+	terrainQuadtree.setFilterRadius(isSmoothingOn ? TERRAIN_SMOOTHING_RADIUS : 0);
+	terrainQuadtree.setTransform(&terrainOrigin.x, terrainSize, terrainSize, amplitude);
+	terrainQuadtree.setLodRanges((float)screenHeight, projection._22, terrainPixelError);
+	XMFLOAT3 wavePadding(0, 0, 0);
+	for (const WavesShader::WavesData& wave : waveData) {
+		// Gerstner waves move sideways by up to the steepness over 3 times the frequency, see Waves_ds
+		float sideways = (wave.frequency > 0) ? wave.steepness / (3.0f * wave.frequency) : 0.0f;
+		wavePadding.x += sideways;
+		wavePadding.y += wave.amplitude;
+		wavePadding.z += sideways;
+	}
+	water.SetBoundsPadding(wavePadding);
+
+	// Objects whose mesh is still loading add no bounds, and so are never culled
+	frustumCuller.clear();
+	for (WorldObject* object : cullObjects) {
+		XMFLOAT3 centre, extents;
+		float radius;
+		if (!object->GetWorldBounds(centre, extents, radius)) {
+			centre = XMFLOAT3(0, 0, 0);
+			extents = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+			radius = FLT_MAX;
+		}
+		frustumCuller.add(&centre.x, &extents.x, radius);
+	}
+}
+
+void App1::selectObjectLights()
+{
+	// Objects whose mesh is still loading have no bounds, every light reaches them
+	for (unsigned int index = 0; index < cullObjects.size(); ++index) {
+		XMFLOAT3 centre, extents;
+		float radius;
+		if (!cullObjects[index]->GetWorldBounds(centre, extents, radius)) {
+			centre = XMFLOAT3(0, 0, 0);
+			extents = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		}
+		clusteredLights->SelectObjectLights(index, centre, extents);
+	}
+}
+
+void App1::cullPass(unsigned int pass, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, float minDepth, float maxDepth)
+{
+	if (!frustumCulling) return;
+
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, viewMatrix * projectionMatrix);
+	FrustumCuller::Frustum frustum;
+	FrustumCuller::computeFrustum(&viewProjection._11, frustum, minDepth, maxDepth);
+	frustumCuller.cull(frustum, passVisible[pass]);
+	passCulled[pass] = true;
+}
+
 bool App1::bloomPass()
 {
 	// Set the full screen ortho mesh up for bloom
@@ -604,21 +1085,117 @@ bool App1::finalPass()
 	return true;
 }
 
+void App1::selectLods(const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, float viewportHeight, float maxPixelError)
+{
+	temple.SelectLod(viewMatrix, projectionMatrix, viewportHeight, maxPixelError);
+	SausageRoll.SelectLod(viewMatrix, projectionMatrix, viewportHeight, maxPixelError);
+}
+
+void App1::cullClusters(const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix)
+{
+	temple.SetClusterCulling(clusterCulling);
+	temple.CullClusters(viewMatrix, projectionMatrix);
+	SausageRoll.SetClusterCulling(clusterCulling);
+	SausageRoll.CullClusters(viewMatrix, projectionMatrix);
+}
+
 void App1::gui()
 {
 	// Force turn off unnecessary shader stages.
-	renderer->getDeviceContext()->GSSetShader(NULL, NULL, 0);
-	renderer->getDeviceContext()->HSSetShader(NULL, NULL, 0);
-	renderer->getDeviceContext()->DSSetShader(NULL, NULL, 0);
+	renderer->getStateCache()->GSSetShader(NULL);
+	renderer->getStateCache()->HSSetShader(NULL);
+	renderer->getStateCache()->DSSetShader(NULL);
 
 	// Build UI
 	ImGui::Text("FPS: %.2f", timer->getFPS());
 	ImGui::Checkbox("Wireframe mode", &wireframeToggle);
 	ImGui::Checkbox("Sausage Roll Model", &sausageRollReplaceSpheres);
+	ImGui::SliderFloat("LOD Pixel Error", &lodPixelError, 0, 8);
+	ImGui::SliderFloat("Shadow LOD Bias", &shadowLodBias, 1, 16);
+	ImGui::Checkbox("Meshlet Culling", &clusterCulling);
+	if (clusterCulling) {
+		// Last cull was the camera's
+		MeshletBuilder::CullStats templeClusters = temple.GetClusterStats();
+		ImGui::Text("Temple meshlets: %u, frustum culled %u, backface culled %u, %u draws", templeClusters.tested, templeClusters.frustumCulled, templeClusters.backfaceCulled, templeClusters.draws);
+	}
+	ImGui::Checkbox("Frustum Culling", &frustumCulling);
+	if (frustumCulling) {
+		// Shadow faces summed, the camera's pass or each DOF layer on its own
+		unsigned int shadowDraws = 0, shadowDrawsSkipped = 0;
+		for (unsigned int pass = SHADOW_PASS; pass < SCENE_PASS; ++pass) {
+			shadowDraws += passDraws[pass];
+			shadowDrawsSkipped += passDrawsSkipped[pass];
+		}
+		ImGui::Text("Shadow views: %u draws, %u culled", shadowDraws, shadowDrawsSkipped);
+		if (!DOFEnabled) ImGui::Text("Camera: %u draws, %u culled", passDraws[SCENE_PASS], passDrawsSkipped[SCENE_PASS]);
+		else {
+			for (int i = 0; i < DOF_LAYER_COUNT; ++i) {
+				ImGui::Text("DOF layer %d: %u draws, %u culled", i, passDraws[SCENE_PASS + i], passDrawsSkipped[SCENE_PASS + i]);
+			}
+		}
+	}
+	ImGui::Checkbox("Shadow Caching", &shadowCaching);
+	ShadowAtlasAllocator& atlasAllocator = shadowAtlas->GetAllocator();
+	ImGui::Text("Shadow atlas: %.1f%% used, %u views kept, %u placed, %u shrunk, %u failed", 100.0f * atlasAllocator.getUsedArea() / ((float)atlasAllocator.getAtlasSize() * atlasAllocator.getAtlasSize()),
+		shadowAtlasStats.kept, shadowAtlasStats.placed, shadowAtlasStats.shrunk, shadowAtlasStats.failed);
+	for (int lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
+		const ShadowViewStats& views = shadowViewStats[lightIndex];
+		ImGui::Text("Light %d shadow views: %u static drawn, %u restored from cache, %u unchanged, %u unseen, %u out of reach", lightIndex, views.staticDrawn, views.restored, views.unchanged, views.unseen, views.outOfReach);
+		if (lights[lightIndex].GetLightType() != 0) ImGui::Text("Light %d atlas view size: %d", lightIndex, lights[lightIndex].GetShadowAtlasRegion(0).size);
+	}
+	int instancedDraws, instancesDrawn;
+	pbrShader->GetInstancingStats(instancedDraws, instancesDrawn);
+	ImGui::Text("Instanced: %d instances in %d draws", instancesDrawn, instancedDraws);
+	int constantUploads, constantsSkipped;
+	frameConstants->GetUploadStats(constantUploads, constantsSkipped);
+	ImGui::Text("Frame constants: %d uploaded, %d unchanged", constantUploads, constantsSkipped);
+	D3D11ConstantRing* constantRing = renderer->getConstantRing();
+	if (constantRing->isSupported()) {
+		bool constantRingEnabled = constantRing->isEnabled();
+		ImGui::Checkbox("Constant Ring", &constantRingEnabled);
+		constantRing->setEnabled(constantRingEnabled);
+	}
+	const D3D11ConstantRing::Stats& ringStats = constantRing->getStats();
+	ImGui::Text("Constant ring%s: %u uploads (%u KB), %u fell back to their own buffers", constantRing->isSupported() ? "" : " (unsupported)", ringStats.uploads, ringStats.bytes / 1024, ringStats.fallbacks);
+	const RenderQueue::Stats& queueStats = renderQueue.getStats();
+	ImGui::Text("Render queue: %u draws in %u passes, sorted in %.3f ms", queueStats.packets, queueStats.passes, queueStats.sortMs);
+	ImGui::Text("State changes sorted (unsorted): shader %u (%u), material %u (%u), mesh %u (%u)", queueStats.shaderChanges, queueStats.unsortedShaderChanges,
+		queueStats.materialChanges, queueStats.unsortedMaterialChanges, queueStats.meshChanges, queueStats.unsortedMeshChanges);
+	const StateCache::Stats& cacheStats = renderer->getStateCache()->getStats();
+	ImGui::Text("State calls: %u issued, %u suppressed", cacheStats.getIssued(), cacheStats.getSuppressed());
+	ImGui::Text("Issued (made): resources %u (%u), constant buffers %u (%u), samplers %u (%u), shaders %u (%u), input %u (%u), states %u (%u)",
+		cacheStats.shaderResources.issued, cacheStats.shaderResources.calls, cacheStats.constantBuffers.issued, cacheStats.constantBuffers.calls,
+		cacheStats.samplers.issued, cacheStats.samplers.calls, cacheStats.shaders.issued, cacheStats.shaders.calls,
+		cacheStats.inputAssembler.issued, cacheStats.inputAssembler.calls, cacheStats.states.issued, cacheStats.states.calls);
+
+	// Asset loading menu
+	ImGui::Begin("Asset Loading");
+	ImGui::Text("Assets pending: %zu, textures on the GPU: %zu", assetLoader->getPendingCount(), textureMgr->getTextureCount());
+	double lastReadyMs = 0;
+	for (const AssetLoader::Timing& timing : assetLoader->getTimings()) {
+		ImGui::Text("%s%s: waited %.1f ms, loaded %.1f ms, uploaded %.1f ms, ready at %.1f ms", timing.name.c_str(), timing.succeeded ? "" : " (failed)", timing.waitMs, timing.loadMs, timing.uploadMs, timing.readyMs);
+		if (timing.readyMs > lastReadyMs) lastReadyMs = timing.readyMs;
+	}
+	// Workers overlap, so the wall time to load everything is less than the sum of the work
+	ImGui::Text("Total load work %.1f ms, everything ready at %.1f ms", assetLoader->getLoadTotalMs(), lastReadyMs);
+	ImGui::End();
 
 	// Lights menu
 	ImGui::Begin("Lights");
 	ImGui::Checkbox("Swing Point Light?", &swingPointLight);
+	if (ImGui::SliderInt("Extra Clustered Lights", &extraLightCount, 0, 4096)) generateExtraLights(extraLightCount);
+	const LightClusterer& clusterer = clusteredLights->GetClusterer();
+	LightClusterer::Stats clusterStats = clusterer.getStats();
+	ImGui::Text("Light clusters %ux%ux%u: %u of %u lights in view, %.2f per cluster, %u in the fullest, binned in %.3f ms", clusterer.getTileCountX(), clusterer.getTileCountY(), clusterer.getSliceCount(),
+		clusterStats.binned, clusterStats.lights, (float)clusterStats.references / clusterer.getClusterCount(), clusterStats.largestCluster, clusteredLights->GetBuildMs());
+	float lightCutoff = clusteredLights->GetLightCutoff();
+	if (ImGui::SliderFloat("Light Cutoff", &lightCutoff, 0.0005f, 0.05f, "%.4f")) clusteredLights->SetLightCutoff(lightCutoff);
+	// In cullObjects' order
+	const char* objectNames[] = { "Temple", "Light spheres", "Spheres", "Sausage roll", "Terrain", "Water" };
+	for (unsigned int index = 0; index < cullObjects.size(); ++index) {
+		unsigned int objectLightCount = clusteredLights->GetObjectLightCount(index);
+		ImGui::Text("%s: %u lights reach it%s", objectNames[index], objectLightCount, (objectLightCount > ClusteredLights::MAX_OBJECT_LIGHTS) ? ", too many to list, lit by its clusters" : "");
+	}
 	std::string lightNames[8] = { "Sun", "Spot 1", "Spot 2", "Spot 3", "Swinging Point", "", "", "" };
 	for (int lightIndex = 0; lightIndex < lights.size(); ++lightIndex) {
 		lights[lightIndex].ShowGuiControls(lightNames[lightIndex].c_str());
@@ -640,10 +1217,16 @@ void App1::gui()
 
 	// Display tessellation menu
 	ImGui::Begin("Tessellation");
-	ImGui::SliderFloat2("Min and Max Tessellation", reinterpret_cast<float*>(&terrainTessellationMinAndMaxTesselation), 1, 64);
-	ImGui::SliderFloat2("Min and Max Distance", reinterpret_cast<float*>(&terrainTessellationMinAndMaxDistance), 0, 100);
+	ImGui::SliderFloat2("Water Min and Max Tessellation", reinterpret_cast<float*>(&terrainTessellationMinAndMaxTesselation), 1, 64);
+	ImGui::SliderFloat2("Water Min and Max Distance", reinterpret_cast<float*>(&terrainTessellationMinAndMaxDistance), 0, 100);
 	ImGui::SliderFloat("Height Map Amplitude", &amplitude, 0, 30);
 	ImGui::Checkbox("Height Map Smoothing On", &isSmoothingOn);
+	// The terrain's level of detail, and how many patches of each level the camera drew
+	ImGui::SliderFloat("Terrain Pixel Error", &terrainPixelError, 0.25f, 16.0f);
+	ImGui::Text("Terrain: %u levels, %u patches, %u nodes visited, %u culled", terrainQuadtree.getLevelCount(), terrainStats.patches, terrainStats.nodesVisited, terrainStats.nodesCulled);
+	for (unsigned int level = 0; level < terrainQuadtree.getLevelCount(); ++level) {
+		ImGui::Text("Terrain level %u: %u patches, drawn to %.1f", level, terrainStats.levelPatches[level], terrainQuadtree.getLodRange(level));
+	}
 	ImGui::End();
 
 	// Display Wave menu
@@ -693,7 +1276,10 @@ void App1::gui()
 
 
 	// Render UI
+	// ImGui restores the state it changes, but rebinds constant buffers whole, so the cache forgets what it knew
+	renderer->getStateCache()->flush();
 	ImGui::Render();
 	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+	renderer->getStateCache()->invalidate();
 }
 
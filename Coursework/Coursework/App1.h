@@ -7,12 +7,14 @@
 #include "WorldObject.h"
 #include "WorldLight.h"
 #include "PBRShader.h"
-//#include "ShadowDepthShader.h"
+#include "ShadowDepthShader.h"
 #include "HeightMapShader.h"
 #include "TextureShader.h"
 #include "WavesShader.h"
 #include "DepthOfFieldShader.h"
 #include "BloomShader.h"
+#include "FrameConstants.h"
+#include "ClusteredLights.h"
 
 class App1 : public BaseApplication
 {
@@ -32,6 +34,16 @@ public:
 	bool frame();
 
 protected:
+	// Passes a shadow view gets this frame, its static casters cleared onto the map, and its moving casters drawn over them,
+	// onto the static depth just drawn, saved to the cache first, or restored from the cache
+	struct ShadowViewPlan {
+		bool drawStatic;
+		bool drawDynamic;
+		bool saveCache;
+	};
+	// Which of the shadow casters a shadow pass draws
+	enum ShadowCasterFilter { SHADOW_CASTERS_ALL, SHADOW_CASTERS_STATIC, SHADOW_CASTERS_DYNAMIC };
+
 	/// <summary>
 	/// Overall render function calls all the relevant passes
 	/// </summary>
@@ -39,22 +51,28 @@ protected:
 
 	/// <summary>
 	/// 1st Pass
-	/// Shadow passes for every light
+	/// Shadow passes for every light, submitted to the render queue
 	/// </summary>
 	bool shadowDepthPasses();
 
 	/// <summary>
 	/// 2nd Pass
-	/// Scene Pass without DOF
+	/// Scene Pass without DOF, submitted to the render queue
 	/// </summary>
 	bool sceneRenderPass();
 
 	/// <summary>
 	/// 2nd Pass
-	/// Scene pass with DOF
+	/// Scene pass with DOF, a pass for each layer submitted to the render queue
 	/// </summary>
 	bool depthOfFieldPass();
 
+	/// <summary>
+	/// 2nd Pass, after the render queue has drawn the layers
+	/// Blurs the DOF layers and combines them
+	/// </summary>
+	bool depthOfFieldBlurPass();
+
 	/// <summary>
 	/// 3rd Pass
 	/// Bloom Pass
@@ -73,20 +91,125 @@ protected:
 	/// </summary>
 	void gui();
 
+	/// <summary>
+	/// Picks the level of detail of the LOD chained models for a pass
+	/// </summary>
+	void selectLods(const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, float viewportHeight, float maxPixelError);
+
+	/// <summary>
+	/// Culls the meshlets of the meshlet models for a pass, call after selectLods
+	/// </summary>
+	void cullClusters(const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix);
+
+	/// <summary>
+	/// Submits the scene's draws to a render queue pass, seen from the camera
+	/// The pass's setup sets its view and DOF range with FrameConstants::SetPass
+	/// </summary>
+	void submitScene(unsigned int pass);
+
+	/// <summary>
+	/// Submits a draw with its sort key, the depth is the object's position in the pass's view
+	/// Objects the pass's frustum culled are skipped and counted instead
+	/// </summary>
+	void submitDraw(unsigned int pass, bool translucent, unsigned int shader, unsigned int material, unsigned int mesh, WorldObject& object, const XMMATRIX& viewMatrix, RenderQueue::DrawFunction draw);
+
+	/// <summary>
+	/// Refits the culled objects' world bounds, once a frame before any pass is culled
+	/// </summary>
+	void updateCullBounds();
+
+	/// <summary>
+	/// Lists the clustered lights reaching each culled object, after its bounds are refit and the lights are clustered
+	/// </summary>
+	void selectObjectLights();
+
+	/// <summary>
+	/// Culls the objects against a pass's frustum, into the pass's visibility list submitDraw checks
+	/// </summary>
+	/// <param name="minDepth">Nearest depth buffer value the pass draws, DOF layers only draw a slice</param>
+	/// <param name="maxDepth">Furthest depth buffer value the pass draws</param>
+	void cullPass(unsigned int pass, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, float minDepth = 0.0f, float maxDepth = 1.0f);
+
+	/// <summary>
+	/// Sizes the point and spot lights' shadow views by how much of the screen they can cover, and places them in the shadow atlas.
+	/// Largest first, so the small views fill in around them, a view that keeps its size keeps its region and its depth.
+	/// </summary>
+	void allocateShadowAtlas();
+
+	/// <summary>
+	/// Scatters unshadowed point lights over the island, for the light clusters, the same lights for the same count
+	/// </summary>
+	void generateExtraLights(int count);
+
+	/// <summary>
+	/// Decides how a shadow view is drawn this frame.
+	/// Views no receiver the camera sees can sample are skipped, as are views whose casters and view are as when last drawn,
+	/// which keep their depth. Otherwise static casters are only drawn when they or the view changed, and moving casters are
+	/// drawn over a copy of the static depth cached when it was last drawn.
+	/// </summary>
+	/// <param name="view">The view's index, its light's index * 6 + face</param>
+	/// <returns>True if the view has passes this frame, false if it is skipped</returns>
+	bool planShadowView(unsigned int view, int lightIndex, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, ShadowViewPlan& plan);
+
+	/// <summary>
+	/// Appends the bytes of a shadow view input, padded to whole values
+	/// </summary>
+	void appendShadowInputs(std::vector<unsigned int>& inputs, const void* data, size_t size);
+
+	/// <summary>
+	/// Binds a shadow view's map and sets the light as the camera, for a shadow pass's setup
+	/// </summary>
+	/// <param name="clear">Clears the map, false to draw over the depth already in it</param>
+	void setupShadowPass(unsigned int pass, int lightIndex, int face, bool clear);
+
+	/// <summary>
+	/// Submits the shadow casters to a shadow pass, all of them, the static ones, or the moving ones
+	/// </summary>
+	void submitShadowCasters(unsigned int pass, const XMMATRIX& lightViewMatrix, const XMMATRIX& lightProjMatrix, ShadowCasterFilter filter);
+
+	/// <summary>
+	/// Submits the terrain's draw to a pass, its quadtree's patches picked at the camera's levels and culled by the pass's frustum as it draws
+	/// </summary>
+	/// <param name="minDepth">Nearest depth buffer value the pass draws, DOF layers only draw a slice</param>
+	/// <param name="maxDepth">Furthest depth buffer value the pass draws</param>
+	void submitTerrain(unsigned int pass, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix, float minDepth = 0.0f, float maxDepth = 1.0f);
+
+	/// <summary>
+	/// Builds the terrain's quadtree over the height map's heights, as the asset loader decodes it
+	/// </summary>
+	void buildTerrainQuadtree(const AssetLoader::Image& image);
+
 private:
 	// Width and height for use throughout
 	int screenWidth, screenHeight;
 
+	// Render queue, every pass's draws are sorted by state and depth before drawing
+	RenderQueue renderQueue;
+	// Render queue passes, shadow views are 6 for each of up to 8 lights, their static casters first, then their moving casters,
+	// then the scene or the DOF layers
+	static const unsigned int SHADOW_VIEW_COUNT = 48;
+	static const unsigned int SHADOW_PASS = 0;
+	static const unsigned int SHADOW_DYNAMIC_PASS = SHADOW_PASS + SHADOW_VIEW_COUNT;
+	static const unsigned int SCENE_PASS = SHADOW_DYNAMIC_PASS + SHADOW_VIEW_COUNT;
+	// Render queue state ids, draws with the same id share that state
+	enum QueueShader { QUEUE_SHADER_PBR, QUEUE_SHADER_HEIGHT_MAP, QUEUE_SHADER_WAVES, QUEUE_SHADER_SHADOW_DEPTH };
+	enum QueueMaterial { QUEUE_MATERIAL_TEMPLE, QUEUE_MATERIAL_LIGHT_SPHERES, QUEUE_MATERIAL_SPHERES, QUEUE_MATERIAL_SAUSAGE_ROLL, QUEUE_MATERIAL_TERRAIN, QUEUE_MATERIAL_WATER, QUEUE_MATERIAL_NONE };
+	enum QueueMesh { QUEUE_MESH_TEMPLE, QUEUE_MESH_LIGHT_SPHERE, QUEUE_MESH_SPHERE, QUEUE_MESH_SAUSAGE_ROLL, QUEUE_MESH_TERRAIN, QUEUE_MESH_WATER };
+
 	// Shaders used
 	PBRShader* pbrShader;
 	HeightMapShader* heightMapShader;
 	WavesShader* wavesShader;
+	ShadowDepthShader* shadowDepthShader; // Depth only, for the shadow passes
+	// Constants the scene shaders share, set once a frame or pass
+	FrameConstants* frameConstants;
 
 	// Temple & Spheres 
 	WorldObject temple;
 	PBRShader::PBRMaterial templeMaterial;
 	WorldObject lightSphere; // Sphere for easy showing where lights are
 	WorldObject groundPlane; // Terrain
+	TextureManager::TextureHandle islandHeightMap, islandTextureMap; // Terrain textures
 	WorldObject water;		// Water
 
 	WorldObject PBRSphere; // Sphere used for 3 spheres 
@@ -95,20 +218,86 @@ private:
 	PBRShader::PBRMaterial BrushedMetalMaterial;
 	PBRShader::PBRMaterial WoorFloorMaterial;
 	PBRShader::PBRMaterial SausageRollMaterial;
+	// Materials the instances index, the spheres in the order above and the light spheres all the temple's
+	PBRShader::PBRMaterial* sphereMaterials[3];
+	PBRShader::PBRMaterial* lightSphereMaterials[1];
 	// Sausage roll object
 	WorldObject SausageRoll;
 	// Bool for toggle between the 2
 	bool sausageRollReplaceSpheres = false;
 
-	// Vector of all lights (MAX 8)
+	// Objects the shadow passes draw depth only, rebuilt every frame from the objects' caster flags
+	struct ShadowCaster {
+		WorldObject* object;
+		unsigned int mesh; // Render queue mesh id
+	};
+	std::vector<ShadowCaster> shadowCasters;
+
+	// Level of detail, largest simplification error allowed on screen in pixels.
+	// Shadow passes multiply it by their bias, shadow maps are blurred and far from the camera so can use coarser meshes.
+	float lodPixelError = 1.0f;
+	float shadowLodBias = 4.0f;
+	// Meshlet culling against each pass's frustum and by normal cones
+	bool clusterCulling = true;
+
+	// Frustum culling of whole objects against every pass's view, the camera's, each DOF layer's slice of it and each shadow face's
+	static const unsigned int PASS_COUNT = SCENE_PASS + DOF_LAYER_COUNT;
+	bool frustumCulling = true;
+	FrustumCuller frustumCuller;
+	std::vector<WorldObject*> cullObjects; // Objects with bounds in the culler, in the order of its indices
+	std::vector<unsigned int> passVisible[PASS_COUNT]; // Indices into cullObjects each pass sees, ascending
+	bool passCulled[PASS_COUNT]; // If the pass was culled this frame, passes that were not draw everything
+	unsigned int passDraws[PASS_COUNT]; // Draws submitted and skipped by each pass this frame
+	unsigned int passDrawsSkipped[PASS_COUNT];
+
+	// Shadow caching, what each view's map and cache hold and what happened to each light's views this frame
+	struct ShadowViewCache {
+		std::vector<unsigned int> staticInputs; // Inputs the static depth was last drawn with
+		std::vector<unsigned int> dynamicInputs; // Inputs the moving casters were last drawn with
+		bool cacheValid = false; // If the map's cache holds the static depth, it is only made once a view has moving casters
+	};
+	struct ShadowViewStats {
+		unsigned int staticDrawn; // Static casters drawn, the view or one of them changed
+		unsigned int restored; // Static depth copied from the cache, for moving casters to be drawn over
+		unsigned int unchanged; // Casters and view as when last drawn, kept
+		unsigned int unseen; // No receiver the camera sees can sample them
+		unsigned int outOfReach; // The light reaches no receiver the camera sees
+	};
+	bool shadowCaching = true;
+	ShadowViewCache shadowViews[SHADOW_VIEW_COUNT];
+	ShadowViewStats shadowViewStats[8];
+	std::vector<unsigned int> cameraVisible; // Indices into cullObjects in the camera's frustum, the receivers
+	std::vector<unsigned int> viewVisible; // Scratch list of a view's objects
+	std::vector<unsigned int> staticInputs, dynamicInputs; // Scratch inputs of a view
+
+	// Depth atlas the point and spot lights' shadow views share, each light's views are one size
+	ShadowAtlas* shadowAtlas;
+	int shadowAtlasViewSizes[8] = {}; // Size each light's views were given last frame, for the hysteresis
+	ShadowAtlasAllocator::Stats shadowAtlasStats = {};
+
+	// Vector of all lights with shadow maps (MAX 8)
 	std::vector<WorldLight> lights;
+	// Point and spot lights binned into clusters of the camera's view, these and the extra lights with no shadows
+	ClusteredLights* clusteredLights;
+	std::vector<ClusterLightData> extraLights;
+	int extraLightCount = 0;
 	// If the point light is swinging or not. 
 	bool swingPointLight = true;
 
-	// Tessellation variables
+	// Tessellation variables, for the water
 	XMFLOAT2 terrainTessellationMinAndMaxTesselation = XMFLOAT2(1, 1);
 	XMFLOAT2 terrainTessellationMinAndMaxDistance;
 
+	// Terrain quadtree, picks the patches the terrain is drawn with by their screen-space error
+	static const unsigned int TERRAIN_PATCH_RESOLUTION = 16; // Cells across a patch
+	static const unsigned int TERRAIN_SMOOTHING_RADIUS = 65; // Texels smoothing reads past its own, 2 blur steps of 32 and the bilinear one
+
+	TerrainQuadtree terrainQuadtree{ TERRAIN_PATCH_RESOLUTION };
+	std::vector<TerrainQuadtree::Patch> terrainPatches; // Scratch patches of the terrain draw running
+	TerrainQuadtree::Stats terrainStats = {}; // Counters of the camera pass's selection
+	float terrainSize = 199.0f; // World size of the terrain along x and z, the patches' unit square is scaled to it
+	float terrainPixelError = 2.0f; // Largest error a terrain cell may cover on screen, in pixels
+
 	// Height map variables
 	float amplitude;
 	bool isSmoothingOn;
@@ -132,6 +321,8 @@ private:
 	RenderTexture* depthOfFieldLayersHBlur[DOF_LAYER_COUNT];
 	RenderTexture* depthOfFieldLayersVBlur[DOF_LAYER_COUNT];
 	bool DOFEnabled;
+	float dofMinDepths[DOF_LAYER_COUNT]; // Depth range of each layer, set when the layers are submitted
+	float dofMaxDepths[DOF_LAYER_COUNT];
 
 	float focusPlane = 0.990; // Depth value which is in focus
 
@@ -81,7 +81,7 @@ void BloomShader::SetShaderParametersPart1(ID3D11ShaderResourceView* sceneTextur
 	// Setup with an orthographic projection
 	*projectionMatrix = XMMatrixOrthographicLH(screenWidth, screenHeight, 0, 1);
 	renderer->getDeviceContext()->Unmap(projectionBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
+	renderer->getStateCache()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
 
 	// Set bloom info data
 	result = renderer->getDeviceContext()->Map(bloomBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
@@ -89,11 +89,11 @@ void BloomShader::SetShaderParametersPart1(ID3D11ShaderResourceView* sceneTextur
 	bufferContents = (BloomInfo*)mappedResource.pData;
 	bufferContents->luminosityThreshold = luminosityThreshold;
 	renderer->getDeviceContext()->Unmap(bloomBuffer, 0);
-	renderer->getDeviceContext()->PSSetConstantBuffers(0, 1, &bloomBuffer); // Bloom buffer b0 in Pixel Shader
+	renderer->getStateCache()->PSSetConstantBuffers(0, 1, &bloomBuffer); // Bloom buffer b0 in Pixel Shader
 
 	// Set textures and sampler
-	renderer->getDeviceContext()->PSSetShaderResources(0, 1, &sceneTexture);
-	renderer->getDeviceContext()->PSSetSamplers(0, 1, &textureSampler);
+	renderer->getStateCache()->PSSetShaderResources(0, 1, &sceneTexture);
+	renderer->getStateCache()->PSSetSamplers(0, 1, &textureSampler);
 }
 
 void BloomShader::SetShaderParametersPart2(ID3D11ShaderResourceView* toBlur, bool xPass, int blurSize, float blurSkip)
@@ -108,7 +108,7 @@ void BloomShader::SetShaderParametersPart2(ID3D11ShaderResourceView* toBlur, boo
 	// Setup with an orthographic projection
 	*projectionMatrix = XMMatrixOrthographicLH(screenWidth, screenHeight, 0, 1);
 	renderer->getDeviceContext()->Unmap(projectionBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
+	renderer->getStateCache()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
 
 	// Set bloom info data
 	result = renderer->getDeviceContext()->Map(bloomBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
@@ -118,11 +118,11 @@ void BloomShader::SetShaderParametersPart2(ID3D11ShaderResourceView* toBlur, boo
 	bufferContents->blurSkips = blurSkip;
 	bufferContents->blurOnX = xPass ? 1 : 0;
 	renderer->getDeviceContext()->Unmap(bloomBuffer, 0);
-	renderer->getDeviceContext()->PSSetConstantBuffers(0, 1, &bloomBuffer); // Bloom buffer b0 in Pixel Shader
+	renderer->getStateCache()->PSSetConstantBuffers(0, 1, &bloomBuffer); // Bloom buffer b0 in Pixel Shader
 
 	// Set textures and sampler 
-	renderer->getDeviceContext()->PSSetShaderResources(0, 1, &toBlur);
-	renderer->getDeviceContext()->PSSetSamplers(0, 1, &textureSampler);
+	renderer->getStateCache()->PSSetShaderResources(0, 1, &toBlur);
+	renderer->getStateCache()->PSSetSamplers(0, 1, &textureSampler);
 }
 
 void BloomShader::SetShaderParametersPart3(ID3D11ShaderResourceView* sceneTexture, ID3D11ShaderResourceView* blurredTexture)
@@ -137,12 +137,12 @@ void BloomShader::SetShaderParametersPart3(ID3D11ShaderResourceView* sceneTextur
 	// Setup with an orthographic projection
 	*projectionMatrix = XMMatrixOrthographicLH(screenWidth, screenHeight, 0, 1);
 	renderer->getDeviceContext()->Unmap(projectionBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
+	renderer->getStateCache()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
 
 	// Set textures and sampler 
-	renderer->getDeviceContext()->PSSetShaderResources(0, 1, &sceneTexture);
-	renderer->getDeviceContext()->PSSetShaderResources(1, 1, &blurredTexture);
-	renderer->getDeviceContext()->PSSetSamplers(0, 1, &textureSampler);
+	renderer->getStateCache()->PSSetShaderResources(0, 1, &sceneTexture);
+	renderer->getStateCache()->PSSetShaderResources(1, 1, &blurredTexture);
+	renderer->getStateCache()->PSSetSamplers(0, 1, &textureSampler);
 }
 
 void BloomShader::initShader(const wchar_t* vs, const wchar_t* ps)
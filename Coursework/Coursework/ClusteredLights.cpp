@@ -0,0 +1,329 @@
+#include "ClusteredLights.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+const float ClusteredLights::DEFAULT_LIGHT_CUTOFF = 1.0f / 256.0f;
+
+ClusteredLights::ClusteredLights(D3D* renderer) : clusterer(TILE_COUNT_X, TILE_COUNT_Y, SLICE_COUNT)
+{
+	this->renderer = renderer;
+	lightCutoff = DEFAULT_LIGHT_CUTOFF;
+	buildMs = 0;
+
+	D3D11_BUFFER_DESC gridBufferDesc;
+	gridBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	gridBufferDesc.ByteWidth = sizeof(ClusterGridData);
+	gridBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	gridBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	gridBufferDesc.MiscFlags = 0;
+	gridBufferDesc.StructureByteStride = 0;
+	gridBuffer = nullptr;
+	renderer->getDevice()->CreateBuffer(&gridBufferDesc, NULL, &gridBuffer);
+
+	lightBuffer = nullptr;
+	lightSRV = nullptr;
+	lightCapacity = 0;
+	rangeBuffer = nullptr;
+	rangeSRV = nullptr;
+	rangeCapacity = 0;
+	indexBuffer = nullptr;
+	indexSRV = nullptr;
+	indexCapacity = 0;
+}
+
+ClusteredLights::~ClusteredLights()
+{
+	// Release the buffers and their views.
+	ID3D11ShaderResourceView** views[] = { &lightSRV, &rangeSRV, &indexSRV };
+	for (ID3D11ShaderResourceView** view : views) {
+		if (*view) (*view)->Release();
+		*view = nullptr;
+	}
+	ID3D11Buffer** buffers[] = { &gridBuffer, &lightBuffer, &rangeBuffer, &indexBuffer };
+	for (ID3D11Buffer** buffer : buffers) {
+		if (*buffer) (*buffer)->Release();
+		*buffer = nullptr;
+	}
+	for (ObjectLights& object : objectLights) {
+		if (object.buffer) object.buffer->Release();
+	}
+	objectLights.clear();
+}
+
+void ClusteredLights::Build(WorldLight* lights, int lightCount, std::vector<ClusterLightData>& extraLights, const XMMATRIX& view, const XMMATRIX& projection, float nearPlane, float farPlane, int screenWidth, int screenHeight)
+{
+	// Point and spot lights from the light buffer first, they keep their index there for their shadows
+	clusterLights.clear();
+	for (int i = 0; i < lightCount; i++) {
+		if (lights[i].GetLightType() == 0) continue;
+		ClusterLightData light;
+		light.ambientColor = lights[i].getAmbientColour();
+		light.diffuseColor = lights[i].getDiffuseColour();
+		light.position = lights[i].getPosition();
+		light.direction = lights[i].getDirection();
+		light.lightType = lights[i].GetLightType();
+		light.constantAttenuation = lights[i].GetConstantAttenuation();
+		light.linearAttenuation = lights[i].GetLinearAttenuation();
+		light.quadraticAttenuation = lights[i].GetQuadraticAttenuation();
+		light.lightPower = lights[i].GetLightPower();
+		light.innerSpotlightCutoffAngle = lights[i].GetInnerSpotlightCutoffAngle();
+		light.outerSpotlightCutoffAngle = lights[i].GetOuterSpotlightCutoffAngle();
+		light.shadowIndex = i;
+		light.padding = 0;
+		light.range = GetRange(light, lightCutoff);
+		clusterLights.push_back(light);
+	}
+	for (ClusterLightData& light : extraLights) {
+		light.shadowIndex = -1;
+		light.range = GetRange(light, lightCutoff);
+		clusterLights.push_back(light);
+	}
+
+	// Bin their spheres in view space, kept in world space for the objects
+	auto start = std::chrono::high_resolution_clock::now();
+	XMFLOAT4X4 cameraProjection;
+	XMStoreFloat4x4(&cameraProjection, projection);
+	clusterer.setProjection(cameraProjection._11, cameraProjection._22, nearPlane, farPlane);
+	clusterer.clear();
+	lightBounds.resize(clusterLights.size());
+	for (size_t i = 0; i < clusterLights.size(); i++) {
+		XMFLOAT3 centre, viewCentre;
+		float radius;
+		GetBounds(clusterLights[i], lightCutoff, centre, radius);
+		lightBounds[i] = XMFLOAT4(centre.x, centre.y, centre.z, radius);
+		XMStoreFloat3(&viewCentre, XMVector3TransformCoord(XMLoadFloat3(&centre), view));
+		clusterer.add(&viewCentre.x, radius);
+	}
+	clusterer.build();
+	buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// Upload the grid, the lights and the lists, every buffer holds at least one element so its view can be made
+	ClusterGridData grid = {};
+	grid.tileCountX = TILE_COUNT_X;
+	grid.tileCountY = TILE_COUNT_Y;
+	grid.sliceCount = SLICE_COUNT;
+	grid.tilesPerPixel = XMFLOAT2((float)TILE_COUNT_X / screenWidth, (float)TILE_COUNT_Y / screenHeight);
+	grid.sliceScale = clusterer.getSliceScale();
+	grid.sliceBias = clusterer.getSliceBias();
+	grid.nearPlane = nearPlane;
+	grid.farPlane = farPlane;
+	Upload(gridBuffer, &grid, sizeof(ClusterGridData));
+
+	const std::vector<unsigned int>& ranges = clusterer.getClusterRanges();
+	const std::vector<unsigned int>& indices = clusterer.getLightIndices();
+	Reserve(&lightBuffer, &lightSRV, lightCapacity, (UINT)clusterLights.size(), sizeof(ClusterLightData));
+	Reserve(&rangeBuffer, &rangeSRV, rangeCapacity, clusterer.getClusterCount(), sizeof(unsigned int) * 2);
+	Reserve(&indexBuffer, &indexSRV, indexCapacity, (UINT)indices.size(), sizeof(unsigned int));
+	Upload(lightBuffer, clusterLights.data(), clusterLights.size() * sizeof(ClusterLightData));
+	Upload(rangeBuffer, ranges.data(), ranges.size() * sizeof(unsigned int));
+	Upload(indexBuffer, indices.data(), indices.size() * sizeof(unsigned int));
+}
+
+void ClusteredLights::Bind()
+{
+	D3D11StateCache* stateCache = renderer->getStateCache();
+	stateCache->PSSetConstantBuffers(GRID_SLOT, 1, &gridBuffer); // Grid b3 in Pixel Shader
+	stateCache->PSSetShaderResources(LIGHTS_SLOT, 1, &lightSRV); // Lights t24 in Pixel Shader
+	stateCache->PSSetShaderResources(CLUSTER_RANGES_SLOT, 1, &rangeSRV); // Cluster ranges t25 in Pixel Shader
+	stateCache->PSSetShaderResources(LIGHT_INDICES_SLOT, 1, &indexSRV); // Light indices t26 in Pixel Shader
+}
+
+void ClusteredLights::SelectObjectLights(unsigned int object, const XMFLOAT3& centre, const XMFLOAT3& extents)
+{
+	if (object >= objectLights.size()) objectLights.resize(object + 1, ObjectLights{ nullptr, {}, 0, 0 });
+	ObjectLights& lists = objectLights[object];
+	if (!lists.buffer) {
+		D3D11_BUFFER_DESC bufferDesc;
+		bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		bufferDesc.ByteWidth = sizeof(ObjectLightBufferData);
+		bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		bufferDesc.MiscFlags = 0;
+		bufferDesc.StructureByteStride = 0;
+		renderer->getDevice()->CreateBuffer(&bufferDesc, NULL, &lists.buffer);
+		// Nothing is uploaded yet, so the first list is
+		memset(&lists.uploaded, 0xFF, sizeof(ObjectLightBufferData));
+	}
+
+	// Lights whose sphere reaches the box, by how bright they are at its nearest point
+	objectCandidates.clear();
+	lists.shadowLights = 0;
+	for (size_t i = 0; i < clusterLights.size(); i++) {
+		const XMFLOAT4& bounds = lightBounds[i];
+		float boundsDistanceSquared = 0;
+		const float sphereCentre[3] = { bounds.x, bounds.y, bounds.z };
+		const float boxCentre[3] = { centre.x, centre.y, centre.z };
+		const float boxExtents[3] = { extents.x, extents.y, extents.z };
+		for (int axis = 0; axis < 3; axis++) {
+			float outside = fabsf(sphereCentre[axis] - boxCentre[axis]) - boxExtents[axis];
+			if (outside > 0) boundsDistanceSquared += outside * outside;
+		}
+		if (boundsDistanceSquared > bounds.w * bounds.w) continue;
+
+		// The light itself may be off the centre of its bounds, so its own distance to the box
+		const ClusterLightData& light = clusterLights[i];
+		const float lightPosition[3] = { light.position.x, light.position.y, light.position.z };
+		float distanceSquared = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			float outside = fabsf(lightPosition[axis] - boxCentre[axis]) - boxExtents[axis];
+			if (outside > 0) distanceSquared += outside * outside;
+		}
+		float distance = sqrtf(distanceSquared);
+		float brightest = (std::max)((std::max)(light.diffuseColor.x, light.diffuseColor.y), light.diffuseColor.z);
+		float attenuation = light.constantAttenuation + light.linearAttenuation * distance + light.quadraticAttenuation * distanceSquared;
+		objectCandidates.push_back(std::make_pair(light.lightPower * brightest / (std::max)(attenuation, FLT_MIN), (unsigned int)i));
+		if (light.shadowIndex >= 0) lists.shadowLights |= 1u << light.shadowIndex;
+	}
+	lists.lightCount = (unsigned int)objectCandidates.size();
+
+	// Brightest first, the most an object's list holds are kept, in light order when as bright so the list only changes when the lights do
+	std::sort(objectCandidates.begin(), objectCandidates.end(), [](const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b) {
+		return a.first > b.first || (a.first == b.first && a.second < b.second);
+	});
+	ObjectLightBufferData list = {};
+	list.lightCount = (UINT)(std::min)(objectCandidates.size(), (size_t)MAX_OBJECT_LIGHTS);
+	list.complete = (objectCandidates.size() <= MAX_OBJECT_LIGHTS) ? 1 : 0;
+	UINT* indices = &list.lightIndices[0].x;
+	for (UINT i = 0; i < list.lightCount; i++) indices[i] = objectCandidates[i].second;
+
+	// Still lights keep still objects' lists the same every frame
+	if (memcmp(&list, &lists.uploaded, sizeof(ObjectLightBufferData)) != 0) {
+		Upload(lists.buffer, &list, sizeof(ObjectLightBufferData));
+		lists.uploaded = list;
+	}
+}
+
+void ClusteredLights::BindObjectLights(unsigned int object)
+{
+	if (object >= objectLights.size()) return;
+	renderer->getStateCache()->PSSetConstantBuffers(OBJECT_LIGHTS_SLOT, 1, &objectLights[object].buffer); // Object lights b4 in Pixel Shader
+}
+
+unsigned int ClusteredLights::GetObjectShadowLights(unsigned int object)
+{
+	// Objects never selected could be reached by any light
+	if (object >= objectLights.size()) return ~0u;
+	return objectLights[object].shadowLights;
+}
+
+unsigned int ClusteredLights::GetObjectLightCount(unsigned int object)
+{
+	if (object >= objectLights.size()) return 0;
+	return objectLights[object].lightCount;
+}
+
+float ClusteredLights::GetRange(const ClusterLightData& light, float cutoff)
+{
+	// Ambient is attenuated as diffuse is, so the brightest channel of either
+	float brightest = 0;
+	const float channels[6] = { light.ambientColor.x, light.ambientColor.y, light.ambientColor.z, light.diffuseColor.x, light.diffuseColor.y, light.diffuseColor.z };
+	for (float channel : channels) {
+		if (channel > brightest) brightest = channel;
+	}
+	return LightClusterer::attenuationRange(light.constantAttenuation, light.linearAttenuation, light.quadraticAttenuation, light.lightPower * brightest, cutoff);
+}
+
+void ClusteredLights::GetBounds(const ClusterLightData& light, float cutoff, XMFLOAT3& centre, float& radius)
+{
+	centre = light.position;
+	radius = GetRange(light, cutoff);
+	if (light.lightType != 2) return;
+
+	// Diffuse and specular are lit in the cone, ambient all around, each as far as its own brightest channel
+	float diffuse = (std::max)((std::max)(light.diffuseColor.x, light.diffuseColor.y), light.diffuseColor.z);
+	float ambient = (std::max)((std::max)(light.ambientColor.x, light.ambientColor.y), light.ambientColor.z);
+	float diffuseRange = LightClusterer::attenuationRange(light.constantAttenuation, light.linearAttenuation, light.quadraticAttenuation, light.lightPower * diffuse, cutoff);
+	float ambientRange = LightClusterer::attenuationRange(light.constantAttenuation, light.linearAttenuation, light.quadraticAttenuation, light.lightPower * ambient, cutoff);
+	XMFLOAT3 direction;
+	XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&light.direction)));
+	float coneRadius;
+	LightClusterer::spotBounds(&light.position.x, &direction.x, diffuseRange, XMConvertToRadians(light.outerSpotlightCutoffAngle), &centre.x, coneRadius);
+
+	// The sphere around both the cone's sphere and the ambient's, if neither holds the other
+	XMVECTOR coneCentre = XMLoadFloat3(&centre);
+	float apart = XMVectorGetX(XMVector3Length(coneCentre - XMLoadFloat3(&light.position)));
+	if (ambientRange + apart <= coneRadius) {
+		radius = coneRadius;
+	}
+	else if (coneRadius + apart <= ambientRange) {
+		centre = light.position;
+		radius = ambientRange;
+	}
+	else {
+		radius = (apart + coneRadius + ambientRange) * 0.5f;
+		XMStoreFloat3(&centre, XMLoadFloat3(&light.position) + (coneCentre - XMLoadFloat3(&light.position)) * ((radius - ambientRange) / apart));
+	}
+}
+
+bool ClusteredLights::GetLightBounds(int lightIndex, XMFLOAT3& centre, float& radius)
+{
+	// Light buffer lights come first, in order
+	for (size_t i = 0; i < clusterLights.size() && clusterLights[i].shadowIndex >= 0; i++) {
+		if (clusterLights[i].shadowIndex != lightIndex) continue;
+		centre = XMFLOAT3(lightBounds[i].x, lightBounds[i].y, lightBounds[i].z);
+		radius = lightBounds[i].w;
+		return true;
+	}
+	return false;
+}
+
+void ClusteredLights::SetLightCutoff(float cutoff)
+{
+	lightCutoff = cutoff;
+}
+
+float ClusteredLights::GetLightCutoff()
+{
+	return lightCutoff;
+}
+
+const LightClusterer& ClusteredLights::GetClusterer()
+{
+	return clusterer;
+}
+
+double ClusteredLights::GetBuildMs()
+{
+	return buildMs;
+}
+
+void ClusteredLights::Reserve(ID3D11Buffer** buffer, ID3D11ShaderResourceView** view, UINT& capacity, UINT count, UINT stride)
+{
+	if (count == 0) count = 1;
+	if (*buffer && count <= capacity) return;
+
+	if (*view) (*view)->Release();
+	if (*buffer) (*buffer)->Release();
+	*view = nullptr;
+	*buffer = nullptr;
+
+	// Double so a growing count does not recreate it every frame
+	capacity = (capacity * 2 > count) ? capacity * 2 : count;
+
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = capacity * stride;
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = stride;
+	renderer->getDevice()->CreateBuffer(&bufferDesc, NULL, buffer);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+	viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	viewDesc.Buffer.FirstElement = 0;
+	viewDesc.Buffer.NumElements = capacity;
+	renderer->getDevice()->CreateShaderResourceView(*buffer, &viewDesc, view);
+}
+
+void ClusteredLights::Upload(ID3D11Buffer* buffer, const void* data, size_t size)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	renderer->getDeviceContext()->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if (size > 0) memcpy(mappedResource.pData, data, size);
+	renderer->getDeviceContext()->Unmap(buffer, 0);
+}
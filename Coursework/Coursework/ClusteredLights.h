@@ -0,0 +1,130 @@
+#pragma once
+#include <vector>
+#include "DXF.h"
+#include "CommonStructs.h"
+#include "WorldLight.h"
+
+/// <summary>
+/// Clustered forward lighting, every point and spot light binned into a grid of screen tiles and depth slices of the camera's view.
+/// Lights reach as far as their attenuation takes them below the light cutoff, spot lights' diffuse only as far as their cone. LightClusterer lists
+/// the clusters each reaches, and pixel shaders light with only their own cluster's lights. Directional lights reach everywhere, so stay in FrameConstants' light buffer.
+/// The lights, each cluster's offset and count, and the packed light indices are structured buffers, bound at fixed slots with the grid.
+/// Each object also has a list of the lights reaching its bounds, most important first, which its pixels use when it is shorter than their cluster's.
+/// </summary>
+class ClusteredLights
+{
+public:
+	// Grid, tiles across and down the screen and slices from the near plane to the far plane
+	static const unsigned int TILE_COUNT_X = 16;
+	static const unsigned int TILE_COUNT_Y = 9;
+	static const unsigned int SLICE_COUNT = 24;
+	// Default intensity lights are cut off at, a step of an 8 bit colour
+	static const float DEFAULT_LIGHT_CUTOFF;
+	// Most lights an object's list holds, objects reached by more use the clusters
+	static const unsigned int MAX_OBJECT_LIGHTS = 32;
+
+	// Grid in the pixel shader, and the lights, cluster ranges and light indices
+	static const UINT GRID_SLOT = 3;
+	static const UINT LIGHTS_SLOT = 24;
+	static const UINT CLUSTER_RANGES_SLOT = 25;
+	static const UINT LIGHT_INDICES_SLOT = 26;
+	// An object's lights in the pixel shader
+	static const UINT OBJECT_LIGHTS_SLOT = 4;
+
+	ClusteredLights(D3D* renderer);
+	~ClusteredLights();
+
+	/// <summary>
+	/// Bins the point and spot lights into the camera's clusters and uploads them, call once a frame after the camera updates
+	/// </summary>
+	/// <param name="lights">The lights in the light buffer, their point and spot lights are clustered with their shadows</param>
+	/// <param name="lightCount">Number of lights in that array</param>
+	/// <param name="extraLights">Lights with no shadows, clustered after them, their range is filled in</param>
+	/// <param name="view">Camera view matrix</param>
+	/// <param name="projection">Camera projection matrix, a perspective projection from nearPlane to farPlane</param>
+	/// <param name="screenWidth">Width of the targets the passes draw into, in pixels, with screenHeight</param>
+	void Build(WorldLight* lights, int lightCount, std::vector<ClusterLightData>& extraLights, const XMMATRIX& view, const XMMATRIX& projection, float nearPlane, float farPlane, int screenWidth, int screenHeight);
+
+	/// <summary>
+	/// Binds the grid and buffers to their slots, call in a camera pass's setup before its draws
+	/// </summary>
+	void Bind();
+
+	/// <summary>
+	/// Lists the lights of the last build reaching an object's bounds, most important first, and uploads them if they changed.
+	/// Call once a frame after Build for every object drawn with BindObjectLights, objects are numbered by the caller.
+	/// </summary>
+	/// <param name="object">Number of the object, its list is kept until selected again</param>
+	/// <param name="centre">Centre of the object's world space box</param>
+	/// <param name="extents">Half the size of the box on each axis, FLT_MAX for an object without bounds, which every light reaches</param>
+	void SelectObjectLights(unsigned int object, const XMFLOAT3& centre, const XMFLOAT3& extents);
+
+	/// <summary>
+	/// Binds an object's list of lights, call before drawing it in a camera pass, after Bind
+	/// </summary>
+	void BindObjectLights(unsigned int object);
+
+	/// <summary>
+	/// Light buffer lights reaching an object, a bit for each index in the light buffer, whether or not its list had room for them
+	/// </summary>
+	unsigned int GetObjectShadowLights(unsigned int object);
+	unsigned int GetObjectLightCount(unsigned int object); // Lights reaching an object, listed or not
+
+	/// <summary>
+	/// Light radius its attenuation fades it below a cutoff at, its brightest colour channel at its power
+	/// </summary>
+	static float GetRange(const ClusterLightData& light, float cutoff);
+
+	/// <summary>
+	/// Sphere around where a light is brighter than a cutoff. Spot lights' diffuse only reaches as far as their cone, which is bounded
+	/// with the sphere of their ambient, lit all around them. Point lights are the sphere of their range.
+	/// </summary>
+	static void GetBounds(const ClusterLightData& light, float cutoff, XMFLOAT3& centre, float& radius);
+
+	/// <summary>
+	/// World space sphere a light buffer light reached in the last build, as GetBounds. False if the light was not clustered.
+	/// </summary>
+	bool GetLightBounds(int lightIndex, XMFLOAT3& centre, float& radius);
+
+	void SetLightCutoff(float cutoff); // Setter for the fraction of a light's intensity it is cut off at, from the next build
+	float GetLightCutoff(); // Getter for the light cutoff
+
+	const LightClusterer& GetClusterer(); // Grid and counters of the last build
+	double GetBuildMs(); // Time binning took in the last build
+
+private:
+	// Grows a dynamic structured buffer to hold count elements, recreating its view
+	void Reserve(ID3D11Buffer** buffer, ID3D11ShaderResourceView** view, UINT& capacity, UINT count, UINT stride);
+	void Upload(ID3D11Buffer* buffer, const void* data, size_t size);
+
+	// An object's list, its buffer and what was last uploaded to it
+	struct ObjectLights {
+		ID3D11Buffer* buffer;
+		ObjectLightBufferData uploaded;
+		unsigned int shadowLights;
+		unsigned int lightCount;
+	};
+
+	LightClusterer clusterer;
+	std::vector<ClusterLightData> clusterLights;
+	std::vector<XMFLOAT4> lightBounds; // World space sphere of each clustered light, centre and radius
+	float lightCutoff;
+	double buildMs;
+
+	std::vector<ObjectLights> objectLights;
+	std::vector<std::pair<float, unsigned int>> objectCandidates; // Scratch importance and index of the lights reaching an object
+
+	ID3D11Buffer* gridBuffer;
+	ID3D11Buffer* lightBuffer;
+	ID3D11ShaderResourceView* lightSRV;
+	UINT lightCapacity;
+	ID3D11Buffer* rangeBuffer;
+	ID3D11ShaderResourceView* rangeSRV;
+	UINT rangeCapacity;
+	ID3D11Buffer* indexBuffer;
+	ID3D11ShaderResourceView* indexSRV;
+	UINT indexCapacity;
+
+	// Renderer pointer, reduces number of parameters needing passed around.
+	D3D* renderer;
+};
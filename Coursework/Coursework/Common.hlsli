@@ -16,8 +16,87 @@ struct LightData
     float innerSpotlightCutoffAngle;
     float outerSpotlightCutoffAngle;
     float2 p_0;
+    float4 atlasRegions[6];
 };
 
+// Point or spot light in the clustered light buffer, see ClusteredLights
+struct ClusterLightData
+{
+    float4 ambient;
+    float4 diffuse;
+    float3 position;
+    float range;
+    float3 direction;
+    int lightType;
+    float constantAttenuation;
+    float linearAttenuation;
+    float quadraticAttenuation;
+    float lightPower;
+    float innerSpotlightCutoffAngle;
+    float outerSpotlightCutoffAngle;
+    int shadowIndex; // Index of its shadow maps in the light buffer, -1 for none
+    float padding;
+};
+
+// How pixels find their cluster, see ClusteredLights
+struct ClusterGridData
+{
+    uint3 tileCount; // Tiles across, tiles down and slices
+    float2 tilesPerPixel;
+    float sliceScale;
+    float sliceBias;
+    float nearPlane;
+    float farPlane;
+};
+
+// The clustered lights reaching an object, as ClusteredLights lists them
+struct ObjectLightData
+{
+    uint lightCount;
+    uint complete; // Every light reaching the object is listed, if not the clusters are used
+    uint2 padding;
+    uint4 lightIndices[8]; // Four to a register
+};
+
+// A light buffer light as a clustered one, so they are lit the same way
+ClusterLightData ToClusterLight(LightData light, int shadowIndex)
+{
+    ClusterLightData clusterLight;
+    clusterLight.ambient = light.ambient;
+    clusterLight.diffuse = light.diffuse;
+    clusterLight.position = light.position;
+    clusterLight.range = 0;
+    clusterLight.direction = light.direction;
+    clusterLight.lightType = light.lightType;
+    clusterLight.constantAttenuation = light.constantAttenuation;
+    clusterLight.linearAttenuation = light.linearAttenuation;
+    clusterLight.quadraticAttenuation = light.quadraticAttenuation;
+    clusterLight.lightPower = light.lightPower;
+    clusterLight.innerSpotlightCutoffAngle = light.innerSpotlightCutoffAngle;
+    clusterLight.outerSpotlightCutoffAngle = light.outerSpotlightCutoffAngle;
+    clusterLight.shadowIndex = shadowIndex;
+    clusterLight.padding = 0;
+    return clusterLight;
+}
+
+// Cluster of a pixel, from its screen position and depth buffer value
+// Tiles split the screen evenly, slices split the view depth exponentially, as LightClusterer bins them
+uint GetClusterIndex(ClusterGridData grid, float4 screenPosition)
+{
+    // Depth buffer value back to view depth, for a perspective projection from the near to far plane
+    float viewDepth = grid.nearPlane * grid.farPlane / (grid.farPlane - screenPosition.z * (grid.farPlane - grid.nearPlane));
+    uint slice = (uint) clamp(floor(log(viewDepth) * grid.sliceScale + grid.sliceBias), 0, grid.tileCount.z - 1);
+    uint2 tile = min((uint2) (screenPosition.xy * grid.tilesPerPixel), grid.tileCount.xy - 1);
+    return (slice * grid.tileCount.y + tile.y) * grid.tileCount.x + tile.x;
+}
+
+// If a pixel loops over its object's lights in place of its cluster's, when the object's list holds every light reaching it and is no longer
+// Both lists hold every light reaching the pixel, so they light it the same, the shorter is only quicker
+bool UseObjectLights(ObjectLightData objectLights, uint2 clusterRange)
+{
+    return objectLights.complete != 0 && objectLights.lightCount <= clusterRange.y;
+}
+
 // spotlight multiplication factor (De Vries, 2014 b)
 float4 calculateSpotlightPower(float3 lightDirection, float3 lightPointing, float innerCutoff, float outerCutoff)
 {
@@ -29,16 +108,30 @@ float4 calculateSpotlightPower(float3 lightDirection, float3 lightPointing, floa
     return (angleThisPixel - outerCutoff) / (innerCutoff - outerCutoff);
 }
 
+// Cascades of a directional light, as WorldLight::CASCADE_COUNT
+static const int CASCADE_COUNT = 4;
+
 // Calculate Shadow function
-// Using the TextureCube for spotlights and point lights (lights which use perspective projection)
-// Using the Texture2D for directional lights (lights which use the orthographic projection)
-// TextureCubes / Cube maps used, Microsoft (no date a, no date b)
-bool IsInShadow(LightData light, float3 worldPos, float3 lightDirection, int lightIndex, Texture2D directionalShadowMap, TextureCube projectionShadowMap, SamplerState shadowSampler)
+// Using the shadow atlas for point and spot lights, a view for each cube face of a point light (lights which see all around them), a single perspective projection for spot lights
+// Using the Texture2DArray for directional lights, a slice for each cascade
+// Cube map face selection, Microsoft (no date a, no date b)
+bool IsInShadow(LightData light, float3 worldPos, float3 lightDirection, int lightIndex, Texture2DArray projectedShadowMap, Texture2D shadowAtlas, SamplerState shadowSampler)
 {
     int shadowMapIndex = 0;
     float4 lightViewPosition = float4(0, 0, 0, 0);
-    // Calculate which view matrix we are using, for directional its always 0 
-    if (light.lightType != 0)
+    // Calculate which view matrix we are using, for spot its always 0, for point the cube face the light direction points through
+    // For directional, the nearest cascade whose map the pixel is in, it has the most texels for it. Each cascade's matrix has its projection too.
+    // A texel short of the edges, so nothing is sampled from the edge of a cascade. Past the last cascade is outside its map and lit.
+    if (light.lightType == 0)
+    {
+        for (shadowMapIndex = 0; shadowMapIndex < CASCADE_COUNT - 1; ++shadowMapIndex)
+        {
+            float4 cascadePosition = mul(light.lightViewMatrix[shadowMapIndex], float4(worldPos, 1));
+            if (all(abs(cascadePosition.xy) < 0.999))
+                break;
+        }
+    }
+    if (light.lightType == 1)
     {
         float3 absoluteLightDirection = abs(lightDirection);
         if (absoluteLightDirection.x > absoluteLightDirection.y && absoluteLightDirection.x > absoluteLightDirection.z)
@@ -71,16 +164,19 @@ bool IsInShadow(LightData light, float3 worldPos, float3 lightDirection, int lig
     {
         return false;
     }
+    // FOR SPOT Behind the light is outside its cone, so unlit anyway
+    if (light.lightType == 2 && lightViewPosition.w <= 0)
+    {
+        return false;
+    }
     
     // Calculate the projected texture coordinates.
     float2 projTex = lightViewPosition.xy / lightViewPosition.w;
     projTex *= float2(0.5, -0.5);
     projTex += float2(0.5f, 0.5f);
     
-    float3 testVector = float3(projTex.x, projTex.y, shadowMapIndex);
-    
-    // FOR DIRECTIONAL Check if UV space projection is within 0 to 1 range
-    if (light.lightType == 0 && (projTex.x < 0.f || projTex.x > 1.f || projTex.y < 0.f || projTex.y > 1.f))
+    // FOR DIRECTIONAL AND SPOT Check if UV space projection is within 0 to 1 range
+    if (light.lightType != 1 && (projTex.x < 0.f || projTex.x > 1.f || projTex.y < 0.f || projTex.y > 1.f))
     {
         return false;
     }
@@ -88,9 +184,19 @@ bool IsInShadow(LightData light, float3 worldPos, float3 lightDirection, int lig
     // Sample the shadow map (get depth of geometry)
     float depthValue = 0;
     if (light.lightType == 0)
-        depthValue = directionalShadowMap.Sample(shadowSampler, projTex).r;
+        depthValue = projectedShadowMap.Sample(shadowSampler, float3(projTex, shadowMapIndex)).r;
     else
-        depthValue = projectionShadowMap.Sample(shadowSampler, lightDirection).r;
+    {
+        // FOR POINT AND SPOT Into the view's region of the atlas, kept half a texel inside it so its neighbours are never sampled
+        // A view the atlas had no room for has no scale, and is unshadowed
+        float4 atlasRegion = light.atlasRegions[shadowMapIndex];
+        if (atlasRegion.z == 0)
+        {
+            return false;
+        }
+        float2 atlasTex = clamp(projTex, atlasRegion.w, 1 - atlasRegion.w) * atlasRegion.z + atlasRegion.xy;
+        depthValue = shadowAtlas.Sample(shadowSampler, atlasTex).r;
+    }
 	// Calculate the depth from the light.
     float lightDepthValue = lightViewPosition.z / lightViewPosition.w;
     // Perform a higher bias for directional lights, they are typically further away
@@ -13,6 +13,13 @@ struct WorldBufferData {
 	XMMATRIX normalWorldMatrix;
 };
 
+// Per instance data struct, one element of the instance structured buffer
+struct InstanceBufferData {
+	XMMATRIX worldMatrix;
+	UINT materialIndex; // Index into the materials passed with the instances
+	UINT padding[3];
+};
+
 
 // Singular light struct
 struct LightData {
@@ -21,8 +28,8 @@ struct LightData {
 	XMFLOAT3A position;
 	XMFLOAT3 direction;
 	int lightType;
-	XMMATRIX lightViewMatrix[6];
-	XMMATRIX lightProjectionMatrix;
+	XMMATRIX lightViewMatrix[6]; // Cube faces for point lights, each cascade's view and projection together for directional lights
+	XMMATRIX lightProjectionMatrix; // Identity for directional lights
 	float constantAttenuation;
 	float linearAttenuation;
 	float quadraticAttenuation;
@@ -31,10 +38,51 @@ struct LightData {
 	float outerSpotlightCutoffAngle;
 	float p_0;
 	float p_1;
+	XMFLOAT4 atlasRegions[6]; // Point and spot lights' views in the shadow atlas, see ShadowAtlas::GetRegionTransform
 };
 
-// Light buffer struct
+// Light buffer struct, the lights with shadow maps, the sun and point and spot lights the clusters refer to
 struct LightBufferData {
 	LightData lights[8];
 	int lightCount;
-};
\ No newline at end of file
+};
+
+// Point or spot light in the clustered light buffer, see ClusteredLights
+struct ClusterLightData {
+	XMFLOAT4 ambientColor;
+	XMFLOAT4 diffuseColor;
+	XMFLOAT3 position;
+	float range; // Distance its attenuation fades it out by, the clusters it is listed in are within it
+	XMFLOAT3 direction;
+	int lightType;
+	float constantAttenuation;
+	float linearAttenuation;
+	float quadraticAttenuation;
+	float lightPower;
+	float innerSpotlightCutoffAngle;
+	float outerSpotlightCutoffAngle;
+	int shadowIndex; // Index in the light buffer of its shadow maps, -1 if it has none
+	float padding;
+};
+
+// Cluster grid buffer struct, how a pixel finds its cluster
+struct ClusterGridData {
+	UINT tileCountX;
+	UINT tileCountY;
+	UINT sliceCount;
+	UINT padding;
+	XMFLOAT2 tilesPerPixel; // Tile count over the screen size
+	float sliceScale; // Slice of a view depth is floor(log(depth) * sliceScale + sliceBias)
+	float sliceBias;
+	float nearPlane;
+	float farPlane;
+	XMFLOAT2 padding2;
+};
+
+// Object light buffer struct, the clustered lights reaching one object, most important first, see ClusteredLights::SelectObjectLights
+struct ObjectLightBufferData {
+	UINT lightCount;
+	UINT complete; // 1 if every light reaching the object is listed, if not shaders use the clusters
+	UINT padding[2];
+	XMUINT4 lightIndices[8]; // Indices into the clustered lights, four to a register, ClusteredLights::MAX_OBJECT_LIGHTS
+};
@@ -79,7 +79,7 @@ void DepthOfFieldShader::SetShaderParametersPart1(ID3D11ShaderResourceView* text
 	// Setup with an orthographic projection
 	*projectionMatrix = XMMatrixOrthographicLH(screenWidth, screenHeight, 0, 1);
 	renderer->getDeviceContext()->Unmap(projectionBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
+	renderer->getStateCache()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
 
 	// Set layer data
 	result = renderer->getDeviceContext()->Map(depthLayerBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
@@ -89,12 +89,12 @@ void DepthOfFieldShader::SetShaderParametersPart1(ID3D11ShaderResourceView* text
 	layerData[0] = maxDepth;
 	layerData[1] = minDepth;
 	renderer->getDeviceContext()->Unmap(depthLayerBuffer, 0);
-	renderer->getDeviceContext()->PSSetConstantBuffers(0, 1, &depthLayerBuffer); // Depth layer buffer b0 in Pixel Shader
+	renderer->getStateCache()->PSSetConstantBuffers(0, 1, &depthLayerBuffer); // Depth layer buffer b0 in Pixel Shader
 
 	// Set textures and sampler
-	renderer->getDeviceContext()->PSSetShaderResources(0, 1, &texture);
-	renderer->getDeviceContext()->PSSetShaderResources(1, 1, &depthFromScene);
-	renderer->getDeviceContext()->PSSetSamplers(0, 1, &textureSampler);
+	renderer->getStateCache()->PSSetShaderResources(0, 1, &texture);
+	renderer->getStateCache()->PSSetShaderResources(1, 1, &depthFromScene);
+	renderer->getStateCache()->PSSetSamplers(0, 1, &textureSampler);
 }
 
 void DepthOfFieldShader::SetShaderParametersPart2(ID3D11ShaderResourceView* layer, ID3D11ShaderResourceView* depthFromScene, int screenWidth, int screenHeight, float* maxDepths, float* minDepths, bool xPass, int layerNum)
@@ -109,7 +109,7 @@ void DepthOfFieldShader::SetShaderParametersPart2(ID3D11ShaderResourceView* laye
 	// Setup with an orthographic projection
 	*projectionMatrix = XMMatrixOrthographicLH(screenWidth, screenHeight, 0, 1);
 	renderer->getDeviceContext()->Unmap(projectionBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
+	renderer->getStateCache()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
 
 	// Set layer data
 	result = renderer->getDeviceContext()->Map(depthLayersBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
@@ -121,12 +121,12 @@ void DepthOfFieldShader::SetShaderParametersPart2(ID3D11ShaderResourceView* laye
 	}
 	layersData[DOF_LAYER_COUNT] = XMFLOAT4((xPass) ? 1 : 0, (float)layerNum, 0, 0);
 	renderer->getDeviceContext()->Unmap(depthLayersBuffer, 0);
-	renderer->getDeviceContext()->PSSetConstantBuffers(0, 1, &depthLayersBuffer); // Depth layers buffer b0 in Pixel Shader
+	renderer->getStateCache()->PSSetConstantBuffers(0, 1, &depthLayersBuffer); // Depth layers buffer b0 in Pixel Shader
 
 	// Set textures and sampler 
-	renderer->getDeviceContext()->PSSetShaderResources(0, 1, &depthFromScene);
-	renderer->getDeviceContext()->PSSetShaderResources(1, 1, &layer);
-	renderer->getDeviceContext()->PSSetSamplers(0, 1, &textureSampler);
+	renderer->getStateCache()->PSSetShaderResources(0, 1, &depthFromScene);
+	renderer->getStateCache()->PSSetShaderResources(1, 1, &layer);
+	renderer->getStateCache()->PSSetSamplers(0, 1, &textureSampler);
 }
 
 void DepthOfFieldShader::SetShaderParametersPart3(ID3D11ShaderResourceView** layers, int screenWidth, int screenHeight)
@@ -141,11 +141,11 @@ void DepthOfFieldShader::SetShaderParametersPart3(ID3D11ShaderResourceView** lay
 	// Setup with an orthographic projection
 	*projectionMatrix = XMMatrixOrthographicLH(screenWidth, screenHeight, 0, 1);
 	renderer->getDeviceContext()->Unmap(projectionBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
+	renderer->getStateCache()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
 
 	// Set textures and sampler 
-	renderer->getDeviceContext()->PSSetShaderResources(0, DOF_LAYER_COUNT, layers);
-	renderer->getDeviceContext()->PSSetSamplers(0, 1, &textureSampler);
+	renderer->getStateCache()->PSSetShaderResources(0, DOF_LAYER_COUNT, layers);
+	renderer->getStateCache()->PSSetSamplers(0, 1, &textureSampler);
 }
 
 //void DepthOfFieldShader::SetShaderParametersPart2(ID3D11ShaderResourceView** layers, ID3D11ShaderResourceView* depthFromScene, int screenWidth, int screenHeight, float* maxDepths, float* minDepths)
@@ -160,7 +160,7 @@ void DepthOfFieldShader::SetShaderParametersPart3(ID3D11ShaderResourceView** lay
 //	// Setup with an orthographic projection
 //	*projectionMatrix = XMMatrixOrthographicLH(screenWidth, screenHeight, 0, 1);
 //	renderer->getDeviceContext()->Unmap(projectionBuffer, 0);
-//	renderer->getDeviceContext()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
+//	renderer->getStateCache()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
 //
 //	// Set layer data
 //	result = renderer->getDeviceContext()->Map(depthLayersBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
@@ -171,12 +171,12 @@ void DepthOfFieldShader::SetShaderParametersPart3(ID3D11ShaderResourceView** lay
 //		layersData[i] = XMFLOAT4(minDepths[i], maxDepths[i], 0, 0);
 //	}
 //	renderer->getDeviceContext()->Unmap(depthLayersBuffer, 0);
-//	renderer->getDeviceContext()->PSSetConstantBuffers(0, 1, &depthLayersBuffer); // Depth layers buffer b0 in Pixel Shader
+//	renderer->getStateCache()->PSSetConstantBuffers(0, 1, &depthLayersBuffer); // Depth layers buffer b0 in Pixel Shader
 //
 //	// Set textures and sampler 
-//	renderer->getDeviceContext()->PSSetShaderResources(0, 1, &depthFromScene);
-//	renderer->getDeviceContext()->PSSetShaderResources(1, 9, layers);
-//	renderer->getDeviceContext()->PSSetSamplers(0, 1, &textureSampler);
+//	renderer->getStateCache()->PSSetShaderResources(0, 1, &depthFromScene);
+//	renderer->getStateCache()->PSSetShaderResources(1, 9, layers);
+//	renderer->getStateCache()->PSSetSamplers(0, 1, &textureSampler);
 //}
 
 void DepthOfFieldShader::initShader(const wchar_t* vs, const wchar_t* ps)
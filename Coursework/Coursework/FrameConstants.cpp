@@ -0,0 +1,152 @@
+#include "FrameConstants.h"
+
+FrameConstants::FrameConstants(D3D* renderer)
+{
+	this->renderer = renderer;
+	lightBuffer = CreateBuffer(sizeof(LightBufferData));
+	ZeroMemory(&packedLights, sizeof(LightBufferData));
+	ZeroMemory(&uploadedLights, sizeof(LightBufferData));
+	lightsUploaded = false;
+	uploads = 0;
+	skipped = 0;
+}
+
+FrameConstants::~FrameConstants()
+{
+	// Release the light buffer.
+	if (lightBuffer)
+	{
+		lightBuffer->Release();
+		lightBuffer = 0;
+	}
+
+	// Release every pass's buffers.
+	for (PassBuffers* passBuffers : passes) {
+		if (!passBuffers) continue;
+		passBuffers->projectionBuffer->Release();
+		passBuffers->cameraBuffer->Release();
+		passBuffers->dofPlaneBuffer->Release();
+		delete passBuffers;
+	}
+	passes.clear();
+}
+
+void FrameConstants::SetLights(WorldLight* lights, int lightCount)
+{
+	// Pack from zero, so unused lights and padding compare equal between frames
+	ZeroMemory(&packedLights, sizeof(LightBufferData));
+	for (int i = 0; i < lightCount; i++) {
+		packedLights.lights[i].ambientColor = lights[i].getAmbientColour();
+		packedLights.lights[i].diffuseColor = lights[i].getDiffuseColour();
+		packedLights.lights[i].position = XMFLOAT3A(lights[i].getPosition().x, lights[i].getPosition().y, lights[i].getPosition().z);
+		packedLights.lights[i].direction = lights[i].getDirection();
+		packedLights.lights[i].lightType = lights[i].GetLightType();
+		packedLights.lights[i].innerSpotlightCutoffAngle = lights[i].GetInnerSpotlightCutoffAngle();
+		packedLights.lights[i].outerSpotlightCutoffAngle = lights[i].GetOuterSpotlightCutoffAngle();
+		if (lights[i].GetLightType() == 0) {
+			// Every cascade has its own projection, so each is packed with its view and the projection left as identity
+			for (int c = 0; c < WorldLight::CASCADE_COUNT; ++c) {
+				packedLights.lights[i].lightViewMatrix[c] = lights[i].GetViewMatrix(c) * lights[i].GetProjMatrix(c);
+			}
+			packedLights.lights[i].lightProjectionMatrix = XMMatrixIdentity();
+		}
+		else {
+			packedLights.lights[i].lightViewMatrix[0] = lights[i].GetViewMatrix(0);
+			if (lights[i].GetShadowFaceCount() > 1) {
+				for (int f = 1; f < 6; ++f) {
+					packedLights.lights[i].lightViewMatrix[f] = lights[i].GetViewMatrix(f);
+				}
+			}
+			packedLights.lights[i].lightProjectionMatrix = lights[i].GetProjMatrix(0);
+			for (int f = 0; f < lights[i].GetShadowFaceCount(); ++f) {
+				packedLights.lights[i].atlasRegions[f] = ShadowAtlas::GetRegionTransform(lights[i].GetShadowAtlasRegion(f));
+			}
+		}
+		packedLights.lights[i].constantAttenuation = lights[i].GetConstantAttenuation();
+		packedLights.lights[i].linearAttenuation = lights[i].GetLinearAttenuation();
+		packedLights.lights[i].quadraticAttenuation = lights[i].GetQuadraticAttenuation();
+		packedLights.lights[i].lightPower = lights[i].GetLightPower();
+	}
+	packedLights.lightCount = lightCount;
+
+	Upload(lightBuffer, &uploadedLights, &packedLights, sizeof(LightBufferData), !lightsUploaded);
+	lightsUploaded = true;
+}
+
+void FrameConstants::SetPass(unsigned int pass, const XMMATRIX& projection, const XMMATRIX& view, XMFLOAT3 position, XMFLOAT2 DOFKeepingRange)
+{
+	PassBuffers* passBuffers = GetPass(pass);
+	bool force = !passBuffers->uploaded;
+	passBuffers->uploaded = true;
+
+	// Upload what changed since this pass was last drawn
+	Upload(passBuffers->projectionBuffer, &passBuffers->projection, &projection, sizeof(XMMATRIX), force);
+	CameraBufferData camera{ view, XMFLOAT4(position.x, position.y, position.z, 1) };
+	Upload(passBuffers->cameraBuffer, &passBuffers->camera, &camera, sizeof(CameraBufferData), force);
+	XMFLOAT4 dofPlane(DOFKeepingRange.x, DOFKeepingRange.y, 0, 0);
+	Upload(passBuffers->dofPlaneBuffer, &passBuffers->dofPlane, &dofPlane, sizeof(XMFLOAT4), force);
+
+	// Bind to the fixed slots, the PBR shader reads them in the vertex shader, the tessellated shaders in the domain shader
+	ID3D11Buffer* viewBuffers[2] = { passBuffers->projectionBuffer, passBuffers->cameraBuffer };
+	D3D11StateCache* stateCache = renderer->getStateCache();
+	stateCache->VSSetConstantBuffers(PROJECTION_SLOT, 2, viewBuffers); // Projection b0 and camera b1 in Vertex Shader
+	stateCache->DSSetConstantBuffers(PROJECTION_SLOT, 2, viewBuffers); // Projection b0 and camera b1 in Domain Shader
+	stateCache->PSSetConstantBuffers(LIGHT_SLOT, 1, &lightBuffer); // Light buffer b1 in Pixel Shader
+	stateCache->PSSetConstantBuffers(DOF_RANGE_SLOT, 1, &passBuffers->dofPlaneBuffer); // DOF range b2 in Pixel Shader
+}
+
+void FrameConstants::GetUploadStats(int& uploads, int& skipped)
+{
+	uploads = this->uploads;
+	skipped = this->skipped;
+}
+
+void FrameConstants::ResetUploadStats()
+{
+	uploads = 0;
+	skipped = 0;
+}
+
+FrameConstants::PassBuffers* FrameConstants::GetPass(unsigned int pass)
+{
+	if (pass >= passes.size()) passes.resize(pass + 1, nullptr);
+	if (!passes[pass]) {
+		PassBuffers* passBuffers = new PassBuffers;
+		passBuffers->projectionBuffer = CreateBuffer(sizeof(XMMATRIX));
+		passBuffers->cameraBuffer = CreateBuffer(sizeof(CameraBufferData));
+		passBuffers->dofPlaneBuffer = CreateBuffer(sizeof(XMFLOAT4));
+		passBuffers->uploaded = false;
+		passes[pass] = passBuffers;
+	}
+	return passes[pass];
+}
+
+ID3D11Buffer* FrameConstants::CreateBuffer(UINT size)
+{
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = size;
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+
+	ID3D11Buffer* buffer = nullptr;
+	renderer->getDevice()->CreateBuffer(&bufferDesc, NULL, &buffer);
+	return buffer;
+}
+
+void FrameConstants::Upload(ID3D11Buffer* buffer, void* uploaded, const void* data, size_t size, bool force)
+{
+	if (!force && memcmp(uploaded, data, size) == 0) {
+		skipped++;
+		return;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	renderer->getDeviceContext()->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	memcpy(mappedResource.pData, data, size);
+	renderer->getDeviceContext()->Unmap(buffer, 0);
+	memcpy(uploaded, data, size);
+	uploads++;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include "DXF.h"
+#include "CommonStructs.h"
+#include "WorldLight.h"
+
+/// <summary>
+/// Constants shared by every draw, packed once and bound at fixed slots for the PBR, height map and waves shaders.
+/// Lights are packed once a frame, projection, camera and DOF range once for each render queue pass.
+/// Every pass has its own buffers and remembers what they hold, so a pass seeing the same as last frame, like a still light's shadow face, uploads nothing.
+/// Shaders only upload what changes between draws, the world matrix and material.
+/// </summary>
+class FrameConstants
+{
+public:
+	// Projection and camera in the vertex and domain shaders
+	static const UINT PROJECTION_SLOT = 0;
+	static const UINT CAMERA_SLOT = 1;
+	// Lights and DOF range in the pixel shader
+	static const UINT LIGHT_SLOT = 1;
+	static const UINT DOF_RANGE_SLOT = 2;
+
+	FrameConstants(D3D* renderer);
+	~FrameConstants();
+
+	/// <summary>
+	/// Packs the lights, they are only uploaded if they changed since the last upload
+	/// Call once a frame before the passes are drawn
+	/// </summary>
+	/// <param name="lights">Array of lights</param>
+	/// <param name="lightCount">Number of active lights in that array, 8 at most</param>
+	void SetLights(WorldLight* lights, int lightCount);
+
+	/// <summary>
+	/// Sets a pass's view and binds every frame constant, call in the pass's setup before its draws
+	/// </summary>
+	/// <param name="pass">Render queue pass</param>
+	/// <param name="projection">Projection matrix of the pass</param>
+	/// <param name="view">View matrix of the pass</param>
+	/// <param name="position">Position the pass is seen from</param>
+	/// <param name="DOFKeepingRange">DOF Pass Data, What range are we in, defaults to entire scene</param>
+	void SetPass(unsigned int pass, const XMMATRIX& projection, const XMMATRIX& view, XMFLOAT3 position, XMFLOAT2 DOFKeepingRange = XMFLOAT2(0, 1));
+
+	/// <summary>
+	/// Buffer upload counters, count up until reset
+	/// </summary>
+	void GetUploadStats(int& uploads, int& skipped);
+	void ResetUploadStats();
+
+private:
+	// A pass's buffers and what was last uploaded to them
+	struct PassBuffers {
+		ID3D11Buffer* projectionBuffer;
+		ID3D11Buffer* cameraBuffer;
+		ID3D11Buffer* dofPlaneBuffer;
+		XMMATRIX projection;
+		CameraBufferData camera;
+		XMFLOAT4 dofPlane;
+		bool uploaded; // Nothing is held until the first upload
+	};
+
+	PassBuffers* GetPass(unsigned int pass); // Creates the pass's buffers the first time it is used
+	ID3D11Buffer* CreateBuffer(UINT size);
+	// Uploads data if it differs from what the buffer holds, uploaded is the copy of that, updated with it
+	void Upload(ID3D11Buffer* buffer, void* uploaded, const void* data, size_t size, bool force);
+
+	ID3D11Buffer* lightBuffer;
+	LightBufferData packedLights;
+	LightBufferData uploadedLights;
+	bool lightsUploaded;
+
+	std::vector<PassBuffers*> passes;
+
+	int uploads;
+	int skipped;
+
+	// Renderer pointer, reduces number of parameters needing passed around.
+	D3D* renderer;
+};
@@ -0,0 +1,120 @@
+// Vertex shader for the height map terrain's quadtree patches
+// Every instance is a patch TerrainQuadtree picked, drawn with one grid. The grid is placed on the patch's square of the
+// height map and displaced by it, this used to be in the domain shader. Towards the end of its level's range a patch's odd
+// vertices slide onto the next level's grid, so it meets the coarser patches beyond it without cracks (Strugar, 2009).
+#include "Common.hlsli"
+
+// Matrix buffers
+cbuffer ProjectionBuffer : register(b0)
+{
+	matrix projectionMatrix;
+};
+
+cbuffer CameraBuffer : register(b1)
+{
+	matrix viewMatrix;
+	float3 cameraPosition;
+};
+
+cbuffer WorldBuffer : register(b2)
+{
+	matrix worldMatrix;
+	matrix normalWorldMatrix;
+};
+// Height map buffer (we only care about amplitude at this point)
+cbuffer HeightMapBuffer : register(b3)
+{
+    float amplitude;
+    float2 worldSizeOfPlane;
+    int isSmoothingOn;
+};
+// Levels are picked from the user camera's position, shadow passes included, so the shadows match the terrain drawn
+cbuffer PatchBuffer : register(b4)
+{
+    float3 lodCameraPosition;
+    float patchResolution; // Cells across the patch grid
+};
+
+// Height map texture and sampler
+Texture2D heightMap : register(t0);
+SamplerState heightMapSampler : register(s0);
+
+// A patch, see TerrainQuadtree::Patch
+struct Patch
+{
+    float2 corner; // In the height map's texture coordinates
+    float size;
+    uint level;
+    float morphStart;
+    float morphEnd;
+    float2 padding;
+};
+StructuredBuffer<Patch> patches : register(t1);
+
+struct InputType
+{
+	float4 position : POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+	float3 tangent : TANGENT;
+	float3 bitangent : BITANGENT;
+	uint instanceID : SV_InstanceID;
+};
+
+struct OutputType
+{
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+	float3 tangent : TANGENT;
+	float3 bitangent : BITANGENT;
+	float3 worldPosition : POSITION;
+};
+
+// Returns a value between -1 and 1 which is the height from the height map.
+// Uses plain sample if not smoothing
+// Uses smoothed sample with custom bilinear sampling if smoothing, See Common.hlsli
+float GetHeightMapOffset(float2 texCoord)
+{
+    if (isSmoothingOn == 0)
+        return (heightMap.SampleLevel(heightMapSampler, texCoord, 0).r * 2) - 1;
+    return (SmoothedSample(heightMapSampler, heightMap, texCoord).r * 2) - 1;
+}
+
+// Position on the plane, before the world matrix, of a point of the height map
+float4 GetPlanePosition(float2 texCoord)
+{
+    return float4(texCoord.x, GetHeightMapOffset(texCoord) * amplitude, texCoord.y, 1);
+}
+
+OutputType main(InputType input)
+{
+	OutputType output;
+    Patch patch = patches[input.instanceID];
+
+    // How far into the morph the vertex is, by its distance before it moves
+    float2 gridPosition = input.position.xz;
+    float3 unmorphedPosition = mul(worldMatrix, GetPlanePosition(patch.corner + gridPosition * patch.size)).xyz;
+    float morph = saturate((distance(unmorphedPosition, lodCameraPosition) - patch.morphStart) / (patch.morphEnd - patch.morphStart));
+
+    // Odd vertices move towards their even neighbour, fully morphed they sit on the grid of half the resolution
+    float2 oddOffset = frac(gridPosition * patchResolution * 0.5) * 2.0 / patchResolution;
+    float2 textureCoordinate = patch.corner + (gridPosition - oddOffset * morph) * patch.size;
+    float4 newPosition = GetPlanePosition(textureCoordinate);
+
+	// Calculate the position of the vertex against the world, view, and projection matrices.
+    output.position = mul(worldMatrix, newPosition);
+    output.worldPosition = output.position.xyz;
+	output.position = mul(viewMatrix, output.position);
+	output.position = mul(projectionMatrix, output.position);
+
+	// Store the texture coordinates for the pixel shader.
+	output.tex = textureCoordinate;
+
+    // Transform directional components, the pixel shader finds the real normal from the height map
+	output.normal = normalize(mul(float4(input.normal, 0), normalWorldMatrix)).xyz;
+	output.tangent = normalize(mul(float4(input.tangent, 0), normalWorldMatrix)).xyz;
+	output.bitangent = normalize(mul(float4(input.bitangent, 0), normalWorldMatrix)).xyz;
+
+	return output;
+}
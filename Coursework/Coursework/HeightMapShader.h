@@ -1,4 +1,5 @@
 #pragma once
+#include <vector>
 #include "DXF.h"
 #include "CommonStructs.h"
 #include "WorldLight.h"
@@ -20,26 +21,28 @@ public:
 	};
 
 	/// <summary>
-	/// Tessellation buffer data structure
+	/// Patch buffer data structure, the levels of the patches are picked from this camera position
 	/// </summary>
-	struct TessInfoData {
-		XMFLOAT2 minMaxTess;
-		XMFLOAT2 minMaxDist;
-		XMFLOAT4 camPos;
-		XMMATRIX worldMatrix;
+	struct PatchBufferData {
+		XMFLOAT3 lodCameraPosition;
+		float patchResolution;
 	};
 
 	
 
 	void SetRenderer(D3D* renderer); // Set render after shader init, used to reduce parameter passing.
-	void SetCurrentCamera(Camera* camera);
-	void SetLightAsCamera(WorldLight* light, int shadowMapIndex = 0);
+	void SetCurrentCamera(Camera* camera); // Patches morph by their distance from this camera, shadow passes included
 
-	void SetCameraAsCamera();
-	void SetLightAsCamera();
+	/// <summary>
+	/// Uploads the terrain patches to draw, call before SetShaderParameters and draw them as instances of the patch mesh
+	/// </summary>
+	/// <param name="patches">Patches TerrainQuadtree picked, one instance each</param>
+	/// <param name="patchResolution">Cells across the patch mesh, the quadtree's patch resolution</param>
+	void SetPatchParameters(const std::vector<TerrainQuadtree::Patch>& patches, UINT patchResolution);
 
 	/// <summary>
 	/// Sets up shader parameters for the height map shader
+	/// While depth only, see setDepthOnly, only the vertex shader's data is set
 	/// </summary>
 	/// <param name="world">World matrix of object to draw</param>
 	/// <param name="heightMapBufferData">Height map buffer data</param>
@@ -47,37 +50,30 @@ public:
 	/// <param name="lightCount">Light count</param>
 	/// <param name="heightMap">Height map texture</param>
 	/// <param name="groundTexture">Ground colour texture (not used atm)</param>
-	/// <param name="minMaxTess">X = minimum tessellation, Y = maximum tessellation</param>
-	/// <param name="minMaxDist">X = distance to start interpolation, Y = distance to stop interpolation</param>
-	/// <param name="DOFKeepingRange">DOF Pass Data, What range are we in, defaults to entire scene</param>
-	void SetShaderParameters(const XMMATRIX& world, HeightMapBufferData* heightMapBufferData, WorldLight* lights, int lightCount, ID3D11ShaderResourceView* heightMap, ID3D11ShaderResourceView* groundTexture, XMFLOAT2 minMaxTess, XMFLOAT2 minMaxDist, XMFLOAT2 DOFKeepingRange = XMFLOAT2(0, 1));
+	void SetShaderParameters(const XMMATRIX& world, HeightMapBufferData* heightMapBufferData, WorldLight* lights, int lightCount, ID3D11ShaderResourceView* heightMap, ID3D11ShaderResourceView* groundTexture);
 
 private:
 	void initShader(const wchar_t* vs, const wchar_t* ps);
-	void initShader(const wchar_t* vsFilename, const wchar_t* hsFilename, const wchar_t* dsFilename, const wchar_t* psFilename);
 
 	// Vertex Shader Buffers
-	ID3D11Buffer* projectionBuffer;
-	ID3D11Buffer* cameraBuffer;
 	ID3D11Buffer* worldBuffer;
+	ID3D11Buffer* patchInfoBuffer;
 
 	ID3D11SamplerState* heightMapSampler;
 
 	// Pixel Shader Buffers
-	ID3D11Buffer* lightBuffer;
 	ID3D11Buffer* heightMapBuffer;
-	ID3D11Buffer* tessInfoBuffer;
-	ID3D11Buffer* dofPlaneBuffer;
+
+	// Patches read by instance in the Vertex Shader
+	ID3D11Buffer* patchBuffer;
+	ID3D11ShaderResourceView* patchSRV;
+	UINT patchCapacity;
 	
 	ID3D11SamplerState* textureSampler;
 	ID3D11SamplerState* shadowSampler;
 
 	// Tie shader directly to camera, reduces number of parameters needing passed around. 
 	Camera* currentCamera;
-	// Have a light we can use as the current camera too.
-	WorldLight* lightCamera;
-	int shadowMapIndex;
-	bool usingLightCamera = true;
 
 	// Renderer pointer, reduces number of parameters needing passed around. 
 	D3D* renderer;
@@ -0,0 +1,5 @@
+// PBR Instanced pixel shader
+// The PBR pixel shader with the material read per instance, for WorldObject::RenderInstanced.
+
+#define INSTANCED
+#include "PBR_ps.hlsl"
@@ -0,0 +1,5 @@
+// PBR Instanced Vertex Shader
+// The PBR vertex shader with the world matrix read per instance, for WorldObject::RenderInstanced.
+
+#define INSTANCED
+#include "PBR_vs.hlsl"
@@ -0,0 +1,5 @@
+// PBR Packed Instanced Vertex Shader
+// The packed PBR vertex shader with the world matrix read per instance, for WorldObject::RenderInstanced.
+
+#define INSTANCED
+#include "PBRPacked_vs.hlsl"
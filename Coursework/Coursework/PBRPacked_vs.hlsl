@@ -0,0 +1,119 @@
+// PBR Packed Vertex Shader
+// Same as the PBR vertex shader, for meshes uploaded in the 20 byte VertexPacking format.
+// Positions arrive as UNORM16 relative to the mesh bounds, the world matrix already contains the decode.
+// The normal, tangent and bitangent arrive as one quaternion (QTangent), the sign of w is the bitangent handedness.
+
+
+// Projection, Camera and World Buffers
+cbuffer ProjectionBuffer : register(b0)
+{
+	matrix projectionMatrix;
+};
+
+cbuffer CameraBuffer : register(b1)
+{
+    matrix viewMatrix;
+    float3 cameraPosition;
+};
+
+#ifdef INSTANCED
+// Instanced draws read their world matrix and material index from the instance buffer, see InstanceBufferData.
+// One draw can cover part of the buffer, SV_InstanceID counts from 0 so the start is passed in.
+struct InstanceData
+{
+    matrix worldMatrix;
+    uint materialIndex;
+    uint3 padding;
+};
+
+StructuredBuffer<InstanceData> instances : register(t0);
+
+cbuffer InstanceOffsetBuffer : register(b3)
+{
+    uint instanceOffset;
+};
+
+static matrix worldMatrix;
+#else
+cbuffer WorldBuffer : register(b2)
+{
+    matrix worldMatrix;
+    matrix normalWorldMatrix;
+};
+#endif
+
+struct InputType
+{
+	float4 position : POSITION;
+	float2 tex : TEXCOORD0;
+	float4 tangentFrame : TANGENTFRAME;
+#ifdef INSTANCED
+	uint instanceID : SV_InstanceID;
+#endif
+};
+
+struct OutputType
+{
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+	float3 tangent : TANGENT;
+	float3 bitangent : BITANGENT;
+	float3 worldPosition : POSITION;
+    float3 cameraVector : CAMVECTOR;
+#ifdef INSTANCED
+	nointerpolation uint materialIndex : MATERIAL;
+#endif
+};
+
+// Rebuilds the tangent frame from the QTangent, must match VertexPacking::decodeTangentFrame
+void DecodeTangentFrame(float4 q, out float3 normal, out float3 tangent, out float3 bitangent)
+{
+	float handedness = q.w < 0.0f ? -1.0f : 1.0f;
+	q = normalize(q);
+
+	tangent = float3(1.0f - 2.0f * (q.y * q.y + q.z * q.z), 2.0f * (q.x * q.y + q.w * q.z), 2.0f * (q.x * q.z - q.w * q.y));
+	bitangent = float3(2.0f * (q.x * q.y - q.w * q.z), 1.0f - 2.0f * (q.x * q.x + q.z * q.z), 2.0f * (q.y * q.z + q.w * q.x)) * handedness;
+	normal = float3(2.0f * (q.x * q.z + q.w * q.y), 2.0f * (q.y * q.z - q.w * q.x), 1.0f - 2.0f * (q.x * q.x + q.y * q.y));
+}
+
+OutputType main(InputType input)
+{
+	OutputType output;
+
+#ifdef INSTANCED
+	InstanceData instance = instances[instanceOffset + input.instanceID];
+	worldMatrix = instance.worldMatrix;
+	output.materialIndex = instance.materialIndex;
+#endif
+
+	// Calculate the position of the vertex against the world, view, and projection matrices.
+	output.position = mul(worldMatrix, input.position);
+	output.position = mul(viewMatrix, output.position);
+	output.position = mul(projectionMatrix, output.position);
+
+	// Store the texture coordinates for the pixel shader.
+	output.tex = input.tex;
+
+	float3 normal, tangent, bitangent;
+	DecodeTangentFrame(input.tangentFrame, normal, tangent, bitangent);
+
+	// Calculate the normal vector against the world matrix only and normalise.
+	// The decode scale is uniform so normalising removes it.
+	output.normal = mul((float3x3)worldMatrix, normal);
+	output.normal = normalize(output.normal);
+
+	// Do the same for tangent and bitangent
+	output.tangent = mul((float3x3)worldMatrix, tangent);
+	output.tangent = normalize(output.tangent);
+
+	output.bitangent = mul((float3x3)worldMatrix, bitangent);
+	output.bitangent = normalize(output.bitangent);
+
+	output.worldPosition = mul(worldMatrix, input.position).xyz;
+	
+	// Calculate the view vector for this vertex
+    output.cameraVector = output.worldPosition - cameraPosition;
+	
+	return output;
+}
\ No newline at end of file
@@ -3,6 +3,14 @@
 PBRShader::PBRShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
 {
 	this->device = device;
+	instanceBuffer = nullptr;
+	instanceSRV = nullptr;
+	instanceCapacity = 0;
+	instanceMaterialBuffer = nullptr;
+	instanceMaterialSRV = nullptr;
+	instanceMaterialCapacity = 0;
+	instancedDraws = 0;
+	instancesDrawn = 0;
 	initShader(L"PBR_vs.cso", L"PBR_ps.cso");
 }
 
@@ -15,20 +23,6 @@ PBRShader::~PBRShader()
 		layout = 0;
 	}
 
-	// Release the projection buffer.
-	if (projectionBuffer)
-	{
-		projectionBuffer->Release();
-		projectionBuffer = 0;
-	}
-
-	// Release the camera buffer.
-	if (cameraBuffer)
-	{
-		cameraBuffer->Release();
-		cameraBuffer = 0;
-	}
-
 	// Release the world buffer.
 	if (worldBuffer)
 	{
@@ -36,25 +30,38 @@ PBRShader::~PBRShader()
 		worldBuffer = 0;
 	}
 
-	// Release the light buffer.
-	if (lightBuffer)
+	// Release the material buffer.
+	if (materialBuffer)
 	{
-		lightBuffer->Release();
-		lightBuffer = 0;
+		materialBuffer->Release();
+		materialBuffer = 0;
 	}
 
-	// Release the dof plane buffer.
-	if (dofPlaneBuffer)
+	// Release the instancing buffers and views.
+	if (instanceSRV)
 	{
-		dofPlaneBuffer->Release();
-		dofPlaneBuffer = 0;
+		instanceSRV->Release();
+		instanceSRV = 0;
 	}
-
-	// Release the material buffer.
-	if (materialBuffer)
+	if (instanceBuffer)
 	{
-		materialBuffer->Release();
-		materialBuffer = 0;
+		instanceBuffer->Release();
+		instanceBuffer = 0;
+	}
+	if (instanceMaterialSRV)
+	{
+		instanceMaterialSRV->Release();
+		instanceMaterialSRV = 0;
+	}
+	if (instanceMaterialBuffer)
+	{
+		instanceMaterialBuffer->Release();
+		instanceMaterialBuffer = 0;
+	}
+	if (instanceOffsetBuffer)
+	{
+		instanceOffsetBuffer->Release();
+		instanceOffsetBuffer = 0;
 	}
 
 	// Release the sampler state.
@@ -73,151 +80,145 @@ void PBRShader::SetRenderer(D3D* renderer)
 	this->renderer = renderer;
 }
 
-void PBRShader::SetCurrentCamera(Camera* camera)
+void PBRShader::SetTextureManager(TextureManager* textureManager)
 {
-	this->currentCamera = camera;
+	this->textureManager = textureManager;
 }
 
-void PBRShader::SetLightAsCamera(WorldLight* light, int shadowMapIndex)
+void PBRShader::SetShaderParameters(const XMMATRIX& world, PBRMaterial* material, WorldLight* lights, int lightCount)
 {
-	this->lightCamera = light;
-	this->shadowMapIndex = shadowMapIndex;
-	usingLightCamera = true;
+	SetPassParameters(lights, lightCount);
+
+	// Per draw constants go in the constant ring, or their own buffers when it can not take them
+	D3D11ConstantRing* constantRing = renderer->getConstantRing();
+
+	// Upload world buffer data
+	WorldBufferData worldBufferData;
+	worldBufferData.worldMatrix = world;
+	worldBufferData.normalWorldMatrix = world;
+	constantRing->bind(StateCache::Stage::VERTEX_SHADER, 2, constantRing->upload(&worldBufferData, sizeof(WorldBufferData), worldBuffer)); // World buffer b2 in Vertex Shader
+
+	// Upload material buffer data
+	PBRMaterialData materialBufferData;
+	materialBufferData.anisotropy = material->anisotropy;
+	materialBufferData.diffuseColor = material->diffuseColor;
+	materialBufferData.specularColor = material->specularColor;
+	materialBufferData.specularity = material->specularity;
+	materialBufferData.smoothness = material->smoothness;
+	materialBufferData.textureFlags = material->textureFlags;
+	constantRing->bind(StateCache::Stage::PIXEL_SHADER, 0, constantRing->upload(&materialBufferData, sizeof(PBRMaterialData), materialBuffer)); // Material buffer b0 in Pixel Shader
+	// Set maps
+	SetMaps(material);
 }
 
-void PBRShader::SetCameraAsCamera()
+void PBRShader::SetInstanceParameters(const std::vector<InstanceBufferData>& instances, PBRMaterial** materials, int materialCount, WorldLight* lights, int lightCount)
 {
-	usingLightCamera = false;
+	SetPassParameters(lights, lightCount);
+	instanceBatches.clear();
+	if (instances.empty() || materialCount <= 0) return;
+
+	HRESULT result;
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	// Map instance buffer data
+	reserveStructuredBuffer(&instanceBuffer, &instanceSRV, instanceCapacity, (UINT)instances.size(), sizeof(InstanceBufferData));
+	result = renderer->getDeviceContext()->Map(instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	memcpy(mappedResource.pData, instances.data(), instances.size() * sizeof(InstanceBufferData));
+	renderer->getDeviceContext()->Unmap(instanceBuffer, 0);
+	renderer->getStateCache()->VSSetShaderResources(0, 1, &instanceSRV); // Instance buffer t0 in Vertex Shader
+
+	// Map instance material buffer data
+	reserveStructuredBuffer(&instanceMaterialBuffer, &instanceMaterialSRV, instanceMaterialCapacity, (UINT)materialCount, sizeof(PBRMaterialData));
+	result = renderer->getDeviceContext()->Map(instanceMaterialBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	PBRMaterialData* materialData = (PBRMaterialData*)mappedResource.pData;
+	for (int i = 0; i < materialCount; ++i) {
+		materialData[i].anisotropy = materials[i]->anisotropy;
+		materialData[i].diffuseColor = materials[i]->diffuseColor;
+		materialData[i].specularColor = materials[i]->specularColor;
+		materialData[i].specularity = materials[i]->specularity;
+		materialData[i].smoothness = materials[i]->smoothness;
+		materialData[i].textureFlags = materials[i]->textureFlags;
+	}
+	renderer->getDeviceContext()->Unmap(instanceMaterialBuffer, 0);
+	renderer->getStateCache()->PSSetShaderResources(20, 1, &instanceMaterialSRV); // Instance material buffer t20 in Pixel Shader
+
+	// Split into batches wherever the maps change
+	for (UINT i = 0; i < (UINT)instances.size(); ++i) {
+		PBRMaterial* material = materials[instances[i].materialIndex < (UINT)materialCount ? instances[i].materialIndex : 0];
+		if (!instanceBatches.empty()) {
+			InstanceBatch& batch = instanceBatches.back();
+			bool sameMaps = batch.material->colorMap == material->colorMap && batch.material->normalMap == material->normalMap
+				&& batch.material->AOMap == material->AOMap && batch.material->roughnessMap == material->roughnessMap;
+			if (sameMaps) {
+				batch.count++;
+				continue;
+			}
+		}
+		instanceBatches.push_back(InstanceBatch{ i, 1, material });
+	}
 }
 
-void PBRShader::SetLightAsCamera()
+void PBRShader::renderInstanced(ID3D11DeviceContext* deviceContext, int indexCount, int instanceCount, int startIndex)
 {
-	usingLightCamera = true;
+	setShaderStages(deviceContext, true);
+	D3D11StateCache* stateCache = renderer->getStateCache();
+	D3D11ConstantRing* constantRing = renderer->getConstantRing();
+
+	for (const InstanceBatch& batch : instanceBatches) {
+		// Instance ID restarts at 0 for every draw, so tell the vertex shader where this batch starts
+		UINT instanceOffset[4] = { batch.start, 0, 0, 0 };
+		constantRing->bind(StateCache::Stage::VERTEX_SHADER, 3, constantRing->upload(instanceOffset, sizeof(instanceOffset), instanceOffsetBuffer)); // Instance offset buffer b3 in Vertex Shader
+
+		SetMaps(batch.material);
+		stateCache->DrawIndexedInstanced(indexCount, batch.count, startIndex, 0, 0);
+		instancedDraws++;
+		instancesDrawn += batch.count;
+	}
 }
 
-void PBRShader::SetShaderParameters(const XMMATRIX& world, PBRMaterial* material, WorldLight* lights, int lightCount, XMFLOAT2 DOFKeepingRange)
+void PBRShader::GetInstancingStats(int& draws, int& instances)
 {
-	// Clear all PS Shader Resource Views, stops type mismatch errors
-	// 20 is the most, used by PBR Shader
-	for (int i = 0; i < 20; ++i) {
-		ID3D11ShaderResourceView* unbind = nullptr;
-		renderer->getDeviceContext()->PSSetShaderResources(i, 1, &unbind);
-	}
+	draws = instancedDraws;
+	instances = instancesDrawn;
+}
 
-	HRESULT result;
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
+void PBRShader::ResetInstancingStats()
+{
+	instancedDraws = 0;
+	instancesDrawn = 0;
+}
 
-	// Set projection buffer data
-	result = renderer->getDeviceContext()->Map(projectionBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	XMMATRIX* projectionMatrix;
-	projectionMatrix = (XMMATRIX*)mappedResource.pData;
-	// If using camera as our camera, use normal projection, otherwise use lights projection
-	if (!usingLightCamera) *projectionMatrix = renderer->getProjectionMatrix();
-	else *projectionMatrix = lightCamera->GetProjMatrix(0);
-	renderer->getDeviceContext()->Unmap(projectionBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
-
-	// Map camera buffer data
-	result = renderer->getDeviceContext()->Map(cameraBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	CameraBufferData* cameraBufferData;
-	cameraBufferData = (CameraBufferData*)mappedResource.pData;
-	// If using camera as our camera, use normal paramaters, otherwise use light camera's parameters
-	if (!usingLightCamera) {
-		cameraBufferData->cameraPosition = XMFLOAT4(currentCamera->getPosition().x, currentCamera->getPosition().y, currentCamera->getPosition().z, 1);
-		cameraBufferData->viewMatrix = currentCamera->getViewMatrix();
-	}
-	else {
-		cameraBufferData->cameraPosition = XMFLOAT4(lightCamera->getPosition().x, lightCamera->getPosition().y, lightCamera->getPosition().z, 1);
-		cameraBufferData->viewMatrix = lightCamera->GetViewMatrix(shadowMapIndex);
-	}
-	renderer->getDeviceContext()->Unmap(cameraBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(1, 1, &cameraBuffer); // Camera buffer b1 in Vertex Shader
-
-	// Map world buffer data
-	result = renderer->getDeviceContext()->Map(worldBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	WorldBufferData* worldBufferData;
-	worldBufferData = (WorldBufferData*)mappedResource.pData;
-	worldBufferData->worldMatrix = world;
-	worldBufferData->normalWorldMatrix = world;
-	renderer->getDeviceContext()->Unmap(worldBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(2, 1, &worldBuffer); // Camera buffer b2 in Vertex Shader
-
-	// Map material buffer data
-	result = renderer->getDeviceContext()->Map(materialBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	PBRMaterialData* materialBufferData;
-	materialBufferData = (PBRMaterialData*)mappedResource.pData;
-	materialBufferData->anisotropy = material->anisotropy;
-	materialBufferData->diffuseColor = material->diffuseColor;
-	materialBufferData->specularColor = material->specularColor;
-	materialBufferData->specularity = material->specularity;
-	materialBufferData->smoothness = material->smoothness;
-	materialBufferData->textureFlags = material->textureFlags;
-	renderer->getDeviceContext()->Unmap(materialBuffer, 0);
-	renderer->getDeviceContext()->PSSetConstantBuffers(0, 1, &materialBuffer); // Material buffer b0 in Pixel Shader
-	// Set maps
-	renderer->getDeviceContext()->PSSetShaderResources(0, 1, &(material->colorMap));
-	renderer->getDeviceContext()->PSSetShaderResources(1, 1, &(material->normalMap));
-	renderer->getDeviceContext()->PSSetShaderResources(2, 1, &(material->AOMap));
-	renderer->getDeviceContext()->PSSetShaderResources(3, 1, &(material->roughnessMap));
-
-	// Map light buffer data
-	result = renderer->getDeviceContext()->Map(lightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	LightBufferData* lightBufferData;
-	lightBufferData = (LightBufferData*)mappedResource.pData;
+void PBRShader::SetMaps(PBRMaterial* material)
+{
+	ID3D11ShaderResourceView* maps[4] = {
+		textureManager->getTexture(material->colorMap), textureManager->getTexture(material->normalMap),
+		textureManager->getTexture(material->AOMap), textureManager->getTexture(material->roughnessMap)
+	};
+	renderer->getStateCache()->PSSetShaderResources(0, 4, maps);
+}
+
+void PBRShader::SetPassParameters(WorldLight* lights, int lightCount)
+{
+	// Clear all PS Shader Resource Views, stops type mismatch errors
+	// 20 is the most, used by PBR Shader. Slots set again before the draw cost nothing, the cache only issues real changes.
+	ID3D11ShaderResourceView* unbind[20] = {};
+	renderer->getStateCache()->PSSetShaderResources(0, 20, unbind);
+
+	// Projection, camera, lights and DOF range are bound by FrameConstants, only the shadow maps are bound here
 	for (int i = 0; i < lightCount; i++) {
-		lightBufferData->lights[i].ambientColor = lights[i].getAmbientColour();
-		lightBufferData->lights[i].diffuseColor = lights[i].getDiffuseColour();
-		lightBufferData->lights[i].position = XMFLOAT3A(lights[i].getPosition().x, lights[i].getPosition().y, lights[i].getPosition().z);
-		lightBufferData->lights[i].direction = lights[i].getDirection();
-		lightBufferData->lights[i].lightType = lights[i].GetLightType(); 
-		lightBufferData->lights[i].innerSpotlightCutoffAngle = lights[i].GetInnerSpotlightCutoffAngle(); 
-		lightBufferData->lights[i].outerSpotlightCutoffAngle = lights[i].GetOuterSpotlightCutoffAngle(); 
-		lightBufferData->lights[i].lightViewMatrix[0] = lights[i].GetViewMatrix(0);
-		
-		if (lightBufferData->lights[i].lightType != 0) {
-			for (int f = 1; f < 6; ++f) {
-				lightBufferData->lights[i].lightViewMatrix[f] = lights[i].GetViewMatrix(f);
-			}
-			ID3D11ShaderResourceView* tempAddress = lights[i].GetTCubeShadowMap()->getDepthMapSRV();
-			renderer->getDeviceContext()->PSSetShaderResources(4 + i, 1, &tempAddress);
+		// Directional lights have their own cascades, point and spot lights share the atlas
+		if (lights[i].GetLightType() == 0) {
+			ID3D11ShaderResourceView* tempAddress = lights[i].GetShadowMap()->getDepthMapSRV();
+			renderer->getStateCache()->PSSetShaderResources(12 + i, 1, &tempAddress);
 		}
-		else{
-			ID3D11ShaderResourceView* tempAddress = lights[i].GetDirectionalShadowMap()->getDepthMapSRV();
-			renderer->getDeviceContext()->PSSetShaderResources(12 + i, 1, &tempAddress);
+		else {
+			ID3D11ShaderResourceView* tempAddress = lights[i].GetShadowAtlas()->getDepthMapSRV();
+			renderer->getStateCache()->PSSetShaderResources(4, 1, &tempAddress);
 		}
-		
-		lightBufferData->lights[i].lightProjectionMatrix = lights[i].GetProjMatrix(0);
-		lightBufferData->lights[i].constantAttenuation = lights[i].GetConstantAttenuation();
-		lightBufferData->lights[i].linearAttenuation = lights[i].GetLinearAttenuation();
-		lightBufferData->lights[i].quadraticAttenuation = lights[i].GetQuadraticAttenuation();
-		lightBufferData->lights[i].lightPower = lights[i].GetLightPower();
-		
 	}
-	for (int i = lightCount; i < 8; i++) {
-		lightBufferData->lights[i].ambientColor = XMFLOAT4(0, 0, 0, 0);
-		lightBufferData->lights[i].diffuseColor = XMFLOAT4(0, 0, 0, 0);
-		lightBufferData->lights[i].position = XMFLOAT3A(0, 0, 0);
-		lightBufferData->lights[i].direction = XMFLOAT3(0, 0, 0);
-		lightBufferData->lights[i].lightType = 0;
-		lightBufferData->lights[i].constantAttenuation = 0;
-		lightBufferData->lights[i].linearAttenuation = 0;
-		lightBufferData->lights[i].quadraticAttenuation = 0;
-		lightBufferData->lights[i].lightPower = 0;
-	}
-	lightBufferData->lightCount = lightCount;
-	renderer->getDeviceContext()->Unmap(lightBuffer, 0);
-	renderer->getDeviceContext()->PSSetConstantBuffers(1, 1, &lightBuffer); // Material buffer b1 in Pixel Shader
-
-	// Setup DOF Plane Buffer Data
-	result = renderer->getDeviceContext()->Map(dofPlaneBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	XMFLOAT2* dofPlaneBufferContents;
-	dofPlaneBufferContents = (XMFLOAT2*)mappedResource.pData;
-	*dofPlaneBufferContents = DOFKeepingRange;
-	renderer->getDeviceContext()->Unmap(dofPlaneBuffer, 0);
-	renderer->getDeviceContext()->PSSetConstantBuffers(2, 1, &dofPlaneBuffer); // Height Map buffer b1 in Pixel Shader
 
 	// Setup samplers
-	renderer->getDeviceContext()->PSSetSamplers(1, 1, &shadowSampler);
+	renderer->getStateCache()->PSSetSamplers(1, 1, &shadowSampler);
 }
 
 void PBRShader::DisplayMaterialUI(std::string name, PBRMaterial* material)
@@ -270,37 +271,21 @@ void PBRShader::DisplayMaterialUI(std::string name, PBRMaterial* material)
 
 void PBRShader::initShader(const wchar_t* vs, const wchar_t* ps)
 {
-	D3D11_BUFFER_DESC projectionBufferDesc;
-	D3D11_BUFFER_DESC cameraBufferDesc;
 	D3D11_BUFFER_DESC worldBufferDesc;
-	
-	D3D11_BUFFER_DESC lightBufferDesc;
 	D3D11_BUFFER_DESC materialBufferDesc;
 	D3D11_SAMPLER_DESC samplerDesc;
 	ZeroMemory(&samplerDesc, sizeof(D3D11_SAMPLER_DESC));
 
 	// Load (+ compile) shader files
 	loadVertexShader(vs);
+	loadPackedVertexShader(L"PBRPacked_vs.cso");
+	loadInstancedVertexShader(L"PBRInstanced_vs.cso", VertexPacking::Format::FULL);
+	loadInstancedVertexShader(L"PBRPackedInstanced_vs.cso", VertexPacking::Format::PACKED);
 	loadPixelShader(ps);
+	loadInstancedPixelShader(L"PBRInstanced_ps.cso");
 
 	// Setup all buffers
 
-	projectionBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	projectionBufferDesc.ByteWidth = sizeof(XMMATRIX);
-	projectionBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	projectionBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	projectionBufferDesc.MiscFlags = 0;
-	projectionBufferDesc.StructureByteStride = 0;
-	device->CreateBuffer(&projectionBufferDesc, NULL, &projectionBuffer);
-
-	cameraBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	cameraBufferDesc.ByteWidth = sizeof(CameraBufferData);
-	cameraBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	cameraBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	cameraBufferDesc.MiscFlags = 0;
-	cameraBufferDesc.StructureByteStride = 0;
-	device->CreateBuffer(&cameraBufferDesc, NULL, &cameraBuffer);
-
 	worldBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
 	worldBufferDesc.ByteWidth = sizeof(WorldBufferData);
 	worldBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
@@ -309,14 +294,6 @@ void PBRShader::initShader(const wchar_t* vs, const wchar_t* ps)
 	worldBufferDesc.StructureByteStride = 0;
 	device->CreateBuffer(&worldBufferDesc, NULL, &worldBuffer);
 
-	lightBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	lightBufferDesc.ByteWidth = sizeof(LightBufferData);
-	lightBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	lightBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	lightBufferDesc.MiscFlags = 0;
-	lightBufferDesc.StructureByteStride = 0;
-	device->CreateBuffer(&lightBufferDesc, NULL, &lightBuffer);
-
 	materialBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
 	materialBufferDesc.ByteWidth = sizeof(PBRMaterialData);
 	materialBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
@@ -326,7 +303,7 @@ void PBRShader::initShader(const wchar_t* vs, const wchar_t* ps)
 	device->CreateBuffer(&materialBufferDesc, NULL, &materialBuffer);
 
 	materialBufferDesc.ByteWidth = sizeof(XMFLOAT4);
-	device->CreateBuffer(&materialBufferDesc, NULL, &dofPlaneBuffer);
+	device->CreateBuffer(&materialBufferDesc, NULL, &instanceOffsetBuffer);
 
 	// Sampler for shadow map sampling
 	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
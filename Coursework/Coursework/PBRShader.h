@@ -1,4 +1,5 @@
 #pragma once
+#include <vector>
 #include "DXF.h"
 #include "WorldLight.h"
 #include "CommonStructs.h"
@@ -28,10 +29,11 @@ public:
 		float anisotropy; // Anisotropy along tangent, 0 is isotropic specular, 1 is anisotropic specular. 
 		int textureFlags; // Flags for which textures are set. 
 
-		ID3D11ShaderResourceView* colorMap; // Diffuse colour map 
-		ID3D11ShaderResourceView* normalMap; // Normal map
-		ID3D11ShaderResourceView* AOMap; // Ambient occlusion map
-		ID3D11ShaderResourceView* roughnessMap; // Roughness, inverse smoothness map
+		// Maps are texture manager handles, resolved once at setup so drawing never looks a name up
+		TextureManager::TextureHandle colorMap; // Diffuse colour map 
+		TextureManager::TextureHandle normalMap; // Normal map
+		TextureManager::TextureHandle AOMap; // Ambient occlusion map
+		TextureManager::TextureHandle roughnessMap; // Roughness, inverse smoothness map
 	};
 
 	// Pure data PBR material struct
@@ -47,21 +49,40 @@ public:
 
 
 	void SetRenderer(D3D* renderer); // Set render after shader init, used to reduce parameter passing.
-	void SetCurrentCamera(Camera* camera);
-	void SetLightAsCamera(WorldLight* light, int shadowMapIndex = 0);
-
-	void SetCameraAsCamera();
-	void SetLightAsCamera();
+	void SetTextureManager(TextureManager* textureManager); // Resolves the material map handles
 
 	/// <summary>
 	/// Setup data for shader
+	/// Projection, camera, lights and DOF range come from FrameConstants, only the world matrix and material are uploaded per draw
 	/// </summary>
 	/// <param name="world">World matrix of object</param>
 	/// <param name="material">Material</param>
 	/// <param name="lights">Array of lights</param>
 	/// <param name="lightCount">Number of active lights in that array</param>
-	/// <param name="DOFKeepingRange">DOF Pass Data, What range are we in, defaults to entire scene</param>
-	void SetShaderParameters(const XMMATRIX& world, PBRMaterial* material, WorldLight* lights, int lightCount, XMFLOAT2 DOFKeepingRange = XMFLOAT2(0, 1));
+	void SetShaderParameters(const XMMATRIX& world, PBRMaterial* material, WorldLight* lights, int lightCount);
+
+	/// <summary>
+	/// Setup data for an instanced render, see WorldObject::RenderInstanced
+	/// Every instance's world matrix and material index, and the materials they index, are uploaded once for the pass.
+	/// Maps can not be picked per instance, so instances are drawn in batches sharing the same maps, keep those next to each other.
+	/// </summary>
+	/// <param name="instances">Instances to draw, material indices index into materials</param>
+	/// <param name="materials">Array of material pointers</param>
+	/// <param name="materialCount">Number of materials in that array</param>
+	/// <param name="lights">Array of lights</param>
+	/// <param name="lightCount">Number of active lights in that array</param>
+	void SetInstanceParameters(const std::vector<InstanceBufferData>& instances, PBRMaterial** materials, int materialCount, WorldLight* lights, int lightCount);
+
+	/// <summary>
+	/// Draws the instances from the last SetInstanceParameters, one draw for each batch of instances sharing maps
+	/// </summary>
+	void renderInstanced(ID3D11DeviceContext* deviceContext, int indexCount, int instanceCount, int startIndex = 0) override;
+
+	/// <summary>
+	/// Instanced draw counters, count up until reset
+	/// </summary>
+	void GetInstancingStats(int& draws, int& instances);
+	void ResetInstancingStats();
 
 	/// <summary>
 	/// Display ImGUI UI for the material passed in
@@ -72,30 +93,39 @@ public:
 
 private:
 	void initShader(const wchar_t* vs, const wchar_t* ps);
+	void SetPassParameters(WorldLight* lights, int lightCount); // Shadow maps shared by every draw in a pass
+	void SetMaps(PBRMaterial* material);
+
+	// Instances drawn together, they share the maps of material
+	struct InstanceBatch {
+		UINT start;
+		UINT count;
+		PBRMaterial* material;
+	};
 
 	// Vertex Shader Buffers
-	ID3D11Buffer* projectionBuffer;
-	ID3D11Buffer* cameraBuffer;
 	ID3D11Buffer* worldBuffer;
-	
 
 	// Pixel Shader Buffers
-	ID3D11Buffer* lightBuffer;
 	ID3D11Buffer* materialBuffer;
-	ID3D11Buffer* dofPlaneBuffer;
+
+	// Instancing buffers, the instances are read in the vertex shader and their materials in the pixel shader
+	ID3D11Buffer* instanceBuffer;
+	ID3D11ShaderResourceView* instanceSRV;
+	UINT instanceCapacity;
+	ID3D11Buffer* instanceMaterialBuffer;
+	ID3D11ShaderResourceView* instanceMaterialSRV;
+	UINT instanceMaterialCapacity;
+	ID3D11Buffer* instanceOffsetBuffer;
+	std::vector<InstanceBatch> instanceBatches;
+	int instancedDraws;
+	int instancesDrawn;
 	ID3D11SamplerState* sampleState;
 	ID3D11SamplerState* shadowSampler;
 
-	// Tie shader directly to camera, reduces number of parameters needing passed around. 
-	Camera* currentCamera;
-
-	// Have a light we can use as the current camera too.
-	WorldLight* lightCamera;
-	int shadowMapIndex;
-	bool usingLightCamera = true;
-
 	// Renderer pointer, reduces number of parameters needing passed around. 
 	D3D* renderer;
+	TextureManager* textureManager;
 	ID3D11Device* device;
 };
 
@@ -9,13 +9,35 @@ Texture2D AOMap : register(t2);
 Texture2D roughnessMap : register(t3);
 
 // Shadow Map SRVS
-TextureCube shadowMaps[8] : register(t4);
-Texture2D directionalShadowMaps[8] : register(t12);
+Texture2D shadowAtlas : register(t4);
+Texture2DArray projectedShadowMaps[8] : register(t12);
 
 // Texture and shadow samplers
 SamplerState textureSampler : register(s0);
 SamplerState shadowSampler : register(s1);
 
+#ifdef INSTANCED
+// Materials of every instance in the draw, indexed by the material index from the vertex shader, see PBRMaterialData
+struct MaterialData
+{
+    float4 diffuseColor;
+    float4 specularColor;
+    float specularity;
+    float smoothness;
+    float anisotropy;
+    int textureFlags;
+};
+
+StructuredBuffer<MaterialData> instanceMaterials : register(t20);
+
+// Filled from the instance's material at the start of main
+static float4 diffuseColor;
+static float4 specularColor;
+static float specularity;
+static float smoothness;
+static float anisotropy;
+static int textureFlags;
+#else
 // Material buffer
 cbuffer MaterialBuffer : register(b0)
 {
@@ -26,6 +48,7 @@ cbuffer MaterialBuffer : register(b0)
     float anisotropy;
     int textureFlags;
 };
+#endif
 
 // Since ENUMS are not supported, use static const ints
 static const int TEX_FLAG_COLOR = 0x1;
@@ -36,10 +59,24 @@ static const int TEX_FLAG_ROUGHNESS = 0x8;
 // Light buffer, see LightData struct in Common.hlsli
 cbuffer LightBuffer : register(b1)
 {
-    LightData lights[8]; // Support 8 lights max
+    LightData lights[8]; // Lights with shadow maps, 8 max, point and spot lights are lit from the clusters
     int lightCount; // LightData ends on a block of 16 fully used bytes so this wont be packed
 };
 
+// Clustered point and spot lights, from ClusteredLights
+cbuffer ClusterBuffer : register(b3)
+{
+    ClusterGridData clusterGrid;
+};
+StructuredBuffer<ClusterLightData> clusterLights : register(t24);
+StructuredBuffer<uint2> clusterRanges : register(t25); // Offset into the light indices and count, for each cluster
+StructuredBuffer<uint> clusterLightIndices : register(t26);
+// The clustered lights reaching the object being drawn, see ClusteredLights::BindObjectLights
+cbuffer ObjectLightBuffer : register(b4)
+{
+    ObjectLightData objectLights;
+};
+
 // DOF discarding
 cbuffer DepthOfFieldDiscardRange : register(b2)
 {
@@ -55,6 +92,9 @@ struct InputType
     float3 bitangent : BITANGENT;
     float3 worldPosition : POSITION;
     float3 cameraVector : CAMVECTOR;
+#ifdef INSTANCED
+    nointerpolation uint materialIndex : MATERIAL;
+#endif
 };
 
 
@@ -119,18 +159,68 @@ float3 CalculateNormalFromNormalMap(InputType pixelData) {
     float3x3 TBN = float3x3(pixelData.tangent, pixelData.bitangent, pixelData.normal);
 
     // Sample normal from normal map
-    float3 mapNormal = normalMap.Sample(textureSampler, pixelData.tex);
-    // Remap to -1 -> 1 from 0 -> 1
-    mapNormal = mapNormal * 2 - 1;
+    // Only x and y are read, baked normal maps are BC5 which stores two channels
+    float2 mapXY = normalMap.Sample(textureSampler, pixelData.tex).xy;
+    // Remap to -1 -> 1 from 0 -> 1, then rebuild z from the unit length
+    mapXY = mapXY * 2 - 1;
+    float3 mapNormal = float3(mapXY, sqrt(saturate(1 - dot(mapXY, mapXY))));
 
     // Return mapNormal * TBN
     return mul(mapNormal, TBN);
 }
 
+// Lighting from one light, its ambient and diffuse are returned and its specular added on
+float4 calculateLight(ClusterLightData light, bool inShadow, InputType input, float ambientModulate, float smoothnessTextureAccounted, inout float4 specularLightColor)
+{
+    // Get distance for attenuation
+    float distanceToLight = length(light.position - input.worldPosition);
+
+    // Get light vector, for point and spotlights its the lights direction to the light position, for directional lights its just light direction
+    float3 lightVector = normalize(light.position - input.worldPosition);
+    if (light.lightType == 0)
+        lightVector = normalize(-light.direction);
+    
+    // Calculate the spotlight factor
+    float spotlightFactor = 1;
+    if (light.lightType == 2)
+        spotlightFactor = calculateSpotlightPower(-lightVector, normalize(light.direction), light.innerSpotlightCutoffAngle, light.outerSpotlightCutoffAngle);
+    
+    // Calculate ambient, modulate with AO Map factor (McReynolds and Blythe, 2005)
+    float4 localLightColor = light.ambient * light.lightPower * ambientModulate;
+    
+    // If we are not in shadow do specular and diffuse
+    if (!inShadow)
+    {
+        // Add diffuse light, modulate with AO Map factor (McReynolds and Blythe, 2005)
+        localLightColor += calculateLighting(lightVector, input.normal, light.diffuse, input.bitangent) * light.lightPower * spotlightFactor * ambientModulate;
+        
+        // Calculate specular light and add onto the specular total
+        // Also attenuate it
+        specularLightColor += calculateSpecularPower(lightVector, normalize(input.normal), normalize(input.cameraVector), specularity, input.tangent, anisotropy) * smoothnessTextureAccounted * light.lightPower * light.diffuse * spotlightFactor
+        / (light.constantAttenuation + light.linearAttenuation * distanceToLight + light.quadraticAttenuation * distanceToLight * distanceToLight);
+
+    }
+    // Attenuate light (Add attenuation variables to light buffer input)
+    // Since ambient is being attenuated we must still attenuate in shadow. 
+    localLightColor *= 1 / (light.constantAttenuation + light.linearAttenuation * distanceToLight + light.quadraticAttenuation * distanceToLight * distanceToLight);
+    
+    return localLightColor;
+}
+
 float4 main(InputType input) : SV_TARGET
 {
     DiscardForDOF(minMaxDepth, input.position.z);
     
+#ifdef INSTANCED
+    MaterialData material = instanceMaterials[input.materialIndex];
+    diffuseColor = material.diffuseColor;
+    specularColor = material.specularColor;
+    specularity = material.specularity;
+    smoothness = material.smoothness;
+    anisotropy = material.anisotropy;
+    textureFlags = material.textureFlags;
+#endif
+
     // Sample the texture and set up base light color (black no lights applied) Specular seperate as applied on top of the texture
     float4 ambientAndDiffuseLightColor = float4(0, 0, 0, 1);
     float4 specularLightColor = float4(0, 0, 0, 1);
@@ -163,42 +253,27 @@ float4 main(InputType input) : SV_TARGET
         smoothnessTextureAccounted = 1 - roughnessMap.Sample(textureSampler, input.tex).r;
     }
 
-    // For each light calculate lighting
-    for (int i = 0; i < lightCount; i++) {
-        // Get distance for attenuation
-        float distanceToLight = length(lights[i].position - input.worldPosition);
+    // Directional lights reach every pixel, from the light buffer with their cascades
+    for (int i = 0; i < lightCount; i++)
+    {
+        if (lights[i].lightType != 0)
+            continue;
+        bool inShadow = IsInShadow(lights[i], input.worldPosition, -normalize(lights[i].position - input.worldPosition), i, projectedShadowMaps[i], shadowAtlas, shadowSampler);
+        ambientAndDiffuseLightColor += calculateLight(ToClusterLight(lights[i], i), inShadow, input, ambientModulate, smoothnessTextureAccounted, specularLightColor);
+    }
 
-        // Get light vector, for point and spotlights its the lights direction to the light position, for directional lights its just light direction
-        float3 lightVector = normalize(lights[i].position - input.worldPosition);
-        if (lights[i].lightType == 0)
-            lightVector = normalize(-lights[i].direction);
-        
-        // Calculate the spotlight factor
-        float spotlightFactor = 1;
-        if (lights[i].lightType == 2)
-            spotlightFactor = calculateSpotlightPower(-lightVector, normalize(lights[i].direction), lights[i].innerSpotlightCutoffAngle, lights[i].outerSpotlightCutoffAngle);
-        
-        // Calculate ambient, modulate with AO Map factor (McReynolds and Blythe, 2005)
-        float4 localLightColor = lights[i].ambient * lights[i].lightPower * ambientModulate;
-        
-        // If we are not in shadow do specular and diffuse
-        if (!IsInShadow(lights[i], input.worldPosition, -normalize(lights[i].position - input.worldPosition), i, directionalShadowMaps[i], shadowMaps[i], shadowSampler))
-        {
-            // Add diffuse light, modulate with AO Map factor (McReynolds and Blythe, 2005)
-            localLightColor += calculateLighting(lightVector, input.normal, lights[i].diffuse, input.bitangent) * lights[i].lightPower * spotlightFactor * ambientModulate;
-            
-            // Calculate specular light and add onto the specular total
-            // Also attenuate it
-            specularLightColor += calculateSpecularPower(lightVector, normalize(input.normal), normalize(input.cameraVector), specularity, input.tangent, anisotropy) * smoothnessTextureAccounted * lights[i].lightPower * lights[i].diffuse * spotlightFactor
-            / (lights[i].constantAttenuation + lights[i].linearAttenuation * distanceToLight + lights[i].quadraticAttenuation * distanceToLight * distanceToLight);
-
-        }
-        // Attenuate light (Add attenuation variables to light buffer input)
-        // Since ambient is being attenuated we must still attenuate in shadow. 
-        localLightColor *= 1 / (lights[i].constantAttenuation + lights[i].linearAttenuation * distanceToLight + lights[i].quadraticAttenuation * distanceToLight * distanceToLight);
-        
-        // Add this lights complete color to the overall light color for this fragment/pixel
-        ambientAndDiffuseLightColor += localLightColor;
+    // Point and spot lights, only those reaching this pixel's cluster, or the object when its list is shorter, their shadows are all in the atlas
+    uint2 clusterRange = clusterRanges[GetClusterIndex(clusterGrid, input.position)];
+    bool useObjectLights = UseObjectLights(objectLights, clusterRange);
+    uint pixelLightCount = useObjectLights ? objectLights.lightCount : clusterRange.y;
+    for (uint c = 0; c < pixelLightCount; c++)
+    {
+        uint lightIndex = useObjectLights ? objectLights.lightIndices[c >> 2][c & 3] : clusterLightIndices[clusterRange.x + c];
+        ClusterLightData light = clusterLights[lightIndex];
+        bool inShadow = false;
+        if (light.shadowIndex >= 0)
+            inShadow = IsInShadow(lights[light.shadowIndex], input.worldPosition, -normalize(light.position - input.worldPosition), light.shadowIndex, projectedShadowMaps[0], shadowAtlas, shadowSampler);
+        ambientAndDiffuseLightColor += calculateLight(light, inShadow, input, ambientModulate, smoothnessTextureAccounted, specularLightColor);
     }
     // Debug output normals
     //return float4((input.normal / 2) + 0.5, 1);
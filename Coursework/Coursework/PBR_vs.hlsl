@@ -14,11 +14,31 @@ cbuffer CameraBuffer : register(b1)
     float3 cameraPosition;
 };
 
+#ifdef INSTANCED
+// Instanced draws read their world matrix and material index from the instance buffer, see InstanceBufferData.
+// One draw can cover part of the buffer, SV_InstanceID counts from 0 so the start is passed in.
+struct InstanceData
+{
+    matrix worldMatrix;
+    uint materialIndex;
+    uint3 padding;
+};
+
+StructuredBuffer<InstanceData> instances : register(t0);
+
+cbuffer InstanceOffsetBuffer : register(b3)
+{
+    uint instanceOffset;
+};
+
+static matrix worldMatrix;
+#else
 cbuffer WorldBuffer : register(b2)
 {
     matrix worldMatrix;
     matrix normalWorldMatrix;
 };
+#endif
 
 struct InputType
 {
@@ -27,6 +47,9 @@ struct InputType
 	float3 normal : NORMAL;
 	float3 tangent : TANGENT;
 	float3 bitangent : BITANGENT;
+#ifdef INSTANCED
+	uint instanceID : SV_InstanceID;
+#endif
 };
 
 struct OutputType
@@ -38,12 +61,21 @@ struct OutputType
 	float3 bitangent : BITANGENT;
 	float3 worldPosition : POSITION;
     float3 cameraVector : CAMVECTOR;
+#ifdef INSTANCED
+	nointerpolation uint materialIndex : MATERIAL;
+#endif
 };
 
 OutputType main(InputType input)
 {
 	OutputType output;
 
+#ifdef INSTANCED
+	InstanceData instance = instances[instanceOffset + input.instanceID];
+	worldMatrix = instance.worldMatrix;
+	output.materialIndex = instance.materialIndex;
+#endif
+
 	// Calculate the position of the vertex against the world, view, and projection matrices.
 	output.position = mul(worldMatrix, input.position);
 	output.position = mul(viewMatrix, output.position);
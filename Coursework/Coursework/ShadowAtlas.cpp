@@ -0,0 +1,82 @@
+#include "ShadowAtlas.h"
+
+ShadowAtlas::ShadowAtlas(D3D* renderer) : ShadowMap(renderer->getDevice(), ATLAS_SIZE, ATLAS_SIZE), allocator(ATLAS_SIZE, MIN_VIEW_SIZE)
+{
+	this->renderer = renderer;
+	clearShader = nullptr;
+
+	// Load the clear vertex shader, it reads no vertices, so it needs no layout
+	ID3DBlob* clearShaderBuffer = nullptr;
+	if (SUCCEEDED(D3DReadFileToBlob(L"ShadowAtlasClear_vs.cso", &clearShaderBuffer))) {
+		renderer->getDevice()->CreateVertexShader(clearShaderBuffer->GetBufferPointer(), clearShaderBuffer->GetBufferSize(), NULL, &clearShader);
+		clearShaderBuffer->Release();
+	}
+
+	// Depth test always passes, so the far depth is written over whatever the region held
+	D3D11_DEPTH_STENCIL_DESC depthStencilDesc = {};
+	depthStencilDesc.DepthEnable = true;
+	depthStencilDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	depthStencilDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	depthStencilDesc.StencilEnable = false;
+	renderer->getDevice()->CreateDepthStencilState(&depthStencilDesc, &clearDepthState);
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+	// Release the clear shader and state.
+	if (clearShader)
+	{
+		clearShader->Release();
+		clearShader = 0;
+	}
+	if (clearDepthState)
+	{
+		clearDepthState->Release();
+		clearDepthState = 0;
+	}
+}
+
+void ShadowAtlas::BindDsvAndSetNullRenderTarget(ID3D11DeviceContext* dc, const ShadowAtlasAllocator::Region& region, bool clear)
+{
+	// Only the region is drawn into
+	D3D11_VIEWPORT regionViewport = viewport;
+	regionViewport.TopLeftX = (float)region.x;
+	regionViewport.TopLeftY = (float)region.y;
+	regionViewport.Width = (float)region.size;
+	regionViewport.Height = (float)region.size;
+	dc->RSSetViewports(1, &regionViewport);
+
+	// Set null render target because we are only going to draw to depth buffer.
+	// Setting a null render target will disable color writes.
+	D3D11StateCache* stateCache = D3D11StateCache::get(dc);
+	stateCache->OMSetRenderTargets(1, renderTargets, mDepthMapDSV);
+	if (!clear || !clearShader) return;
+
+	// A triangle over the viewport at the far depth, the next draw binds its own shaders, layout and topology.
+	// Wireframe would only clear its edges, so it is filled whatever the raster state was.
+	bool wireframe = renderer->getWireframeState();
+	renderer->setWireframeMode(false);
+	stateCache->IASetInputLayout(nullptr);
+	stateCache->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	stateCache->VSSetShader(clearShader);
+	stateCache->HSSetShader(nullptr);
+	stateCache->DSSetShader(nullptr);
+	stateCache->GSSetShader(nullptr);
+	stateCache->PSSetShader(nullptr);
+	stateCache->OMSetDepthStencilState(clearDepthState, 0);
+	stateCache->Draw(3, 0);
+	renderer->setZBuffer(true);
+	renderer->setWireframeMode(wireframe);
+}
+
+XMFLOAT4 ShadowAtlas::GetRegionTransform(const ShadowAtlasAllocator::Region& region)
+{
+	// A view with no region has no scale, the shaders treat it as unshadowed
+	if (region.size == 0) return XMFLOAT4(0, 0, 0, 0);
+	return XMFLOAT4((float)region.x / ATLAS_SIZE, (float)region.y / ATLAS_SIZE, (float)region.size / ATLAS_SIZE, 0.5f / region.size);
+}
+
+ShadowAtlasAllocator& ShadowAtlas::GetAllocator()
+{
+	return allocator;
+}
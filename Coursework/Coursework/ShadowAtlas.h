@@ -0,0 +1,42 @@
+#pragma once
+#include "DXF.h"
+
+/// <summary>
+/// Adapted shadow map class for one depth atlas shared by every point and spot light's shadow views.
+/// ShadowAtlasAllocator places the views, each is drawn into its region with the viewport, and shaders sample it through the region's scale and offset.
+/// Depth can only be cleared a whole texture at a time, so a region is cleared by drawing a triangle over it at the far depth.
+/// </summary>
+class ShadowAtlas : public ShadowMap
+{
+public:
+	// Width and height of the atlas, and the smallest and largest a view in it can be
+	static const int ATLAS_SIZE = 4096;
+	static const int MIN_VIEW_SIZE = 64;
+	static const int MAX_VIEW_SIZE = 1024;
+
+	ShadowAtlas(D3D* renderer);
+	~ShadowAtlas();
+
+	/// <summary>
+	/// Binds the atlas with the viewport over one view's region
+	/// </summary>
+	/// <param name="region">The view's region</param>
+	/// <param name="clear">Clears the region to the far depth, false to draw over the depth already in it</param>
+	void BindDsvAndSetNullRenderTarget(ID3D11DeviceContext* dc, const ShadowAtlasAllocator::Region& region, bool clear = true);
+
+	/// <summary>
+	/// Scale and offset from a view's projected texture coordinates to the atlas's, for the shaders
+	/// </summary>
+	/// <returns>Offset in x and y, scale in z, and half a texel of the view in w, which samples are kept inside</returns>
+	static XMFLOAT4 GetRegionTransform(const ShadowAtlasAllocator::Region& region);
+
+	ShadowAtlasAllocator& GetAllocator(); // Places the views in the atlas
+private:
+	ShadowAtlasAllocator allocator;
+
+	// Clears a region, no vertex buffer or pixel shader, depth always written
+	ID3D11VertexShader* clearShader;
+	ID3D11DepthStencilState* clearDepthState;
+
+	D3D* renderer;
+};
@@ -0,0 +1,10 @@
+// Shadow Atlas Clear Vertex Shader
+// Draws one triangle over the whole viewport at the far depth, reading no vertices, see ShadowAtlas.
+// The viewport is a view's region of the shadow atlas, so only that view is cleared. There is no pixel shader.
+
+float4 main(uint vertexID : SV_VertexID) : SV_POSITION
+{
+    // Vertices at (-1, 1), (-1, -3) and (3, 1) cover the viewport, counter-clockwise so the default back face culling keeps it
+    float2 corner = float2(vertexID & 2, (vertexID << 1) & 2);
+    return float4(corner.x * 2 - 1, 1 - corner.y * 2, 1, 1);
+}
@@ -0,0 +1,5 @@
+// Shadow Depth Instanced Vertex Shader
+// The shadow depth vertex shader with the world matrix read per instance, for WorldObject::RenderInstancedDepth.
+
+#define INSTANCED
+#include "ShadowDepth_vs.hlsl"
@@ -3,19 +3,34 @@
 ShadowDepthShader::ShadowDepthShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
 {
 	this->device = device;
-	initShader(L"ShadowDepth_vs.cso", L"ShadowDepth_ps.cso");
+	instanceBuffer = nullptr;
+	instanceSRV = nullptr;
+	instanceCapacity = 0;
+	initShader(L"ShadowDepth_vs.cso", L"ShadowDepthInstanced_vs.cso");
 }
 
 ShadowDepthShader::~ShadowDepthShader()
 {
-	// Release the matrix constant buffer.
-	if (matrixBuffer)
+	// Release the world buffer.
+	if (worldBuffer)
 	{
-		matrixBuffer->Release();
-		matrixBuffer = 0;
+		worldBuffer->Release();
+		worldBuffer = 0;
 	}
 
-	// Release the layout.
+	// Release the instancing buffer and view.
+	if (instanceSRV)
+	{
+		instanceSRV->Release();
+		instanceSRV = 0;
+	}
+	if (instanceBuffer)
+	{
+		instanceBuffer->Release();
+		instanceBuffer = 0;
+	}
+
+	// Release the layouts.
 	if (layout)
 	{
 		layout->Release();
@@ -31,36 +46,49 @@ void ShadowDepthShader::SetRenderer(D3D* renderer)
 	this->renderer = renderer;
 }
 
-void ShadowDepthShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename)
+void ShadowDepthShader::initShader(const wchar_t* vsFilename, const wchar_t* instancedVsFilename)
 {
-	D3D11_BUFFER_DESC matrixBufferDesc;
+	D3D11_BUFFER_DESC worldBufferDesc;
 
 	// Load (+ compile) shader files
-	loadVertexShader(vsFilename);
-	loadPixelShader(psFilename);
+	// One shader for both vertex formats, only the layouts differ. No pixel shader is loaded, so none is bound.
+	loadPositionVertexShader(vsFilename, VertexPacking::Format::FULL);
+	loadPositionVertexShader(vsFilename, VertexPacking::Format::PACKED);
+	loadInstancedVertexShader(instancedVsFilename, VertexPacking::Format::FULL);
+	loadInstancedVertexShader(instancedVsFilename, VertexPacking::Format::PACKED);
 
-	// Setup the description of the dynamic matrix constant buffer that is in the vertex shader.
-	matrixBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	matrixBufferDesc.ByteWidth = sizeof(MatrixBufferType);
-	matrixBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	matrixBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	matrixBufferDesc.MiscFlags = 0;
-	matrixBufferDesc.StructureByteStride = 0;
-	device->CreateBuffer(&matrixBufferDesc, NULL, &matrixBuffer);
+	// Setup the world buffer, the fallback for when the constant ring can not take the world matrix
+	worldBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	worldBufferDesc.ByteWidth = sizeof(XMMATRIX);
+	worldBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	worldBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	worldBufferDesc.MiscFlags = 0;
+	worldBufferDesc.StructureByteStride = 0;
+	device->CreateBuffer(&worldBufferDesc, NULL, &worldBuffer);
+}
 
+void ShadowDepthShader::SetShaderParameters(const XMMATRIX& world)
+{
+	// Projection and view are bound by FrameConstants
+	D3D11ConstantRing* constantRing = renderer->getConstantRing();
+	constantRing->bind(StateCache::Stage::VERTEX_SHADER, 2, constantRing->upload(&world, sizeof(XMMATRIX), worldBuffer)); // World buffer b2 in Vertex Shader
 }
 
-void ShadowDepthShader::SetShaderParameters(const XMMATRIX& worldMatrix, const XMMATRIX& viewMatrix, const XMMATRIX& projectionMatrix)
+void ShadowDepthShader::SetInstanceParameters(const std::vector<InstanceBufferData>& instances)
 {
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-	MatrixBufferType* dataPtr;
+	if (instances.empty()) return;
 
-	// Lock the constant buffer so it can be written to.
-	renderer->getDeviceContext()->Map(matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	dataPtr = (MatrixBufferType*)mappedResource.pData;
-	dataPtr->world = worldMatrix;
-	dataPtr->view = viewMatrix;
-	dataPtr->projection = projectionMatrix;
-	renderer->getDeviceContext()->Unmap(matrixBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(0, 1, &matrixBuffer);
+	// Only upload when the instances differ from the last ones, the same ones are drawn into every shadow map
+	bool changed = instances.size() != uploadedInstances.size()
+		|| memcmp(instances.data(), uploadedInstances.data(), instances.size() * sizeof(InstanceBufferData)) != 0;
+	if (changed) {
+		reserveStructuredBuffer(&instanceBuffer, &instanceSRV, instanceCapacity, (UINT)instances.size(), sizeof(InstanceBufferData));
+
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		renderer->getDeviceContext()->Map(instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		memcpy(mappedResource.pData, instances.data(), instances.size() * sizeof(InstanceBufferData));
+		renderer->getDeviceContext()->Unmap(instanceBuffer, 0);
+		uploadedInstances = instances;
+	}
+	renderer->getStateCache()->VSSetShaderResources(0, 1, &instanceSRV); // Instance buffer t0 in Vertex Shader
 }
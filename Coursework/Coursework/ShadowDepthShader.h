@@ -1,12 +1,13 @@
 #pragma once
+#include <vector>
 #include "DXF.h"
+#include "CommonStructs.h"
 
-// ====================================================
-// UNUSED SHADER
-// Now depth pass uses normal shaders!
-// ====================================================
-
-
+/// <summary>
+/// Depth only shader for the shadow passes.
+/// Reads nothing but the vertex positions, see BaseMesh::sendPositionData, and has no pixel shader, so opaque casters only write depth.
+/// Projection and view come from FrameConstants for the light's pass, the only per draw constant is the world matrix.
+/// </summary>
 class ShadowDepthShader :
     public BaseShader
 {
@@ -17,13 +18,32 @@ public:
 
 	void SetRenderer(D3D* renderer); // Set render after shader init, used to reduce parameter passing.
 
-	void SetShaderParameters(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection);
+	/// <summary>
+	/// Setup data for shader, the world matrix is the whole per draw constant buffer
+	/// </summary>
+	/// <param name="world">World matrix of object</param>
+	void SetShaderParameters(const XMMATRIX& world);
 
-private:
-	void initShader(const wchar_t* vs, const wchar_t* ps);
+	/// <summary>
+	/// Setup data for an instanced render, see WorldObject::RenderInstancedDepth
+	/// Every shadow view draws the same instances, so they are only uploaded when they change.
+	/// </summary>
+	/// <param name="instances">Instances to draw, their material indices are not used</param>
+	void SetInstanceParameters(const std::vector<InstanceBufferData>& instances);
 
 private:
-	ID3D11Buffer* matrixBuffer;
+	// No pixel shader, the second shader is the instanced vertex shader
+	void initShader(const wchar_t* vs, const wchar_t* instancedVs);
+
+	// Vertex Shader Buffers
+	ID3D11Buffer* worldBuffer;
+
+	// Instancing buffer, and what it holds
+	ID3D11Buffer* instanceBuffer;
+	ID3D11ShaderResourceView* instanceSRV;
+	UINT instanceCapacity;
+	std::vector<InstanceBufferData> uploadedInstances;
+
 	D3D* renderer;
 	ID3D11Device* device;
-};
\ No newline at end of file
+};
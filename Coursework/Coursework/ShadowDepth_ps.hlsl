@@ -1,13 +0,0 @@
-// Pixel shader never ran as should only be used in depth pass contexts. 
-
-// NOT USED
-// NOT USED
-// NOT USED
-// NOT USED
-// NOT USED
-
-
-float4 main() : SV_TARGET
-{
-	return float4(1.0f, 1.0f, 1.0f, 1.0f);
-}
\ No newline at end of file
@@ -1,26 +1,45 @@
-// Shadow depth shader for depth pass of shadow data
+// Shadow Depth Vertex Shader
+// Depth only vertex shader for shadow casters, it reads nothing but the position, see BaseMesh::sendPositionData.
+// Full and packed meshes share it, packed positions arrive as UNORM16 with w = 1 and their world matrix already contains the decode.
+// There is no pixel shader, the depth is written without one.
 
-// NOT USED
-// NOT USED
-// NOT USED
-// NOT USED
-// NOT USED
 
+// Projection and Camera Buffers, the light's, set by FrameConstants
+cbuffer ProjectionBuffer : register(b0)
+{
+	matrix projectionMatrix;
+};
 
-cbuffer MatrixBuffer : register(b0)
+cbuffer CameraBuffer : register(b1)
 {
-	matrix worldMatrix;
 	matrix viewMatrix;
-	matrix projectionMatrix;
+	float3 cameraPosition;
+};
+
+#ifdef INSTANCED
+// Instanced draws read their world matrix from the instance buffer, see InstanceBufferData.
+// Depth only draws are never split by material, so every draw starts at the first instance.
+struct InstanceData
+{
+	matrix worldMatrix;
+	uint materialIndex;
+	uint3 padding;
 };
 
+StructuredBuffer<InstanceData> instances : register(t0);
+#else
+cbuffer WorldBuffer : register(b2)
+{
+	matrix worldMatrix;
+};
+#endif
+
 struct InputType
 {
 	float4 position : POSITION;
-	float2 tex : TEXCOORD0;
-	float3 normal : NORMAL;
-	float3 tangent : TANGENT;
-	float3 bitangent : BITANGENT;
+#ifdef INSTANCED
+	uint instanceID : SV_InstanceID;
+#endif
 };
 
 struct OutputType
@@ -32,10 +51,14 @@ OutputType main(InputType input)
 {
 	OutputType output;
 
+#ifdef INSTANCED
+	matrix worldMatrix = instances[input.instanceID].worldMatrix;
+#endif
+
 	// Calculate the position of the vertex against the world, view, and projection matrices.
 	output.position = mul(worldMatrix, input.position);
 	output.position = mul(viewMatrix, output.position);
 	output.position = mul(projectionMatrix, output.position);
 
 	return output;
-}
\ No newline at end of file
+}
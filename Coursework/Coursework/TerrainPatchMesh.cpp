@@ -0,0 +1,52 @@
+// Terrain Patch Mesh
+// Generates a grid of resolution by resolution cells over the unit square, as a triangle list.
+#include "TerrainPatchMesh.h"
+#include <vector>
+
+// Store grid resolution (default is 16) and initialise buffers.
+TerrainPatchMesh::TerrainPatchMesh(ID3D11Device* device, ID3D11DeviceContext* deviceContext, int lresolution)
+{
+	resolution = lresolution;
+	initBuffers(device);
+}
+
+// Release resources.
+TerrainPatchMesh::~TerrainPatchMesh()
+{
+	// Run parent deconstructor
+	BaseMesh::~BaseMesh();
+}
+
+// Generate grid, texture coordinates match the position so the shader can read the height map with either.
+void TerrainPatchMesh::initBuffers(ID3D11Device* device)
+{
+	int verticesAcross = resolution + 1;
+	vertexCount = verticesAcross * verticesAcross;
+	indexCount = resolution * resolution * 6;
+
+	std::vector<VertexType> vertices(vertexCount);
+	for (int z = 0; z < verticesAcross; z++) {
+		for (int x = 0; x < verticesAcross; x++) {
+			VertexType& vertex = vertices[z * verticesAcross + x];
+			vertex.position = XMFLOAT3((float)x / resolution, 0.0f, (float)z / resolution);
+			vertex.texture = XMFLOAT2(vertex.position.x, vertex.position.z);
+			vertex.normal = XMFLOAT3(0, 1, 0);
+			vertex.tangent = XMFLOAT3(1, 0, 0);
+			vertex.bitangent = XMFLOAT3(0, 0, 1);
+		}
+	}
+
+	// Two triangles a cell, wound counter-clockwise seen from above as PlaneMesh is, so they face up
+	std::vector<unsigned long> indices;
+	indices.reserve(indexCount);
+	for (int z = 0; z < resolution; z++) {
+		for (int x = 0; x < resolution; x++) {
+			unsigned long lowerLeft = z * verticesAcross + x;
+			unsigned long upperLeft = lowerLeft + verticesAcross;
+			indices.insert(indices.end(), { lowerLeft, upperLeft + 1, upperLeft, lowerLeft, lowerLeft + 1, upperLeft + 1 });
+		}
+	}
+
+	createVertexBuffer(device, vertices.data(), vertexCount);
+	createIndexBuffer(device, indices.data(), indexCount);
+}
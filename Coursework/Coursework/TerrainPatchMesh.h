@@ -0,0 +1,20 @@
+#pragma once
+#include "BaseMesh.h"
+
+
+/// <summary>
+/// Flat square grid over the unit square, the patch every terrain quadtree patch is drawn with, see TerrainQuadtree
+/// The height map vertex shader places, displaces and morphs each instance, so the grid is only x and z from 0 to 1
+/// WITH Tangents & Bitangents
+/// </summary>
+class TerrainPatchMesh :
+    public BaseMesh
+{
+public:
+	TerrainPatchMesh(ID3D11Device* device, ID3D11DeviceContext* deviceContext, int resolution = 16);
+	~TerrainPatchMesh();
+
+protected:
+	void initBuffers(ID3D11Device* device);
+	int resolution; // Cells across the grid
+};
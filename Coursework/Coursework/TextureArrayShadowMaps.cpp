@@ -0,0 +1,82 @@
+#include "TextureArrayShadowMaps.h"
+
+TextureArrayShadowMaps::TextureArrayShadowMaps(ID3D11Device* device, int mWidth, int mHeight, int sliceCount) : ShadowMap()
+{
+	// Use typeless format because the DSV is going to interpret
+	// the bits as DXGI_FORMAT_D24_UNORM_S8_UINT, whereas the SRV is going to interpret
+	// the bits as DXGI_FORMAT_R24_UNORM_X8_TYPELESS.
+	D3D11_TEXTURE2D_DESC texDesc;
+	texDesc.Width = mWidth;
+	texDesc.Height = mHeight;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = sliceCount;
+	texDesc.Format = DXGI_FORMAT_R24G8_TYPELESS;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	texDesc.CPUAccessFlags = 0;
+	texDesc.MiscFlags = 0;
+	device->CreateTexture2D(&texDesc, 0, &depthMap);
+
+	// A DSV for every slice, each only its own slice so slices are cleared on their own. 
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+	dsvDesc.Flags = 0;
+	dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+	dsvDesc.Texture2DArray.MipSlice = 0;
+	dsvDesc.Texture2DArray.ArraySize = 1;
+	sliceDSVs.resize(sliceCount, nullptr);
+	for (int slice = 0; slice < sliceCount; ++slice) {
+		dsvDesc.Texture2DArray.FirstArraySlice = slice;
+		device->CreateDepthStencilView(depthMap, &dsvDesc, &sliceDSVs[slice]);
+	}
+	// The base class deletes its DSV, the slices' are released here
+	mDepthMapDSV = nullptr;
+
+	// We only need one SRV, all the slices in a Texture2DArray
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+	srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = texDesc.MipLevels;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = sliceCount;
+	device->CreateShaderResourceView(depthMap, &srvDesc, &mDepthMapSRV);
+
+	// Setup the viewport for rendering.
+	viewport.Width = (float)mWidth;
+	viewport.Height = (float)mHeight;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	viewport.TopLeftX = 0.0f;
+	viewport.TopLeftY = 0.0f;
+
+	//NULL render target
+	renderTargets[0] = { 0 };
+}
+
+TextureArrayShadowMaps::~TextureArrayShadowMaps()
+{
+	for (ID3D11DepthStencilView* sliceDSV : sliceDSVs) {
+		if (sliceDSV) sliceDSV->Release();
+	}
+	sliceDSVs.clear();
+}
+
+void TextureArrayShadowMaps::BindDsvAndSetNullRenderTarget(ID3D11DeviceContext* dc, int sliceIndex, bool clear)
+{
+	dc->RSSetViewports(1, &viewport);
+
+	// Set null render target because we are only going to draw to depth buffer.
+	// Setting a null render target will disable color writes.
+	D3D11StateCache::get(dc)->OMSetRenderTargets(1, renderTargets, sliceDSVs[sliceIndex]);
+
+	// Clearing only the slice drawn if asked, so slices not redrawn this frame keep their depth
+	if (clear) dc->ClearDepthStencilView(sliceDSVs[sliceIndex], D3D11_CLEAR_DEPTH, 1.0f, 0);
+}
+
+int TextureArrayShadowMaps::GetSliceCount()
+{
+	return (int)sliceDSVs.size();
+}
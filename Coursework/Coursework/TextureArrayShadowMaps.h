@@ -0,0 +1,20 @@
+#pragma once
+#include <vector>
+#include "DXF.h"
+
+/// <summary>
+/// Adapted shadow map class for a texture array of shadow maps, one slice for each of a directional light's cascades, or a single slice for a spot light.
+/// Sampled as a Texture2DArray in hlsl.
+/// </summary>
+class TextureArrayShadowMaps : public ShadowMap
+{
+public:
+	TextureArrayShadowMaps(ID3D11Device* device, int mWidth, int mHeight, int sliceCount);
+	~TextureArrayShadowMaps();
+
+	void BindDsvAndSetNullRenderTarget(ID3D11DeviceContext* dc, int sliceIndex, bool clear = true); // Binds one slice, clearing it unless asked not to
+	int GetSliceCount(); // Number of slices in the array
+protected:
+	// A DSV for every slice, so each is drawn and cleared on its own
+	std::vector<ID3D11DepthStencilView*> sliceDSVs;
+};
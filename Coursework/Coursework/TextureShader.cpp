@@ -57,11 +57,11 @@ void TextureShader::SetShaderParameters(ID3D11ShaderResourceView* texture, int s
 	// Setup with an orthographic projection
 	*projectionMatrix = XMMatrixOrthographicLH(screenWidth, screenHeight, 0, 1);
 	renderer->getDeviceContext()->Unmap(projectionBuffer, 0);
-	renderer->getDeviceContext()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
+	renderer->getStateCache()->VSSetConstantBuffers(0, 1, &projectionBuffer); // Projection buffer b0 in Vertex Shader
 
 	// Set texture and sampler
-	renderer->getDeviceContext()->PSSetShaderResources(0, 1, &texture);
-	renderer->getDeviceContext()->PSSetSamplers(0, 1, &textureSampler);
+	renderer->getStateCache()->PSSetShaderResources(0, 1, &texture);
+	renderer->getStateCache()->PSSetSamplers(0, 1, &textureSampler);
 }
 
 void TextureShader::initShader(const wchar_t* vs, const wchar_t* ps)
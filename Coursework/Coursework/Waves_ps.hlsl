@@ -2,19 +2,33 @@
 #include "Common.hlsli"
 
 // Shadow maps
-TextureCube shadowMaps[8] : register(t0);
-Texture2D directionalShadowMaps[8] : register(t8);
+Texture2D shadowAtlas : register(t0);
+Texture2DArray projectedShadowMaps[8] : register(t8);
 
 // And sampler states for each 
 SamplerState shadowSampler : register(s0);
 
-// Light buffer
-cbuffer LightBuffer : register(b0)
+// Light buffer, from FrameConstants
+cbuffer LightBuffer : register(b1)
 {
-    LightData lights[8]; // Support 8 lights max
+    LightData lights[8]; // Lights with shadow maps, 8 max, point and spot lights are lit from the clusters
     int lightCount; // LightData ends on a block of 16 fully used bytes so this wont be packed
 };
 
+// Clustered point and spot lights, from ClusteredLights
+cbuffer ClusterBuffer : register(b3)
+{
+    ClusterGridData clusterGrid;
+};
+StructuredBuffer<ClusterLightData> clusterLights : register(t24);
+StructuredBuffer<uint2> clusterRanges : register(t25); // Offset into the light indices and count, for each cluster
+StructuredBuffer<uint> clusterLightIndices : register(t26);
+// The clustered lights reaching the object being drawn, see ClusteredLights::BindObjectLights
+cbuffer ObjectLightBuffer : register(b4)
+{
+    ObjectLightData objectLights;
+};
+
 // Wave data buffer
 struct Wave
 {
@@ -26,7 +40,7 @@ struct Wave
     float steepness;
 };
 
-cbuffer WavesBuffer : register(b1)
+cbuffer WavesBuffer : register(b0)
 {
     Wave waves[3];
 };
@@ -113,6 +127,43 @@ float calculateSpecularPower(float3 lightDirection, float3 normal, float3 viewVe
     return blinnPhong;
 }
 
+// Lighting from one light, its ambient and diffuse are returned and its specular added on
+float4 calculateLight(ClusterLightData light, bool inShadow, InputType input, inout float4 specularColor)
+{
+    // Get distance for attenuation
+    float distanceToLight = length(light.position - input.worldPosition);
+
+    // Get light vector, for point and spotlights its the lights direction to the light position, for directional lights its just light direction
+    float3 lightVector = normalize(light.position - input.worldPosition);
+    if (light.lightType == 0)
+        lightVector = normalize(-light.direction);
+    
+    // Calculate the spotlight factor
+    float spotlightFactor = 1;
+    if (light.lightType == 2)
+        spotlightFactor = calculateSpotlightPower(-lightVector, normalize(light.direction), light.innerSpotlightCutoffAngle, light.outerSpotlightCutoffAngle);
+    
+    // Calculate ambient 
+    float4 localLightColor = light.ambient * light.lightPower;
+    
+    if (!inShadow)
+    {
+        // Add diffuse light
+        localLightColor += calculateLighting(lightVector, input.normal, light.diffuse, input.bitangent) * light.lightPower * spotlightFactor;
+        
+        // Add and attenuate specular light
+        specularColor += calculateSpecularPower(lightVector, input.normal, input.cameraVector, 64.0f) * light.lightPower * spotlightFactor * light.diffuse
+        / (light.constantAttenuation + light.linearAttenuation * distanceToLight + light.quadraticAttenuation * distanceToLight * distanceToLight);
+        
+    }
+    
+    // Attenuate light (Add attenuation variables to light buffer input)
+    // Since ambient is being attenuated we must still attenuate in shadow. 
+    localLightColor *= 1 / (light.constantAttenuation + light.linearAttenuation * distanceToLight + light.quadraticAttenuation * distanceToLight * distanceToLight);
+    
+    return localLightColor;
+}
+
 float4 main(InputType input) : SV_TARGET
 {
     // Do depth of field discard if any
@@ -128,42 +179,27 @@ float4 main(InputType input) : SV_TARGET
     float4 ambientAndDiffuseLightColor = float4(0, 0, 0, 1);
     float4 specularColor = float4(0, 0, 0, 0);
     
-    // For each light calculate lighting
+    // Directional lights reach every pixel, from the light buffer with their cascades
     for (int i = 0; i < lightCount; i++)
     {
-        // Get distance for attenuation
-        float distanceToLight = length(lights[i].position - input.worldPosition);
+        if (lights[i].lightType != 0)
+            continue;
+        bool inShadow = IsInShadow(lights[i], input.worldPosition, -normalize(lights[i].position - input.worldPosition), i, projectedShadowMaps[i], shadowAtlas, shadowSampler);
+        ambientAndDiffuseLightColor += calculateLight(ToClusterLight(lights[i], i), inShadow, input, specularColor);
+    }
 
-        // Get light vector, for point and spotlights its the lights direction to the light position, for directional lights its just light direction
-        float3 lightVector = normalize(lights[i].position - input.worldPosition);
-        if (lights[i].lightType == 0)
-            lightVector = normalize(-lights[i].direction);
-        
-        // Calculate the spotlight factor
-        float spotlightFactor = 1;
-        if (lights[i].lightType == 2)
-            spotlightFactor = calculateSpotlightPower(-lightVector, normalize(lights[i].direction), lights[i].innerSpotlightCutoffAngle, lights[i].outerSpotlightCutoffAngle);
-        
-        // Calculate ambient 
-        float4 localLightColor = lights[i].ambient * lights[i].lightPower;
-        
-        if (!IsInShadow(lights[i], input.worldPosition, -normalize(lights[i].position - input.worldPosition), i, directionalShadowMaps[i], shadowMaps[i], shadowSampler))
-        {
-            // Add diffuse light
-            localLightColor += calculateLighting(lightVector, input.normal, lights[i].diffuse, input.bitangent) * lights[i].lightPower * spotlightFactor;
-            
-            // Add and attenuate specular light
-            specularColor += calculateSpecularPower(lightVector, input.normal, input.cameraVector, 64.0f) * lights[i].lightPower * spotlightFactor * lights[i].diffuse
-            / (lights[i].constantAttenuation + lights[i].linearAttenuation * distanceToLight + lights[i].quadraticAttenuation * distanceToLight * distanceToLight);
-            
-        }
-        
-        // Attenuate light (Add attenuation variables to light buffer input)
-        // Since ambient is being attenuated we must still attenuate in shadow. 
-        localLightColor *= 1 / (lights[i].constantAttenuation + lights[i].linearAttenuation * distanceToLight + lights[i].quadraticAttenuation * distanceToLight * distanceToLight);
-        
-        // Add this lights complete color to the overall light color for this fragment/pixel
-        ambientAndDiffuseLightColor += localLightColor;
+    // Point and spot lights, only those reaching this pixel's cluster, or the object when its list is shorter, their shadows are all in the atlas
+    uint2 clusterRange = clusterRanges[GetClusterIndex(clusterGrid, input.position)];
+    bool useObjectLights = UseObjectLights(objectLights, clusterRange);
+    uint pixelLightCount = useObjectLights ? objectLights.lightCount : clusterRange.y;
+    for (uint c = 0; c < pixelLightCount; c++)
+    {
+        uint lightIndex = useObjectLights ? objectLights.lightIndices[c >> 2][c & 3] : clusterLightIndices[clusterRange.x + c];
+        ClusterLightData light = clusterLights[lightIndex];
+        bool inShadow = false;
+        if (light.shadowIndex >= 0)
+            inShadow = IsInShadow(lights[light.shadowIndex], input.worldPosition, -normalize(light.position - input.worldPosition), light.shadowIndex, projectedShadowMaps[0], shadowAtlas, shadowSampler);
+        ambientAndDiffuseLightColor += calculateLight(light, inShadow, input, specularColor);
     }
     
     // Non amplitude wave height, wave height between 0 and 1
@@ -1,32 +1,71 @@
 #include "WorldLight.h"
 #include "imGUI/imgui.h"
 #include <string>
+#include <cmath>
 #include "ShadowMap.h"
 
+const float WorldLight::CASCADE_CASTER_DISTANCE = 200.0f;
+
 WorldLight::WorldLight()
 {
 	viewMatrices = new XMMATRIX[6];
 	projectionMatrices = new XMMATRIX[6];
+	shadowMap = nullptr;
+	shadowAtlas = nullptr;
+	for (int face = 0; face < 6; ++face) atlasRegions[face] = ShadowAtlasAllocator::Region{ 0, 0, 0 };
+	shadowMatricesGenerated = false;
+
+	// Spotlights default to a 90 degree cone until their angles are set
+	innerSpotlightCutoffAngle = 40;
+	outerSpotlightCutoffAngle = 45;
+
+	// Cascades mostly logarithmic, so the nearest have the most texels, out to the whole scene
+	cascadeSplitBlend = 0.75f;
+	shadowDistance = 200.0f;
+	for (int cascade = 0; cascade < CASCADE_COUNT; ++cascade) cascadeSplits[cascade] = 0;
 
 	constantAttenuation = 1;
 	linearAttenuation = 0;
 	quadraticAttenuation = 0;
 }
 
-void WorldLight::CreateShadowMaps(D3D* renderer)
+void WorldLight::CreateShadowMaps(D3D* renderer, ShadowAtlas* shadowAtlas)
+{
+	// Directional lights have a map for each cascade, point lights' 6 faces and spotlights' single view are given regions of the atlas every frame
+	if (lightType == 0) shadowMap = new TextureArrayShadowMaps(renderer->getDevice(), CASCADE_SHADOW_MAP_SIZE, CASCADE_SHADOW_MAP_SIZE, CASCADE_COUNT);
+	else this->shadowAtlas = shadowAtlas;
+}
+
+int WorldLight::GetShadowMapResolution(int index)
+{
+	if (lightType == 0) return CASCADE_SHADOW_MAP_SIZE;
+	return atlasRegions[index].size;
+}
+
+int WorldLight::GetShadowFaceCount()
 {
-	if(lightType == 0) directionalShadowMap = new ShadowMap(renderer->getDevice(), 8192, 8192);
-	else tCubeShadowMap = new TextureCubeShadowMaps(renderer->getDevice(), 1024, 1024);
+	if (lightType == 0) return CASCADE_COUNT;
+	return (lightType == 1) ? 6 : 1;
 }
 
-ShadowMap* WorldLight::GetDirectionalShadowMap()
+TextureArrayShadowMaps* WorldLight::GetShadowMap()
 {
-	return directionalShadowMap;
+	return shadowMap;
 }
 
-TextureCubeShadowMaps* WorldLight::GetTCubeShadowMap()
+ShadowAtlas* WorldLight::GetShadowAtlas()
 {
-	return tCubeShadowMap;
+	return shadowAtlas;
+}
+
+void WorldLight::SetShadowAtlasRegion(int index, const ShadowAtlasAllocator::Region& region)
+{
+	atlasRegions[index] = region;
+}
+
+ShadowAtlasAllocator::Region WorldLight::GetShadowAtlasRegion(int index)
+{
+	return atlasRegions[index];
 }
 
 XMMATRIX WorldLight::GetViewMatrix(int index)
@@ -41,20 +80,33 @@ XMMATRIX WorldLight::GetProjMatrix(int index)
 
 void WorldLight::GenerateShadowMatrices()
 {
-	// If directional light, set position to be 100 away (viewing whole scene)
-	// Set ortho matrix to be 200 units wide, (viewing whole scene)
+	// Keep the matrices while nothing they come from has changed, so cached shadows stay valid
+	// Directional lights place themselves from their direction, so their position is not compared
+	XMFLOAT3 currentPosition = getPosition();
+	if (shadowMatricesGenerated && shadowMatricesDirection.x == direction.x && shadowMatricesDirection.y == direction.y && shadowMatricesDirection.z == direction.z
+		&& (lightType == 0 || (shadowMatricesPosition.x == currentPosition.x && shadowMatricesPosition.y == currentPosition.y && shadowMatricesPosition.z == currentPosition.z))
+		&& (lightType != 2 || shadowMatricesOuterAngle == outerSpotlightCutoffAngle)) {
+		return;
+	}
+
+	// If directional light, set position to be 100 away, where it shows in the scene
+	// Its cascades follow the camera, FitShadowCascades places them
 	if (lightType == 0) {
 		XMStoreFloat3(&direction, (XMVector3Normalize(XMLoadFloat3(&direction))));
 		XMFLOAT3 newPos = XMFLOAT3(-direction.x * 100.0f, -direction.y * 100.0f, -direction.z * 100.0f);
 		position = XMLoadFloat3(&newPos);
-		generateOrthoMatrix(200, 200, 0.01, 200);
+	}
+	// If spot light, one perspective view down the light's direction, its FOV just covering the outer cutoff cone
+	// A degree either side keeps the filtered edge of the cone inside the map, cones wider than 80 degrees are clipped to it
+	if (lightType == 2) {
 		generateViewMatrix();
 		viewMatrices[0] = getViewMatrix();
-		projectionMatrices[0] = getOrthoMatrix();
+		float fieldOfView = XMConvertToRadians(fminf(outerSpotlightCutoffAngle + 1.0f, 80.0f) * 2.0f);
+		projectionMatrices[0] = XMMatrixPerspectiveFovLH(fieldOfView, 1.0f, 0.1f, 200.0f);
 	}
-	// If point or spot light, cube maps are being used, use perspective projection with 90DEG FOV
-	// Keep a note of light direction before modifying it for matrices, its needed for spotlight
-	if (lightType == 1 || lightType == 2) {
+	// If point light, a view for each face of a cube around it, use perspective projection with 90DEG FOV
+	// Keep a note of light direction before modifying it for matrices
+	if (lightType == 1) {
 		XMFLOAT3 directionBefore = direction;
 		direction = XMFLOAT3(1, 0, 0);
 		generateProjectionMatrix(0.1, 200);
@@ -83,6 +135,78 @@ void WorldLight::GenerateShadowMatrices()
 		projectionMatrices[5] = getProjectionMatrix();
 		direction = directionBefore;
 	}
+
+	shadowMatricesGenerated = true;
+	shadowMatricesPosition = getPosition();
+	shadowMatricesDirection = direction;
+	shadowMatricesOuterAngle = outerSpotlightCutoffAngle;
+}
+
+void WorldLight::FitShadowCascades(const XMMATRIX& cameraView, const XMMATRIX& cameraProjection, float nearPlane, float farPlane)
+{
+	if (lightType != 0) return;
+
+	// Corners of the camera frustum, near then far. Points along each edge are linear in view depth between them.
+	XMMATRIX inverseViewProjection = XMMatrixInverse(nullptr, cameraView * cameraProjection);
+	XMVECTOR nearCorners[4], farCorners[4];
+	for (int corner = 0; corner < 4; ++corner) {
+		float x = (corner & 1) ? 1.0f : -1.0f;
+		float y = (corner & 2) ? 1.0f : -1.0f;
+		nearCorners[corner] = XMVector3TransformCoord(XMVectorSet(x, y, 0, 1), inverseViewProjection);
+		farCorners[corner] = XMVector3TransformCoord(XMVectorSet(x, y, 1, 1), inverseViewProjection);
+	}
+
+	// Light space is only the light's rotation, so a cascade moving with the camera is just its projection moving
+	XMVECTOR lightDirection = XMVector3Normalize(XMLoadFloat3(&direction));
+	XMVECTOR up = (fabsf(XMVectorGetY(lightDirection)) > 0.99f) ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+	XMMATRIX lightView = XMMatrixLookToLH(XMVectorZero(), lightDirection, up);
+
+	// Practical split scheme, a blend of logarithmic splits, even in texels per pixel, and even splits (Zhang et al., 2006)
+	float lastDistance = fminf(shadowDistance, farPlane);
+	float splitStart = nearPlane;
+	for (int cascade = 0; cascade < CASCADE_COUNT; ++cascade) {
+		float along = (float)(cascade + 1) / CASCADE_COUNT;
+		float logarithmicSplit = nearPlane * powf(lastDistance / nearPlane, along);
+		float evenSplit = nearPlane + (lastDistance - nearPlane) * along;
+		float splitEnd = cascadeSplitBlend * logarithmicSplit + (1.0f - cascadeSplitBlend) * evenSplit;
+		cascadeSplits[cascade] = splitEnd;
+
+		// Bounding sphere of this slice of the frustum, its size does not change as the camera turns
+		XMVECTOR sliceCorners[8];
+		XMVECTOR centre = XMVectorZero();
+		for (int corner = 0; corner < 4; ++corner) {
+			sliceCorners[corner] = XMVectorLerp(nearCorners[corner], farCorners[corner], (splitStart - nearPlane) / (farPlane - nearPlane));
+			sliceCorners[corner + 4] = XMVectorLerp(nearCorners[corner], farCorners[corner], (splitEnd - nearPlane) / (farPlane - nearPlane));
+			centre += sliceCorners[corner] + sliceCorners[corner + 4];
+		}
+		centre /= 8.0f;
+		float radius = 0;
+		for (int corner = 0; corner < 8; ++corner) {
+			radius = fmaxf(radius, XMVectorGetX(XMVector3Length(sliceCorners[corner] - centre)));
+		}
+		// Rounded up, so rounding errors as the camera turns do not resize it
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		// Move the centre in whole texels in light space, so texels land on the same places in the world as the camera moves
+		// Depth is snapped too, a texel further back, so the matrices only change when a texel's worth of movement builds up
+		float texelSize = (2.0f * radius) / CASCADE_SHADOW_MAP_SIZE;
+		XMFLOAT3 lightSpaceCentre;
+		XMStoreFloat3(&lightSpaceCentre, XMVector3TransformCoord(centre, lightView));
+		lightSpaceCentre.x = floorf(lightSpaceCentre.x / texelSize) * texelSize;
+		lightSpaceCentre.y = floorf(lightSpaceCentre.y / texelSize) * texelSize;
+		lightSpaceCentre.z = floorf(lightSpaceCentre.z / texelSize) * texelSize;
+
+		// Reaches back towards the light, so casters outside the slice still shadow it
+		viewMatrices[cascade] = lightView;
+		projectionMatrices[cascade] = XMMatrixOrthographicOffCenterLH(lightSpaceCentre.x - radius, lightSpaceCentre.x + radius, lightSpaceCentre.y - radius, lightSpaceCentre.y + radius,
+			lightSpaceCentre.z - radius - CASCADE_CASTER_DISTANCE, lightSpaceCentre.z + radius + texelSize);
+		splitStart = splitEnd;
+	}
+}
+
+float WorldLight::GetCascadeSplit(int index)
+{
+	return cascadeSplits[index];
 }
 
 void WorldLight::SetAttenuation(float constant, float linear, float quadratic)
@@ -115,6 +239,7 @@ float WorldLight::GetLightPower()
 void WorldLight::SetLightType(int type)
 {
 	lightType = type;
+	shadowMatricesGenerated = false;
 }
 
 void WorldLight::SetLightPower(float power)
@@ -156,6 +281,12 @@ void WorldLight::ShowGuiControls(const char* label)
 		ImGui::DragFloat("Power", &lightPower, 0.001, 0, 5);
 		if (lightType == 2)ImGui::SliderFloat("Inner Cutoff", &innerSpotlightCutoffAngle, 0, 89);
 		if (lightType == 2)ImGui::SliderFloat("Outer Cutoff", &outerSpotlightCutoffAngle, 0, 90);
+		// Cascades for directional
+		if (lightType == 0) {
+			ImGui::SliderFloat("Cascade Split Blend", &cascadeSplitBlend, 0, 1);
+			ImGui::SliderFloat("Shadow Distance", &shadowDistance, 10, 200);
+			ImGui::Text("Cascades end at %.1f, %.1f, %.1f, %.1f", cascadeSplits[0], cascadeSplits[1], cascadeSplits[2], cascadeSplits[3]);
+		}
 		// Attenuation & Graph
 		ImGui::Text("Attenuation");
 		ImGui::DragFloat("Constant", &constantAttenuation, 0.001, 1, 100);
@@ -1,7 +1,8 @@
 #pragma once
 #include "Light.h"
 #include "DXF.h"
-#include "TextureCubeShadowMaps.h"
+#include "TextureArrayShadowMaps.h"
+#include "ShadowAtlas.h"
 
 /// <summary>
 /// Extension of light, used in scene
@@ -10,20 +11,44 @@ class WorldLight :
     public Light
 {
 public:
+    // Shadow map resolution, directional lights have one map of this size for each cascade
+    // Point and spot lights' views are in the shadow atlas, sized by how much of the screen they shadow
+    static const int CASCADE_SHADOW_MAP_SIZE = 2048;
+    // Cascades of a directional light, nearest first, as CASCADE_COUNT in Common.hlsli
+    static const int CASCADE_COUNT = 4;
+    // How far behind a cascade's slice of the camera frustum casters are drawn from, towards the light
+    static const float CASCADE_CASTER_DISTANCE;
+
     WorldLight();
 
     /// <summary>
     /// Creates shadow maps in memory, must be done
     /// </summary>
     /// <param name="renderer"></param>
-    void CreateShadowMaps(D3D* renderer);
+    /// <param name="shadowAtlas">Atlas point and spot lights draw their views into</param>
+    void CreateShadowMaps(D3D* renderer, ShadowAtlas* shadowAtlas);
 
-    ShadowMap* GetDirectionalShadowMap(); // Get shadow map for directional light
-    TextureCubeShadowMaps* GetTCubeShadowMap(); // Get shadow map for point & spot light
-    XMMATRIX GetViewMatrix(int index); // Get view matrix, index if for point/spot light
+    TextureArrayShadowMaps* GetShadowMap(); // Get projected 2D shadow maps for directional light, a slice for each cascade
+    ShadowAtlas* GetShadowAtlas(); // Get the shadow atlas for point & spot light
+    void SetShadowAtlasRegion(int index, const ShadowAtlasAllocator::Region& region); // Set where a view is in the atlas, index is the cube face for point light
+    ShadowAtlasAllocator::Region GetShadowAtlasRegion(int index); // Get where a view is in the atlas, size 0 if it has no region
+    int GetShadowMapResolution(int index); // Width and height of a shadow view, a cascade or its region of the atlas
+    int GetShadowFaceCount(); // Number of shadow views, 6 cube faces for point lights, the cascades for directional lights, 1 for spot lights
+    XMMATRIX GetViewMatrix(int index); // Get view matrix, index is the cube face for point light or the cascade for directional
     XMMATRIX GetProjMatrix(int index); // Get projection matrix
 
-    void GenerateShadowMatrices(); // Generate new matrices for shadows, do this every time a light moves.
+    void GenerateShadowMatrices(); // Generate new matrices for shadows, call every frame, does nothing unless the light moved or its cone changed.
+
+    /// <summary>
+    /// Fits a directional light's cascades to the camera, call every frame after the camera updates, does nothing for other lights.
+    /// The shadow distance is split between the cascades, blending logarithmic and even splits. Each cascade is an orthographic
+    /// projection around the bounding sphere of its slice of the camera frustum, moved in whole texels so its shadows do not shimmer
+    /// as the camera moves, and so it keeps its matrices while the camera only turns.
+    /// </summary>
+    /// <param name="cameraView">View matrix of the camera</param>
+    /// <param name="cameraProjection">Projection matrix of the camera, with nearPlane and farPlane</param>
+    void FitShadowCascades(const XMMATRIX& cameraView, const XMMATRIX& cameraProjection, float nearPlane, float farPlane);
+    float GetCascadeSplit(int index); // Camera distance a cascade ends at
 
     
 
@@ -57,10 +82,11 @@ private:
     XMMATRIX* viewMatrices;
     // Pointer to projection matrix
     XMMATRIX* projectionMatrices;
-    // Pointer to shadow map
-    ShadowMap* directionalShadowMap;
-    // Pointer to texture cube shadow map
-    TextureCubeShadowMaps* tCubeShadowMap;
+    // Pointer to shadow map, directional lights
+    TextureArrayShadowMaps* shadowMap;
+    // Pointer to the shared shadow atlas, and this light's views in it, point and spot lights
+    ShadowAtlas* shadowAtlas;
+    ShadowAtlasAllocator::Region atlasRegions[6];
 
     float lightPower; // Light power multiplied by diffuse colour
     float constantAttenuation; // Constant attenuation, typically 1
@@ -71,5 +97,16 @@ private:
     // Spotlight cutoff angles. (De Vries, 2014 b)
     float innerSpotlightCutoffAngle;
     float outerSpotlightCutoffAngle;
+
+    // Cascade splits, 0 is even splits, 1 logarithmic, and how far from the camera the last cascade ends
+    float cascadeSplitBlend;
+    float shadowDistance;
+    float cascadeSplits[CASCADE_COUNT];
+
+    // What the shadow matrices were last generated from
+    bool shadowMatricesGenerated;
+    XMFLOAT3 shadowMatricesPosition;
+    XMFLOAT3 shadowMatricesDirection;
+    float shadowMatricesOuterAngle;
 };
 
@@ -1,4 +1,6 @@
 #include "WorldObject.h"
+#include <algorithm>
+#include <cfloat>
 
 WorldObject::WorldObject()
 {
@@ -9,6 +11,17 @@ WorldObject::WorldObject()
 
 	// World matrix for this is identity
 	worldMatrix = XMMatrixIdentity();
+
+	// Meshlet culling is on, but nothing is culled until the first CullClusters
+	clusterCulling = true;
+	clusterLod = -1;
+	clusterStats = MeshletBuilder::CullStats{ 0, 0, 0, 0 };
+
+	instancesDirty = false;
+
+	castsShadows = true;
+	isStatic = false;
+	boundsPadding = XMFLOAT3(0, 0, 0);
 }
 
 void WorldObject::SetRenderer(D3D* renderer)
@@ -26,6 +39,9 @@ void WorldObject::SetMesh(BaseMesh* mesh)
 	// Delete old mesh (if there was one) and add new one
 	if (this->mesh.get() != nullptr) this->mesh.release();
 	this->mesh.reset(mesh);
+
+	// Instance matrices include the mesh's decode
+	instancesDirty = true;
 }
 
 void WorldObject::SetPosition(DirectX::XMFLOAT3 position)
@@ -46,6 +62,11 @@ void WorldObject::SetScale(DirectX::XMFLOAT3 scale)
 	RefreshWorldMatrix();
 }
 
+void WorldObject::SetCastsShadows(bool castsShadows)
+{
+	this->castsShadows = castsShadows;
+}
+
 DirectX::XMFLOAT3 WorldObject::GetPosition()
 {
 	return position;
@@ -63,13 +84,247 @@ DirectX::XMFLOAT3 WorldObject::GetScale()
 
 DirectX::XMMATRIX WorldObject::GetWorldMatrix()
 {
+	// Packed meshes store positions relative to their bounds, the decode matrix maps them back to object space
+	if (mesh.get() != nullptr) return mesh->getDecodeMatrix() * worldMatrix;
 	return worldMatrix;
 }
 
+void WorldObject::SetBoundsPadding(DirectX::XMFLOAT3 padding)
+{
+	boundsPadding = padding;
+}
+
+bool WorldObject::CastsShadows()
+{
+	return castsShadows;
+}
+
+void WorldObject::SetStatic(bool isStatic)
+{
+	this->isStatic = isStatic;
+}
+
+bool WorldObject::IsStatic()
+{
+	return isStatic;
+}
+
+bool WorldObject::GetWorldBounds(DirectX::XMFLOAT3& centre, DirectX::XMFLOAT3& extents, float& radius)
+{
+	if (mesh.get() == nullptr) return false;
+
+	// The mesh's bounds are of its decoded positions, so the decode is not applied here
+	XMFLOAT3 boxMin, boxMax;
+	mesh->getBoundingBox(boxMin, boxMax);
+	if (instanceTransforms.empty())
+	{
+		XMFLOAT4X4 world;
+		XMStoreFloat4x4(&world, worldMatrix);
+		FrustumCuller::transformBounds(&boxMin.x, &boxMax.x, &world._11, &centre.x, &extents.x, radius);
+	}
+	else
+	{
+		// Box around every instance's box
+		XMVECTOR unionMin = XMVectorReplicate(FLT_MAX);
+		XMVECTOR unionMax = XMVectorReplicate(-FLT_MAX);
+		for (const InstanceBufferData& instance : instanceTransforms)
+		{
+			XMFLOAT4X4 world;
+			XMStoreFloat4x4(&world, instance.worldMatrix);
+			XMFLOAT3 instanceCentre, instanceExtents;
+			float instanceRadius;
+			FrustumCuller::transformBounds(&boxMin.x, &boxMax.x, &world._11, &instanceCentre.x, &instanceExtents.x, instanceRadius);
+			unionMin = XMVectorMin(unionMin, XMLoadFloat3(&instanceCentre) - XMLoadFloat3(&instanceExtents));
+			unionMax = XMVectorMax(unionMax, XMLoadFloat3(&instanceCentre) + XMLoadFloat3(&instanceExtents));
+		}
+		XMStoreFloat3(&centre, (unionMin + unionMax) * 0.5f);
+		XMStoreFloat3(&extents, (unionMax - unionMin) * 0.5f);
+		radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&extents)));
+	}
+
+	// Padding grows the box on each side, and the sphere by as much as the box's diagonal grows
+	XMVECTOR padded = XMLoadFloat3(&extents) + XMLoadFloat3(&boundsPadding);
+	radius += XMVectorGetX(XMVector3Length(padded)) - XMVectorGetX(XMVector3Length(XMLoadFloat3(&extents)));
+	XMStoreFloat3(&extents, padded);
+	return true;
+}
+
+void WorldObject::SelectLod(const DirectX::XMMATRIX& viewMatrix, const DirectX::XMMATRIX& projectionMatrix, float viewportHeight, float maxPixelError)
+{
+	if (mesh.get() == nullptr || mesh->getLodCount() <= 1) return;
+
+	// Bounding sphere in view space, scaled by the largest axis scale so it still encloses the mesh
+	XMFLOAT3 centre;
+	float radius;
+	mesh->getBoundingSphere(centre, radius);
+	float worldScale = fmaxf(fabsf(scale.x), fmaxf(fabsf(scale.y), fabsf(scale.z)));
+	XMVECTOR viewCentre = XMVector3TransformCoord(XMLoadFloat3(&centre), worldMatrix * viewMatrix);
+
+	// Clip space w of the sphere's nearest point, the view depth for perspective and 1 for orthographic projections
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, projectionMatrix);
+	float nearestW = (XMVectorGetZ(viewCentre) - radius * worldScale) * projection._34 + projection._44;
+
+	// Inside the sphere, or it is right in front of the camera
+	if (nearestW <= 0.0001f)
+	{
+		mesh->setLod(0);
+		return;
+	}
+
+	// Pixels one world unit covers at that depth
+	float pixelsPerUnit = projection._22 * 0.5f * viewportHeight / nearestW;
+
+	int lod = 0;
+	while (lod + 1 < mesh->getLodCount() && mesh->getLodError(lod + 1) * worldScale * pixelsPerUnit <= maxPixelError)
+	{
+		lod++;
+	}
+	mesh->setLod(lod);
+}
+
+void WorldObject::CullClusters(const DirectX::XMMATRIX& viewMatrix, const DirectX::XMMATRIX& projectionMatrix)
+{
+	if (!clusterCulling || mesh.get() == nullptr || mesh->getMeshletCount() == 0)
+	{
+		clusterLod = -1;
+		return;
+	}
+
+	// Meshlet bounds are in object space, so the frustum and eye are taken there instead of moving every meshlet
+	XMMATRIX worldView = worldMatrix * viewMatrix;
+	XMFLOAT4X4 worldViewProjection;
+	XMStoreFloat4x4(&worldViewProjection, worldView * projectionMatrix);
+
+	// Orthographic projections see everything along the view direction, perspective ones from the eye
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, projectionMatrix);
+	bool orthographic = projection._34 == 0.0f;
+	XMMATRIX objectFromView = XMMatrixInverse(nullptr, worldView);
+	XMFLOAT4 eye;
+	XMStoreFloat4(&eye, XMVector4Transform(orthographic ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 0, 0, 1), objectFromView));
+
+	// A mirroring transform swaps which winding faces front, so the normal cones can not be trusted
+	bool mirrored = XMVectorGetX(XMMatrixDeterminant(worldMatrix)) < 0.0f;
+
+	MeshletBuilder::View view;
+	MeshletBuilder::computeView(&worldViewProjection._11, &eye.x, !mirrored, view);
+	MeshletBuilder::cull(mesh->getMeshlets(), mesh->getMeshletCount(), view, clusterDraws, &clusterStats);
+	clusterLod = mesh->getLod();
+}
+
+void WorldObject::SetClusterCulling(bool enabled)
+{
+	clusterCulling = enabled;
+}
+
+MeshletBuilder::CullStats WorldObject::GetClusterStats()
+{
+	return clusterStats;
+}
+
 void WorldObject::Render(D3D_PRIMITIVE_TOPOLOGY topology)
 {
+	Draw(shader, false, topology);
+}
+
+void WorldObject::RenderDepth(BaseShader* depthShader, D3D_PRIMITIVE_TOPOLOGY topology)
+{
+	Draw(depthShader, true, topology);
+}
+
+void WorldObject::Draw(BaseShader* drawShader, bool positionsOnly, D3D_PRIMITIVE_TOPOLOGY topology)
+{
+	// Nothing to draw until a background loaded mesh arrives
+	if (mesh.get() == nullptr) return;
+
+	if (positionsOnly) mesh->sendPositionData(renderer->getDeviceContext(), topology);
+	else mesh->sendData(renderer->getDeviceContext(), topology);
+	drawShader->setVertexFormat(mesh->getVertexFormat());
+
+	if (!clusterCulling || clusterLod != mesh->getLod())
+	{
+		drawShader->render(renderer->getDeviceContext(), mesh->getIndexCount(), mesh->getIndexStart());
+		return;
+	}
+
+	// Only the visible meshlets. The shader binds its state on the first draw, the rest reuse it.
+	for (size_t i = 0; i < clusterDraws.size(); i++)
+	{
+		if (i == 0) drawShader->render(renderer->getDeviceContext(), clusterDraws[i].indexCount, clusterDraws[i].indexStart);
+		else renderer->getStateCache()->DrawIndexed(clusterDraws[i].indexCount, clusterDraws[i].indexStart, 0);
+	}
+}
+
+void WorldObject::AddInstance(DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 rotation, DirectX::XMFLOAT3 scale, UINT materialIndex)
+{
+	InstanceBufferData instance;
+	instance.worldMatrix = XMMatrixScaling(scale.x, scale.y, scale.z) * XMMatrixRotationRollPitchYaw(rotation.x, rotation.y, rotation.z) * XMMatrixTranslation(position.x, position.y, position.z);
+	instance.materialIndex = materialIndex;
+	instance.padding[0] = instance.padding[1] = instance.padding[2] = 0;
+
+	// After the last instance with the same or a lower material index
+	auto insertAt = std::upper_bound(instanceTransforms.begin(), instanceTransforms.end(), materialIndex,
+		[](UINT index, const InstanceBufferData& other) { return index < other.materialIndex; });
+	instanceTransforms.insert(insertAt, instance);
+	instancesDirty = true;
+}
+
+void WorldObject::ClearInstances()
+{
+	instanceTransforms.clear();
+	instancesDirty = true;
+}
+
+int WorldObject::GetInstanceCount()
+{
+	return (int)instanceTransforms.size();
+}
+
+const std::vector<InstanceBufferData>& WorldObject::GetInstances()
+{
+	if (instancesDirty)
+	{
+		instances = instanceTransforms;
+		if (mesh.get() != nullptr)
+		{
+			XMMATRIX decode = mesh->getDecodeMatrix();
+			for (InstanceBufferData& instance : instances) instance.worldMatrix = decode * instance.worldMatrix;
+		}
+		instancesDirty = false;
+	}
+	return instances;
+}
+
+void WorldObject::RenderInstanced(D3D_PRIMITIVE_TOPOLOGY topology)
+{
+	DrawInstanced(shader, false, topology);
+}
+
+void WorldObject::RenderInstancedDepth(BaseShader* depthShader, D3D_PRIMITIVE_TOPOLOGY topology)
+{
+	DrawInstanced(depthShader, true, topology);
+}
+
+void WorldObject::DrawInstanced(BaseShader* drawShader, bool positionsOnly, D3D_PRIMITIVE_TOPOLOGY topology)
+{
+	// Nothing to draw until a background loaded mesh arrives
+	if (mesh.get() == nullptr || instanceTransforms.empty()) return;
+
+	if (positionsOnly) mesh->sendPositionData(renderer->getDeviceContext(), topology);
+	else mesh->sendData(renderer->getDeviceContext(), topology);
+	drawShader->setVertexFormat(mesh->getVertexFormat());
+	drawShader->renderInstanced(renderer->getDeviceContext(), mesh->getIndexCount(), (int)instanceTransforms.size(), mesh->getIndexStart());
+}
+
+void WorldObject::RenderInstances(int instanceCount, D3D_PRIMITIVE_TOPOLOGY topology)
+{
+	// Nothing to draw until a background loaded mesh arrives
+	if (mesh.get() == nullptr || instanceCount <= 0) return;
+
 	mesh->sendData(renderer->getDeviceContext(), topology);
-	shader->render(renderer->getDeviceContext(), mesh->getIndexCount());
+	shader->setVertexFormat(mesh->getVertexFormat());
+	shader->renderInstanced(renderer->getDeviceContext(), mesh->getIndexCount(), instanceCount, mesh->getIndexStart());
 }
 
 void WorldObject::RefreshWorldMatrix()
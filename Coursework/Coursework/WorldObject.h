@@ -1,6 +1,8 @@
 #pragma once
 #include <memory>
+#include <vector>
 #include "DXF.h"
+#include "CommonStructs.h"
 
 /// <summary>
 /// World Object class
@@ -18,11 +20,23 @@ public:
 	void SetPosition(DirectX::XMFLOAT3 position); // Setter for position
 	void SetRotation(DirectX::XMFLOAT3 rotation); // Setter for rotation
 	void SetScale(DirectX::XMFLOAT3 scale); // Setter for scale
+	void SetCastsShadows(bool castsShadows); // Setter for if the object is drawn into shadow maps, on by default
+	void SetBoundsPadding(DirectX::XMFLOAT3 padding); // Setter for how far the shaders can move vertices past the mesh's bounds, in world units
+	void SetStatic(bool isStatic); // Setter for if the object never moves, static casters' shadows are cached, off by default
 
 	DirectX::XMFLOAT3 GetPosition(); // Getter for position
 	DirectX::XMFLOAT3 GetRotation(); // Getter for rotation
 	DirectX::XMFLOAT3 GetScale(); // Getter for scale
-	DirectX::XMMATRIX GetWorldMatrix(); // Getter for world matrix
+	DirectX::XMMATRIX GetWorldMatrix(); // Getter for world matrix, includes the mesh's packed position decode
+	bool CastsShadows(); // Getter for if the object is drawn into shadow maps
+	bool IsStatic(); // Getter for if the object never moves
+
+	/// <summary>
+	/// Gets the world space bounds used for frustum culling, a box and a sphere around the same centre.
+	/// Instanced objects give the bounds around all of their instances, as they are drawn together.
+	/// </summary>
+	/// <returns>False if there is no mesh yet, so nothing to cull</returns>
+	bool GetWorldBounds(DirectX::XMFLOAT3& centre, DirectX::XMFLOAT3& extents, float& radius);
 
 	/// <summary>
 	/// Sends the mesh data to the GPU
@@ -30,12 +44,77 @@ public:
 	/// </summary>
 	//void SendMeshData();
 
+	/// <summary>
+	/// Picks the mesh's level of detail from its projected size on screen.
+	/// The nearest point of the bounding sphere gives the pixels covered by one unit, and the coarsest level whose error covers no more than maxPixelError pixels is used.
+	/// Call before Render in every pass, as each pass sees the object at a different size.
+	/// </summary>
+	/// <param name="viewMatrix">View matrix of the pass</param>
+	/// <param name="projectionMatrix">Projection matrix of the pass, perspective or orthographic</param>
+	/// <param name="viewportHeight">Height of the render target in pixels</param>
+	/// <param name="maxPixelError">Largest error allowed on screen in pixels, shadow passes use a larger value as their LOD bias</param>
+	void SelectLod(const DirectX::XMMATRIX& viewMatrix, const DirectX::XMMATRIX& projectionMatrix, float viewportHeight, float maxPixelError);
+
+	/// <summary>
+	/// Culls the mesh's meshlets for a pass, against the pass frustum and by their normal cones.
+	/// Render then only draws the meshlets left, merged into as few draws as possible.
+	/// Call after SelectLod in every pass, the cull is for the level of detail selected at the time.
+	/// </summary>
+	/// <param name="viewMatrix">View matrix of the pass</param>
+	/// <param name="projectionMatrix">Projection matrix of the pass, perspective or orthographic</param>
+	void CullClusters(const DirectX::XMMATRIX& viewMatrix, const DirectX::XMMATRIX& projectionMatrix);
+
+	void SetClusterCulling(bool enabled); // Turns meshlet culling on or off, off draws the whole level of detail
+	MeshletBuilder::CullStats GetClusterStats(); // Counters from the last CullClusters
+
 	/// <summary>
 	/// Renders the mesh using the shader set.
+	/// Tells the shader which vertex format the mesh uses.
 	/// Does not set any CB values!
+	/// With meshlet culling only the visible meshlets are drawn.
 	/// </summary>
 	void Render(D3D_PRIMITIVE_TOPOLOGY topology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
+	/// <summary>
+	/// As Render, but sends only the mesh's positions and draws with a depth only shader in place of the object's own.
+	/// Used by the shadow passes, see BaseMesh::sendPositionData.
+	/// </summary>
+	/// <param name="depthShader">Shader reading only positions, its CB values must already be set</param>
+	void RenderDepth(BaseShader* depthShader, D3D_PRIMITIVE_TOPOLOGY topology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	/// <summary>
+	/// Adds an instance of the mesh, drawn by RenderInstanced.
+	/// Instances are kept in material order, so those sharing a material, and so its maps, are next to each other.
+	/// </summary>
+	/// <param name="materialIndex">Index into the materials given to the shader with the instances</param>
+	void AddInstance(DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 rotation, DirectX::XMFLOAT3 scale, UINT materialIndex);
+	void ClearInstances(); // Removes every instance
+	int GetInstanceCount(); // Getter for number of instances
+
+	/// <summary>
+	/// Getter for the instance data, world matrices include the mesh's packed position decode like GetWorldMatrix.
+	/// Pass to the shader before RenderInstanced.
+	/// </summary>
+	const std::vector<InstanceBufferData>& GetInstances();
+
+	/// <summary>
+	/// Renders every instance of the mesh with the shader set, in as few draws as the shader can.
+	/// Does not set any CB values!
+	/// The level of detail is the one last selected for this object's own transform, and meshlet culling is not used, as it is per transform.
+	/// </summary>
+	void RenderInstanced(D3D_PRIMITIVE_TOPOLOGY topology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	/// <summary>
+	/// As RenderInstanced, with only the mesh's positions and a depth only shader, see RenderDepth.
+	/// </summary>
+	void RenderInstancedDepth(BaseShader* depthShader, D3D_PRIMITIVE_TOPOLOGY topology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	/// <summary>
+	/// Renders a number of instances of the mesh the shader places itself, with no transforms of its own, in one draw.
+	/// Does not set any CB values! The terrain draws its quadtree patches with it.
+	/// </summary>
+	void RenderInstances(int instanceCount, D3D_PRIMITIVE_TOPOLOGY topology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
 private:
 	// This objects transform components
 	DirectX::XMFLOAT3 position;
@@ -49,6 +128,10 @@ private:
 	/// </summary>
 	void RefreshWorldMatrix();
 
+	// Render and RenderInstanced with a given shader, sending only positions if asked
+	void Draw(BaseShader* drawShader, bool positionsOnly, D3D_PRIMITIVE_TOPOLOGY topology);
+	void DrawInstanced(BaseShader* drawShader, bool positionsOnly, D3D_PRIMITIVE_TOPOLOGY topology);
+
 	// A pointer to this objects mesh (For now its 1 to 1)
 	std::unique_ptr<BaseMesh> mesh;
 
@@ -58,5 +141,23 @@ private:
 	// A pointer to the shader
 	// As base shader as only used for calling render, not used to send data to buffers.
 	BaseShader* shader;
+
+	// If the shadow passes draw this object, and if it never moves so its shadows can be cached
+	bool castsShadows;
+	bool isStatic;
+
+	// Added to the bounds on each side, for displacement in the shaders
+	DirectX::XMFLOAT3 boundsPadding;
+
+	// Meshlet culling, the draws are for clusterLod and from the last CullClusters
+	bool clusterCulling;
+	int clusterLod;
+	std::vector<MeshletBuilder::DrawRange> clusterDraws;
+	MeshletBuilder::CullStats clusterStats;
+
+	// Instances, transforms as added and with the mesh decode applied, rebuilt from them when dirty
+	std::vector<InstanceBufferData> instanceTransforms;
+	std::vector<InstanceBufferData> instances;
+	bool instancesDirty;
 }; 
 
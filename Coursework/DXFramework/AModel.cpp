@@ -1,9 +1,42 @@
 #include "AModel.h"
 
-AModel::AModel(ID3D11Device* ldevice, const std::string& file)
+// Post processing the mesh is imported with, baked into the cache key
+static const unsigned int importFlags =
+	aiProcess_CalcTangentSpace |
+	aiProcess_Triangulate |
+	aiProcess_JoinIdenticalVertices |
+	aiProcess_SortByPType |
+	aiProcess_MakeLeftHanded |
+	aiProcess_FlipUVs;
+
+AModel::AModel()
+{
+	device = nullptr;
+	packVertices = false;
+	loaded = false;
+	boundsMin = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	boundsMax = XMFLOAT3(0.0f, 0.0f, 0.0f);
+}
+
+AModel::AModel(ID3D11Device* ldevice, const std::string& file, bool packed, const MeshSimplifier::LodSettings& settings)
 {
 	device = ldevice;
-	importModel(file);
+	packVertices = packed;
+	lodSettings = settings;
+	boundsMin = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	boundsMax = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	loaded = importModel(file);
+	upload(device);
+}
+
+AModel::AModel(const std::string& file, bool packed, const MeshSimplifier::LodSettings& settings)
+{
+	device = nullptr;
+	packVertices = packed;
+	lodSettings = settings;
+	boundsMin = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	boundsMax = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	loaded = importModel(file);
 }
 
 AModel::~AModel()
@@ -11,80 +44,199 @@ AModel::~AModel()
 
 }
 
+bool AModel::bakeModel(const std::string& file, MeshOptimizer::Report* report, const MeshSimplifier::LodSettings& lodSettings)
+{
+	unsigned long long sourceHash;
+	if (!MeshCache::hashFile(file.c_str(), sourceHash))
+	{
+		return false;
+	}
+
+	AModel model;
+	model.lodSettings = lodSettings;
+	if (!model.importScene(file))
+	{
+		return false;
+	}
+
+	MeshOptimizer::Report optimization = model.optimizeMesh();
+	if (report) *report = optimization;
+	model.generateLods();
+	model.buildMeshlets();
+	return model.writeCache(MeshCache::getCachePath(file), sourceHash);
+}
+
+const std::vector<MeshCache::Submesh>& AModel::getSubmeshes() const
+{
+	return submeshes;
+}
+
+XMFLOAT3 AModel::getBoundsMin() const
+{
+	return boundsMin;
+}
+
+XMFLOAT3 AModel::getBoundsMax() const
+{
+	return boundsMax;
+}
+
+void AModel::upload(ID3D11Device* ldevice)
+{
+	device = ldevice;
+	if (cache.getMesh().vertexCount > 0)
+	{
+		// Buffers are created straight from the mapped file
+		const MeshCache::MeshDesc& mesh = cache.getMesh();
+		createBuffers(device, (const VertexType*)mesh.vertices, mesh.vertexCount, mesh.indices, mesh.indexCount);
+		cache.close();
+	}
+	else if (!vertices.empty())
+	{
+		initBuffers(device);
+	}
+}
+
+bool AModel::isLoaded() const
+{
+	return loaded;
+}
+
 void AModel::initBuffers(ID3D11Device* device)
 {
-	
+	createBuffers(device, vertices.data(), (int)vertices.size(), indices.data(), (int)indices.size());
+}
+
+void AModel::createBuffers(ID3D11Device* device, const VertexType* vertexData, int vertexTotal, const unsigned long* indexData, int indexTotal)
+{
+	// Packing happens at upload so the cache always holds full precision vertices
+	createVertexBuffer(device, vertexData, vertexTotal, packVertices);
+	createIndexBuffer(device, indexData, indexTotal);
+}
+
+bool AModel::importModel(const std::string& pFile)
+{
+	// Use the baked mesh if it was built from this exact file with the same import flags.
+	// Without the source file there is nothing to check against, so any baked mesh is trusted.
+	unsigned long long sourceHash = 0;
+	bool hasSource = MeshCache::hashFile(pFile.c_str(), sourceHash);
+	std::string cacheFile = MeshCache::getCachePath(pFile);
+
+	if (cache.open(cacheFile.c_str(), importFlags, MeshSimplifier::getSettingsKey(lodSettings), sizeof(VertexType)) && (!hasSource || cache.getSourceHash() == sourceHash))
+	{
+		const MeshCache::MeshDesc& mesh = cache.getMesh();
+		submeshes.assign(mesh.submeshes, mesh.submeshes + mesh.submeshCount);
+		setLods(mesh.lods, (int)mesh.lodCount);
+		modelMeshlets.assign(mesh.meshlets, mesh.meshlets + mesh.meshletCount);
+		setMeshlets(modelMeshlets.data(), (int)modelMeshlets.size());
+		boundsMin = mesh.boundsMin;
+		boundsMax = mesh.boundsMax;
+
+		// The mapping stays open for upload
+		return true;
+	}
+	cache.close();
+
+	if (!hasSource || !importScene(pFile))
+	{
+		return false;
+	}
+
+	optimizeMesh();
+	generateLods();
+	buildMeshlets();
+	writeCache(cacheFile, sourceHash);
+	return true;
 }
 
-void AModel::importModel(const std::string& pFile)
+bool AModel::importScene(const std::string& pFile)
 {
 	// Create an instance of the Importer class
 	Assimp::Importer importer;
-	// And have it read the given file with some example postprocessing
-	// Usually - if speed is not the most important aspect for you - you'll
-	// probably to request more postprocessing than we do in this example.
-	const aiScene* scene = importer.ReadFile(pFile,
-		aiProcess_CalcTangentSpace |
-		aiProcess_Triangulate |
-		aiProcess_JoinIdenticalVertices |
-		aiProcess_SortByPType|
-		aiProcess_MakeLeftHanded|
-		aiProcess_FlipUVs);
-	// If the import failed, report it
-	/*if (!scene)
+	const aiScene* scene = importer.ReadFile(pFile, importFlags);
+	if (!scene)
 	{
-		DoTheErrorLogging(importer.GetErrorString());
 		return false;
-	}*/
-	// Now we can access the file's contents.
-	//modelProcessing(scene);#
+	}
+
+	processNode(scene->mRootNode, scene);
+	return true;
+}
+
+MeshOptimizer::Report AModel::optimizeMesh()
+{
+	MeshOptimizer::Report report;
+	report.before = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertices.size());
 
-	if (scene)
+	// Each submesh only indexes its own vertex range, so it is optimized on its own with indices local to that range
+	for (const MeshCache::Submesh& submesh : submeshes)
 	{
-		processNode(scene->mRootNode, scene);
+		unsigned long* submeshIndices = indices.data() + submesh.indexStart;
+		for (unsigned int i = 0; i < submesh.indexCount; i++) submeshIndices[i] -= submesh.vertexStart;
+
+		MeshOptimizer::optimizeMesh(vertices.data() + submesh.vertexStart, sizeof(VertexType), submesh.vertexCount, offsetof(VertexType, normal), submeshIndices, submesh.indexCount);
+
+		for (unsigned int i = 0; i < submesh.indexCount; i++) submeshIndices[i] += submesh.vertexStart;
 	}
 
-	// Set up the description of the static vertex buffer.
-	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
-	D3D11_SUBRESOURCE_DATA vertexData, indexData;
-	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	vertexBufferDesc.ByteWidth = sizeof(VertexType)* (int)vertices.size();
-	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexBufferDesc.CPUAccessFlags = 0;
-	vertexBufferDesc.MiscFlags = 0;
-	vertexBufferDesc.StructureByteStride = 0;
-	// Give the subresource structure a pointer to the vertex data.
-	vertexData.pSysMem = vertices.data();
-	vertexData.SysMemPitch = 0;
-	vertexData.SysMemSlicePitch = 0;
-	// Now create the vertex buffer.
-	device->CreateBuffer(&vertexBufferDesc, &vertexData, &vertexBuffer);
-
-	// Set up the description of the static index buffer.
-	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	indexBufferDesc.ByteWidth = sizeof(unsigned long)* (int)indices.size();
-	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexBufferDesc.CPUAccessFlags = 0;
-	indexBufferDesc.MiscFlags = 0;
-	indexBufferDesc.StructureByteStride = 0;
-	// Give the subresource structure a pointer to the index data.
-	indexData.pSysMem = indices.data();
-	indexData.SysMemPitch = 0;
-	indexData.SysMemSlicePitch = 0;
-	// Create the index buffer.
-	device->CreateBuffer(&indexBufferDesc, &indexData, &indexBuffer);
-
-	// Release the arrays now that the vertex and index buffers have been created and loaded.
-	//delete vertices;
-	//vertices = 0;
-
-	//delete indices;
-	//indices = 0;
-	vertexCount = (int)vertices.size();
-	indexCount = (int)indices.size();
-
-	//vertices.clear();
-	//indices.clear();
+	report.after = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+	return report;
+}
+
+void AModel::generateLods()
+{
+	if (vertices.empty())
+	{
+		return;
+	}
+
+	// Submeshes are simplified separately, each level holds all of them so it draws in one call
+	std::vector<MeshSimplifier::Range> ranges;
+	for (const MeshCache::Submesh& submesh : submeshes)
+	{
+		ranges.push_back({ submesh.indexStart, submesh.indexCount, submesh.vertexStart, submesh.vertexCount });
+	}
+
+	std::vector<MeshSimplifier::Lod> chain;
+	MeshSimplifier::appendLodChain(indices, ranges.data(), ranges.size(), &vertices[0].position.x, sizeof(VertexType), vertices.size(), lodSettings, chain);
+	setLods(chain.data(), (int)chain.size());
+}
+
+void AModel::buildMeshlets()
+{
+	if (vertices.empty())
+	{
+		return;
+	}
+
+	// Each level is reordered into its own meshlets, so culling works at every level of detail
+	modelMeshlets.clear();
+	for (int level = 0; level < getLodCount(); level++)
+	{
+		unsigned int indexStart = (lodCount == 0) ? 0 : lods[level].indexStart;
+		unsigned int levelIndexCount = (lodCount == 0) ? (unsigned int)indices.size() : lods[level].indexCount;
+		MeshletBuilder::buildMeshlets(indices.data(), indexStart, levelIndexCount, &vertices[0].position.x, &vertices[0].normal.x, sizeof(VertexType), vertices.size(), modelMeshlets);
+	}
+	setMeshlets(modelMeshlets.data(), (int)modelMeshlets.size());
+}
+
+bool AModel::writeCache(const std::string& cacheFile, unsigned long long sourceHash)
+{
+	MeshCache::MeshDesc mesh;
+	mesh.vertices = vertices.data();
+	mesh.vertexStride = sizeof(VertexType);
+	mesh.vertexCount = (unsigned int)vertices.size();
+	mesh.indices = indices.data();
+	mesh.indexCount = (unsigned int)indices.size();
+	mesh.submeshes = submeshes.data();
+	mesh.submeshCount = (unsigned int)submeshes.size();
+	mesh.lods = lods;
+	mesh.lodCount = (unsigned int)lodCount;
+	mesh.meshlets = modelMeshlets.data();
+	mesh.meshletCount = (unsigned int)modelMeshlets.size();
+	mesh.boundsMin = boundsMin;
+	mesh.boundsMax = boundsMax;
+	return MeshCache::write(cacheFile.c_str(), sourceHash, importFlags, MeshSimplifier::getSettingsKey(lodSettings), mesh);
 }
 
 void AModel::modelProcessing(const aiScene* scene)
@@ -232,6 +384,17 @@ void AModel::processMesh(const aiMesh* mesh, const aiScene* scene)
 
 	//---------------------------------
 
+	// Meshes are appended to one buffer, so indices are offset by the vertices already added
+	MeshCache::Submesh submesh;
+	submesh.indexStart = (unsigned int)indices.size();
+	submesh.vertexStart = (unsigned int)vertices.size();
+	submesh.vertexCount = mesh->mNumVertices;
+
+	if (vertices.empty() && mesh->mNumVertices > 0)
+	{
+		boundsMin = boundsMax = XMFLOAT3(mesh->mVertices[0].x, mesh->mVertices[0].y, mesh->mVertices[0].z);
+	}
+
 	for (UINT i = 0; i < mesh->mNumVertices; i++)
 	{
 		XMFLOAT3 vert;
@@ -274,6 +437,9 @@ void AModel::processMesh(const aiMesh* mesh, const aiScene* scene)
 		vertex.tangent = tang;
 		vertex.bitangent = bita;
 		vertices.push_back(vertex);
+
+		XMStoreFloat3(&boundsMin, XMVectorMin(XMLoadFloat3(&boundsMin), XMLoadFloat3(&vert)));
+		XMStoreFloat3(&boundsMax, XMVectorMax(XMLoadFloat3(&boundsMax), XMLoadFloat3(&vert)));
 	}
 
 	for (UINT i = 0; i < mesh->mNumFaces; i++)
@@ -281,8 +447,11 @@ void AModel::processMesh(const aiMesh* mesh, const aiScene* scene)
 		aiFace face = mesh->mFaces[i];
 
 		for (UINT j = 0; j < face.mNumIndices; j++)
-			indices.push_back(face.mIndices[j]);
+			indices.push_back(submesh.vertexStart + face.mIndices[j]);
 	}
+
+	submesh.indexCount = (unsigned int)indices.size() - submesh.indexStart;
+	submeshes.push_back(submesh);
 }
 
 //vector<Texture> ModelLoader::loadMaterialTextures(aiMaterial * mat, aiTextureType type, string typeName, const aiScene * scene)
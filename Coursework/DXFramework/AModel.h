@@ -4,6 +4,11 @@
 * \brief Improved model loader, using the assimp library
 *
 * Inherits from Base Mesh, read a provided file and builds a mesh from the file data.
+* The imported mesh is baked to a .dxmesh file next to the source (see MeshCache). Later runs map the baked file instead of running Assimp,
+* as long as the source file and import flags have not changed.
+* Imported meshes are run through MeshOptimizer before they are baked, so the cache holds the optimized order.
+* A LOD chain is built by MeshSimplifier and baked with the mesh, every level is a range of the same index buffer.
+* Every level is then split into meshlets by MeshletBuilder, also baked, so the renderer can cull parts of the model.
 *
 * \author Paul Robertson
 */
@@ -11,6 +16,8 @@
 #pragma once
 
 #include "BaseMesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 #include "assimp\Importer.hpp"      // C++ importer interface
 #include "assimp\scene.h"           // Output data structure
 #include "assimp\postprocess.h"     // Post processing flags
@@ -26,13 +33,43 @@ public:
 	* Loads a sub-set of model. Tested with single mesh FBX and OBJ. Currently does not auto load textures. 
 	* @param device is the renderer device
 	* @param file path to model file
+	* @param packed uploads the vertices in the 20 byte VertexPacking format, the shader needs a packed vertex shader
+	* @param lodSettings controls the LOD chain, changing them rebuilds the cache
 	*/
-	AModel(ID3D11Device* device, const std::string& file);
+	AModel(ID3D11Device* device, const std::string& file, bool packed = false, const MeshSimplifier::LodSettings& lodSettings = MeshSimplifier::LodSettings());
+
+	/** \brief Loads a model without creating any GPU resources, so it can run on a worker thread (see AssetLoader).
+	* upload() must be called on the thread owning the device before the model is rendered.
+	*/
+	AModel(const std::string& file, bool packed = false, const MeshSimplifier::LodSettings& lodSettings = MeshSimplifier::LodSettings());
 	~AModel();
 
+	void upload(ID3D11Device* device);	///< Creates the buffers of a model loaded without a device
+	bool isLoaded() const;				///< False if neither the cache nor the source file could be read
+
+	/** \brief Imports a model with Assimp and writes its .dxmesh cache, without creating any GPU resources.
+	* Used by the offline mesh baker.
+	* @param file path to model file
+	* @param report optionally receives the vertex cache statistics before and after optimization
+	* @param lodSettings must match the settings the model is loaded with, or the cache is rebuilt at load
+	*/
+	static bool bakeModel(const std::string& file, MeshOptimizer::Report* report = nullptr, const MeshSimplifier::LodSettings& lodSettings = MeshSimplifier::LodSettings());
+
+	const std::vector<MeshCache::Submesh>& getSubmeshes() const;	///< Index and vertex range of every imported mesh
+	XMFLOAT3 getBoundsMin() const;									///< Object space bounding box
+	XMFLOAT3 getBoundsMax() const;
+
 protected:
+	AModel();
+
 	void initBuffers(ID3D11Device* device);
-	void importModel(const std::string& pFile);
+	void createBuffers(ID3D11Device* device, const VertexType* vertexData, int vertexTotal, const unsigned long* indexData, int indexTotal);
+	bool importModel(const std::string& pFile);
+	bool importScene(const std::string& pFile);
+	MeshOptimizer::Report optimizeMesh();
+	void generateLods();
+	void buildMeshlets();
+	bool writeCache(const std::string& cacheFile, unsigned long long sourceHash);
 	void modelProcessing(const aiScene* scene);
 
 	void processScene(const aiScene* scene);
@@ -41,4 +78,11 @@ protected:
 	ID3D11Device* device;
 	std::vector<VertexType> vertices;
 	std::vector<unsigned long> indices;
+	std::vector<MeshCache::Submesh> submeshes;
+	XMFLOAT3 boundsMin, boundsMax;
+	bool packVertices;
+	MeshSimplifier::LodSettings lodSettings;
+	MeshCache cache;	///< Baked mesh mapped by importModel, kept open until upload
+	bool loaded;
+	std::vector<MeshletBuilder::Meshlet> modelMeshlets;
 };
\ No newline at end of file
@@ -0,0 +1,401 @@
+// Asset loader
+// Decodes textures and parses models on worker threads, creates their GPU resources on the owning thread, see AssetLoader.h
+#include "AssetLoader.h"
+#include "AModel.h"
+#include "TextureManager.h"
+#include <wincodec.h>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+namespace
+{
+	// WIC pixel format a texture is decoded to and its matching DXGI format, as the WIC texture loader picks them
+	struct DecodeFormat
+	{
+		WICPixelFormatGUID target;
+		DXGI_FORMAT format;
+		unsigned int bytesPerPixel;
+	};
+
+	DecodeFormat pickDecodeFormat(const WICPixelFormatGUID& source)
+	{
+		if (source == GUID_WICPixelFormat8bppGray) return { GUID_WICPixelFormat8bppGray, DXGI_FORMAT_R8_UNORM, 1 };
+		if (source == GUID_WICPixelFormat16bppGray) return { GUID_WICPixelFormat16bppGray, DXGI_FORMAT_R16_UNORM, 2 };
+		if (source == GUID_WICPixelFormat48bppRGB || source == GUID_WICPixelFormat48bppBGR || source == GUID_WICPixelFormat64bppRGBA
+			|| source == GUID_WICPixelFormat64bppBGRA || source == GUID_WICPixelFormat64bppPRGBA)
+		{
+			return { GUID_WICPixelFormat64bppRGBA, DXGI_FORMAT_R16G16B16A16_UNORM, 8 };
+		}
+		return { GUID_WICPixelFormat32bppRGBA, DXGI_FORMAT_R8G8B8A8_UNORM, 4 };
+	}
+
+	// Decodes the first frame of an image file already in memory into tightly packed rows
+	bool decodeImage(IWICImagingFactory* factory, std::vector<unsigned char>& file, std::vector<unsigned char>& pixels, unsigned int& width, unsigned int& height, unsigned int& rowPitch, DXGI_FORMAT& format)
+	{
+		if (!factory)
+		{
+			return false;
+		}
+
+		IWICStream* stream = nullptr;
+		IWICBitmapDecoder* decoder = nullptr;
+		IWICBitmapFrameDecode* frame = nullptr;
+		IWICFormatConverter* converter = nullptr;
+		bool decoded = false;
+
+		if (SUCCEEDED(factory->CreateStream(&stream)) && SUCCEEDED(stream->InitializeFromMemory(file.data(), (DWORD)file.size()))
+			&& SUCCEEDED(factory->CreateDecoderFromStream(stream, nullptr, WICDecodeMetadataCacheOnDemand, &decoder))
+			&& SUCCEEDED(decoder->GetFrame(0, &frame)))
+		{
+			WICPixelFormatGUID source;
+			UINT frameWidth = 0, frameHeight = 0;
+			if (SUCCEEDED(frame->GetSize(&frameWidth, &frameHeight)) && SUCCEEDED(frame->GetPixelFormat(&source)) && frameWidth > 0 && frameHeight > 0)
+			{
+				DecodeFormat target = pickDecodeFormat(source);
+				width = frameWidth;
+				height = frameHeight;
+				rowPitch = frameWidth * target.bytesPerPixel;
+				format = target.format;
+				pixels.resize((size_t)rowPitch * frameHeight);
+
+				if (source == target.target)
+				{
+					decoded = SUCCEEDED(frame->CopyPixels(nullptr, rowPitch, (UINT)pixels.size(), pixels.data()));
+				}
+				else if (SUCCEEDED(factory->CreateFormatConverter(&converter))
+					&& SUCCEEDED(converter->Initialize(frame, target.target, WICBitmapDitherTypeErrorDiffusion, nullptr, 0.0, WICBitmapPaletteTypeMedianCut)))
+				{
+					decoded = SUCCEEDED(converter->CopyPixels(nullptr, rowPitch, (UINT)pixels.size(), pixels.data()));
+				}
+			}
+		}
+
+		if (converter) converter->Release();
+		if (frame) frame->Release();
+		if (decoder) decoder->Release();
+		if (stream) stream->Release();
+		return decoded;
+	}
+
+	bool readWholeFile(const std::wstring& filename, std::vector<unsigned char>& data)
+	{
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if (!file.good())
+		{
+			return false;
+		}
+		std::streamoff size = file.tellg();
+		if (size <= 0)
+		{
+			return false;
+		}
+		data.resize((size_t)size);
+		file.seekg(0);
+		return file.read((char*)data.data(), size).good();
+	}
+
+	bool hasExtension(const std::wstring& filename, const wchar_t* extension)
+	{
+		std::wstring::size_type dot = filename.rfind(L'.');
+		return dot != std::wstring::npos && _wcsicmp(filename.c_str() + dot + 1, extension) == 0;
+	}
+}
+
+AssetLoader::AssetLoader(ID3D11Device* ldevice, ID3D11DeviceContext* ldeviceContext, TextureManager* ltextureManager, unsigned int threadCount)
+{
+	device = ldevice;
+	deviceContext = ldeviceContext;
+	textureManager = ltextureManager;
+	created = std::chrono::steady_clock::now();
+	inFlight = 0;
+	stopping = false;
+
+	// Leave a core for the thread rendering placeholders while the assets load
+	if (threadCount == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = (cores > 1) ? cores - 1 : 1;
+	}
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&AssetLoader::workerMain, this));
+	}
+}
+
+// Unstarted assets are dropped, the ones already loading are finished and freed.
+AssetLoader::~AssetLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		inFlight -= queued.size();
+		queued.clear();
+	}
+	jobAvailable.notify_all();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+
+	for (std::unique_ptr<Job>& job : completed)
+	{
+		delete job->model;
+	}
+}
+
+void AssetLoader::loadTexture(const wchar_t* uid, const wchar_t* filename, const ImageCallback& onDecoded)
+{
+	std::unique_ptr<Job> job(new Job());
+	job->type = JobType::TEXTURE;
+	job->uid = uid ? uid : L"";
+	// A baked .dds is block compressed, callers reading the pixels get the file's own
+	if (!filename) job->filename = L"";
+	else job->filename = onDecoded ? std::wstring(filename) : TextureManager::findBakedTexture(filename);
+	job->onDecoded = onDecoded;
+	job->dds = hasExtension(job->filename, L"dds");
+	job->name.assign(job->filename.begin(), job->filename.end());
+	job->model = nullptr;
+	queue(std::move(job));
+}
+
+void AssetLoader::loadModel(const std::string& filename, bool packed, const ModelCallback& onLoaded, const MeshSimplifier::LodSettings& lodSettings)
+{
+	std::unique_ptr<Job> job(new Job());
+	job->type = JobType::MODEL;
+	job->name = filename;
+	job->modelFile = filename;
+	job->packed = packed;
+	job->lodSettings = lodSettings;
+	job->onLoaded = onLoaded;
+	job->model = nullptr;
+	queue(std::move(job));
+}
+
+void AssetLoader::queue(std::unique_ptr<Job> job)
+{
+	job->succeeded = false;
+	job->queued = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(std::move(job));
+		inFlight++;
+	}
+	jobAvailable.notify_one();
+}
+
+void AssetLoader::workerMain()
+{
+	// WIC is COM, every worker needs its own apartment and factory
+	HRESULT comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	IWICImagingFactory* factory = nullptr;
+	CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+
+	while (true)
+	{
+		std::unique_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !queued.empty(); });
+			if (queued.empty())
+			{
+				break;
+			}
+			job = std::move(queued.front());
+			queued.pop_front();
+		}
+
+		job->started = std::chrono::steady_clock::now();
+		runJob(*job, factory);
+		job->finished = std::chrono::steady_clock::now();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			completed.push_back(std::move(job));
+			inFlight--;
+		}
+		jobFinished.notify_all();
+	}
+
+	if (factory) factory->Release();
+	if (SUCCEEDED(comResult)) CoUninitialize();
+}
+
+void AssetLoader::runJob(Job& job, void* imagingFactory)
+{
+	if (job.type == JobType::MODEL)
+	{
+		// Built without a device, update() creates the buffers
+		job.model = new AModel(job.modelFile, job.packed, job.lodSettings);
+		job.succeeded = job.model->isLoaded();
+		return;
+	}
+
+	// The file is hashed so a texture with the same content can be shared instead of created again
+	std::vector<unsigned char> file;
+	if (!readWholeFile(job.filename, file))
+	{
+		job.succeeded = false;
+		return;
+	}
+	job.contentHash = TextureManager::hashContent(file.data(), file.size());
+
+	if (job.dds)
+	{
+		// DDS files are already in their GPU format, the bytes go to the DDS loader as they are
+		job.data.swap(file);
+		job.succeeded = true;
+	}
+	else
+	{
+		job.succeeded = decodeImage((IWICImagingFactory*)imagingFactory, file, job.data, job.width, job.height, job.rowPitch, job.format);
+	}
+}
+
+int AssetLoader::update()
+{
+	std::deque<std::unique_ptr<Job>> ready;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ready.swap(completed);
+	}
+
+	for (std::unique_ptr<Job>& job : ready)
+	{
+		auto uploadStart = std::chrono::steady_clock::now();
+		if (job->type == JobType::MODEL)
+		{
+			if (job->succeeded)
+			{
+				job->model->upload(device);
+				if (job->onLoaded) job->onLoaded(job->model);
+				else delete job->model;
+			}
+			else
+			{
+				delete job->model;
+			}
+			job->model = nullptr;
+		}
+		else
+		{
+			if (job->succeeded && !job->dds && job->onDecoded)
+			{
+				Image image = { job->width, job->height, job->rowPitch, job->format, job->data.data() };
+				job->onDecoded(image);
+			}
+			job->succeeded = job->succeeded && createTexture(*job);
+			if (!job->succeeded)
+			{
+				MessageBox(NULL, L"Texture loading error", L"ERROR", MB_OK);
+			}
+		}
+		auto uploadEnd = std::chrono::steady_clock::now();
+
+		Timing timing;
+		timing.name = job->name;
+		timing.waitMs = millisecondsSince(job->queued, job->started);
+		timing.loadMs = millisecondsSince(job->started, job->finished);
+		timing.uploadMs = millisecondsSince(uploadStart, uploadEnd);
+		timing.readyMs = millisecondsSince(created, uploadEnd);
+		timing.succeeded = job->succeeded;
+		timings.push_back(timing);
+	}
+	return (int)ready.size();
+}
+
+void AssetLoader::waitForAll()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		jobFinished.wait(lock, [this]() { return inFlight == 0; });
+	}
+	update();
+}
+
+size_t AssetLoader::getPendingCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return inFlight + completed.size();
+}
+
+const std::vector<AssetLoader::Timing>& AssetLoader::getTimings() const
+{
+	return timings;
+}
+
+double AssetLoader::getLoadTotalMs() const
+{
+	double total = 0.0;
+	for (const Timing& timing : timings)
+	{
+		total += timing.loadMs + timing.uploadMs;
+	}
+	return total;
+}
+
+// Creates the texture and view, with a full mip chain generated on the GPU when the format allows it
+bool AssetLoader::createTexture(Job& job)
+{
+	if (textureManager->shareTexture(job.uid.c_str(), job.contentHash))
+	{
+		return true;
+	}
+
+	ID3D11ShaderResourceView* view = nullptr;
+	if (job.dds)
+	{
+		if (FAILED(CreateDDSTextureFromMemory(device, deviceContext, job.data.data(), job.data.size(), nullptr, &view)))
+		{
+			return false;
+		}
+		textureManager->addTexture(job.uid.c_str(), view, job.contentHash);
+		return true;
+	}
+
+	UINT support = 0;
+	bool generateMips = SUCCEEDED(device->CheckFormatSupport(job.format, &support)) && (support & D3D11_FORMAT_SUPPORT_MIP_AUTOGEN);
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = job.width;
+	desc.Height = job.height;
+	desc.MipLevels = generateMips ? 0 : 1;
+	desc.ArraySize = 1;
+	desc.Format = job.format;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | (generateMips ? D3D11_BIND_RENDER_TARGET : 0);
+	desc.MiscFlags = generateMips ? D3D11_RESOURCE_MISC_GENERATE_MIPS : 0;
+
+	D3D11_SUBRESOURCE_DATA initData = { job.data.data(), job.rowPitch, 0 };
+	ID3D11Texture2D* texture = nullptr;
+	if (FAILED(device->CreateTexture2D(&desc, generateMips ? nullptr : &initData, &texture)))
+	{
+		return false;
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+	viewDesc.Format = job.format;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	viewDesc.Texture2D.MipLevels = generateMips ? (UINT)-1 : 1;
+	HRESULT result = device->CreateShaderResourceView(texture, &viewDesc, &view);
+	if (SUCCEEDED(result) && generateMips)
+	{
+		deviceContext->UpdateSubresource(texture, 0, nullptr, job.data.data(), job.rowPitch, (UINT)job.data.size());
+		deviceContext->GenerateMips(view);
+	}
+	texture->Release();
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// The decoded pixels are not needed once they are on the GPU
+	std::vector<unsigned char>().swap(job.data);
+	textureManager->addTexture(job.uid.c_str(), view, job.contentHash);
+	return true;
+}
+
+double AssetLoader::millisecondsSince(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) const
+{
+	return std::chrono::duration<double, std::milli>(to - from).count();
+}
@@ -0,0 +1,145 @@
+/**
+* \class AssetLoader
+*
+* \brief Loads textures and models on a pool of worker threads
+*
+* Workers read and decode the files: PNG and JPG textures are decoded with WIC, DDS textures are read into memory,
+* and models are imported or mapped from their cache by an AModel built without a device.
+* GPU resources are only created by update(), in one batch per call, on the thread that owns the device context.
+* Until a texture arrives TextureManager returns its default white texture for the uid, and a model is not handed
+* to its callback, so the scene draws with placeholders instead of waiting.
+* Every asset records how long it waited for a worker, how long the worker took and how long the upload took.
+*/
+
+
+#ifndef _ASSETLOADER_H_
+#define _ASSETLOADER_H_
+
+#include <d3d11.h>
+#include "MeshSimplifier.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AModel;
+class TextureManager;
+
+class AssetLoader
+{
+public:
+	/// Load times of one asset, in milliseconds
+	struct Timing
+	{
+		std::string name;
+		double waitMs;		///< Queued before a worker picked it up
+		double loadMs;		///< Reading, decoding or parsing on the worker
+		double uploadMs;	///< Creating the GPU resources in update()
+		double readyMs;		///< From the loader's creation until the asset was ready to draw
+		bool succeeded;
+	};
+
+	/// Receives a loaded model and takes ownership of it
+	typedef std::function<void(AModel* model)> ModelCallback;
+
+	/// A decoded texture's pixels, in the format it is created with, only valid during the callback
+	struct Image
+	{
+		unsigned int width, height;
+		unsigned int rowPitch;			///< Bytes from one row to the next
+		DXGI_FORMAT format;
+		const unsigned char* pixels;
+	};
+
+	/// Reads a texture's pixels on the CPU as it is created
+	typedef std::function<void(const Image& image)> ImageCallback;
+
+	/** \brief Starts the worker threads
+	* @param threadCount is the number of workers, 0 uses every core but the calling one
+	*/
+	AssetLoader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, TextureManager* textureManager, unsigned int threadCount = 0);
+	~AssetLoader();
+
+	/** \brief Queues a texture for the texture manager. A file with the same content as a loaded texture shares it.
+	* @param onDecoded is optionally run by update() with the decoded pixels, before the texture is created. The file itself is then
+	* read rather than its baked .dds, so the pixels are as the file has them, and a .dds file is never decoded so never runs it.
+	*/
+	void loadTexture(const wchar_t* uid, const wchar_t* filename, const ImageCallback& onDecoded = ImageCallback());
+	/// Queues a model. The callback is run by update() once the model's buffers exist, and is not run if the model fails to load.
+	void loadModel(const std::string& filename, bool packed, const ModelCallback& onLoaded, const MeshSimplifier::LodSettings& lodSettings = MeshSimplifier::LodSettings());
+
+	/** \brief Creates the GPU resources of every asset the workers have finished
+	* Call once a frame from the thread owning the device context.
+	* Returns the number of assets that became ready.
+	*/
+	int update();
+	void waitForAll();						///< Blocks until every queued asset is ready
+
+	size_t getPendingCount() const;			///< Assets queued, loading or waiting for update()
+	const std::vector<Timing>& getTimings() const;	///< Timing of every finished asset, in the order they became ready
+	double getLoadTotalMs() const;			///< Sum of the worker and upload times, what loading one by one would have cost
+
+private:
+	enum class JobType
+	{
+		TEXTURE,
+		MODEL
+	};
+
+	struct Job
+	{
+		JobType type;
+		std::string name;
+		bool succeeded;
+		std::chrono::steady_clock::time_point queued, started, finished;
+
+		// Textures, either decoded pixels or the raw bytes of a DDS file
+		std::wstring uid;
+		std::wstring filename;
+		unsigned long long contentHash;
+		bool dds;
+		std::vector<unsigned char> data;
+		unsigned int width, height, rowPitch;
+		DXGI_FORMAT format;
+		ImageCallback onDecoded;
+
+		// Models
+		std::string modelFile;
+		bool packed;
+		MeshSimplifier::LodSettings lodSettings;
+		ModelCallback onLoaded;
+		AModel* model;
+	};
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	void queue(std::unique_ptr<Job> job);
+	void workerMain();
+	void runJob(Job& job, void* imagingFactory);
+	bool createTexture(Job& job);
+	double millisecondsSince(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) const;
+
+	ID3D11Device* device;
+	ID3D11DeviceContext* deviceContext;
+	TextureManager* textureManager;
+	std::chrono::steady_clock::time_point created;
+
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobFinished;
+	std::deque<std::unique_ptr<Job>> queued;
+	std::deque<std::unique_ptr<Job>> completed;
+	size_t inFlight;		///< Queued or running, guarded by mutex
+	bool stopping;
+
+	std::vector<Timing> timings;
+};
+
+#endif
@@ -10,6 +10,12 @@ BaseApplication::BaseApplication()
 // Release resources.
 BaseApplication::~BaseApplication()
 {
+	// Stop the loader first, it adds finished textures to the texture manager
+	if (assetLoader)
+	{
+		delete assetLoader;
+		assetLoader = 0;
+	}
 
 	if (timer)
 	{
@@ -64,6 +70,9 @@ void BaseApplication::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int
 	textureMgr = new TextureManager(renderer->getDevice(), renderer->getDeviceContext());
 	//textureMgr->loadTexture(L"default", L"res/DefaultDiffuse.png");
 
+	// Initialise asset loader, textures and models are loaded in the background and uploaded by frame()
+	assetLoader = new AssetLoader(renderer->getDevice(), renderer->getDeviceContext(), textureMgr);
+
 	//Initialise ImGUI
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO(); (void)io;
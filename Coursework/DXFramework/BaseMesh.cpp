@@ -7,9 +7,24 @@ BaseMesh::BaseMesh()
 {
 	vertexBuffer = nullptr;
 	indexBuffer = nullptr;
+	positionBuffer = nullptr;
 	vertexCount = 0;
 	indexCount = 0;
-
+	vertexFormat = VertexPacking::Format::FULL;
+	positionDecode.offset = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	positionDecode.scale = 1.0f;
+	indexFormat = DXGI_FORMAT_R32_UINT;
+	lodCount = 0;
+	currentLod = 0;
+	sphereCentre = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	sphereRadius = 0.0f;
+	boxMin = boxMax = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	meshlets = nullptr;
+	for (int i = 0; i < MAX_LODS; i++)
+	{
+		lodMeshletStart[i] = 0;
+		lodMeshletCount[i] = 0;
+	}
 }
 
 // Release base objects (index, vertex buffers and texture object.
@@ -26,11 +41,232 @@ BaseMesh::~BaseMesh()
 		vertexBuffer->Release();
 		vertexBuffer = 0;
 	}
+
+	if (positionBuffer)
+	{
+		positionBuffer->Release();
+		positionBuffer = 0;
+	}
 }
 
 int BaseMesh::getIndexCount()
 {
-	return indexCount;
+	if (lodCount == 0)
+	{
+		return indexCount;
+	}
+	return (int)lods[currentLod].indexCount;
+}
+
+int BaseMesh::getIndexStart()
+{
+	if (lodCount == 0)
+	{
+		return 0;
+	}
+	return (int)lods[currentLod].indexStart;
+}
+
+int BaseMesh::getLodCount() const
+{
+	return lodCount == 0 ? 1 : lodCount;
+}
+
+float BaseMesh::getLodError(int level) const
+{
+	if (level <= 0 || level >= lodCount)
+	{
+		return 0.0f;
+	}
+	return lods[level].error;
+}
+
+void BaseMesh::setLod(int level)
+{
+	int last = getLodCount() - 1;
+	currentLod = level < 0 ? 0 : (level > last ? last : level);
+}
+
+int BaseMesh::getLod() const
+{
+	return currentLod;
+}
+
+void BaseMesh::getBoundingSphere(XMFLOAT3& centre, float& radius) const
+{
+	centre = sphereCentre;
+	radius = sphereRadius;
+}
+
+void BaseMesh::getBoundingBox(XMFLOAT3& boxMinimum, XMFLOAT3& boxMaximum) const
+{
+	boxMinimum = boxMin;
+	boxMaximum = boxMax;
+}
+
+void BaseMesh::computeBounds(const XMFLOAT3* firstPosition, size_t vertexStride, int count)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	const char* position = reinterpret_cast<const char*>(firstPosition);
+	XMVECTOR minimum = XMLoadFloat3(firstPosition);
+	XMVECTOR maximum = minimum;
+	for (int i = 1; i < count; i++)
+	{
+		position += vertexStride;
+		XMVECTOR point = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(position));
+		minimum = XMVectorMin(minimum, point);
+		maximum = XMVectorMax(maximum, point);
+	}
+	XMStoreFloat3(&boxMin, minimum);
+	XMStoreFloat3(&boxMax, maximum);
+
+	// Sphere around the bounding box
+	XMStoreFloat3(&sphereCentre, (minimum + maximum) * 0.5f);
+	sphereRadius = XMVectorGetX(XMVector3Length(maximum - minimum)) * 0.5f;
+}
+
+void BaseMesh::setLods(const MeshSimplifier::Lod* levels, int count)
+{
+	lodCount = count < MAX_LODS ? count : MAX_LODS;
+	for (int i = 0; i < lodCount; i++)
+	{
+		lods[i] = levels[i];
+	}
+	currentLod = 0;
+}
+
+int BaseMesh::getMeshletCount() const
+{
+	return meshlets ? lodMeshletCount[currentLod] : 0;
+}
+
+const MeshletBuilder::Meshlet* BaseMesh::getMeshlets() const
+{
+	return meshlets ? meshlets + lodMeshletStart[currentLod] : nullptr;
+}
+
+// Splits the meshlets between the levels of detail, every level's meshlets cover its index range
+void BaseMesh::setMeshlets(const MeshletBuilder::Meshlet* list, int count)
+{
+	meshlets = (count > 0) ? list : nullptr;
+	int levels = getLodCount();
+	int next = 0;
+	for (int level = 0; level < levels; level++)
+	{
+		unsigned int start = (unsigned int)(lodCount == 0 ? 0 : lods[level].indexStart);
+		unsigned int end = (lodCount == 0) ? 0xFFFFFFFFu : start + lods[level].indexCount;
+		while (next < count && list[next].indexStart < start) next++;
+
+		lodMeshletStart[level] = next;
+		while (next < count && list[next].indexStart < end) next++;
+		lodMeshletCount[level] = next - lodMeshletStart[level];
+	}
+}
+
+VertexPacking::Format BaseMesh::getVertexFormat() const
+{
+	return vertexFormat;
+}
+
+XMMATRIX BaseMesh::getDecodeMatrix() const
+{
+	if (vertexFormat == VertexPacking::Format::PACKED)
+	{
+		return VertexPacking::getDecodeMatrix(positionDecode);
+	}
+	return XMMatrixIdentity();
+}
+
+// Creates a static vertex buffer. Packed vertices are less than half the size, see VertexPacking.
+void BaseMesh::createVertexBuffer(ID3D11Device* device, const VertexType* vertices, int count, bool packed)
+{
+	static_assert(sizeof(VertexType) == sizeof(VertexPacking::FullVertex), "VertexType must match VertexPacking::FullVertex");
+
+	D3D11_BUFFER_DESC vertexBufferDesc;
+	D3D11_SUBRESOURCE_DATA vertexData;
+	std::vector<VertexPacking::PackedVertex> packedVertices;
+
+	computeBounds(&vertices[0].position, sizeof(VertexType), count);
+
+	vertexFormat = packed ? VertexPacking::Format::PACKED : VertexPacking::Format::FULL;
+	if (packed)
+	{
+		const VertexPacking::FullVertex* fullVertices = reinterpret_cast<const VertexPacking::FullVertex*>(vertices);
+		positionDecode = VertexPacking::computePositionDecode(fullVertices, count);
+		packedVertices.resize(count);
+		VertexPacking::encode(fullVertices, count, positionDecode, packedVertices.data());
+	}
+
+	// Set up the description of the static vertex buffer.
+	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	vertexBufferDesc.ByteWidth = packed ? sizeof(VertexPacking::PackedVertex) * count : sizeof(VertexType) * count;
+	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.MiscFlags = 0;
+	vertexBufferDesc.StructureByteStride = 0;
+	// Give the subresource structure a pointer to the vertex data.
+	vertexData.pSysMem = packed ? (const void*)packedVertices.data() : (const void*)vertices;
+	vertexData.SysMemPitch = 0;
+	vertexData.SysMemSlicePitch = 0;
+	// Now create the vertex buffer.
+	device->CreateBuffer(&vertexBufferDesc, &vertexData, &vertexBuffer);
+
+	// Split the positions out for depth only passes, which would otherwise fetch the whole vertex for one attribute.
+	// Packed positions are kept packed, they are already the first 8 bytes of a packed vertex.
+	std::vector<XMFLOAT3> positions;
+	std::vector<unsigned short> packedPositions;
+	if (packed)
+	{
+		packedPositions.resize(count * 4);
+		for (int i = 0; i < count; i++)
+		{
+			for (int axis = 0; axis < 4; axis++) packedPositions[i * 4 + axis] = packedVertices[i].position[axis];
+		}
+	}
+	else
+	{
+		positions.resize(count);
+		for (int i = 0; i < count; i++) positions[i] = vertices[i].position;
+	}
+	vertexBufferDesc.ByteWidth = packed ? sizeof(unsigned short) * 4 * count : sizeof(XMFLOAT3) * count;
+	vertexData.pSysMem = packed ? (const void*)packedPositions.data() : (const void*)positions.data();
+	device->CreateBuffer(&vertexBufferDesc, &vertexData, &positionBuffer);
+
+	vertexCount = count;
+}
+
+// Creates a static index buffer. Meshes with less than 65536 vertices get 16 bit indices, halving index bandwidth.
+void BaseMesh::createIndexBuffer(ID3D11Device* device, const unsigned long* indices, int count)
+{
+	D3D11_BUFFER_DESC indexBufferDesc;
+	D3D11_SUBRESOURCE_DATA indexData;
+	std::vector<unsigned short> shortIndices;
+
+	indexFormat = (vertexCount > 0 && vertexCount <= 65536) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	if (indexFormat == DXGI_FORMAT_R16_UINT)
+	{
+		shortIndices.assign(indices, indices + count);
+	}
+
+	// Set up the description of the static index buffer.
+	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	indexBufferDesc.ByteWidth = (indexFormat == DXGI_FORMAT_R16_UINT) ? sizeof(unsigned short) * count : sizeof(unsigned long) * count;
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+	indexBufferDesc.StructureByteStride = 0;
+	// Give the subresource structure a pointer to the index data.
+	indexData.pSysMem = (indexFormat == DXGI_FORMAT_R16_UINT) ? (const void*)shortIndices.data() : (const void*)indices;
+	indexData.SysMemPitch = 0;
+	indexData.SysMemSlicePitch = 0;
+	// Create the index buffer.
+	device->CreateBuffer(&indexBufferDesc, &indexData, &indexBuffer);
+
+	indexCount = count;
 }
 
 // Sends geometry data to the GPU. Default primitive topology is TriangleList.
@@ -41,12 +277,32 @@ void BaseMesh::sendData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLO
 	unsigned int offset;
 	
 	// Set vertex buffer stride and offset.
-	stride = sizeof(VertexType);
+	stride = (vertexFormat == VertexPacking::Format::PACKED) ? sizeof(VertexPacking::PackedVertex) : sizeof(VertexType);
 	offset = 0;
 
-	deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
-	deviceContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-	deviceContext->IASetPrimitiveTopology(top);
+	// Meshes drawn again and again only bind their buffers once
+	D3D11StateCache* stateCache = D3D11StateCache::get(deviceContext);
+	stateCache->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+	stateCache->IASetIndexBuffer(indexBuffer, indexFormat, 0);
+	stateCache->IASetPrimitiveTopology(top);
+}
+
+// Sends the position only stream, or the whole vertices for meshes that made their own vertex buffer.
+void BaseMesh::sendPositionData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top)
+{
+	if (!positionBuffer)
+	{
+		sendData(deviceContext, top);
+		return;
+	}
+
+	unsigned int stride = (vertexFormat == VertexPacking::Format::PACKED) ? sizeof(unsigned short) * 4 : sizeof(XMFLOAT3);
+	unsigned int offset = 0;
+
+	D3D11StateCache* stateCache = D3D11StateCache::get(deviceContext);
+	stateCache->IASetVertexBuffers(0, 1, &positionBuffer, &stride, &offset);
+	stateCache->IASetIndexBuffer(indexBuffer, indexFormat, 0);
+	stateCache->IASetPrimitiveTopology(top);
 }
 
 
@@ -14,6 +14,10 @@
 
 #include <d3d11.h>
 #include <directxmath.h>
+#include "VertexPacking.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "D3D11StateCache.h"
 
 using namespace DirectX;
 
@@ -50,17 +54,61 @@ public:
 	BaseMesh();
 	~BaseMesh();
 
+	/// Most levels of detail a mesh keeps
+	static const int MAX_LODS = 8;
+
 	/// Transfers mesh data to the GPU.
 	virtual void sendData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	int getIndexCount();			///< Returns total index value of the mesh
+	/** \brief Transfers only the vertex positions to the GPU, for depth only passes
+	* Meshes made with createVertexBuffer have a position only stream, others send their whole vertices. The position is the first
+	* element of every vertex format, so a position only input layout reads either.
+	*/
+	void sendPositionData(ID3D11DeviceContext* deviceContext, D3D_PRIMITIVE_TOPOLOGY top = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	int getIndexCount();			///< Returns the index count of the current level of detail, the whole mesh without a LOD chain
+	int getIndexStart();			///< Returns the first index of the current level of detail
+	VertexPacking::Format getVertexFormat() const;	///< Layout of the vertex buffer, shaders pick their vertex shader from it
+	XMMATRIX getDecodeMatrix() const;				///< Maps packed positions back to object space, identity for full vertices
+
+	int getLodCount() const;						///< Levels of detail in the index buffer, 1 without a LOD chain
+	float getLodError(int level) const;				///< Object space error of a level of detail, 0 for full detail
+	void setLod(int level);							///< Selects the level of detail getIndexStart() and getIndexCount() return, clamped to the chain
+	int getLod() const;
+	void getBoundingSphere(XMFLOAT3& centre, float& radius) const;	///< Object space sphere around the mesh, used for LOD selection
+	void getBoundingBox(XMFLOAT3& boxMinimum, XMFLOAT3& boxMaximum) const;	///< Object space box around the mesh, used for frustum culling
+	int getMeshletCount() const;									///< Meshlets of the current level of detail, 0 if the mesh has none
+	const MeshletBuilder::Meshlet* getMeshlets() const;				///< First meshlet of the current level of detail
 	//D3D11_INPUT_ELEMENT_DESC getInputLayout();
 
 protected:
 	virtual void initBuffers(ID3D11Device*) = 0;
 
+	/// Creates the vertex buffer, packing the vertices first if asked to, and the position only stream in the same format. Sets vertexCount.
+	void createVertexBuffer(ID3D11Device* device, const VertexType* vertices, int count, bool packed = false);
+	/// Creates the index buffer, using 16 bit indices when vertexCount allows it. Sets indexCount.
+	void createIndexBuffer(ID3D11Device* device, const unsigned long* indices, int count);
+	/// Stores the LOD chain of the index buffer, see MeshSimplifier::appendLodChain. Levels past MAX_LODS are dropped.
+	void setLods(const MeshSimplifier::Lod* levels, int count);
+	/// Points the mesh at its meshlets, sorted by index start and owned by the derived mesh. Call after setLods.
+	void setMeshlets(const MeshletBuilder::Meshlet* list, int count);
+	/// Fits the bounding box around the positions and the bounding sphere around the box. createVertexBuffer calls it,
+	/// meshes creating their own vertex buffer call it themselves.
+	void computeBounds(const XMFLOAT3* firstPosition, size_t vertexStride, int count);
+
 	ID3D11Buffer *vertexBuffer, *indexBuffer;
+	ID3D11Buffer* positionBuffer;	///< Positions split from the vertices, 12 bytes each or 8 when packed
 	//D3D11_INPUT_ELEMENT_DESC *inputLayout;
 	int vertexCount, indexCount;
+	VertexPacking::Format vertexFormat;
+	VertexPacking::PositionDecode positionDecode;
+	DXGI_FORMAT indexFormat;
+	// Fixed size, meshes call the base destructor by hand so BaseMesh must stay trivially destructible
+	MeshSimplifier::Lod lods[MAX_LODS];
+	int lodCount, currentLod;
+	XMFLOAT3 sphereCentre;
+	float sphereRadius;
+	XMFLOAT3 boxMin, boxMax;
+	const MeshletBuilder::Meshlet* meshlets;
+	int lodMeshletStart[MAX_LODS], lodMeshletCount[MAX_LODS];
 };
 
 #endif
\ No newline at end of file
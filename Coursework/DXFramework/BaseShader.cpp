@@ -8,6 +8,22 @@ BaseShader::BaseShader(ID3D11Device* device, HWND lhwnd)
 {
 	renderer = device;
 	hwnd = hwnd;
+
+	// Stages a shader does not load stay unbound, a depth only shader has no pixel shader at all
+	vertexShader = nullptr;
+	pixelShader = nullptr;
+	hullShader = nullptr;
+	domainShader = nullptr;
+	geometryShader = nullptr;
+	computeShader = nullptr;
+	layout = nullptr;
+	packedVertexShader = nullptr;
+	packedLayout = nullptr;
+	instancedVertexShader = nullptr;
+	instancedPackedVertexShader = nullptr;
+	instancedPixelShader = nullptr;
+	vertexFormat = VertexPacking::Format::FULL;
+	depthOnly = false;
 }
 
 // Release resources (if used).
@@ -25,6 +41,36 @@ BaseShader::~BaseShader()
 		vertexShader = 0;
 	}
 
+	if (packedVertexShader)
+	{
+		packedVertexShader->Release();
+		packedVertexShader = 0;
+	}
+
+	if (packedLayout)
+	{
+		packedLayout->Release();
+		packedLayout = 0;
+	}
+
+	if (instancedVertexShader)
+	{
+		instancedVertexShader->Release();
+		instancedVertexShader = 0;
+	}
+
+	if (instancedPackedVertexShader)
+	{
+		instancedPackedVertexShader->Release();
+		instancedPackedVertexShader = 0;
+	}
+
+	if (instancedPixelShader)
+	{
+		instancedPixelShader->Release();
+		instancedPixelShader = 0;
+	}
+
 	if (hullShader)
 	{
 		hullShader->Release();
@@ -116,6 +162,101 @@ void BaseShader::loadVertexShader(const wchar_t* filename)
 	vertexShaderBuffer = 0;
 }
 
+// Given pre-compiled file, load and create the vertex shader for packed meshes.
+void BaseShader::loadPackedVertexShader(const wchar_t* filename)
+{
+	ID3DBlob* vertexShaderBuffer = 0;
+
+	// Reads compiled shader into buffer (bytecode).
+	HRESULT result = D3DReadFileToBlob(filename, &vertexShaderBuffer);
+	if (result != S_OK)
+	{
+		MessageBox(NULL, filename, L"File ERROR", MB_OK);
+		exit(0);
+	}
+
+	renderer->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &packedVertexShader);
+
+	// This setup needs to match VertexPacking::PackedVertex and the packed shader input.
+	D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TANGENTFRAME", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+	unsigned int numElements = sizeof(polygonLayout) / sizeof(polygonLayout[0]);
+
+	renderer->CreateInputLayout(polygonLayout, numElements, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), &packedLayout);
+
+	vertexShaderBuffer->Release();
+	vertexShaderBuffer = 0;
+}
+
+// Given pre-compiled file, load and create the instanced vertex shader for a vertex format.
+// Its vertex inputs match the non-instanced shader's, so that shader's input layout is used with it.
+void BaseShader::loadInstancedVertexShader(const wchar_t* filename, VertexPacking::Format format)
+{
+	ID3DBlob* vertexShaderBuffer = 0;
+
+	// Reads compiled shader into buffer (bytecode).
+	HRESULT result = D3DReadFileToBlob(filename, &vertexShaderBuffer);
+	if (result != S_OK)
+	{
+		MessageBox(NULL, filename, L"File ERROR", MB_OK);
+		exit(0);
+	}
+
+	ID3D11VertexShader** target = (format == VertexPacking::Format::PACKED) ? &instancedPackedVertexShader : &instancedVertexShader;
+	renderer->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, target);
+
+	vertexShaderBuffer->Release();
+	vertexShaderBuffer = 0;
+}
+
+// Given pre-compiled file, load and create a vertex shader that only reads positions, with a layout for a vertex format.
+// The layout has just the position, at the start of the vertex, so it reads position only streams and whole vertices alike.
+void BaseShader::loadPositionVertexShader(const wchar_t* filename, VertexPacking::Format format)
+{
+	ID3DBlob* vertexShaderBuffer = 0;
+
+	// Reads compiled shader into buffer (bytecode).
+	HRESULT result = D3DReadFileToBlob(filename, &vertexShaderBuffer);
+	if (result != S_OK)
+	{
+		MessageBox(NULL, filename, L"File ERROR", MB_OK);
+		exit(0);
+	}
+
+	bool packed = (format == VertexPacking::Format::PACKED);
+	renderer->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, packed ? &packedVertexShader : &vertexShader);
+
+	// Packed positions are UNORM16 with w = 1, full ones three floats, w defaults to 1.
+	D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
+		{ "POSITION", 0, packed ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+	renderer->CreateInputLayout(polygonLayout, 1, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), packed ? &packedLayout : &layout);
+
+	vertexShaderBuffer->Release();
+	vertexShaderBuffer = 0;
+}
+
+// Given pre-compiled file, load and create the pixel shader for instanced renders.
+void BaseShader::loadInstancedPixelShader(const wchar_t* filename)
+{
+	ID3DBlob* pixelShaderBuffer = 0;
+
+	// Reads compiled shader into buffer (bytecode).
+	HRESULT result = D3DReadFileToBlob(filename, &pixelShaderBuffer);
+	if (result != S_OK)
+	{
+		MessageBox(NULL, filename, L"File ERROR", MB_OK);
+		exit(0);
+	}
+
+	renderer->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &instancedPixelShader);
+
+	pixelShaderBuffer->Release();
+	pixelShaderBuffer = 0;
+}
 
 void BaseShader::loadTextureVertexShader(const wchar_t* filename)
 {
@@ -473,45 +614,110 @@ void BaseShader::loadComputeShader(const wchar_t* filename)
 }
 
 // De/Activate shader stages and send shaders to GPU.
-void BaseShader::render(ID3D11DeviceContext* deviceContext, int indexCount)
+void BaseShader::setVertexFormat(VertexPacking::Format format)
+{
+	vertexFormat = format;
+}
+
+void BaseShader::setDepthOnly(bool ldepthOnly)
 {
-	// Set the vertex input layout.
-	deviceContext->IASetInputLayout(layout);
+	depthOnly = ldepthOnly;
+}
+
+void BaseShader::setShaderStages(ID3D11DeviceContext* deviceContext, bool instanced)
+{
+	// Shaders go through the cache, so repeated draws with one shader only set it once.
+	D3D11StateCache* stateCache = D3D11StateCache::get(deviceContext);
+
+	// Set the vertex input layout and vertex shader matching the mesh's vertices, instanced shaders share the layouts.
+	if (vertexFormat == VertexPacking::Format::PACKED && packedVertexShader)
+	{
+		stateCache->IASetInputLayout(packedLayout);
+		stateCache->VSSetShader((instanced && instancedPackedVertexShader) ? instancedPackedVertexShader : packedVertexShader);
+	}
+	else
+	{
+		stateCache->IASetInputLayout(layout);
+		stateCache->VSSetShader((instanced && instancedVertexShader) ? instancedVertexShader : vertexShader);
+	}
 
-	// Set the vertex and pixel shaders that will be used to render.
-	deviceContext->VSSetShader(vertexShader, NULL, 0);
-	deviceContext->PSSetShader(pixelShader, NULL, 0);
-	deviceContext->CSSetShader(NULL, NULL, 0);
+	// Set the pixel shader that will be used to render.
+	if (depthOnly) stateCache->PSSetShader(NULL);
+	else stateCache->PSSetShader((instanced && instancedPixelShader) ? instancedPixelShader : pixelShader);
+	stateCache->CSSetShader(NULL);
 	
 	// if Hull shader is not null then set HS and DS
 	if (hullShader)
 	{
-		deviceContext->HSSetShader(hullShader, NULL, 0);
-		deviceContext->DSSetShader(domainShader, NULL, 0);
+		stateCache->HSSetShader(hullShader);
+		stateCache->DSSetShader(domainShader);
 	}
 	else
 	{
-		deviceContext->HSSetShader(NULL, NULL, 0);
-		deviceContext->DSSetShader(NULL, NULL, 0);
+		stateCache->HSSetShader(NULL);
+		stateCache->DSSetShader(NULL);
 	}
 
 	// if geometry shader is not null then set GS
 	if (geometryShader)
 	{
-		deviceContext->GSSetShader(geometryShader, NULL, 0);
+		stateCache->GSSetShader(geometryShader);
 	}
 	else
 	{
-		deviceContext->GSSetShader(NULL, NULL, 0);
+		stateCache->GSSetShader(NULL);
 	}
+}
+
+void BaseShader::render(ID3D11DeviceContext* deviceContext, int indexCount, int startIndex)
+{
+	setShaderStages(deviceContext, false);
 
 	// Render the triangle.
-	deviceContext->DrawIndexed(indexCount, 0, 0);
+	D3D11StateCache::get(deviceContext)->DrawIndexed(indexCount, startIndex, 0);
+}
+
+void BaseShader::renderInstanced(ID3D11DeviceContext* deviceContext, int indexCount, int instanceCount, int startIndex)
+{
+	setShaderStages(deviceContext, true);
+
+	// Render every instance of the triangles in one draw.
+	D3D11StateCache::get(deviceContext)->DrawIndexedInstanced(indexCount, instanceCount, startIndex, 0, 0);
+}
+
+void BaseShader::reserveStructuredBuffer(ID3D11Buffer** buffer, ID3D11ShaderResourceView** view, UINT& capacity, UINT count, UINT stride)
+{
+	if (*buffer && count <= capacity) return;
+
+	if (*view) (*view)->Release();
+	if (*buffer) (*buffer)->Release();
+	*view = nullptr;
+	*buffer = nullptr;
+
+	// Double so a growing count does not recreate it every frame
+	capacity = (capacity * 2 > count) ? capacity * 2 : count;
+
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = capacity * stride;
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = stride;
+	renderer->CreateBuffer(&bufferDesc, NULL, buffer);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+	viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	viewDesc.Buffer.FirstElement = 0;
+	viewDesc.Buffer.NumElements = capacity;
+	renderer->CreateShaderResourceView(*buffer, &viewDesc, view);
 }
 
 // Dispatch the compute shader.
 void BaseShader::compute(ID3D11DeviceContext* dc, int x, int y, int z)
 {
-	dc->CSSetShader(computeShader, NULL, 0);
-	dc->Dispatch(x, y, z);
+	D3D11StateCache* stateCache = D3D11StateCache::get(dc);
+	stateCache->CSSetShader(computeShader);
+	stateCache->Dispatch(x, y, z);
 }
\ No newline at end of file
@@ -24,6 +24,9 @@ D3D::D3D(int screenWidth, int screenHeight, bool vsync, HWND hwnd, bool fullscre
 	// Configure and create DirectX 11 renderer
 	// include z buffer for 2D rendering and alpha blend state.
 	createDevice();
+	// Binds go through the cache from here on, so it can drop the redundant ones
+	stateCache = new D3D11StateCache(deviceContext);
+	constantRing = new D3D11ConstantRing(device, deviceContext, stateCache);
 	createSwapchain();
 	createRenderTargetView();
 	createDepthBuffer();
@@ -180,7 +183,7 @@ void D3D::createStencilBuffer()
 
 	// Create the depth stencil state.
 	device->CreateDepthStencilState(&depthStencilDesc, &depthStencilState);
-	deviceContext->OMSetDepthStencilState(depthStencilState, 1);
+	stateCache->OMSetDepthStencilState(depthStencilState, 1);
 
 	// Initialise the depth stencil view.
 	D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc;
@@ -191,7 +194,7 @@ void D3D::createStencilBuffer()
 
 	// Create the depth stencil view.
 	device->CreateDepthStencilView(depthStencilBuffer, &depthStencilViewDesc, &depthStencilView);
-	deviceContext->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
+	stateCache->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
 
 }
 
@@ -213,7 +216,7 @@ void D3D::createDefaultRasterState()
 
 	// Create the rasterizer state from the description we just filled out.
 	device->CreateRasterizerState(&rasterDesc, &rasterState);
-	deviceContext->RSSetState(rasterState);
+	stateCache->RSSetState(rasterState);
 
 	//create raster state with wireframe enabled
 	rasterDesc.FillMode = D3D11_FILL_WIREFRAME;
@@ -351,6 +354,18 @@ D3D::~D3D()
 		renderTargetView = 0;
 	}
 
+	if (constantRing)
+	{
+		delete constantRing;
+		constantRing = 0;
+	}
+
+	if (stateCache)
+	{
+		delete stateCache;
+		stateCache = 0;
+	}
+
 	if (deviceContext)
 	{
 		deviceContext->Release();
@@ -397,6 +412,8 @@ void D3D::endScene()
 	{
 		swapChain->Present(0, 0);
 	}
+	constantRing->endFrame();
+	stateCache->endFrame();
 
 	return;
 }
@@ -413,6 +430,16 @@ ID3D11DeviceContext* D3D::getDeviceContext()
 	return deviceContext;
 }
 
+D3D11StateCache* D3D::getStateCache()
+{
+	return stateCache;
+}
+
+D3D11ConstantRing* D3D::getConstantRing()
+{
+	return constantRing;
+}
+
 
 XMMATRIX D3D::getProjectionMatrix()
 {
@@ -437,11 +464,11 @@ void D3D::setZBuffer(bool b)
 	zbufferState = b;
 	if (zbufferState)
 	{
-		deviceContext->OMSetDepthStencilState(depthStencilState, 1);
+		stateCache->OMSetDepthStencilState(depthStencilState, 1);
 	}
 	else
 	{
-		deviceContext->OMSetDepthStencilState(depthDisabledStencilState, 1);
+		stateCache->OMSetDepthStencilState(depthDisabledStencilState, 1);
 	}
 }
 
@@ -464,12 +491,12 @@ void D3D::setAlphaBlending(bool b)
 	if (alphaBlendState)
 	{
 		// Turn on the alpha blending.
-		deviceContext->OMSetBlendState(alphaEnableBlendingState, blendFactor, 0xffffffff);
+		stateCache->OMSetBlendState(alphaEnableBlendingState, blendFactor, 0xffffffff);
 	}
 	else
 	{
 		// Turn off the alpha blending.
-		deviceContext->OMSetBlendState(alphaDisableBlendingState, blendFactor, 0xffffffff);
+		stateCache->OMSetBlendState(alphaDisableBlendingState, blendFactor, 0xffffffff);
 	}
 }
 
@@ -481,7 +508,7 @@ bool D3D::getAlphaBlendingState()
 // Set the back buffer as the render target
 void D3D::setBackBufferRenderTarget()
 {
-	deviceContext->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
+	stateCache->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
 	return;
 }
 
@@ -498,11 +525,11 @@ void D3D::setWireframeMode(bool b)
 	wireframeState = b;
 	if (wireframeState)
 	{
-		deviceContext->RSSetState(rasterStateWF);
+		stateCache->RSSetState(rasterStateWF);
 	}
 	else
 	{
-		deviceContext->RSSetState(rasterState);
+		stateCache->RSSetState(rasterState);
 	}
 }
 
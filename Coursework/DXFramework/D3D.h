@@ -22,6 +22,8 @@
 #include <vector>
 #include <dxgi.h>
 #include <string>
+#include "D3D11StateCache.h"
+#include "D3D11ConstantRing.h"
 //#include <winerror.h>
 
 using namespace DirectX;
@@ -57,6 +59,8 @@ public:
 
 	ID3D11Device* getDevice();	///< Returns render device
 	ID3D11DeviceContext* getDeviceContext(); ///< Returns renderer device context
+	D3D11StateCache* getStateCache();	///< Returns the state cache binds and draws should go through
+	D3D11ConstantRing* getConstantRing();	///< Returns the ring per draw constants are uploaded to
 
 	XMMATRIX getProjectionMatrix();	///< Returns default projection matrix
 	XMMATRIX getWorldMatrix();		///< Returns identity world matrix
@@ -108,6 +112,8 @@ protected:
 	IDXGISwapChain* swapChain;
 	ID3D11Device* device;
 	ID3D11DeviceContext* deviceContext;
+	D3D11StateCache* stateCache;				///< Filters redundant binds to deviceContext
+	D3D11ConstantRing* constantRing;			///< Per draw constants, bound as ranges of one buffer
 	ID3D11RenderTargetView* renderTargetView;	///< Default render target
 	ID3D11Texture2D* depthStencilBuffer;		///< Depth and stencil buffer
 	ID3D11DepthStencilState* depthStencilState;
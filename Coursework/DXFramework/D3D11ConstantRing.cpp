@@ -0,0 +1,176 @@
+// Direct3D 11 constant ring
+// Sub-allocates per draw constants from one buffer, fenced by end of frame queries, see D3D11ConstantRing.h
+#include "D3D11ConstantRing.h"
+#include <cstring>
+
+D3D11ConstantRing::D3D11ConstantRing(ID3D11Device* ldevice, ID3D11DeviceContext* ldeviceContext, D3D11StateCache* lstateCache, UINT capacity)
+	: ring(capacity, CONSTANT_ALIGNMENT)
+{
+	device = ldevice;
+	deviceContext = ldeviceContext;
+	stateCache = lstateCache;
+	buffer = nullptr;
+	enabled = true;
+	mapped = false;
+	nextFence = 0;
+	memset(&stats, 0, sizeof(stats));
+	memset(&lastFrameStats, 0, sizeof(lastFrameStats));
+
+	// Ranges are bound through the cache, so it needs a context that can bind them, and the driver has to allow offsets and no overwrite maps
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	supported = stateCache->supportsConstantBufferRanges()
+		&& SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options)))
+		&& options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+	if (!supported) return;
+
+	// 11.1 allows constant buffers bigger than a shader can see, only the bound range has to fit in 4096 constants
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = (UINT)ring.getCapacity();
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	bufferDesc.StructureByteStride = 0;
+	if (FAILED(device->CreateBuffer(&bufferDesc, NULL, &buffer)))
+	{
+		buffer = nullptr;
+		supported = false;
+	}
+}
+
+D3D11ConstantRing::~D3D11ConstantRing()
+{
+	for (Fence& fence : fences)
+	{
+		fence.query->Release();
+	}
+	fences.clear();
+	for (ID3D11Query* query : freeQueries)
+	{
+		query->Release();
+	}
+	freeQueries.clear();
+
+	if (buffer)
+	{
+		buffer->Release();
+		buffer = 0;
+	}
+}
+
+D3D11ConstantRing::Allocation D3D11ConstantRing::upload(const void* data, UINT size, ID3D11Buffer* fallback)
+{
+	if (!supported || !enabled) return uploadFallback(data, size, fallback);
+
+	size_t offset = ring.allocate(size);
+	if (offset == RingAllocator::INVALID_OFFSET)
+	{
+		// Full, free whatever the GPU has finished with since the frame ended and try once more
+		retireCompleted();
+		offset = ring.allocate(size);
+		if (offset == RingAllocator::INVALID_OFFSET) return uploadFallback(data, size, fallback);
+	}
+
+	// No overwrite promises the GPU is not reading this range, the fences make sure of it
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (FAILED(deviceContext->Map(buffer, 0, mapped ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD, 0, &mappedResource)))
+	{
+		return uploadFallback(data, size, fallback);
+	}
+	memcpy((char*)mappedResource.pData + offset, data, size);
+	deviceContext->Unmap(buffer, 0);
+	mapped = true;
+
+	UINT alignedSize = (UINT)ring.align(size);
+	stats.uploads++;
+	stats.bytes += alignedSize;
+	return Allocation{ buffer, (UINT)(offset / 16), alignedSize / 16 };
+}
+
+D3D11ConstantRing::Allocation D3D11ConstantRing::uploadFallback(const void* data, UINT size, ID3D11Buffer* fallback)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	deviceContext->Map(fallback, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	memcpy(mappedResource.pData, data, size);
+	deviceContext->Unmap(fallback, 0);
+	stats.fallbacks++;
+	return Allocation{ fallback, 0, 0 };
+}
+
+void D3D11ConstantRing::bind(StateCache::Stage stage, UINT slot, const Allocation& allocation)
+{
+	StateCache::Handle handle = allocation.buffer;
+	if (allocation.constantCount > 0)
+	{
+		stateCache->setConstantBufferRanges(stage, slot, 1, &handle, &allocation.firstConstant, &allocation.constantCount);
+	}
+	else
+	{
+		stateCache->setConstantBuffers(stage, slot, 1, &handle);
+	}
+}
+
+void D3D11ConstantRing::endFrame()
+{
+	lastFrameStats = stats;
+	memset(&stats, 0, sizeof(stats));
+	if (!supported) return;
+
+	// The query completes once the GPU has run everything before it, so this frame's ranges can be reused after it
+	ID3D11Query* query = nullptr;
+	if (!freeQueries.empty())
+	{
+		query = freeQueries.back();
+		freeQueries.pop_back();
+	}
+	else
+	{
+		D3D11_QUERY_DESC queryDesc = { D3D11_QUERY_EVENT, 0 };
+		if (FAILED(device->CreateQuery(&queryDesc, &query)))
+		{
+			// Without a fence the frame's ranges can never be known to be free, so stop using the ring
+			supported = false;
+			return;
+		}
+	}
+	deviceContext->End(query);
+	nextFence++;
+	fences.push_back(Fence{ query, nextFence });
+	ring.endFrame(nextFence);
+
+	retireCompleted();
+}
+
+void D3D11ConstantRing::retireCompleted()
+{
+	unsigned long long completed = 0;
+	while (!fences.empty())
+	{
+		// Do not flush, a fence not yet reached is simply left for later
+		if (deviceContext->GetData(fences.front().query, NULL, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK) break;
+		completed = fences.front().value;
+		freeQueries.push_back(fences.front().query);
+		fences.pop_front();
+	}
+	if (completed > 0) ring.retire(completed);
+}
+
+bool D3D11ConstantRing::isSupported() const
+{
+	return supported;
+}
+
+void D3D11ConstantRing::setEnabled(bool lenabled)
+{
+	enabled = lenabled;
+}
+
+bool D3D11ConstantRing::isEnabled() const
+{
+	return enabled;
+}
+
+const D3D11ConstantRing::Stats& D3D11ConstantRing::getStats() const
+{
+	return lastFrameStats;
+}
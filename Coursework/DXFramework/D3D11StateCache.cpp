@@ -0,0 +1,197 @@
+// Direct3D 11 state cache
+// Passes the state cache's calls on to a device context, see D3D11StateCache.h
+#include "D3D11StateCache.h"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+	// Every cache, so get can find one from its context, there is normally only the one
+	std::vector<D3D11StateCache*> caches;
+	std::vector<ID3D11DeviceContext*> cacheContexts;
+
+	template<class T> T* object(StateCache::Handle handle)
+	{
+		return const_cast<T*>(static_cast<const T*>(handle));
+	}
+
+	template<class T> T* const* objects(const StateCache::Handle* handles)
+	{
+		return reinterpret_cast<T* const*>(const_cast<void* const*>(handles));
+	}
+}
+
+D3D11StateCache::D3D11StateCache(ID3D11DeviceContext* ldeviceContext) : StateCache(&deviceContext), deviceContext(ldeviceContext)
+{
+	caches.push_back(this);
+	cacheContexts.push_back(ldeviceContext);
+}
+
+D3D11StateCache::~D3D11StateCache()
+{
+	size_t index = std::find(caches.begin(), caches.end(), this) - caches.begin();
+	if (index < caches.size())
+	{
+		caches.erase(caches.begin() + index);
+		cacheContexts.erase(cacheContexts.begin() + index);
+	}
+}
+
+D3D11StateCache* D3D11StateCache::get(ID3D11DeviceContext* ldeviceContext)
+{
+	for (size_t i = 0; i < cacheContexts.size(); i++)
+	{
+		if (cacheContexts[i] == ldeviceContext) return caches[i];
+	}
+	return nullptr;
+}
+
+D3D11StateCache::DeviceContext::DeviceContext(ID3D11DeviceContext* deviceContext)
+{
+	context = deviceContext;
+	context1 = nullptr;
+	if (FAILED(context->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&context1)))
+	{
+		context1 = nullptr;
+	}
+}
+
+D3D11StateCache::DeviceContext::~DeviceContext()
+{
+	if (context1)
+	{
+		context1->Release();
+		context1 = 0;
+	}
+}
+
+void D3D11StateCache::DeviceContext::setShaderResources(Stage stage, unsigned int start, unsigned int count, const Handle* views)
+{
+	ID3D11ShaderResourceView* const* srvs = objects<ID3D11ShaderResourceView>(views);
+	switch (stage)
+	{
+	case Stage::VERTEX_SHADER: context->VSSetShaderResources(start, count, srvs); break;
+	case Stage::HULL_SHADER: context->HSSetShaderResources(start, count, srvs); break;
+	case Stage::DOMAIN_SHADER: context->DSSetShaderResources(start, count, srvs); break;
+	case Stage::GEOMETRY_SHADER: context->GSSetShaderResources(start, count, srvs); break;
+	case Stage::PIXEL_SHADER: context->PSSetShaderResources(start, count, srvs); break;
+	case Stage::COMPUTE_SHADER: context->CSSetShaderResources(start, count, srvs); break;
+	}
+}
+
+void D3D11StateCache::DeviceContext::setConstantBuffers(Stage stage, unsigned int start, unsigned int count, const Handle* buffers)
+{
+	ID3D11Buffer* const* cbs = objects<ID3D11Buffer>(buffers);
+	switch (stage)
+	{
+	case Stage::VERTEX_SHADER: context->VSSetConstantBuffers(start, count, cbs); break;
+	case Stage::HULL_SHADER: context->HSSetConstantBuffers(start, count, cbs); break;
+	case Stage::DOMAIN_SHADER: context->DSSetConstantBuffers(start, count, cbs); break;
+	case Stage::GEOMETRY_SHADER: context->GSSetConstantBuffers(start, count, cbs); break;
+	case Stage::PIXEL_SHADER: context->PSSetConstantBuffers(start, count, cbs); break;
+	case Stage::COMPUTE_SHADER: context->CSSetConstantBuffers(start, count, cbs); break;
+	}
+}
+
+void D3D11StateCache::DeviceContext::setConstantBufferRanges(Stage stage, unsigned int start, unsigned int count, const Handle* buffers, const unsigned int* firstConstants, const unsigned int* constantCounts)
+{
+	// Only reached once something bound a range, which needs 11.1
+	if (!context1) return;
+	ID3D11Buffer* const* cbs = objects<ID3D11Buffer>(buffers);
+	switch (stage)
+	{
+	case Stage::VERTEX_SHADER: context1->VSSetConstantBuffers1(start, count, cbs, firstConstants, constantCounts); break;
+	case Stage::HULL_SHADER: context1->HSSetConstantBuffers1(start, count, cbs, firstConstants, constantCounts); break;
+	case Stage::DOMAIN_SHADER: context1->DSSetConstantBuffers1(start, count, cbs, firstConstants, constantCounts); break;
+	case Stage::GEOMETRY_SHADER: context1->GSSetConstantBuffers1(start, count, cbs, firstConstants, constantCounts); break;
+	case Stage::PIXEL_SHADER: context1->PSSetConstantBuffers1(start, count, cbs, firstConstants, constantCounts); break;
+	case Stage::COMPUTE_SHADER: context1->CSSetConstantBuffers1(start, count, cbs, firstConstants, constantCounts); break;
+	}
+}
+
+void D3D11StateCache::DeviceContext::setSamplers(Stage stage, unsigned int start, unsigned int count, const Handle* samplers)
+{
+	ID3D11SamplerState* const* states = objects<ID3D11SamplerState>(samplers);
+	switch (stage)
+	{
+	case Stage::VERTEX_SHADER: context->VSSetSamplers(start, count, states); break;
+	case Stage::HULL_SHADER: context->HSSetSamplers(start, count, states); break;
+	case Stage::DOMAIN_SHADER: context->DSSetSamplers(start, count, states); break;
+	case Stage::GEOMETRY_SHADER: context->GSSetSamplers(start, count, states); break;
+	case Stage::PIXEL_SHADER: context->PSSetSamplers(start, count, states); break;
+	case Stage::COMPUTE_SHADER: context->CSSetSamplers(start, count, states); break;
+	}
+}
+
+void D3D11StateCache::DeviceContext::setShader(Stage stage, Handle shader)
+{
+	switch (stage)
+	{
+	case Stage::VERTEX_SHADER: context->VSSetShader(object<ID3D11VertexShader>(shader), NULL, 0); break;
+	case Stage::HULL_SHADER: context->HSSetShader(object<ID3D11HullShader>(shader), NULL, 0); break;
+	case Stage::DOMAIN_SHADER: context->DSSetShader(object<ID3D11DomainShader>(shader), NULL, 0); break;
+	case Stage::GEOMETRY_SHADER: context->GSSetShader(object<ID3D11GeometryShader>(shader), NULL, 0); break;
+	case Stage::PIXEL_SHADER: context->PSSetShader(object<ID3D11PixelShader>(shader), NULL, 0); break;
+	case Stage::COMPUTE_SHADER: context->CSSetShader(object<ID3D11ComputeShader>(shader), NULL, 0); break;
+	}
+}
+
+void D3D11StateCache::DeviceContext::setInputLayout(Handle layout)
+{
+	context->IASetInputLayout(object<ID3D11InputLayout>(layout));
+}
+
+void D3D11StateCache::DeviceContext::setPrimitiveTopology(unsigned int topology)
+{
+	context->IASetPrimitiveTopology((D3D11_PRIMITIVE_TOPOLOGY)topology);
+}
+
+void D3D11StateCache::DeviceContext::setVertexBuffers(unsigned int start, unsigned int count, const Handle* buffers, const unsigned int* strides, const unsigned int* offsets)
+{
+	context->IASetVertexBuffers(start, count, objects<ID3D11Buffer>(buffers), strides, offsets);
+}
+
+void D3D11StateCache::DeviceContext::setIndexBuffer(Handle buffer, unsigned int format, unsigned int offset)
+{
+	context->IASetIndexBuffer(object<ID3D11Buffer>(buffer), (DXGI_FORMAT)format, offset);
+}
+
+void D3D11StateCache::DeviceContext::setBlendState(Handle state, const float* blendFactor, unsigned int sampleMask)
+{
+	context->OMSetBlendState(object<ID3D11BlendState>(state), blendFactor, sampleMask);
+}
+
+void D3D11StateCache::DeviceContext::setDepthStencilState(Handle state, unsigned int stencilRef)
+{
+	context->OMSetDepthStencilState(object<ID3D11DepthStencilState>(state), stencilRef);
+}
+
+void D3D11StateCache::DeviceContext::setRasterizerState(Handle state)
+{
+	context->RSSetState(object<ID3D11RasterizerState>(state));
+}
+
+void D3D11StateCache::DeviceContext::setRenderTargets(unsigned int count, const Handle* views, Handle depthView)
+{
+	context->OMSetRenderTargets(count, objects<ID3D11RenderTargetView>(views), object<ID3D11DepthStencilView>(depthView));
+}
+
+void D3D11StateCache::DeviceContext::draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	context->Draw(vertexCount, startVertex);
+}
+
+void D3D11StateCache::DeviceContext::drawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	context->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void D3D11StateCache::DeviceContext::drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance)
+{
+	context->DrawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+void D3D11StateCache::DeviceContext::dispatch(unsigned int x, unsigned int y, unsigned int z)
+{
+	context->Dispatch(x, y, z);
+}
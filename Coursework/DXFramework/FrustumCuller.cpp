@@ -0,0 +1,188 @@
+// Frustum culler
+// Object bounds against view frustums, four objects to an SSE register, see FrustumCuller.h
+#include "FrustumCuller.h"
+#include <cmath>
+#include <xmmintrin.h>
+
+void FrustumCuller::computeFrustum(const float viewProjection[16], Frustum& frustum, float minDepth, float maxDepth)
+{
+	// Clip space is the world position times the matrix, so each clip coordinate is a column (Gribb and Hartmann).
+	// D3D clips x and y to [-w, w] and z to [0, w], the depth slice narrows z to [minDepth w, maxDepth w].
+	const float* m = viewProjection;
+	const float columns[4][4] =
+	{
+		{ m[0], m[4], m[8], m[12] },
+		{ m[1], m[5], m[9], m[13] },
+		{ m[2], m[6], m[10], m[14] },
+		{ m[3], m[7], m[11], m[15] },
+	};
+	for (int i = 0; i < 4; i++)
+	{
+		frustum.planes[0][i] = columns[3][i] + columns[0][i];
+		frustum.planes[1][i] = columns[3][i] - columns[0][i];
+		frustum.planes[2][i] = columns[3][i] + columns[1][i];
+		frustum.planes[3][i] = columns[3][i] - columns[1][i];
+		frustum.planes[4][i] = columns[2][i] - minDepth * columns[3][i];
+		frustum.planes[5][i] = maxDepth * columns[3][i] - columns[2][i];
+	}
+
+	for (int p = 0; p < 6; p++)
+	{
+		float* plane = frustum.planes[p];
+		float planeLength = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (planeLength > 0.0f)
+		{
+			for (int i = 0; i < 4; i++) plane[i] /= planeLength;
+		}
+	}
+}
+
+void FrustumCuller::transformBounds(const float boxMin[3], const float boxMax[3], const float world[16], float centre[3], float extents[3], float& radius)
+{
+	float objectCentre[3], objectExtents[3];
+	for (int i = 0; i < 3; i++)
+	{
+		objectCentre[i] = (boxMin[i] + boxMax[i]) * 0.5f;
+		objectExtents[i] = (boxMax[i] - boxMin[i]) * 0.5f;
+	}
+
+	// Row vectors, so row i of the matrix is where the object's axis i ends up (Arvo)
+	float largestScale = 0.0f;
+	for (int column = 0; column < 3; column++)
+	{
+		centre[column] = world[12 + column];
+		extents[column] = 0.0f;
+		for (int row = 0; row < 3; row++)
+		{
+			centre[column] += objectCentre[row] * world[row * 4 + column];
+			extents[column] += objectExtents[row] * fabsf(world[row * 4 + column]);
+		}
+	}
+	for (int row = 0; row < 3; row++)
+	{
+		float scale = sqrtf(world[row * 4] * world[row * 4] + world[row * 4 + 1] * world[row * 4 + 1] + world[row * 4 + 2] * world[row * 4 + 2]);
+		if (scale > largestScale) largestScale = scale;
+	}
+	radius = sqrtf(objectExtents[0] * objectExtents[0] + objectExtents[1] * objectExtents[1] + objectExtents[2] * objectExtents[2]) * largestScale;
+}
+
+void FrustumCuller::clear()
+{
+	centreX.clear();
+	centreY.clear();
+	centreZ.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+	radii.clear();
+	count = 0;
+}
+
+unsigned int FrustumCuller::add(const float centre[3], const float extents[3], float radius)
+{
+	// Grow four at a time, the padding is zero sized bounds at the origin and is never reported
+	if (count % 4 == 0)
+	{
+		size_t padded = count + 4;
+		centreX.resize(padded, 0.0f);
+		centreY.resize(padded, 0.0f);
+		centreZ.resize(padded, 0.0f);
+		extentX.resize(padded, 0.0f);
+		extentY.resize(padded, 0.0f);
+		extentZ.resize(padded, 0.0f);
+		radii.resize(padded, 0.0f);
+	}
+
+	centreX[count] = centre[0];
+	centreY[count] = centre[1];
+	centreZ[count] = centre[2];
+	extentX[count] = extents[0];
+	extentY[count] = extents[1];
+	extentZ[count] = extents[2];
+	radii[count] = radius;
+	return (unsigned int)count++;
+}
+
+size_t FrustumCuller::getCount() const
+{
+	return count;
+}
+
+void FrustumCuller::cull(const Frustum& frustum, std::vector<unsigned int>& visible, Stats* stats) const
+{
+	visible.clear();
+
+	// Each plane splatted across a register, with the absolute normal for the box's projected radius
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+	for (int p = 0; p < 6; p++)
+	{
+		planeX[p] = _mm_set1_ps(frustum.planes[p][0]);
+		planeY[p] = _mm_set1_ps(frustum.planes[p][1]);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p][2]);
+		planeW[p] = _mm_set1_ps(frustum.planes[p][3]);
+		absX[p] = _mm_set1_ps(fabsf(frustum.planes[p][0]));
+		absY[p] = _mm_set1_ps(fabsf(frustum.planes[p][1]));
+		absZ[p] = _mm_set1_ps(fabsf(frustum.planes[p][2]));
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	for (size_t first = 0; first < count; first += 4)
+	{
+		__m128 x = _mm_loadu_ps(&centreX[first]);
+		__m128 y = _mm_loadu_ps(&centreY[first]);
+		__m128 z = _mm_loadu_ps(&centreZ[first]);
+		__m128 ex = _mm_loadu_ps(&extentX[first]);
+		__m128 ey = _mm_loadu_ps(&extentY[first]);
+		__m128 ez = _mm_loadu_ps(&extentZ[first]);
+		__m128 radius = _mm_loadu_ps(&radii[first]);
+
+		__m128 outside = zero;
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+			__m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)), _mm_mul_ps(absZ[p], ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, _mm_min_ps(boxRadius, radius)), zero));
+		}
+
+		int outsideMask = _mm_movemask_ps(outside);
+		size_t lanes = (count - first < 4) ? count - first : 4;
+		for (size_t lane = 0; lane < lanes; lane++)
+		{
+			if (!(outsideMask & (1 << lane))) visible.push_back((unsigned int)(first + lane));
+		}
+	}
+
+	if (stats)
+	{
+		stats->tested = (unsigned int)count;
+		stats->culled = (unsigned int)(count - visible.size());
+	}
+}
+
+void FrustumCuller::cullScalar(const Frustum& frustum, std::vector<unsigned int>& visible, Stats* stats) const
+{
+	visible.clear();
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!isOutside((unsigned int)i, frustum)) visible.push_back((unsigned int)i);
+	}
+
+	if (stats)
+	{
+		stats->tested = (unsigned int)count;
+		stats->culled = (unsigned int)(count - visible.size());
+	}
+}
+
+bool FrustumCuller::isOutside(unsigned int index, const Frustum& frustum) const
+{
+	for (int p = 0; p < 6; p++)
+	{
+		const float* plane = frustum.planes[p];
+		float distance = plane[0] * centreX[index] + plane[1] * centreY[index] + plane[2] * centreZ[index] + plane[3];
+		float boxRadius = fabsf(plane[0]) * extentX[index] + fabsf(plane[1]) * extentY[index] + fabsf(plane[2]) * extentZ[index];
+		float radius = (boxRadius < radii[index]) ? boxRadius : radii[index];
+		if (distance + radius < 0.0f) return true;
+	}
+	return false;
+}
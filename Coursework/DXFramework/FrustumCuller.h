@@ -0,0 +1,66 @@
+/**
+* \class FrustumCuller
+*
+* \brief Culls object bounds against view frustums, four objects at a time with SSE
+*
+* Objects are added once a frame with their world space bounds, a box given by its centre and half extents, and a sphere
+* around the same centre. They are kept as a structure of arrays, so cull() tests four objects against a plane at once.
+* An object is outside when its box or its sphere is wholly behind one of the planes. Both are conservative, so each plane
+* uses whichever is tighter. computeFrustum takes the planes from any view projection pair, and can limit them to a slice
+* of the depth range, as the depth of field layers draw. Plain C++ and SSE, it can be measured without a device.
+*/
+
+
+#ifndef _FRUSTUMCULLER_H_
+#define _FRUSTUMCULLER_H_
+
+#include <cstddef>
+#include <vector>
+
+class FrustumCuller
+{
+public:
+	/// Planes of a view, normalised, a point is inside when ax + by + cz + d >= 0 for all of them
+	struct Frustum
+	{
+		float planes[6][4];
+	};
+
+	/// Counters from a cull
+	struct Stats
+	{
+		unsigned int tested;
+		unsigned int culled;
+	};
+
+	/** \brief Planes of a view projection matrix, in the row vector layout DirectXMath stores
+	* @param minDepth and maxDepth limit the frustum to the depth buffer values between them, 0 and 1 keeps all of it
+	*/
+	static void computeFrustum(const float viewProjection[16], Frustum& frustum, float minDepth = 0.0f, float maxDepth = 1.0f);
+
+	/** \brief World bounds of an object space box moved by a world matrix, row vector layout
+	* The box is refitted with the absolute value of the matrix, the sphere is around the object box scaled by the largest axis scale.
+	*/
+	static void transformBounds(const float boxMin[3], const float boxMax[3], const float world[16], float centre[3], float extents[3], float& radius);
+
+	void clear();
+	unsigned int add(const float centre[3], const float extents[3], float radius);	///< Adds an object's world bounds, returns its index
+	size_t getCount() const;
+
+	/** \brief Finds the objects inside a frustum, four at a time
+	* @param visible is cleared and receives the indices of the objects inside, in order
+	* @param stats optionally receives the counters
+	*/
+	void cull(const Frustum& frustum, std::vector<unsigned int>& visible, Stats* stats = nullptr) const;
+	void cullScalar(const Frustum& frustum, std::vector<unsigned int>& visible, Stats* stats = nullptr) const;	///< As cull, one object at a time
+	bool isOutside(unsigned int index, const Frustum& frustum) const;
+
+private:
+	// Bounds as a structure of arrays, padded to a multiple of four so cull() never reads past the end
+	std::vector<float> centreX, centreY, centreZ;
+	std::vector<float> extentX, extentY, extentZ;
+	std::vector<float> radii;
+	size_t count = 0;
+};
+
+#endif
@@ -0,0 +1,476 @@
+// Light clusterer
+// Bins view space light spheres into a froxel grid, four lights or four tiles to an SSE register, slices split between threads, see LightClusterer.h
+#include "LightClusterer.h"
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <emmintrin.h>
+
+const float LightClusterer::MAX_RADIUS = 1.0e6f;
+
+namespace
+{
+	// Fewer lights than this to a thread are binned faster than the threads start
+	const size_t MIN_LIGHTS_PER_THREAD = 256;
+
+	// Padding tiles' boxes, no sphere reaches them
+	const float EMPTY_BOX = 1.0e30f;
+
+	// Splits the items into a chunk for each thread, the calling thread takes the first chunk
+	void runChunks(unsigned int threadCount, size_t itemCount, const std::function<void(size_t, size_t)>& function)
+	{
+		if (threadCount > itemCount) threadCount = (unsigned int)itemCount;
+		if (threadCount <= 1)
+		{
+			function(0, itemCount);
+			return;
+		}
+
+		std::vector<std::thread> workers;
+		workers.reserve(threadCount - 1);
+		for (unsigned int i = 1; i < threadCount; ++i)
+		{
+			workers.emplace_back(function, itemCount * i / threadCount, itemCount * (i + 1) / threadCount);
+		}
+
+		function(0, itemCount / threadCount);
+
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	// Slice of a depth, clamped to the grid
+	int sliceOf(float depth, float scale, float bias, unsigned int sliceCount)
+	{
+		int slice = (int)floorf(logf(depth) * scale + bias);
+		if (slice < 0) return 0;
+		if (slice >= (int)sliceCount) return (int)sliceCount - 1;
+		return slice;
+	}
+}
+
+LightClusterer::LightClusterer(unsigned int tileCountX, unsigned int tileCountY, unsigned int sliceCount) :
+	tileCountX(tileCountX), tileCountY(tileCountY), sliceCount(sliceCount)
+{
+	paddedTileCountX = (tileCountX + 3) & ~3u;
+	clusterLights.resize(getClusterCount());
+	clusterRanges.resize(getClusterCount() * 2, 0);
+	setProjection(projectionScaleX, projectionScaleY, nearPlane, farPlane);
+}
+
+float LightClusterer::attenuationRange(float constant, float linear, float quadratic, float intensity, float threshold)
+{
+	if (threshold <= 0.0f) return MAX_RADIUS;
+
+	// constant + linear d + quadratic d^2 = intensity / threshold, the positive root
+	float target = intensity / threshold - constant;
+	if (target <= 0.0f) return 0.0f;
+	float range = MAX_RADIUS;
+	if (quadratic > 0.0f)
+	{
+		range = (-linear + sqrtf(linear * linear + 4.0f * quadratic * target)) / (2.0f * quadratic);
+	}
+	else if (linear > 0.0f)
+	{
+		range = target / linear;
+	}
+	return (range < MAX_RADIUS) ? range : MAX_RADIUS;
+}
+
+void LightClusterer::spotBounds(const float apex[3], const float direction[3], float range, float outerAngle, float centre[3], float& radius)
+{
+	// Past 45 degrees the apex is inside the sphere around the rim, before it the rim is inside the sphere through the apex
+	float cosAngle = cosf(outerAngle);
+	float distance;
+	if (cosAngle < 0.70710678f)
+	{
+		distance = range * cosAngle;
+		radius = range * sinf(outerAngle);
+	}
+	else
+	{
+		distance = range / (2.0f * cosAngle);
+		radius = distance;
+	}
+	// A cone wider than a half sphere is bounded by the sphere of its range
+	if (cosAngle <= 0.0f)
+	{
+		distance = 0.0f;
+		radius = range;
+	}
+	for (int axis = 0; axis < 3; axis++)
+	{
+		centre[axis] = apex[axis] + direction[axis] * distance;
+	}
+}
+
+void LightClusterer::setProjection(float projectionScaleX, float projectionScaleY, float nearPlane, float farPlane)
+{
+	this->projectionScaleX = projectionScaleX;
+	this->projectionScaleY = projectionScaleY;
+	this->nearPlane = nearPlane;
+	this->farPlane = farPlane;
+
+	// Slices are spaced exponentially, slice s starts at near * (far / near)^(s / sliceCount)
+	float depthRatio = logf(farPlane / nearPlane);
+	sliceScale = sliceCount / depthRatio;
+	sliceBias = -(float)sliceCount * logf(nearPlane) / depthRatio;
+	sliceNear.resize(sliceCount);
+	sliceFar.resize(sliceCount);
+	for (unsigned int slice = 0; slice < sliceCount; ++slice)
+	{
+		sliceNear[slice] = (slice == 0) ? nearPlane : sliceFar[slice - 1];
+		sliceFar[slice] = (slice + 1 == sliceCount) ? farPlane : nearPlane * expf(depthRatio * (slice + 1) / sliceCount);
+	}
+
+	// A tile's edges at a depth are its NDC edges times the depth over the projection's scale, so its box in a slice is
+	// the further out of the two at the slice's near and far depths
+	tileMinX.resize(paddedTileCountX * sliceCount);
+	tileMaxX.resize(paddedTileCountX * sliceCount);
+	tileMinY.resize(tileCountY * sliceCount);
+	tileMaxY.resize(tileCountY * sliceCount);
+	for (unsigned int slice = 0; slice < sliceCount; ++slice)
+	{
+		float depths[2] = { sliceNear[slice], sliceFar[slice] };
+		for (unsigned int x = 0; x < paddedTileCountX; ++x)
+		{
+			float* minX = &tileMinX[slice * paddedTileCountX + x];
+			float* maxX = &tileMaxX[slice * paddedTileCountX + x];
+			if (x >= tileCountX)
+			{
+				*minX = EMPTY_BOX;
+				*maxX = -EMPTY_BOX;
+				continue;
+			}
+			float left = -1.0f + 2.0f * x / tileCountX;
+			float right = -1.0f + 2.0f * (x + 1) / tileCountX;
+			*minX = fminf(left * depths[0], left * depths[1]) / projectionScaleX;
+			*maxX = fmaxf(right * depths[0], right * depths[1]) / projectionScaleX;
+		}
+		for (unsigned int y = 0; y < tileCountY; ++y)
+		{
+			// Tile rows go down the screen, NDC y goes up
+			float top = 1.0f - 2.0f * y / tileCountY;
+			float bottom = 1.0f - 2.0f * (y + 1) / tileCountY;
+			tileMinY[slice * tileCountY + y] = fminf(bottom * depths[0], bottom * depths[1]) / projectionScaleY;
+			tileMaxY[slice * tileCountY + y] = fmaxf(top * depths[0], top * depths[1]) / projectionScaleY;
+		}
+	}
+}
+
+void LightClusterer::clear()
+{
+	centreX.clear();
+	centreY.clear();
+	centreZ.clear();
+	radii.clear();
+	count = 0;
+}
+
+unsigned int LightClusterer::add(const float viewCentre[3], float radius)
+{
+	// Grow four at a time, the padding is zero sized spheres at the origin, which is before the near plane
+	if (count % 4 == 0)
+	{
+		size_t padded = count + 4;
+		centreX.resize(padded, 0.0f);
+		centreY.resize(padded, 0.0f);
+		centreZ.resize(padded, 0.0f);
+		radii.resize(padded, 0.0f);
+	}
+
+	centreX[count] = viewCentre[0];
+	centreY[count] = viewCentre[1];
+	centreZ[count] = viewCentre[2];
+	radii[count] = (radius < MAX_RADIUS) ? radius : MAX_RADIUS;
+	return (unsigned int)count++;
+}
+
+size_t LightClusterer::getCount() const
+{
+	return count;
+}
+
+void LightClusterer::build(unsigned int threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+		if (threadCount == 0) threadCount = 1;
+	}
+	size_t lightThreads = count / MIN_LIGHTS_PER_THREAD;
+	if (lightThreads < threadCount) threadCount = (lightThreads > 0) ? (unsigned int)lightThreads : 1;
+
+	size_t padded = (count + 3) & ~(size_t)3;
+	for (std::vector<int>* bounds : { &firstTileX, &lastTileX, &firstTileY, &lastTileY, &firstSlice, &lastSlice }) bounds->resize(padded);
+
+	// Each light's bounds, split by light, then each thread bins every light into its own slices
+	runChunks(threadCount, padded / 4, [this](size_t first, size_t end) { computeBounds(first * 4, (end * 4 < count) ? end * 4 : count); });
+	runChunks(threadCount, sliceCount, [this](size_t first, size_t end) { binSlices((unsigned int)first, (unsigned int)end, true); });
+
+	// Offsets are a running total over every slice, then each thread packs its own
+	finishBuild();
+	runChunks(threadCount, sliceCount, [this](size_t first, size_t end) { packSlices((unsigned int)first, (unsigned int)end); });
+}
+
+void LightClusterer::buildScalar()
+{
+	size_t padded = (count + 3) & ~(size_t)3;
+	for (std::vector<int>* bounds : { &firstTileX, &lastTileX, &firstTileY, &lastTileY, &firstSlice, &lastSlice }) bounds->resize(padded);
+
+	computeBoundsScalar(0, count);
+	binSlices(0, sliceCount, false);
+	finishBuild();
+	packSlices(0, sliceCount);
+}
+
+void LightClusterer::computeBounds(size_t first, size_t lightEnd)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 minusOne = _mm_set1_ps(-1.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 nearDepth = _mm_set1_ps(nearPlane);
+	const __m128 farDepth = _mm_set1_ps(farPlane);
+	const __m128 scaleX = _mm_set1_ps(projectionScaleX);
+	const __m128 scaleY = _mm_set1_ps(projectionScaleY);
+	const __m128 tilesX = _mm_set1_ps((float)tileCountX);
+	const __m128 tilesY = _mm_set1_ps((float)tileCountY);
+	const __m128 lastX = _mm_set1_ps((float)(tileCountX - 1));
+	const __m128 lastY = _mm_set1_ps((float)(tileCountY - 1));
+
+	for (size_t light = first; light < lightEnd; light += 4)
+	{
+		__m128 x = _mm_loadu_ps(&centreX[light]);
+		__m128 y = _mm_loadu_ps(&centreY[light]);
+		__m128 z = _mm_loadu_ps(&centreZ[light]);
+		__m128 radius = _mm_loadu_ps(&radii[light]);
+
+		// The sphere's depth range in the grid
+		__m128 front = _mm_sub_ps(z, radius);
+		__m128 back = _mm_add_ps(z, radius);
+		__m128 minDepth = _mm_max_ps(front, nearDepth);
+		__m128 maxDepth = _mm_min_ps(back, farDepth);
+		__m128 inside = _mm_and_ps(_mm_cmpge_ps(back, nearDepth), _mm_cmple_ps(front, farDepth));
+
+		// Each edge of the box around the sphere projects furthest out at the nearest depth on the side of the view it is on,
+		// and the furthest depth on the other side
+		__m128 left = _mm_sub_ps(x, radius);
+		__m128 right = _mm_add_ps(x, radius);
+		__m128 bottom = _mm_sub_ps(y, radius);
+		__m128 top = _mm_add_ps(y, radius);
+		__m128 leftNear = _mm_cmplt_ps(left, zero);
+		__m128 rightNear = _mm_cmpgt_ps(right, zero);
+		__m128 bottomNear = _mm_cmplt_ps(bottom, zero);
+		__m128 topNear = _mm_cmpgt_ps(top, zero);
+		__m128 minX = _mm_div_ps(_mm_mul_ps(scaleX, left), _mm_or_ps(_mm_and_ps(leftNear, minDepth), _mm_andnot_ps(leftNear, maxDepth)));
+		__m128 maxX = _mm_div_ps(_mm_mul_ps(scaleX, right), _mm_or_ps(_mm_and_ps(rightNear, minDepth), _mm_andnot_ps(rightNear, maxDepth)));
+		__m128 minY = _mm_div_ps(_mm_mul_ps(scaleY, bottom), _mm_or_ps(_mm_and_ps(bottomNear, minDepth), _mm_andnot_ps(bottomNear, maxDepth)));
+		__m128 maxY = _mm_div_ps(_mm_mul_ps(scaleY, top), _mm_or_ps(_mm_and_ps(topNear, minDepth), _mm_andnot_ps(topNear, maxDepth)));
+		inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(maxX, minusOne), _mm_cmple_ps(minX, one)));
+		inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(maxY, minusOne), _mm_cmple_ps(minY, one)));
+
+		// NDC to tiles, clamped to the grid before truncating so truncating floors, rows go down the screen
+		__m128 tileMinXf = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(minX, half), half), tilesX);
+		__m128 tileMaxXf = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(maxX, half), half), tilesX);
+		__m128 tileMinYf = _mm_mul_ps(_mm_sub_ps(half, _mm_mul_ps(maxY, half)), tilesY);
+		__m128 tileMaxYf = _mm_mul_ps(_mm_sub_ps(half, _mm_mul_ps(minY, half)), tilesY);
+		_mm_storeu_si128((__m128i*)&firstTileX[light], _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(tileMinXf, zero), lastX)));
+		_mm_storeu_si128((__m128i*)&lastTileX[light], _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(tileMaxXf, zero), lastX)));
+		_mm_storeu_si128((__m128i*)&firstTileY[light], _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(tileMinYf, zero), lastY)));
+		_mm_storeu_si128((__m128i*)&lastTileY[light], _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(tileMaxYf, zero), lastY)));
+
+		// Slices need a logarithm, one lane at a time
+		int insideMask = _mm_movemask_ps(inside);
+		float minDepths[4], maxDepths[4];
+		_mm_storeu_ps(minDepths, minDepth);
+		_mm_storeu_ps(maxDepths, maxDepth);
+		size_t lanes = (lightEnd - light < 4) ? lightEnd - light : 4;
+		for (size_t lane = 0; lane < lanes; ++lane)
+		{
+			if (insideMask & (1 << lane))
+			{
+				firstSlice[light + lane] = sliceOf(minDepths[lane], sliceScale, sliceBias, sliceCount);
+				lastSlice[light + lane] = sliceOf(maxDepths[lane], sliceScale, sliceBias, sliceCount);
+			}
+			else
+			{
+				firstSlice[light + lane] = (int)sliceCount;
+				lastSlice[light + lane] = -1;
+			}
+		}
+	}
+}
+
+void LightClusterer::computeBoundsScalar(size_t first, size_t lightEnd)
+{
+	for (size_t light = first; light < lightEnd; ++light)
+	{
+		float x = centreX[light], y = centreY[light], z = centreZ[light], radius = radii[light];
+
+		float front = z - radius, back = z + radius;
+		float minDepth = (front > nearPlane) ? front : nearPlane;
+		float maxDepth = (back < farPlane) ? back : farPlane;
+		bool inside = back >= nearPlane && front <= farPlane;
+
+		float left = x - radius, right = x + radius, bottom = y - radius, top = y + radius;
+		float minX = projectionScaleX * left / ((left < 0.0f) ? minDepth : maxDepth);
+		float maxX = projectionScaleX * right / ((right > 0.0f) ? minDepth : maxDepth);
+		float minY = projectionScaleY * bottom / ((bottom < 0.0f) ? minDepth : maxDepth);
+		float maxY = projectionScaleY * top / ((top > 0.0f) ? minDepth : maxDepth);
+		inside = inside && maxX >= -1.0f && minX <= 1.0f && maxY >= -1.0f && minY <= 1.0f;
+
+		auto toTile = [](float tile, unsigned int tileCount) {
+			float last = (float)(tileCount - 1);
+			return (int)((tile < 0.0f) ? 0.0f : (tile > last) ? last : tile);
+		};
+		firstTileX[light] = toTile((minX * 0.5f + 0.5f) * tileCountX, tileCountX);
+		lastTileX[light] = toTile((maxX * 0.5f + 0.5f) * tileCountX, tileCountX);
+		firstTileY[light] = toTile((0.5f - maxY * 0.5f) * tileCountY, tileCountY);
+		lastTileY[light] = toTile((0.5f - minY * 0.5f) * tileCountY, tileCountY);
+		firstSlice[light] = inside ? sliceOf(minDepth, sliceScale, sliceBias, sliceCount) : (int)sliceCount;
+		lastSlice[light] = inside ? sliceOf(maxDepth, sliceScale, sliceBias, sliceCount) : -1;
+	}
+}
+
+void LightClusterer::binSlices(unsigned int first, unsigned int sliceEnd, bool simd)
+{
+	for (unsigned int cluster = first * tileCountX * tileCountY; cluster < sliceEnd * tileCountX * tileCountY; ++cluster)
+	{
+		clusterLights[cluster].clear();
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	for (size_t light = 0; light < count; ++light)
+	{
+		int sliceBegin = (firstSlice[light] > (int)first) ? firstSlice[light] : (int)first;
+		int sliceLast = (lastSlice[light] < (int)sliceEnd - 1) ? lastSlice[light] : (int)sliceEnd - 1;
+		if (sliceBegin > sliceLast) continue;
+
+		float x = centreX[light], y = centreY[light], z = centreZ[light];
+		float radiusSquared = radii[light] * radii[light];
+		int tileBeginX = firstTileX[light], tileLastX = lastTileX[light];
+		__m128 centre = _mm_set1_ps(x);
+
+		// The sphere against each cluster's box, the distance to a box is apart in each axis, so a row's depth and height are
+		// taken off the squared radius once, leaving only the tiles' x
+		for (int slice = sliceBegin; slice <= sliceLast; ++slice)
+		{
+			float distanceZ = fmaxf(sliceNear[slice] - z, 0.0f) + fmaxf(z - sliceFar[slice], 0.0f);
+			float remainingZ = radiusSquared - distanceZ * distanceZ;
+			if (remainingZ < 0.0f) continue;
+
+			for (int row = firstTileY[light]; row <= lastTileY[light]; ++row)
+			{
+				float distanceY = fmaxf(tileMinY[slice * tileCountY + row] - y, 0.0f) + fmaxf(y - tileMaxY[slice * tileCountY + row], 0.0f);
+				float remaining = remainingZ - distanceY * distanceY;
+				if (remaining < 0.0f) continue;
+
+				const float* minX = &tileMinX[slice * paddedTileCountX];
+				const float* maxX = &tileMaxX[slice * paddedTileCountX];
+				std::vector<unsigned int>* rowLights = &clusterLights[(slice * tileCountY + row) * tileCountX];
+				if (simd)
+				{
+					__m128 remainingSquared = _mm_set1_ps(remaining);
+					for (int group = tileBeginX & ~3; group <= tileLastX; group += 4)
+					{
+						__m128 distanceX = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minX + group), centre), zero), _mm_max_ps(_mm_sub_ps(centre, _mm_loadu_ps(maxX + group)), zero));
+						int touching = _mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(distanceX, distanceX), remainingSquared));
+						for (int lane = 0; lane < 4; ++lane)
+						{
+							int tile = group + lane;
+							if ((touching & (1 << lane)) && tile >= tileBeginX && tile <= tileLastX) rowLights[tile].push_back((unsigned int)light);
+						}
+					}
+				}
+				else
+				{
+					for (int tile = tileBeginX; tile <= tileLastX; ++tile)
+					{
+						float distanceX = fmaxf(minX[tile] - x, 0.0f) + fmaxf(x - maxX[tile], 0.0f);
+						if (distanceX * distanceX <= remaining) rowLights[tile].push_back((unsigned int)light);
+					}
+				}
+			}
+		}
+	}
+}
+
+void LightClusterer::finishBuild()
+{
+	unsigned int offset = 0;
+	stats = {};
+	for (unsigned int cluster = 0; cluster < getClusterCount(); ++cluster)
+	{
+		unsigned int lights = (unsigned int)clusterLights[cluster].size();
+		clusterRanges[cluster * 2] = offset;
+		clusterRanges[cluster * 2 + 1] = lights;
+		offset += lights;
+		if (lights > stats.largestCluster) stats.largestCluster = lights;
+	}
+	lightIndices.resize(offset);
+
+	stats.lights = (unsigned int)count;
+	stats.references = offset;
+	for (size_t light = 0; light < count; ++light)
+	{
+		if (firstSlice[light] <= lastSlice[light]) stats.binned++;
+	}
+}
+
+void LightClusterer::packSlices(unsigned int first, unsigned int sliceEnd)
+{
+	for (unsigned int cluster = first * tileCountX * tileCountY; cluster < sliceEnd * tileCountX * tileCountY; ++cluster)
+	{
+		const std::vector<unsigned int>& lights = clusterLights[cluster];
+		if (!lights.empty()) memcpy(&lightIndices[clusterRanges[cluster * 2]], lights.data(), lights.size() * sizeof(unsigned int));
+	}
+}
+
+unsigned int LightClusterer::getTileCountX() const
+{
+	return tileCountX;
+}
+
+unsigned int LightClusterer::getTileCountY() const
+{
+	return tileCountY;
+}
+
+unsigned int LightClusterer::getSliceCount() const
+{
+	return sliceCount;
+}
+
+unsigned int LightClusterer::getClusterCount() const
+{
+	return tileCountX * tileCountY * sliceCount;
+}
+
+float LightClusterer::getSliceScale() const
+{
+	return sliceScale;
+}
+
+float LightClusterer::getSliceBias() const
+{
+	return sliceBias;
+}
+
+const std::vector<unsigned int>& LightClusterer::getClusterRanges() const
+{
+	return clusterRanges;
+}
+
+const std::vector<unsigned int>& LightClusterer::getLightIndices() const
+{
+	return lightIndices;
+}
+
+LightClusterer::Stats LightClusterer::getStats() const
+{
+	return stats;
+}
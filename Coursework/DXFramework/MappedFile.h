@@ -0,0 +1,39 @@
+/**
+* \class MappedFile
+*
+* \brief Read only memory mapped view of a file
+*
+* Maps a whole file into the address space so loaders can parse it in place, without copying it into a buffer first.
+* The view stays valid until close() is called or the object is destroyed.
+*/
+
+
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <windows.h>
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char* filename);	///< Maps the file, returns false if it is missing or empty
+	void close();						///< Unmaps the file and closes the handles
+
+	const char* getData() const;		///< Start of the mapped file
+	size_t getSize() const;				///< Size of the mapped file in bytes
+
+private:
+	// Non copyable, the handles are owned
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	HANDLE file;
+	HANDLE mapping;
+	const char* data;
+	size_t size;
+};
+
+#endif
@@ -0,0 +1,218 @@
+// Mesh cache
+// Reads and writes baked .dxmesh files, see MeshCache.h
+#include "MeshCache.h"
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	const char MAGIC[4] = { 'D', 'X', 'M', 'S' };
+
+	// Every block in the file starts on this alignment
+	const unsigned long long BLOCK_ALIGNMENT = 16;
+
+	// On disk header, all offsets are from the start of the file
+	struct FileHeader
+	{
+		char magic[4];
+		unsigned int version;
+		unsigned long long sourceHash;
+		unsigned int importFlags;
+		unsigned int vertexStride;
+		unsigned int vertexCount;
+		unsigned int indexCount;
+		unsigned int submeshCount;
+		unsigned int lodKey;
+		unsigned int lodCount;
+		unsigned int meshletCount;
+		XMFLOAT3 boundsMin;
+		XMFLOAT3 boundsMax;
+		unsigned long long vertexOffset;
+		unsigned long long indexOffset;
+		unsigned long long submeshOffset;
+		unsigned long long lodOffset;
+		unsigned long long meshletOffset;
+	};
+
+	inline unsigned long long alignOffset(unsigned long long offset)
+	{
+		return (offset + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+	}
+
+	// True if the block lies inside the file
+	inline bool blockInFile(unsigned long long offset, unsigned long long size, unsigned long long fileSize)
+	{
+		return offset <= fileSize && size <= fileSize - offset;
+	}
+
+	bool writeBlock(FILE* file, unsigned long long& position, unsigned long long offset, const void* data, size_t size)
+	{
+		static const char zeros[BLOCK_ALIGNMENT] = {};
+		if (offset > position && fwrite(zeros, 1, (size_t)(offset - position), file) != offset - position)
+		{
+			return false;
+		}
+		if (size > 0 && fwrite(data, 1, size, file) != size)
+		{
+			return false;
+		}
+		position = offset + size;
+		return true;
+	}
+}
+
+MeshCache::MeshCache()
+{
+	memset(&mesh, 0, sizeof(mesh));
+	sourceHash = 0;
+}
+
+MeshCache::~MeshCache()
+{
+	close();
+}
+
+bool MeshCache::open(const char* filename, unsigned int importFlags, unsigned int lodKey, unsigned int vertexStride)
+{
+	close();
+
+	if (!file.open(filename))
+	{
+		return false;
+	}
+
+	const unsigned long long fileSize = file.getSize();
+	const char* data = file.getData();
+	if (fileSize < sizeof(FileHeader))
+	{
+		close();
+		return false;
+	}
+
+	const FileHeader* header = (const FileHeader*)data;
+	bool valid = memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0
+		&& header->version == VERSION
+		&& header->importFlags == importFlags
+		&& header->lodKey == lodKey
+		&& header->vertexStride == vertexStride
+		&& blockInFile(header->vertexOffset, (unsigned long long)header->vertexCount * header->vertexStride, fileSize)
+		&& blockInFile(header->indexOffset, (unsigned long long)header->indexCount * sizeof(unsigned long), fileSize)
+		&& blockInFile(header->submeshOffset, (unsigned long long)header->submeshCount * sizeof(Submesh), fileSize)
+		&& blockInFile(header->lodOffset, (unsigned long long)header->lodCount * sizeof(MeshSimplifier::Lod), fileSize)
+		&& blockInFile(header->meshletOffset, (unsigned long long)header->meshletCount * sizeof(MeshletBuilder::Meshlet), fileSize);
+	if (!valid)
+	{
+		close();
+		return false;
+	}
+
+	sourceHash = header->sourceHash;
+	mesh.vertices = data + header->vertexOffset;
+	mesh.vertexStride = header->vertexStride;
+	mesh.vertexCount = header->vertexCount;
+	mesh.indices = (const unsigned long*)(data + header->indexOffset);
+	mesh.indexCount = header->indexCount;
+	mesh.submeshes = (const Submesh*)(data + header->submeshOffset);
+	mesh.submeshCount = header->submeshCount;
+	mesh.lods = (const MeshSimplifier::Lod*)(data + header->lodOffset);
+	mesh.lodCount = header->lodCount;
+	mesh.meshlets = (const MeshletBuilder::Meshlet*)(data + header->meshletOffset);
+	mesh.meshletCount = header->meshletCount;
+	mesh.boundsMin = header->boundsMin;
+	mesh.boundsMax = header->boundsMax;
+	return true;
+}
+
+void MeshCache::close()
+{
+	file.close();
+	memset(&mesh, 0, sizeof(mesh));
+	sourceHash = 0;
+}
+
+unsigned long long MeshCache::getSourceHash() const
+{
+	return sourceHash;
+}
+
+const MeshCache::MeshDesc& MeshCache::getMesh() const
+{
+	return mesh;
+}
+
+bool MeshCache::write(const char* filename, unsigned long long sourceHash, unsigned int importFlags, unsigned int lodKey, const MeshDesc& mesh)
+{
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.sourceHash = sourceHash;
+	header.importFlags = importFlags;
+	header.vertexStride = mesh.vertexStride;
+	header.vertexCount = mesh.vertexCount;
+	header.indexCount = mesh.indexCount;
+	header.submeshCount = mesh.submeshCount;
+	header.lodKey = lodKey;
+	header.lodCount = mesh.lodCount;
+	header.meshletCount = mesh.meshletCount;
+	header.boundsMin = mesh.boundsMin;
+	header.boundsMax = mesh.boundsMax;
+
+	const size_t vertexSize = (size_t)mesh.vertexCount * mesh.vertexStride;
+	const size_t indexSize = (size_t)mesh.indexCount * sizeof(unsigned long);
+	const size_t submeshSize = (size_t)mesh.submeshCount * sizeof(Submesh);
+	const size_t lodSize = (size_t)mesh.lodCount * sizeof(MeshSimplifier::Lod);
+	const size_t meshletSize = (size_t)mesh.meshletCount * sizeof(MeshletBuilder::Meshlet);
+	header.vertexOffset = alignOffset(sizeof(FileHeader));
+	header.indexOffset = alignOffset(header.vertexOffset + vertexSize);
+	header.submeshOffset = alignOffset(header.indexOffset + indexSize);
+	header.lodOffset = alignOffset(header.submeshOffset + submeshSize);
+	header.meshletOffset = alignOffset(header.lodOffset + lodSize);
+
+	std::string tempFilename = std::string(filename) + ".tmp";
+	FILE* file;
+	if (fopen_s(&file, tempFilename.c_str(), "wb") != 0)
+	{
+		return false;
+	}
+
+	unsigned long long position = 0;
+	bool written = writeBlock(file, position, 0, &header, sizeof(header))
+		&& writeBlock(file, position, header.vertexOffset, mesh.vertices, vertexSize)
+		&& writeBlock(file, position, header.indexOffset, mesh.indices, indexSize)
+		&& writeBlock(file, position, header.submeshOffset, mesh.submeshes, submeshSize)
+		&& writeBlock(file, position, header.lodOffset, mesh.lods, lodSize)
+		&& writeBlock(file, position, header.meshletOffset, mesh.meshlets, meshletSize);
+	written = (fclose(file) == 0) && written;
+
+	if (!written || !MoveFileExA(tempFilename.c_str(), filename, MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(tempFilename.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool MeshCache::hashFile(const char* filename, unsigned long long& hash)
+{
+	MappedFile source;
+	if (!source.open(filename))
+	{
+		return false;
+	}
+
+	const unsigned char* data = (const unsigned char*)source.getData();
+	const size_t size = source.getSize();
+	hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return true;
+}
+
+std::string MeshCache::getCachePath(const std::string& source)
+{
+	return source + ".dxmesh";
+}
@@ -0,0 +1,89 @@
+/**
+* \class MeshCache
+*
+* \brief Versioned binary mesh cache (.dxmesh)
+*
+* Stores a mesh exactly as it is uploaded to the GPU: the vertex array, the index buffer, submesh ranges, LOD ranges, meshlets and bounds.
+* Every file is keyed by a hash of the source file, the import flags and the LOD settings used to build it, so a stale cache is ignored.
+* Cache files are memory mapped when opened and the mesh data points straight into the mapping, so buffer creation reads from it without a copy.
+*/
+
+
+#ifndef _MESHCACHE_H_
+#define _MESHCACHE_H_
+
+#include "MappedFile.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include <directxmath.h>
+#include <string>
+
+using namespace DirectX;
+
+class MeshCache
+{
+public:
+	/// Bump whenever the layout of the file, or of the stored vertex, changes
+	static const unsigned int VERSION = 4;
+
+	/// Range of the index and vertex buffers used by one source mesh
+	struct Submesh
+	{
+		unsigned int indexStart;
+		unsigned int indexCount;
+		unsigned int vertexStart;
+		unsigned int vertexCount;
+	};
+
+	/// Mesh data to write, or read back from a mapped cache file
+	struct MeshDesc
+	{
+		const void* vertices;
+		unsigned int vertexStride;
+		unsigned int vertexCount;
+		const unsigned long* indices;
+		unsigned int indexCount;
+		const Submesh* submeshes;
+		unsigned int submeshCount;
+		const MeshSimplifier::Lod* lods;
+		unsigned int lodCount;
+		const MeshletBuilder::Meshlet* meshlets;
+		unsigned int meshletCount;
+		XMFLOAT3 boundsMin;
+		XMFLOAT3 boundsMax;
+	};
+
+	MeshCache();
+	~MeshCache();
+
+	/** \brief Maps a cache file and validates it
+	* @param filename is the .dxmesh file
+	* @param importFlags are the flags the caller imports with, a cache built with other flags is rejected
+	* @param lodKey is the key of the caller's LOD settings (MeshSimplifier::getSettingsKey), a cache built with other settings is rejected
+	* @param vertexStride is the size of the caller's vertex, a cache built with another vertex is rejected
+	* Returns false if the file is missing, from another version or does not match.
+	*/
+	bool open(const char* filename, unsigned int importFlags, unsigned int lodKey, unsigned int vertexStride);
+	void close();
+
+	unsigned long long getSourceHash() const;	///< Hash of the source file the cache was built from
+	const MeshDesc& getMesh() const;			///< Mesh data, points into the mapped file until close()
+
+	/** \brief Writes a cache file
+	* Written to a temporary file first and then renamed, so a failed write never leaves a broken cache behind.
+	*/
+	static bool write(const char* filename, unsigned long long sourceHash, unsigned int importFlags, unsigned int lodKey, const MeshDesc& mesh);
+
+	static bool hashFile(const char* filename, unsigned long long& hash);	///< 64 bit FNV-1a hash of a whole file
+	static std::string getCachePath(const std::string& source);				///< Cache file used for a source model
+
+private:
+	MeshCache(const MeshCache&) = delete;
+	MeshCache& operator=(const MeshCache&) = delete;
+
+	MappedFile file;
+	MeshDesc mesh;
+	unsigned long long sourceHash;
+};
+
+#endif
@@ -0,0 +1,398 @@
+// Mesh optimizer
+// Vertex cache, overdraw and vertex fetch reordering, see MeshOptimizer.h
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const unsigned int NO_VERTEX = 0xffffffff;
+
+	// Forsyth's tuning, models a LRU cache slightly larger than the hardware FIFO
+	const int FORSYTH_CACHE_SIZE = 32;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	// A cluster is cut once its running ACMR is within this factor of the whole cluster's
+	const float OVERDRAW_THRESHOLD = 1.05f;
+
+	float vertexScore(int cachePosition, unsigned int liveTriangles)
+	{
+		// No triangles left to draw, the vertex is worthless
+		if (liveTriangles == 0) return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// The last triangle's vertices get a fixed score so the next triangle does not just reuse its edge
+			if (cachePosition < 3)
+			{
+				score = LAST_TRIANGLE_SCORE;
+			}
+			else
+			{
+				const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+				score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+			}
+		}
+
+		// Boost vertices with few triangles left, so lone triangles are finished instead of left behind
+		score += VALENCE_BOOST_SCALE * powf((float)liveTriangles, -VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	// FIFO cache simulation, a vertex is cached if it was last transformed less than cacheSize misses ago
+	struct FifoCache
+	{
+		std::vector<unsigned int> timestamps;
+		unsigned int time;
+		unsigned int cacheSize;
+
+		FifoCache(size_t vertexCount, unsigned int size) : timestamps(vertexCount, 0), time(size + 1), cacheSize(size) {}
+
+		// Returns the misses caused by a triangle
+		unsigned int add(unsigned long a, unsigned long b, unsigned long c)
+		{
+			return add(a) + add(b) + add(c);
+		}
+
+		unsigned int add(unsigned long vertex)
+		{
+			if (time - timestamps[vertex] > cacheSize)
+			{
+				timestamps[vertex] = time++;
+				return 1;
+			}
+			return 0;
+		}
+
+		// Empties the cache without touching every vertex
+		void flush()
+		{
+			time += cacheSize + 1;
+		}
+	};
+
+	struct Cluster
+	{
+		size_t start;
+		size_t end;
+		float sortKey;
+	};
+
+	inline const float* stridedFloat3(const float* base, size_t stride, size_t index)
+	{
+		return (const float*)((const char*)base + stride * index);
+	}
+}
+
+MeshOptimizer::Report MeshOptimizer::optimizeMesh(void* vertices, size_t vertexStride, size_t vertexCount, size_t normalOffset, unsigned long* indices, size_t indexCount)
+{
+	Report report;
+	report.before = analyzeVertexCache(indices, indexCount, vertexCount);
+
+	optimizeVertexCache(indices, indexCount, vertexCount);
+	optimizeOverdraw(indices, indexCount, (const float*)vertices, (const float*)((const char*)vertices + normalOffset), vertexStride, vertexCount);
+	optimizeVertexFetch(vertices, vertexStride, vertexCount, indices, indexCount);
+
+	report.after = analyzeVertexCache(indices, indexCount, vertexCount);
+	return report;
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::analyzeVertexCache(const unsigned long* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+	CacheStats stats = { 0.0f, 0.0f };
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return stats;
+	}
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+	size_t misses = 0, referencedCount = 0;
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		misses += cache.add(indices[i]);
+		if (!referenced[indices[i]])
+		{
+			referenced[indices[i]] = true;
+			++referencedCount;
+		}
+	}
+
+	stats.acmr = (float)misses / triangleCount;
+	stats.atvr = (float)misses / referencedCount;
+	return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(unsigned long* indices, size_t indexCount, size_t vertexCount)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Triangles using each vertex, as one flat array. liveTriangles is the length of each list,
+	// drawn triangles are swapped past the end of their vertices' lists
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		liveTriangles[indices[i]]++;
+	}
+
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		vertexScores[v] = vertexScore(-1, liveTriangles[v]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> drawn(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+	}
+
+	std::vector<unsigned long> output(triangleCount * 3);
+	std::vector<unsigned int> cache, newCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	// Start on the best triangle in the mesh
+	size_t bestTriangle = 0;
+	for (size_t t = 1; t < triangleCount; ++t)
+	{
+		if (triangleScores[t] > triangleScores[bestTriangle]) bestTriangle = t;
+	}
+
+	size_t scanPosition = 0;
+	for (size_t drawnCount = 0; drawnCount < triangleCount; ++drawnCount)
+	{
+		const unsigned long* triangle = indices + bestTriangle * 3;
+		memcpy(&output[drawnCount * 3], triangle, sizeof(unsigned long) * 3);
+		drawn[bestTriangle] = true;
+
+		// Take the triangle out of its vertices' live lists
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			const unsigned long vertex = triangle[corner];
+			unsigned int* list = &adjacency[adjacencyOffsets[vertex]];
+			unsigned int& count = liveTriangles[vertex];
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				if (list[i] == bestTriangle)
+				{
+					list[i] = list[count - 1];
+					--count;
+					break;
+				}
+			}
+		}
+
+		// The triangle's vertices move to the front of the cache, everything else shifts back
+		newCache.clear();
+		newCache.push_back(triangle[0]);
+		newCache.push_back(triangle[1]);
+		newCache.push_back(triangle[2]);
+		for (unsigned int vertex : cache)
+		{
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) newCache.push_back(vertex);
+		}
+
+		// Rescore everything that moved, including vertices that just fell out of the cache
+		for (size_t i = 0; i < newCache.size(); ++i)
+		{
+			const unsigned int vertex = newCache[i];
+			cachePositions[vertex] = (i < FORSYTH_CACHE_SIZE) ? (int)i : -1;
+
+			const float score = vertexScore(cachePositions[vertex], liveTriangles[vertex]);
+			const float delta = score - vertexScores[vertex];
+			vertexScores[vertex] = score;
+
+			const unsigned int* list = &adjacency[adjacencyOffsets[vertex]];
+			for (unsigned int j = 0; j < liveTriangles[vertex]; ++j)
+			{
+				triangleScores[list[j]] += delta;
+			}
+		}
+
+		if (newCache.size() > FORSYTH_CACHE_SIZE) newCache.resize(FORSYTH_CACHE_SIZE);
+		cache.swap(newCache);
+
+		// Next triangle is the best one using a cached vertex
+		float bestScore = -1.0f;
+		bestTriangle = triangleCount;
+		for (unsigned int vertex : cache)
+		{
+			const unsigned int* list = &adjacency[adjacencyOffsets[vertex]];
+			for (unsigned int j = 0; j < liveTriangles[vertex]; ++j)
+			{
+				if (triangleScores[list[j]] > bestScore)
+				{
+					bestScore = triangleScores[list[j]];
+					bestTriangle = list[j];
+				}
+			}
+		}
+
+		// Nothing connected to the cache is left, continue with the next undrawn triangle
+		if (bestTriangle == triangleCount)
+		{
+			while (scanPosition < triangleCount && drawn[scanPosition]) ++scanPosition;
+			if (scanPosition == triangleCount) break;
+			bestTriangle = scanPosition;
+		}
+	}
+
+	memcpy(indices, output.data(), sizeof(unsigned long) * triangleCount * 3);
+}
+
+void MeshOptimizer::optimizeOverdraw(unsigned long* indices, size_t indexCount, const float* positions, const float* normals, size_t vertexStride, size_t vertexCount)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Hard boundaries, where the cache optimizer had to restart and every vertex misses.
+	// Cutting there costs nothing.
+	std::vector<size_t> hardBoundaries;
+	FifoCache cache(vertexCount, STATS_CACHE_SIZE);
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		if (cache.add(indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]) == 3 || t == 0)
+		{
+			hardBoundaries.push_back(t);
+		}
+	}
+	hardBoundaries.push_back(triangleCount);
+
+	// Soft boundaries, cut a hard cluster wherever the misses so far are close to its overall ACMR,
+	// the extra misses from restarting the cache there stay small
+	std::vector<Cluster> clusters;
+	for (size_t h = 0; h + 1 < hardBoundaries.size(); ++h)
+	{
+		const size_t start = hardBoundaries[h];
+		const size_t end = hardBoundaries[h + 1];
+
+		cache.flush();
+		size_t clusterMisses = 0;
+		for (size_t t = start; t < end; ++t)
+		{
+			clusterMisses += cache.add(indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]);
+		}
+		const float threshold = OVERDRAW_THRESHOLD * clusterMisses / (end - start);
+
+		cache.flush();
+		size_t clusterStart = start;
+		size_t runningMisses = 0;
+		for (size_t t = start; t < end; ++t)
+		{
+			runningMisses += cache.add(indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]);
+			if ((float)runningMisses / (t + 1 - clusterStart) <= threshold || t + 1 == end)
+			{
+				Cluster cluster = { clusterStart, t + 1, 0.0f };
+				clusters.push_back(cluster);
+				clusterStart = t + 1;
+				runningMisses = 0;
+				cache.flush();
+			}
+		}
+	}
+
+	// Mesh centre, average of the referenced vertices
+	float meshCentre[3] = { 0.0f, 0.0f, 0.0f };
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		const float* position = stridedFloat3(positions, vertexStride, indices[i]);
+		meshCentre[0] += position[0];
+		meshCentre[1] += position[1];
+		meshCentre[2] += position[2];
+	}
+	for (int axis = 0; axis < 3; ++axis) meshCentre[axis] /= (float)(triangleCount * 3);
+
+	// Clusters facing away from the centre are usually in front of the rest of the mesh, so they draw first
+	for (Cluster& cluster : clusters)
+	{
+		float centre[3] = { 0.0f, 0.0f, 0.0f };
+		float normal[3] = { 0.0f, 0.0f, 0.0f };
+		for (size_t i = cluster.start * 3; i < cluster.end * 3; ++i)
+		{
+			const float* position = stridedFloat3(positions, vertexStride, indices[i]);
+			const float* vertexNormal = stridedFloat3(normals, vertexStride, indices[i]);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				centre[axis] += position[axis];
+				normal[axis] += vertexNormal[axis];
+			}
+		}
+
+		const float cornerCount = (float)((cluster.end - cluster.start) * 3);
+		const float normalLength = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		cluster.sortKey = 0.0f;
+		if (normalLength > 0.0f)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				cluster.sortKey += (centre[axis] / cornerCount - meshCentre[axis]) * normal[axis] / normalLength;
+			}
+		}
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<unsigned long> output;
+	output.reserve(triangleCount * 3);
+	for (const Cluster& cluster : clusters)
+	{
+		output.insert(output.end(), indices + cluster.start * 3, indices + cluster.end * 3);
+	}
+	memcpy(indices, output.data(), sizeof(unsigned long) * output.size());
+}
+
+void MeshOptimizer::optimizeVertexFetch(void* vertices, size_t vertexStride, size_t vertexCount, unsigned long* indices, size_t indexCount)
+{
+	// New position of every vertex, in the order the index buffer first uses them
+	std::vector<unsigned int> remap(vertexCount, NO_VERTEX);
+	unsigned int next = 0;
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		if (remap[indices[i]] == NO_VERTEX) remap[indices[i]] = next++;
+		indices[i] = remap[indices[i]];
+	}
+
+	// Unreferenced vertices keep their relative order at the end
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		if (remap[v] == NO_VERTEX) remap[v] = next++;
+	}
+
+	std::vector<char> reordered(vertexStride * vertexCount);
+	const char* source = (const char*)vertices;
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		memcpy(&reordered[remap[v] * vertexStride], source + v * vertexStride, vertexStride);
+	}
+	memcpy(vertices, reordered.data(), reordered.size());
+}
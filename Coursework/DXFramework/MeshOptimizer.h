@@ -0,0 +1,70 @@
+/**
+* \class MeshOptimizer
+*
+* \brief Reorders index and vertex buffers for faster rendering
+*
+* Three passes, run in this order by optimizeMesh():
+* - Vertex cache: reorders triangles for post transform cache hits (Forsyth's linear speed algorithm).
+* - Overdraw: splits the cache optimized order into clusters and sorts the clusters so outward facing ones draw first,
+*   which keeps most of the cache gain while letting early depth testing reject more hidden pixels.
+* - Vertex fetch: reorders vertices into first use order so the vertex buffer is read front to back.
+* The vertex cache is measured with ACMR (average cache misses per triangle) and ATVR (average transforms per vertex, 1 is ideal),
+* using a FIFO cache the size of the post transform cache on current hardware.
+*/
+
+
+#ifndef _MESHOPTIMIZER_H_
+#define _MESHOPTIMIZER_H_
+
+#include <cstddef>
+
+class MeshOptimizer
+{
+public:
+	/// Simulated post transform cache size used for the statistics
+	static const unsigned int STATS_CACHE_SIZE = 16;
+
+	/// Vertex cache efficiency of an index buffer
+	struct CacheStats
+	{
+		float acmr;		///< Average cache misses per triangle, 0.5 is the best possible for a regular grid, 3 the worst
+		float atvr;		///< Average transforms per vertex, 1 means every vertex is shaded exactly once
+	};
+
+	/// Cache efficiency before and after optimizeMesh()
+	struct Report
+	{
+		CacheStats before;
+		CacheStats after;
+	};
+
+	/** \brief Runs the vertex cache, overdraw and vertex fetch passes
+	* @param vertices is the vertex buffer, the position must be the first three floats of every vertex
+	* @param vertexStride is the size of one vertex in bytes
+	* @param vertexCount is the number of vertices
+	* @param normalOffset is the byte offset of the three float normal inside a vertex
+	* @param indices is a triangle list, reordered in place
+	* @param indexCount is the number of indices
+	*/
+	static Report optimizeMesh(void* vertices, size_t vertexStride, size_t vertexCount, size_t normalOffset, unsigned long* indices, size_t indexCount);
+
+	/// Simulates a FIFO post transform cache over a triangle list
+	static CacheStats analyzeVertexCache(const unsigned long* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = STATS_CACHE_SIZE);
+
+	/// Reorders triangles for vertex cache locality
+	static void optimizeVertexCache(unsigned long* indices, size_t indexCount, size_t vertexCount);
+
+	/** \brief Reorders clusters of a cache optimized triangle list to reduce overdraw
+	* @param positions points at the position of the first vertex, three floats
+	* @param normals points at the normal of the first vertex, three floats
+	* @param vertexStride is the distance in bytes between consecutive positions and normals
+	*/
+	static void optimizeOverdraw(unsigned long* indices, size_t indexCount, const float* positions, const float* normals, size_t vertexStride, size_t vertexCount);
+
+	/** \brief Reorders vertices into the order the index buffer first uses them, and remaps the indices
+	* Unreferenced vertices are kept, after the referenced ones, so the vertex count never changes.
+	*/
+	static void optimizeVertexFetch(void* vertices, size_t vertexStride, size_t vertexCount, unsigned long* indices, size_t indexCount);
+};
+
+#endif
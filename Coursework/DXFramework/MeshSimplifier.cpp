@@ -0,0 +1,621 @@
+// Mesh simplifier
+// Quadric error edge collapse simplification and LOD chains, see MeshSimplifier.h
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+	// Weight of the planes holding border and seam edges in place, against the area weighted triangle planes
+	const double EDGE_WEIGHT = 10.0;
+
+	// A LOD chain stops once a level keeps more than this fraction of the previous level's triangles
+	const float MIN_LEVEL_REDUCTION = 0.9f;
+
+	enum VertexKind : unsigned char
+	{
+		KIND_MANIFOLD,	// Inside the surface, collapses anywhere
+		KIND_BORDER,	// On an open edge, only collapses along it
+		KIND_SEAM,		// Two vertices at one position, both collapse along the seam together
+		KIND_LOCKED		// Corners of borders and seams, never moves
+	};
+
+	struct Vector3
+	{
+		double x, y, z;
+	};
+
+	inline Vector3 subtract(const Vector3& a, const Vector3& b)
+	{
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	inline Vector3 cross(const Vector3& a, const Vector3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	inline double dot(const Vector3& a, const Vector3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	// Symmetric 4x4 matrix giving the weighted sum of squared distances to a set of planes
+	struct Quadric
+	{
+		double a00, a11, a22, a10, a20, a21;
+		double b0, b1, b2;
+		double c;
+		double weight;
+	};
+
+	void addPlane(Quadric& quadric, const Vector3& normal, double distance, double weight)
+	{
+		quadric.a00 += weight * normal.x * normal.x;
+		quadric.a11 += weight * normal.y * normal.y;
+		quadric.a22 += weight * normal.z * normal.z;
+		quadric.a10 += weight * normal.y * normal.x;
+		quadric.a20 += weight * normal.z * normal.x;
+		quadric.a21 += weight * normal.z * normal.y;
+		quadric.b0 += weight * normal.x * distance;
+		quadric.b1 += weight * normal.y * distance;
+		quadric.b2 += weight * normal.z * distance;
+		quadric.c += weight * distance * distance;
+		quadric.weight += weight;
+	}
+
+	void addQuadric(Quadric& target, const Quadric& source)
+	{
+		target.a00 += source.a00; target.a11 += source.a11; target.a22 += source.a22;
+		target.a10 += source.a10; target.a20 += source.a20; target.a21 += source.a21;
+		target.b0 += source.b0; target.b1 += source.b1; target.b2 += source.b2;
+		target.c += source.c;
+		target.weight += source.weight;
+	}
+
+	// Weighted mean squared distance of a point to the quadric's planes
+	double evaluate(const Quadric& quadric, const Vector3& point)
+	{
+		double rx = quadric.a00 * point.x + quadric.a10 * point.y + quadric.a20 * point.z;
+		double ry = quadric.a10 * point.x + quadric.a11 * point.y + quadric.a21 * point.z;
+		double rz = quadric.a20 * point.x + quadric.a21 * point.y + quadric.a22 * point.z;
+		double result = rx * point.x + ry * point.y + rz * point.z + 2.0 * (quadric.b0 * point.x + quadric.b1 * point.y + quadric.b2 * point.z) + quadric.c;
+		if (result < 0.0 || quadric.weight <= 0.0) return 0.0;
+		return result / quadric.weight;
+	}
+
+	struct PositionKey
+	{
+		unsigned int x, y, z;
+
+		bool operator==(const PositionKey& other) const
+		{
+			return x == other.x && y == other.y && z == other.z;
+		}
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const PositionKey& key) const
+		{
+			return (size_t)((key.x * 73856093u) ^ (key.y * 19349663u) ^ (key.z * 83492791u));
+		}
+	};
+
+	inline unsigned long long edgeKey(unsigned int from, unsigned int to)
+	{
+		return ((unsigned long long)from << 32) | to;
+	}
+
+	// Reads the positions, scaled so the largest extent is 1. Returns the extent.
+	double readPositions(const float* positions, size_t vertexStride, size_t vertexCount, std::vector<Vector3>& scaled)
+	{
+		scaled.resize(vertexCount);
+		if (vertexCount == 0) return 0.0;
+
+		Vector3 boundsMin = { HUGE_VAL, HUGE_VAL, HUGE_VAL };
+		Vector3 boundsMax = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+		const char* data = (const char*)positions;
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			const float* position = (const float*)(data + i * vertexStride);
+			scaled[i] = { position[0], position[1], position[2] };
+			boundsMin = { fmin(boundsMin.x, scaled[i].x), fmin(boundsMin.y, scaled[i].y), fmin(boundsMin.z, scaled[i].z) };
+			boundsMax = { fmax(boundsMax.x, scaled[i].x), fmax(boundsMax.y, scaled[i].y), fmax(boundsMax.z, scaled[i].z) };
+		}
+
+		double extent = fmax(boundsMax.x - boundsMin.x, fmax(boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z));
+		double scale = extent > 0.0 ? 1.0 / extent : 0.0;
+		for (Vector3& position : scaled)
+		{
+			position = { (position.x - boundsMin.x) * scale, (position.y - boundsMin.y) * scale, (position.z - boundsMin.z) * scale };
+		}
+		return extent;
+	}
+
+	// Links vertices at the same position. remap is the first vertex at each position, wedge is a cycle through the vertices at it.
+	void buildPositionRemap(const float* positions, size_t vertexStride, size_t vertexCount, std::vector<unsigned int>& remap, std::vector<unsigned int>& wedge)
+	{
+		remap.resize(vertexCount);
+		wedge.resize(vertexCount);
+
+		std::unordered_map<PositionKey, unsigned int, PositionKeyHash> firstVertex;
+		firstVertex.reserve(vertexCount);
+		const char* data = (const char*)positions;
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			PositionKey key;
+			memcpy(&key, data + i * vertexStride, sizeof(key));
+			unsigned int first = firstVertex.emplace(key, (unsigned int)i).first->second;
+
+			remap[i] = first;
+			wedge[i] = (unsigned int)i;
+			if (first != i)
+			{
+				wedge[i] = wedge[first];
+				wedge[first] = (unsigned int)i;
+			}
+		}
+	}
+
+	void classifyVertices(const unsigned long* indices, size_t indexCount, const std::vector<unsigned int>& remap, const std::vector<unsigned int>& wedge, std::vector<unsigned char>& kinds)
+	{
+		const size_t vertexCount = remap.size();
+		std::unordered_set<unsigned long long> wedgeEdges, positionEdges;
+		wedgeEdges.reserve(indexCount);
+		positionEdges.reserve(indexCount);
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			unsigned int a = indices[i];
+			unsigned int b = indices[i % 3 == 2 ? i - 2 : i + 1];
+			wedgeEdges.insert(edgeKey(a, b));
+			positionEdges.insert(edgeKey(remap[a], remap[b]));
+		}
+
+		// Count the open edges leaving and entering every vertex, borders per position and seams per wedge
+		std::vector<unsigned int> borderOut(vertexCount, 0), borderIn(vertexCount, 0), seamOut(vertexCount, 0), seamIn(vertexCount, 0);
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			unsigned int a = indices[i];
+			unsigned int b = indices[i % 3 == 2 ? i - 2 : i + 1];
+			if (remap[a] == remap[b]) continue;
+
+			if (positionEdges.count(edgeKey(remap[b], remap[a])) == 0)
+			{
+				borderOut[remap[a]]++;
+				borderIn[remap[b]]++;
+			}
+			else if (wedgeEdges.count(edgeKey(b, a)) == 0)
+			{
+				seamOut[a]++;
+				seamIn[b]++;
+			}
+		}
+
+		kinds.assign(vertexCount, KIND_LOCKED);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			if (remap[i] != i) continue;
+
+			unsigned int other = wedge[i];
+			bool open = borderOut[i] != 0 || borderIn[i] != 0;
+			unsigned char kind = KIND_LOCKED;
+			if (other == i)
+			{
+				if (!open) kind = KIND_MANIFOLD;
+				else if (borderOut[i] == 1 && borderIn[i] == 1) kind = KIND_BORDER;
+			}
+			else if (wedge[other] == i && !open)
+			{
+				// A seam running straight through, one seam edge in and out on each side
+				if (seamOut[i] == 1 && seamIn[i] == 1 && seamOut[other] == 1 && seamIn[other] == 1) kind = KIND_SEAM;
+			}
+
+			// Every vertex at the position shares the kind
+			unsigned int vertex = (unsigned int)i;
+			do
+			{
+				kinds[vertex] = kind;
+				vertex = wedge[vertex];
+			} while (vertex != i);
+		}
+	}
+
+	void buildQuadrics(const unsigned long* indices, size_t indexCount, const std::vector<Vector3>& positions, const std::vector<unsigned int>& remap, std::vector<Quadric>& quadrics)
+	{
+		Quadric zero;
+		memset(&zero, 0, sizeof(zero));
+		quadrics.assign(positions.size(), zero);
+
+		std::unordered_set<unsigned long long> wedgeEdges;
+		wedgeEdges.reserve(indexCount);
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			wedgeEdges.insert(edgeKey(indices[i], indices[i % 3 == 2 ? i - 2 : i + 1]));
+		}
+
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			unsigned int corners[3] = { remap[indices[i]], remap[indices[i + 1]], remap[indices[i + 2]] };
+			const Vector3& p0 = positions[corners[0]];
+			Vector3 normal = cross(subtract(positions[corners[1]], p0), subtract(positions[corners[2]], p0));
+			double length = sqrt(dot(normal, normal));
+			if (length == 0.0) continue;
+			normal = { normal.x / length, normal.y / length, normal.z / length };
+
+			// Triangle plane, weighted by area
+			double distance = -dot(normal, p0);
+			for (int k = 0; k < 3; k++)
+			{
+				addPlane(quadrics[corners[k]], normal, distance, length * 0.5);
+			}
+
+			// Border and seam edges get a plane through the edge, at right angles to the triangle
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned long a = indices[i + k];
+				unsigned long b = indices[i + (k + 1) % 3];
+				if (wedgeEdges.count(edgeKey(b, a)) != 0) continue;
+
+				const Vector3& pa = positions[remap[a]];
+				Vector3 edge = subtract(positions[remap[b]], pa);
+				double edgeLengthSquared = dot(edge, edge);
+				Vector3 edgeNormal = cross(edge, normal);
+				double edgeNormalLength = sqrt(dot(edgeNormal, edgeNormal));
+				if (edgeNormalLength == 0.0) continue;
+				edgeNormal = { edgeNormal.x / edgeNormalLength, edgeNormal.y / edgeNormalLength, edgeNormal.z / edgeNormalLength };
+
+				double edgeDistance = -dot(edgeNormal, pa);
+				addPlane(quadrics[remap[a]], edgeNormal, edgeDistance, edgeLengthSquared * EDGE_WEIGHT);
+				addPlane(quadrics[remap[b]], edgeNormal, edgeDistance, edgeLengthSquared * EDGE_WEIGHT);
+			}
+		}
+	}
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double error;
+	};
+
+	// Triangles around every position, rebuilt each pass
+	struct Adjacency
+	{
+		std::vector<unsigned int> offsets;
+		std::vector<unsigned int> triangles;
+
+		void build(const unsigned long* indices, size_t indexCount, const std::vector<unsigned int>& remap)
+		{
+			offsets.assign(remap.size() + 1, 0);
+			for (size_t i = 0; i < indexCount; i++) offsets[remap[indices[i]] + 1]++;
+			for (size_t i = 0; i < remap.size(); i++) offsets[i + 1] += offsets[i];
+
+			triangles.resize(indexCount);
+			std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indexCount; i++) triangles[fill[remap[indices[i]]]++] = (unsigned int)(i / 3);
+		}
+	};
+
+	class Simplifier
+	{
+	public:
+		Simplifier(unsigned long* indices, size_t indexCount, const std::vector<Vector3>& positions, const std::vector<unsigned int>& remap,
+			const std::vector<unsigned int>& wedge, const std::vector<unsigned char>& kinds, std::vector<Quadric>& quadrics)
+			: indices(indices), indexCount(indexCount), positions(positions), remap(remap), wedge(wedge), kinds(kinds), quadrics(quadrics)
+		{
+			collapseRemap.resize(remap.size());
+			locked.resize(remap.size());
+		}
+
+		// Runs collapse passes until the target or the error limit is reached, returns the new index count
+		size_t run(size_t targetIndexCount, double errorLimit, double& maxError)
+		{
+			while (indexCount > targetIndexCount)
+			{
+				adjacency.build(indices, indexCount, remap);
+				findCollapses();
+				std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+				size_t removed = performCollapses((indexCount - targetIndexCount) / 3, errorLimit, maxError);
+				if (removed == 0) break;
+				removeDegenerates();
+			}
+			return indexCount;
+		}
+
+	private:
+		unsigned long* indices;
+		size_t indexCount;
+		const std::vector<Vector3>& positions;
+		const std::vector<unsigned int>& remap;
+		const std::vector<unsigned int>& wedge;
+		const std::vector<unsigned char>& kinds;
+		std::vector<Quadric>& quadrics;
+
+		Adjacency adjacency;
+		std::vector<Collapse> collapses;
+		std::vector<unsigned int> collapseRemap;
+		std::vector<unsigned char> locked;
+
+		// Number of triangles using both positions, 1 for a border edge and 2 for an inside edge
+		unsigned int sharedTriangles(unsigned int a, unsigned int b) const
+		{
+			unsigned int shared = 0;
+			for (unsigned int i = adjacency.offsets[a]; i < adjacency.offsets[a + 1]; i++)
+			{
+				const unsigned long* triangle = &indices[adjacency.triangles[i] * 3];
+				if (remap[triangle[0]] == b || remap[triangle[1]] == b || remap[triangle[2]] == b) shared++;
+			}
+			return shared;
+		}
+
+		bool canCollapse(unsigned int from, unsigned int to) const
+		{
+			switch (kinds[from])
+			{
+			case KIND_MANIFOLD:
+				return true;
+			case KIND_BORDER:
+				return (kinds[to] == KIND_BORDER || kinds[to] == KIND_LOCKED) && sharedTriangles(from, to) == 1;
+			case KIND_SEAM:
+				// Checked against the wedges when the collapse is made
+				return kinds[to] == KIND_SEAM || kinds[to] == KIND_LOCKED;
+			default:
+				return false;
+			}
+		}
+
+		void findCollapses()
+		{
+			collapses.clear();
+			for (size_t i = 0; i < indexCount; i++)
+			{
+				unsigned int a = remap[indices[i]];
+				unsigned int b = remap[indices[i % 3 == 2 ? i - 2 : i + 1]];
+				if (a == b) continue;
+
+				// Inside edges are seen from both triangles, only take them from one
+				if (a > b && kinds[a] == KIND_MANIFOLD && kinds[b] == KIND_MANIFOLD) continue;
+
+				Quadric combined = quadrics[a];
+				addQuadric(combined, quadrics[b]);
+				if (canCollapse(a, b)) collapses.push_back({ a, b, evaluate(combined, positions[b]) });
+				if (canCollapse(b, a)) collapses.push_back({ b, a, evaluate(combined, positions[a]) });
+			}
+		}
+
+		// Finds the vertex at the target position every vertex at the source position moves to, through a shared triangle edge
+		bool matchWedges(unsigned int from, unsigned int to)
+		{
+			unsigned int vertex = from;
+			do
+			{
+				bool used = false;
+				unsigned int target = ~0u;
+				for (unsigned int i = adjacency.offsets[from]; i < adjacency.offsets[from + 1] && target == ~0u; i++)
+				{
+					const unsigned long* triangle = &indices[adjacency.triangles[i] * 3];
+					if (triangle[0] != vertex && triangle[1] != vertex && triangle[2] != vertex) continue;
+
+					used = true;
+					for (int k = 0; k < 3; k++)
+					{
+						if (remap[triangle[k]] == to) target = triangle[k];
+					}
+				}
+
+				// A vertex without a triangle can go anywhere, one with triangles but no edge to the target would tear the seam
+				if (used && target == ~0u) return false;
+				collapseRemap[vertex] = used ? target : to;
+				vertex = wedge[vertex];
+			} while (vertex != from);
+			return true;
+		}
+
+		bool flipsTriangle(unsigned int from, unsigned int to) const
+		{
+			for (unsigned int i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; i++)
+			{
+				const unsigned long* triangle = &indices[adjacency.triangles[i] * 3];
+				unsigned int corners[3] = { remap[triangle[0]], remap[triangle[1]], remap[triangle[2]] };
+				if (corners[0] == to || corners[1] == to || corners[2] == to) continue;
+
+				Vector3 before = cross(subtract(positions[corners[1]], positions[corners[0]]), subtract(positions[corners[2]], positions[corners[0]]));
+				for (int k = 0; k < 3; k++)
+				{
+					if (corners[k] == from) corners[k] = to;
+				}
+				Vector3 after = cross(subtract(positions[corners[1]], positions[corners[0]]), subtract(positions[corners[2]], positions[corners[0]]));
+				if (dot(before, after) <= 0.0) return true;
+			}
+			return false;
+		}
+
+		void lockNeighbourhood(unsigned int position)
+		{
+			for (unsigned int i = adjacency.offsets[position]; i < adjacency.offsets[position + 1]; i++)
+			{
+				const unsigned long* triangle = &indices[adjacency.triangles[i] * 3];
+				locked[remap[triangle[0]]] = locked[remap[triangle[1]]] = locked[remap[triangle[2]]] = 1;
+			}
+		}
+
+		size_t performCollapses(size_t triangleGoal, double errorLimit, double& maxError)
+		{
+			for (size_t i = 0; i < collapseRemap.size(); i++) collapseRemap[i] = (unsigned int)i;
+			std::fill(locked.begin(), locked.end(), 0);
+
+			size_t removed = 0;
+			for (const Collapse& collapse : collapses)
+			{
+				if (collapse.error > errorLimit || removed >= triangleGoal) break;
+				if (locked[collapse.from] || locked[collapse.to]) continue;
+				if (flipsTriangle(collapse.from, collapse.to)) continue;
+				if (!matchWedges(collapse.from, collapse.to))
+				{
+					// Undo the partial match
+					unsigned int vertex = collapse.from;
+					do
+					{
+						collapseRemap[vertex] = vertex;
+						vertex = wedge[vertex];
+					} while (vertex != collapse.from);
+					continue;
+				}
+
+				removed += sharedTriangles(collapse.from, collapse.to);
+				addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+				maxError = std::max(maxError, collapse.error);
+
+				// Triangles around a moved vertex changed, so nothing touching them collapses again this pass
+				lockNeighbourhood(collapse.from);
+				lockNeighbourhood(collapse.to);
+			}
+			return removed;
+		}
+
+		void removeDegenerates()
+		{
+			size_t written = 0;
+			for (size_t i = 0; i + 2 < indexCount; i += 3)
+			{
+				unsigned int a = collapseRemap[indices[i]];
+				unsigned int b = collapseRemap[indices[i + 1]];
+				unsigned int c = collapseRemap[indices[i + 2]];
+				if (remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c]) continue;
+
+				indices[written++] = a;
+				indices[written++] = b;
+				indices[written++] = c;
+			}
+			indexCount = written;
+		}
+	};
+}
+
+size_t MeshSimplifier::simplify(unsigned long* destination, const unsigned long* indices, size_t indexCount, const float* positions, size_t vertexStride, size_t vertexCount,
+	size_t targetIndexCount, float targetError, float* resultError)
+{
+	indexCount -= indexCount % 3;
+	if (destination != indices) memmove(destination, indices, indexCount * sizeof(unsigned long));
+	if (resultError) *resultError = 0.0f;
+	if (indexCount == 0 || vertexCount == 0 || targetIndexCount >= indexCount)
+	{
+		return indexCount;
+	}
+
+	std::vector<Vector3> scaledPositions;
+	readPositions(positions, vertexStride, vertexCount, scaledPositions);
+
+	std::vector<unsigned int> remap, wedge;
+	buildPositionRemap(positions, vertexStride, vertexCount, remap, wedge);
+
+	std::vector<unsigned char> kinds;
+	classifyVertices(destination, indexCount, remap, wedge, kinds);
+
+	std::vector<Quadric> quadrics;
+	buildQuadrics(destination, indexCount, scaledPositions, remap, quadrics);
+
+	// Quadrics hold squared distances
+	double maxError = 0.0;
+	Simplifier simplifier(destination, indexCount, scaledPositions, remap, wedge, kinds, quadrics);
+	size_t result = simplifier.run(targetIndexCount, (double)targetError * targetError, maxError);
+
+	if (resultError) *resultError = (float)sqrt(maxError);
+	return result;
+}
+
+void MeshSimplifier::appendLodChain(std::vector<unsigned long>& indices, const Range* ranges, size_t rangeCount, const float* positions, size_t vertexStride, size_t vertexCount,
+	const LodSettings& settings, std::vector<Lod>& lods)
+{
+	lods.clear();
+	if (indices.empty()) return;
+	lods.push_back({ 0, (unsigned int)indices.size(), 0.0f });
+
+	// A range past the end of either buffer would be read out of bounds, the mesh keeps level 0 only
+	for (size_t r = 0; r < rangeCount; r++)
+	{
+		const Range& range = ranges[r];
+		if ((size_t)range.vertexStart + range.vertexCount > vertexCount || (size_t)range.indexStart + range.indexCount > indices.size()) return;
+	}
+
+	// Chains are built per range, with indices local to the range's vertices, then interleaved level by level
+	std::vector<std::vector<std::vector<unsigned long>>> chains(rangeCount);
+	std::vector<std::vector<float>> chainErrors(rangeCount);
+	size_t levelCount = 1;
+	const char* vertexData = (const char*)positions;
+	for (size_t r = 0; r < rangeCount; r++)
+	{
+		const Range& range = ranges[r];
+		const float* rangePositions = (const float*)(vertexData + (size_t)range.vertexStart * vertexStride);
+
+		std::vector<Vector3> scaled;
+		double extent = readPositions(rangePositions, vertexStride, range.vertexCount, scaled);
+
+		std::vector<unsigned long> previous(indices.begin() + range.indexStart, indices.begin() + range.indexStart + range.indexCount);
+		for (unsigned long& index : previous) index -= range.vertexStart;
+
+		float error = 0.0f;
+		for (unsigned int level = 1; level < settings.maxLevels; level++)
+		{
+			size_t target = (size_t)(previous.size() / 3 * settings.reduction) * 3;
+			std::vector<unsigned long> simplified(previous.size());
+			float levelError = 0.0f;
+			simplified.resize(simplify(simplified.data(), previous.data(), previous.size(), rangePositions, vertexStride, range.vertexCount, target, settings.maxError, &levelError));
+
+			// Not worth a level of its own
+			if (simplified.empty() || simplified.size() > previous.size() * MIN_LEVEL_REDUCTION) break;
+
+			MeshOptimizer::optimizeVertexCache(simplified.data(), simplified.size(), range.vertexCount);
+			error += (float)(levelError * extent);
+			chains[r].push_back(simplified);
+			chainErrors[r].push_back(error);
+			previous.swap(simplified);
+		}
+		levelCount = std::max(levelCount, chains[r].size() + 1);
+	}
+
+	for (size_t level = 1; level < levelCount; level++)
+	{
+		Lod lod = { (unsigned int)indices.size(), 0, 0.0f };
+		for (size_t r = 0; r < rangeCount; r++)
+		{
+			const Range& range = ranges[r];
+			if (chains[r].empty())
+			{
+				// The range could not be simplified, it stays at full detail
+				for (unsigned int i = 0; i < range.indexCount; i++) indices.push_back(indices[range.indexStart + i]);
+				continue;
+			}
+
+			size_t chainLevel = std::min(level, chains[r].size()) - 1;
+			for (unsigned long index : chains[r][chainLevel]) indices.push_back(index + range.vertexStart);
+			lod.error = std::max(lod.error, chainErrors[r][chainLevel]);
+		}
+		lod.indexCount = (unsigned int)indices.size() - lod.indexStart;
+		lods.push_back(lod);
+	}
+}
+
+unsigned int MeshSimplifier::getSettingsKey(const LodSettings& settings)
+{
+	unsigned int values[3];
+	values[0] = settings.maxLevels;
+	memcpy(&values[1], &settings.reduction, sizeof(float));
+	memcpy(&values[2], &settings.maxError, sizeof(float));
+
+	// 32 bit FNV-1a
+	unsigned int key = 2166136261u;
+	const unsigned char* bytes = (const unsigned char*)values;
+	for (size_t i = 0; i < sizeof(values); i++)
+	{
+		key ^= bytes[i];
+		key *= 16777619u;
+	}
+	return key;
+}
@@ -0,0 +1,76 @@
+/**
+* \class MeshSimplifier
+*
+* \brief Quadric error edge collapse simplification and LOD chains
+*
+* Every vertex keeps a quadric, the sum of the squared distances to the planes of the triangles around it (Garland and Heckbert).
+* Edges are collapsed cheapest first onto one of their existing vertices, so every level of detail shares the original vertex buffer
+* and only needs its own indices.
+* Vertices that share a position but not their other attributes (UV and normal seams) are collapsed together along the seam,
+* and only along it, so seams never tear open. Open borders are kept in place the same way, and both get extra edge planes
+* so the simplifier prefers to keep them straight. Collapses that would flip a triangle are rejected.
+* Errors are distances, relative to the largest extent of the mesh.
+*/
+
+
+#ifndef _MESHSIMPLIFIER_H_
+#define _MESHSIMPLIFIER_H_
+
+#include <cstddef>
+#include <vector>
+
+class MeshSimplifier
+{
+public:
+	/// How a LOD chain is built
+	struct LodSettings
+	{
+		unsigned int maxLevels = 4;		///< Levels including the full detail mesh
+		float reduction = 0.5f;			///< Triangle count of every level as a fraction of the previous one
+		float maxError = 0.02f;			///< Largest error a single level may add, relative to the mesh extent
+	};
+
+	/// Index range of one level of detail, every level is contiguous in the index buffer
+	struct Lod
+	{
+		unsigned int indexStart;
+		unsigned int indexCount;
+		float error;			///< Worst distance from the full detail mesh, in object space units
+	};
+
+	/// Part of a mesh that is simplified on its own, the indices are absolute and only reference the vertex range
+	struct Range
+	{
+		unsigned int indexStart;
+		unsigned int indexCount;
+		unsigned int vertexStart;
+		unsigned int vertexCount;
+	};
+
+	/** \brief Simplifies a triangle list
+	* @param destination receives the simplified triangle list, it must hold indexCount indices and may be the same as indices
+	* @param positions points at the position of the first vertex, three floats
+	* @param vertexStride is the distance in bytes between consecutive positions
+	* @param targetIndexCount is the index count to stop at
+	* @param targetError is the largest error a collapse may cause, relative to the mesh extent
+	* @param resultError optionally receives the largest error of the collapses made, relative to the mesh extent
+	* Returns the number of indices written, which is above the target if the target error was reached first.
+	*/
+	static size_t simplify(unsigned long* destination, const unsigned long* indices, size_t indexCount, const float* positions, size_t vertexStride, size_t vertexCount,
+		size_t targetIndexCount, float targetError, float* resultError = nullptr);
+
+	/** \brief Builds a LOD chain for every range of an index buffer and appends it to the buffer
+	* The existing indices are level 0. Every further level holds the simplified indices of each range, in range order,
+	* so a level is drawn with a single draw call. Ranges that stop simplifying early repeat their last level.
+	* Levels are cache optimized, the vertex buffer is left untouched.
+	* If a range reaches past vertexCount or the end of indices, no levels are added.
+	* @param lods receives the index range and error of every level, starting with level 0
+	*/
+	static void appendLodChain(std::vector<unsigned long>& indices, const Range* ranges, size_t rangeCount, const float* positions, size_t vertexStride, size_t vertexCount,
+		const LodSettings& settings, std::vector<Lod>& lods);
+
+	/// Key of a set of LOD settings, caches built with other settings are rebuilt
+	static unsigned int getSettingsKey(const LodSettings& settings);
+};
+
+#endif
@@ -0,0 +1,410 @@
+// Meshlet builder
+// Splits triangle lists into meshlets with bounding spheres and normal cones and culls them, see MeshletBuilder.h
+#include "MeshletBuilder.h"
+#include "FrustumCuller.h"
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+	// Cone half angles are widened by this much, in cosine, so rounding never culls a triangle that is just visible
+	const float CONE_MARGIN = 0.001f;
+
+	const unsigned int NO_TRIANGLE = 0xFFFFFFFFu;
+
+	struct Vector3
+	{
+		float x, y, z;
+	};
+
+	inline Vector3 subtract(const Vector3& a, const Vector3& b)
+	{
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	inline Vector3 cross(const Vector3& a, const Vector3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	inline float dot(const Vector3& a, const Vector3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline float length(const Vector3& v)
+	{
+		return sqrtf(dot(v, v));
+	}
+
+	inline Vector3 readVector(const float* base, size_t stride, unsigned long index)
+	{
+		const float* v = (const float*)((const char*)base + stride * index);
+		return { v[0], v[1], v[2] };
+	}
+
+	struct PositionKey
+	{
+		unsigned int x, y, z;
+
+		bool operator==(const PositionKey& other) const
+		{
+			return x == other.x && y == other.y && z == other.z;
+		}
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const PositionKey& key) const
+		{
+			return (size_t)((key.x * 73856093u) ^ (key.y * 19349663u) ^ (key.z * 83492791u));
+		}
+	};
+
+	// Meshlet being grown
+	struct Cluster
+	{
+		unsigned int stamp;						// Marks the vertices and positions already in this meshlet
+		unsigned int vertexCount;
+		std::vector<unsigned int> positions;	// Unique positions, where neighbouring triangles are searched from
+		std::vector<unsigned int> triangles;
+		Vector3 centroidSum;
+		Vector3 normalSum;
+	};
+}
+
+void MeshletBuilder::buildMeshlets(unsigned long* indices, unsigned int indexStart, unsigned int indexCount, const float* positions, const float* normals, size_t vertexStride, size_t vertexCount,
+	std::vector<Meshlet>& meshlets)
+{
+	const unsigned int triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+	unsigned long* triangleIndices = indices + indexStart;
+	const std::vector<unsigned long> source(triangleIndices, triangleIndices + triangleCount * 3);
+
+	// Corners that share a position are neighbours even when their other attributes differ
+	std::vector<unsigned int> positionIds(vertexCount, NO_TRIANGLE);
+	std::unordered_map<PositionKey, unsigned int, PositionKeyHash> uniquePositions;
+	unsigned int positionCount = 0;
+	for (unsigned long index : source)
+	{
+		if (positionIds[index] != NO_TRIANGLE) continue;
+
+		Vector3 position = readVector(positions, vertexStride, index);
+		PositionKey key;
+		memcpy(&key.x, &position.x, sizeof(float));
+		memcpy(&key.y, &position.y, sizeof(float));
+		memcpy(&key.z, &position.z, sizeof(float));
+		auto inserted = uniquePositions.insert(std::make_pair(key, positionCount));
+		if (inserted.second) positionCount++;
+		positionIds[index] = inserted.first->second;
+	}
+
+	// Unit face normals and centroids. The winding that faces front is the one agreeing with the vertex normals overall.
+	std::vector<Vector3> faceNormals(triangleCount);
+	std::vector<Vector3> centroids(triangleCount);
+	float agreement = 0.0f;
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		Vector3 p0 = readVector(positions, vertexStride, source[t * 3]);
+		Vector3 p1 = readVector(positions, vertexStride, source[t * 3 + 1]);
+		Vector3 p2 = readVector(positions, vertexStride, source[t * 3 + 2]);
+		Vector3 normal = cross(subtract(p1, p0), subtract(p2, p0));
+		float area = length(normal);
+		faceNormals[t] = (area > 0.0f) ? Vector3{ normal.x / area, normal.y / area, normal.z / area } : Vector3{ 0.0f, 0.0f, 0.0f };
+		centroids[t] = { (p0.x + p1.x + p2.x) / 3.0f, (p0.y + p1.y + p2.y) / 3.0f, (p0.z + p1.z + p2.z) / 3.0f };
+
+		for (int corner = 0; corner < 3; corner++)
+		{
+			agreement += dot(normal, readVector(normals, vertexStride, source[t * 3 + corner]));
+		}
+	}
+	if (agreement < 0.0f)
+	{
+		for (Vector3& normal : faceNormals) normal = { -normal.x, -normal.y, -normal.z };
+	}
+
+	// Triangles around every position, and how many of them are not in a meshlet yet
+	std::vector<unsigned int> adjacencyOffsets(positionCount + 1, 0);
+	for (unsigned long index : source) adjacencyOffsets[positionIds[index] + 1]++;
+	for (unsigned int p = 0; p < positionCount; p++) adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+	std::vector<unsigned int> liveCounts(positionCount);
+	for (unsigned int p = 0; p < positionCount; p++) liveCounts[p] = adjacencyOffsets[p + 1] - adjacencyOffsets[p];
+	std::vector<unsigned int> adjacency(source.size());
+	{
+		std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (unsigned int t = 0; t < triangleCount; t++)
+		{
+			for (int corner = 0; corner < 3; corner++) adjacency[fill[positionIds[source[t * 3 + corner]]]++] = t;
+		}
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> vertexStamps(vertexCount, 0);
+	std::vector<unsigned int> positionStamps(positionCount, 0);
+	Cluster cluster;
+	cluster.stamp = 0;
+	std::vector<unsigned int> previousPositions;
+	unsigned int cursor = 0;
+	unsigned int indexOffset = 0;
+
+	auto newVertices = [&](unsigned int t)
+	{
+		unsigned int count = 0;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned long index = source[t * 3 + corner];
+			bool repeated = (corner > 0 && source[t * 3] == index) || (corner > 1 && source[t * 3 + 1] == index);
+			if (vertexStamps[index] != cluster.stamp && !repeated) count++;
+		}
+		return count;
+	};
+
+	auto addTriangle = [&](unsigned int t)
+	{
+		emitted[t] = true;
+		cluster.triangles.push_back(t);
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned long index = source[t * 3 + corner];
+			unsigned int position = positionIds[index];
+			if (vertexStamps[index] != cluster.stamp)
+			{
+				vertexStamps[index] = cluster.stamp;
+				cluster.vertexCount++;
+			}
+			if (positionStamps[position] != cluster.stamp)
+			{
+				positionStamps[position] = cluster.stamp;
+				cluster.positions.push_back(position);
+			}
+			liveCounts[position]--;
+		}
+		cluster.centroidSum = { cluster.centroidSum.x + centroids[t].x, cluster.centroidSum.y + centroids[t].y, cluster.centroidSum.z + centroids[t].z };
+		cluster.normalSum = { cluster.normalSum.x + faceNormals[t].x, cluster.normalSum.y + faceNormals[t].y, cluster.normalSum.z + faceNormals[t].z };
+	};
+
+	for (unsigned int emittedCount = 0; emittedCount < triangleCount; emittedCount += (unsigned int)cluster.triangles.size())
+	{
+		cluster.stamp++;
+		cluster.vertexCount = 0;
+		cluster.positions.clear();
+		cluster.triangles.clear();
+		cluster.centroidSum = { 0.0f, 0.0f, 0.0f };
+		cluster.normalSum = { 0.0f, 0.0f, 0.0f };
+
+		// Start next to the last meshlet, on the triangle with the fewest free neighbours so the surface is peeled from its edge.
+		// With nothing left nearby, continue from the first free triangle in the existing (cache optimized) order.
+		unsigned int seed = NO_TRIANGLE;
+		unsigned int seedNeighbours = 0;
+		for (unsigned int position : previousPositions)
+		{
+			for (unsigned int a = adjacencyOffsets[position]; a < adjacencyOffsets[position + 1]; a++)
+			{
+				unsigned int t = adjacency[a];
+				if (emitted[t]) continue;
+
+				unsigned int neighbours = 0;
+				for (int corner = 0; corner < 3; corner++) neighbours += liveCounts[positionIds[source[t * 3 + corner]]];
+				if (seed == NO_TRIANGLE || neighbours < seedNeighbours)
+				{
+					seed = t;
+					seedNeighbours = neighbours;
+				}
+			}
+		}
+		if (seed == NO_TRIANGLE)
+		{
+			while (emitted[cursor]) cursor++;
+			seed = cursor;
+		}
+		addTriangle(seed);
+
+		// Grow onto the neighbour adding the fewest vertices, then the one closest to the meshlet and facing its way
+		while (cluster.triangles.size() < MAX_TRIANGLES)
+		{
+			float inverseCount = 1.0f / cluster.triangles.size();
+			Vector3 centre = { cluster.centroidSum.x * inverseCount, cluster.centroidSum.y * inverseCount, cluster.centroidSum.z * inverseCount };
+			float normalLength = length(cluster.normalSum);
+			Vector3 axis = (normalLength > 0.0f) ? Vector3{ cluster.normalSum.x / normalLength, cluster.normalSum.y / normalLength, cluster.normalSum.z / normalLength } : Vector3{ 0.0f, 0.0f, 0.0f };
+
+			unsigned int best = NO_TRIANGLE;
+			unsigned int bestPriority = 0;
+			float bestCost = 0.0f;
+			for (size_t p = 0; p < cluster.positions.size(); p++)
+			{
+				unsigned int position = cluster.positions[p];
+				if (liveCounts[position] == 0) continue;
+
+				for (unsigned int a = adjacencyOffsets[position]; a < adjacencyOffsets[position + 1]; a++)
+				{
+					unsigned int t = adjacency[a];
+					if (emitted[t]) continue;
+
+					unsigned int added = newVertices(t);
+					if (cluster.vertexCount + added > MAX_VERTICES) continue;
+
+					// The last free triangle at a position is taken as eagerly as one adding nothing, or it would be left stranded
+					unsigned int priority = added;
+					for (int corner = 0; corner < 3; corner++)
+					{
+						if (liveCounts[positionIds[source[t * 3 + corner]]] == 1) priority = 0;
+					}
+
+					float facing = (normalLength > 0.0f) ? 1.0f - dot(faceNormals[t], axis) : 0.0f;
+					float cost = length(subtract(centroids[t], centre)) * (1.0f + 2.0f * facing);
+					if (best == NO_TRIANGLE || priority < bestPriority || (priority == bestPriority && cost < bestCost))
+					{
+						best = t;
+						bestPriority = priority;
+						bestCost = cost;
+					}
+				}
+			}
+			if (best == NO_TRIANGLE) break;
+			addTriangle(best);
+		}
+
+		// Bounding sphere around the centre of the meshlet's box
+		Vector3 boundsMin = readVector(positions, vertexStride, source[cluster.triangles[0] * 3]);
+		Vector3 boundsMax = boundsMin;
+		for (unsigned int t : cluster.triangles)
+		{
+			for (int corner = 0; corner < 3; corner++)
+			{
+				Vector3 p = readVector(positions, vertexStride, source[t * 3 + corner]);
+				boundsMin = { fminf(boundsMin.x, p.x), fminf(boundsMin.y, p.y), fminf(boundsMin.z, p.z) };
+				boundsMax = { fmaxf(boundsMax.x, p.x), fmaxf(boundsMax.y, p.y), fmaxf(boundsMax.z, p.z) };
+			}
+		}
+		Vector3 centre = { (boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f };
+		float radius = 0.0f;
+		for (unsigned int t : cluster.triangles)
+		{
+			for (int corner = 0; corner < 3; corner++)
+			{
+				radius = fmaxf(radius, length(subtract(readVector(positions, vertexStride, source[t * 3 + corner]), centre)));
+			}
+		}
+
+		// Normal cone around the average facing direction, degenerate triangles are never drawn so they are ignored
+		float normalLength = length(cluster.normalSum);
+		Vector3 axis = (normalLength > 0.0f) ? Vector3{ cluster.normalSum.x / normalLength, cluster.normalSum.y / normalLength, cluster.normalSum.z / normalLength } : Vector3{ 0.0f, 0.0f, 0.0f };
+		float minimumDot = 1.0f;
+		for (unsigned int t : cluster.triangles)
+		{
+			if (dot(faceNormals[t], faceNormals[t]) > 0.0f) minimumDot = fminf(minimumDot, dot(faceNormals[t], axis));
+		}
+		minimumDot -= CONE_MARGIN;
+
+		Meshlet meshlet;
+		meshlet.indexStart = indexStart + indexOffset;
+		meshlet.indexCount = (unsigned int)cluster.triangles.size() * 3;
+		meshlet.centre[0] = centre.x;
+		meshlet.centre[1] = centre.y;
+		meshlet.centre[2] = centre.z;
+		meshlet.radius = radius;
+		meshlet.coneAxis[0] = axis.x;
+		meshlet.coneAxis[1] = axis.y;
+		meshlet.coneAxis[2] = axis.z;
+		meshlet.coneCutoff = (normalLength > 0.0f && minimumDot > 0.0f) ? sqrtf(1.0f - minimumDot * minimumDot) : 2.0f;
+		meshlets.push_back(meshlet);
+
+		for (unsigned int t : cluster.triangles)
+		{
+			for (int corner = 0; corner < 3; corner++) triangleIndices[indexOffset++] = source[t * 3 + corner];
+		}
+		previousPositions = cluster.positions;
+	}
+}
+
+void MeshletBuilder::computeView(const float worldViewProjection[16], const float objectEye[4], bool cullBackfaces, View& view)
+{
+	// Object space planes, as the world view projection takes object positions to clip space
+	FrustumCuller::Frustum frustum;
+	FrustumCuller::computeFrustum(worldViewProjection, frustum);
+	memcpy(view.planes, frustum.planes, sizeof(view.planes));
+
+	memcpy(view.eye, objectEye, sizeof(view.eye));
+	if (view.eye[3] == 0.0f)
+	{
+		float directionLength = sqrtf(view.eye[0] * view.eye[0] + view.eye[1] * view.eye[1] + view.eye[2] * view.eye[2]);
+		if (directionLength > 0.0f)
+		{
+			for (int i = 0; i < 3; i++) view.eye[i] /= directionLength;
+		}
+	}
+	view.cullBackfaces = cullBackfaces;
+}
+
+bool MeshletBuilder::isOutsideFrustum(const Meshlet& meshlet, const View& view)
+{
+	for (int p = 0; p < 6; p++)
+	{
+		const float* plane = view.planes[p];
+		float distance = plane[0] * meshlet.centre[0] + plane[1] * meshlet.centre[1] + plane[2] * meshlet.centre[2] + plane[3];
+		if (distance < -meshlet.radius) return true;
+	}
+	return false;
+}
+
+bool MeshletBuilder::isBackfacing(const Meshlet& meshlet, const View& view)
+{
+	if (meshlet.coneCutoff > 1.0f)
+	{
+		return false;
+	}
+
+	const float* axis = meshlet.coneAxis;
+	if (view.eye[3] == 0.0f)
+	{
+		// Orthographic, every triangle is seen along the same direction
+		return view.eye[0] * axis[0] + view.eye[1] * axis[1] + view.eye[2] * axis[2] >= meshlet.coneCutoff;
+	}
+
+	// Every point of the sphere must be seen within 90 degrees minus the cone's half angle of the axis,
+	// then no normal in the cone can face the eye. The radius term extends the test from the centre to the whole sphere.
+	float toCentre[3];
+	for (int i = 0; i < 3; i++) toCentre[i] = meshlet.centre[i] - view.eye[i] / view.eye[3];
+	float distance = sqrtf(toCentre[0] * toCentre[0] + toCentre[1] * toCentre[1] + toCentre[2] * toCentre[2]);
+	float along = toCentre[0] * axis[0] + toCentre[1] * axis[1] + toCentre[2] * axis[2];
+	return along >= meshlet.coneCutoff * distance + meshlet.radius * (1.0f + meshlet.coneCutoff);
+}
+
+void MeshletBuilder::cull(const Meshlet* meshlets, size_t meshletCount, const View& view, std::vector<DrawRange>& draws, CullStats* stats)
+{
+	CullStats counters = { 0, 0, 0, 0 };
+	draws.clear();
+
+	for (size_t i = 0; i < meshletCount; i++)
+	{
+		const Meshlet& meshlet = meshlets[i];
+		counters.tested++;
+		if (isOutsideFrustum(meshlet, view))
+		{
+			counters.frustumCulled++;
+			continue;
+		}
+		if (view.cullBackfaces && isBackfacing(meshlet, view))
+		{
+			counters.backfaceCulled++;
+			continue;
+		}
+
+		// Meshlets are contiguous, so a visible meshlet directly after the last one extends its draw
+		if (!draws.empty() && draws.back().indexStart + draws.back().indexCount == meshlet.indexStart)
+		{
+			draws.back().indexCount += meshlet.indexCount;
+		}
+		else
+		{
+			draws.push_back({ meshlet.indexStart, meshlet.indexCount });
+		}
+	}
+
+	counters.draws = (unsigned int)draws.size();
+	if (stats) *stats = counters;
+}
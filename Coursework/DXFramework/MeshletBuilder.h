@@ -0,0 +1,88 @@
+/**
+* \class MeshletBuilder
+*
+* \brief Splits a triangle list into meshlets and culls them on the CPU
+*
+* A meshlet is a small cluster of neighbouring triangles, at most MAX_VERTICES unique vertices and MAX_TRIANGLES triangles.
+* buildMeshlets() reorders the triangles of an index range so every meshlet is a contiguous run of indices, and gives each one
+* a bounding sphere and a normal cone (the average facing direction of its triangles and how far they spread from it).
+* Each pass cull()s the meshlets against its frustum and rejects those whose triangles all face away from the eye,
+* then merges the remaining runs into as few ranged draws as possible.
+* Adjacency is found through shared positions, so flat shaded meshes with split vertices still grow connected meshlets.
+*/
+
+
+#ifndef _MESHLETBUILDER_H_
+#define _MESHLETBUILDER_H_
+
+#include <cstddef>
+#include <vector>
+
+class MeshletBuilder
+{
+public:
+	static const unsigned int MAX_VERTICES = 64;
+	static const unsigned int MAX_TRIANGLES = 124;
+
+	/// One cluster of triangles, stored in the .dxmesh cache
+	struct Meshlet
+	{
+		unsigned int indexStart;	///< Contiguous run of the index buffer
+		unsigned int indexCount;
+		float centre[3];			///< Object space bounding sphere
+		float radius;
+		float coneAxis[3];			///< Average front facing direction of the triangles
+		float coneCutoff;			///< Sine of the cone's half angle, above 1 when the triangles face too many ways to ever be culled
+	};
+
+	/// A pass as seen from the mesh's object space
+	struct View
+	{
+		float planes[6][4];		///< Frustum planes, normalised, a point is inside when ax + by + cz + d >= 0 for all of them
+		float eye[4];			///< Eye position with w = 1, or the view direction with w = 0 for orthographic projections
+		bool cullBackfaces;		///< False when the transform mirrors the mesh, which swaps front and back faces
+	};
+
+	/// Run of visible meshlets drawn with one DrawIndexed
+	struct DrawRange
+	{
+		unsigned int indexStart;
+		unsigned int indexCount;
+	};
+
+	/// Counters from a cull
+	struct CullStats
+	{
+		unsigned int tested;
+		unsigned int frustumCulled;
+		unsigned int backfaceCulled;
+		unsigned int draws;
+	};
+
+	/** \brief Reorders an index range into meshlets and appends them
+	* @param indices is the whole index buffer, only [indexStart, indexStart + indexCount) is reordered
+	* @param positions points at the position of the first vertex, three floats
+	* @param normals points at the normal of the first vertex, three floats, used to find which winding faces front
+	* @param vertexStride is the distance in bytes between consecutive positions and normals
+	*/
+	static void buildMeshlets(unsigned long* indices, unsigned int indexStart, unsigned int indexCount, const float* positions, const float* normals, size_t vertexStride, size_t vertexCount,
+		std::vector<Meshlet>& meshlets);
+
+	/** \brief Builds a view from the pass matrices, both in the row vector layout DirectXMath stores
+	* @param worldViewProjection maps object space to clip space
+	* @param objectEye is the eye in object space, w = 1 for a position or w = 0 for the view direction of orthographic projections
+	* @param cullBackfaces enables the normal cone test
+	*/
+	static void computeView(const float worldViewProjection[16], const float objectEye[4], bool cullBackfaces, View& view);
+
+	/** \brief Culls meshlets against a view
+	* @param draws is cleared and receives the visible meshlets, with neighbouring runs merged
+	* @param stats optionally receives the counters
+	*/
+	static void cull(const Meshlet* meshlets, size_t meshletCount, const View& view, std::vector<DrawRange>& draws, CullStats* stats = nullptr);
+
+	static bool isOutsideFrustum(const Meshlet& meshlet, const View& view);	///< Sphere against the frustum planes
+	static bool isBackfacing(const Meshlet& meshlet, const View& view);		///< Every triangle faces away from the eye
+};
+
+#endif
@@ -1,11 +1,14 @@
 // Model mesh and load
 // Loads a .obj and creates a mesh object from the data
 #include "model.h"
+#include <algorithm>
 
 // load model datat, initialise buffers (with model data) and load texture.
-Model::Model(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const char* filename)
+Model::Model(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const char* filename, const MeshSimplifier::LodSettings& lodSettings)
 {
-	loadModel(filename);
+	model = nullptr;
+	modelIndices = nullptr;
+	loadModel(filename, lodSettings);
 	initBuffers(device);
 }
 
@@ -20,6 +23,12 @@ Model::~Model()
 		delete[] model;
 		model = 0;
 	}
+
+	if (modelIndices)
+	{
+		delete[] modelIndices;
+		modelIndices = 0;
+	}
 }
 
 
@@ -28,8 +37,6 @@ void Model::initBuffers(ID3D11Device* device)
 {
 	VertexType* vertices;
 	unsigned long* indices;
-	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
-	D3D11_SUBRESOURCE_DATA vertexData, indexData;
 		
 	vertices = new VertexType[vertexCount];
 	indices = new unsigned long[indexCount];
@@ -40,37 +47,15 @@ void Model::initBuffers(ID3D11Device* device)
 		vertices[i].position = XMFLOAT3(model[i].x, model[i].y, -model[i].z);
 		vertices[i].texture = XMFLOAT2(model[i].tu, model[i].tv);
 		vertices[i].normal = XMFLOAT3(model[i].nx, model[i].ny, -model[i].nz);
-
-		indices[i] = i;
 	}
 
-	// Set up the description of the static vertex buffer.
-	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	vertexBufferDesc.ByteWidth = sizeof(VertexType)* vertexCount;
-	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexBufferDesc.CPUAccessFlags = 0;
-	vertexBufferDesc.MiscFlags = 0;
-	vertexBufferDesc.StructureByteStride = 0;
-	// Give the subresource structure a pointer to the vertex data.
-	vertexData.pSysMem = vertices;
-	vertexData.SysMemPitch = 0;
-	vertexData.SysMemSlicePitch = 0;
-	// Now create the vertex buffer.
-	device->CreateBuffer(&vertexBufferDesc, &vertexData, &vertexBuffer);
+	for (int i = 0; i < indexCount; i++)
+	{
+		indices[i] = modelIndices[i];
+	}
 
-	// Set up the description of the static index buffer.
-	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	indexBufferDesc.ByteWidth = sizeof(unsigned long)* indexCount;
-	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexBufferDesc.CPUAccessFlags = 0;
-	indexBufferDesc.MiscFlags = 0;
-	indexBufferDesc.StructureByteStride = 0;
-	// Give the subresource structure a pointer to the index data.
-	indexData.pSysMem = indices;
-	indexData.SysMemPitch = 0;
-	indexData.SysMemSlicePitch = 0;
-	// Create the index buffer.
-	device->CreateBuffer(&indexBufferDesc, &indexData, &indexBuffer);
+	createVertexBuffer(device, vertices, vertexCount);
+	createIndexBuffer(device, indices, indexCount);
 	
 	// Release the arrays now that the vertex and index buffers have been created and loaded.
 	delete[] vertices;
@@ -221,104 +206,88 @@ void Model::initBuffers(ID3D11Device* device)
 //	faces.clear();
 //}
 
-// Modified from a mulit-threaded version by Mark Ropper (CGT).
-void Model::loadModel(const char* filename)
+// Parses the file with the mapped, multithreaded ObjLoader and welds identical corners into an indexed mesh.
+void Model::loadModel(const char* filename, const MeshSimplifier::LodSettings& lodSettings)
 {
-	std::vector<XMFLOAT3> verts;
-	std::vector<XMFLOAT3> norms;
-	std::vector<XMFLOAT2> texCs;
-	std::vector<unsigned int> faces;
-
-	FILE* file;// = fopen(filename, "r");
-	errno_t err;
-	err = fopen_s(&file, filename, "r");
-	if(err != 0)
-	//if (file == NULL)
+	ObjLoader::ObjData obj;
+	if (!ObjLoader::load(filename, obj))
 	{
+		// Missing file, or a parser error
 		return;
 	}
 
-	while (true)
+	// Share one vertex between every corner with the same position, texture coordinate and normal
+	std::vector<ObjLoader::Corner> uniqueCorners;
+	std::vector<unsigned int> cornerIndices;
+	ObjLoader::weld(obj.corners, uniqueCorners, cornerIndices);
+
+	// Create the model using the vertex and index counts that were read in.
+	vertexCount = (int)uniqueCorners.size();
+	indexCount = (int)cornerIndices.size();
+	model = new ModelType[vertexCount];
+	modelIndices = new unsigned long[indexCount];
+
+	for (int vIndex = 0; vIndex < vertexCount; vIndex++)
 	{
-		char lineHeader[128];
+		const ObjLoader::Corner& corner = uniqueCorners[vIndex];
+		const XMFLOAT3& position = obj.positions[corner.position];
+		model[vIndex].x = position.x;
+		model[vIndex].y = position.y;
+		model[vIndex].z = position.z;
 
-		// Read first word of the line
-		int res = fscanf_s(file, "%s", lineHeader, (int)sizeof(lineHeader));
-		if (res == EOF)
+		// Texture coordinates are optional in OBJ files
+		if (corner.texture != ObjLoader::NO_INDEX)
 		{
-			break; // exit loop
+			model[vIndex].tu = obj.texCoords[corner.texture].x;
+			model[vIndex].tv = obj.texCoords[corner.texture].y;
 		}
-		else // Parse
+		else
 		{
-			if (strcmp(lineHeader, "v") == 0) // Vertex
-			{
-				XMFLOAT3 vertex;
-				fscanf_s(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-				verts.push_back(vertex);
-			}
-			else if (strcmp(lineHeader, "vt") == 0) // Tex Coord
-			{
-				XMFLOAT2 uv;
-				fscanf_s(file, "%f %f\n", &uv.x, &uv.y);
-				texCs.push_back(uv);
-			}
-			else if (strcmp(lineHeader, "vn") == 0) // Normal
-			{
-				XMFLOAT3 normal;
-				fscanf_s(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-				norms.push_back(normal);
-			}
-			else if (strcmp(lineHeader, "f") == 0) // Face
-			{
-				unsigned int face[9];
-				int matches = fscanf_s(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &face[0], &face[1], &face[2],
-																			&face[3], &face[4], &face[5],
-																			&face[6], &face[7], &face[8]);
-				if (matches != 9)
-				{
-					// Parser error, or not triangle faces
-					return;
-				}
-
-				for (int i = 0; i < 9; i++)
-				{
-					faces.push_back(face[i]);
-				}
-
+			model[vIndex].tu = 0.0f;
+			model[vIndex].tv = 0.0f;
+		}
 
-			}
+		if (corner.normal != ObjLoader::NO_INDEX)
+		{
+			const XMFLOAT3& normal = obj.normals[corner.normal];
+			model[vIndex].nx = normal.x;
+			model[vIndex].ny = normal.y;
+			model[vIndex].nz = normal.z;
 		}
 	}
 
-	int vIndex = 0, nIndex = 0, tIndex = 0;
-	int numFaces = (int)faces.size() / 9;
-
-	//// Create the model using the vertex count that was read in.
-	vertexCount = numFaces * 3;
-	model = new ModelType[vertexCount];
-
-	// "Unroll" the loaded obj information into a list of triangles.
-	for (int f = 0; f < (int)faces.size(); f += 3)
+	for (int i = 0; i < indexCount; i++)
 	{
-		model[vIndex].x = verts[(faces[f + 0] - 1)].x;
-		model[vIndex].y = verts[(faces[f + 0] - 1)].y;
-		model[vIndex].z = verts[(faces[f + 0] - 1)].z;
-		model[vIndex].tu = texCs[(faces[f + 1] - 1)].x;
-		model[vIndex].tv = texCs[(faces[f + 1] - 1)].y;
-		model[vIndex].nx = norms[(faces[f + 2] - 1)].x;
-		model[vIndex].ny = norms[(faces[f + 2] - 1)].y;
-		model[vIndex].nz = norms[(faces[f + 2] - 1)].z;
+		modelIndices[i] = cornerIndices[i];
 
-		//increase index count
-		vIndex++;
+		// No normal given, use the face normal. These corners are never welded so the vertex belongs to this face only.
+		if (obj.corners[i].normal == ObjLoader::NO_INDEX)
+		{
+			const int first = i - (i % 3);
+			XMVECTOR p0 = XMLoadFloat3(&obj.positions[obj.corners[first].position]);
+			XMVECTOR p1 = XMLoadFloat3(&obj.positions[obj.corners[first + 1].position]);
+			XMVECTOR p2 = XMLoadFloat3(&obj.positions[obj.corners[first + 2].position]);
+			XMFLOAT3 faceNormal;
+			XMStoreFloat3(&faceNormal, XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0)));
 
+			ModelType& vertex = model[cornerIndices[i]];
+			vertex.nx = faceNormal.x;
+			vertex.ny = faceNormal.y;
+			vertex.nz = faceNormal.z;
+		}
 	}
-	indexCount = vIndex;
 
+	MeshOptimizer::optimizeMesh(model, sizeof(ModelType), vertexCount, offsetof(ModelType, nx), modelIndices, indexCount);
 
-	verts.clear();
-	norms.clear();
-	texCs.clear();
-	faces.clear();
+	// Append the LOD chain, every level shares the vertices
+	std::vector<unsigned long> chainIndices(modelIndices, modelIndices + indexCount);
+	MeshSimplifier::Range range = { 0, (unsigned int)indexCount, 0, (unsigned int)vertexCount };
+	std::vector<MeshSimplifier::Lod> chain;
+	MeshSimplifier::appendLodChain(chainIndices, &range, 1, &model[0].x, sizeof(ModelType), vertexCount, lodSettings, chain);
+	setLods(chain.data(), (int)chain.size());
 
+	delete[] modelIndices;
+	indexCount = (int)chainIndices.size();
+	modelIndices = new unsigned long[indexCount];
+	std::copy(chainIndices.begin(), chainIndices.end(), modelIndices);
 }
@@ -4,7 +4,10 @@
 * \brief Very basic OBJ loading mesh object
 *
 * Is treated like a standard mesh object, but loads a basic OBJ file based on provided filename.
-* Future version will update/replace this model loader with something more complete.
+* Parsing is done by ObjLoader, which memory maps the file and parses it across multiple threads.
+* Corners sharing a position, texture coordinate and normal are welded into one vertex, so the mesh is properly indexed.
+* The indexed mesh is then reordered by MeshOptimizer for the vertex cache, overdraw and vertex fetch.
+* Finally MeshSimplifier appends a LOD chain to the index buffer.
 *
 * \author Paul Robertson
 */
@@ -14,6 +17,9 @@
 #define _MODEL_H_
 
 #include "BaseMesh.h"
+#include "ObjLoader.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 //#include "TokenStream.h"
 #include <vector>
 #include <fstream>
@@ -35,15 +41,17 @@ public:
 	* @param device is the renderer device
 	* @param device context is the renderer device context
 	* @param filename is a char* for filename.
+	* @param lodSettings controls the LOD chain
 	*/
-	Model(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const char* filename);
+	Model(ID3D11Device* device, ID3D11DeviceContext* deviceContext, const char* filename, const MeshSimplifier::LodSettings& lodSettings = MeshSimplifier::LodSettings());
 	~Model();
 
 protected:
 	void initBuffers(ID3D11Device* device);
-	void loadModel(const char* filename);
+	void loadModel(const char* filename, const MeshSimplifier::LodSettings& lodSettings);
 	
-	ModelType* model;
+	ModelType* model;				///< Unique vertices
+	unsigned long* modelIndices;	///< Triangle list indexing into model
 };
 
 #endif
\ No newline at end of file
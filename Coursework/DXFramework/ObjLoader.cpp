@@ -0,0 +1,534 @@
+// OBJ loader
+// Memory mapped, multithreaded OBJ parser. Replaces the fscanf based parsing in Model.
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include <thread>
+#include <functional>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	// Chunks smaller than this are not worth a thread of their own
+	const size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+	// Index given to corners that reference data outside the file, fails validation
+	const unsigned int BAD_INDEX = ObjLoader::NO_INDEX - 1;
+
+	// Exactly representable powers of ten, used to scale the parsed mantissa
+	const double POWERS_OF_TEN[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	enum class LineType
+	{
+		OTHER,
+		POSITION,
+		TEXCOORD,
+		NORMAL,
+		FACE
+	};
+
+	// Line aligned slice of the file and everything parsed out of it
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+
+		// Stream sizes, counted in the first pass
+		size_t positionCount;
+		size_t texCoordCount;
+		size_t normalCount;
+
+		// Where this chunk's data starts in the merged streams (prefix sum of the counts)
+		size_t positionBase;
+		size_t texCoordBase;
+		size_t normalBase;
+
+		std::vector<ObjLoader::Corner> corners;
+		bool valid;
+	};
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	inline bool isDigit(char c)
+	{
+		return (unsigned char)(c - '0') < 10;
+	}
+
+	inline const char* skipSpaces(const char* p, const char* end)
+	{
+		while (p < end && isSpace(*p)) ++p;
+		return p;
+	}
+
+	// Returns the position of the next new line, or end if this is the last line
+	inline const char* findLineEnd(const char* p, const char* end)
+	{
+		const char* newLine = (const char*)memchr(p, '\n', end - p);
+		return newLine ? newLine : end;
+	}
+
+	// Both passes must agree on what a line is, so the classification lives in one place
+	inline LineType classifyLine(const char* p, const char* lineEnd)
+	{
+		if (lineEnd - p < 2) return LineType::OTHER;
+		if (p[0] == 'f' && isSpace(p[1])) return LineType::FACE;
+		if (p[0] != 'v') return LineType::OTHER;
+		if (isSpace(p[1])) return LineType::POSITION;
+		if (lineEnd - p < 3 || !isSpace(p[2])) return LineType::OTHER;
+		if (p[1] == 't') return LineType::TEXCOORD;
+		if (p[1] == 'n') return LineType::NORMAL;
+		return LineType::OTHER;
+	}
+
+	// Parses a decimal float ([+-]digits[.digits][(e|E)[+-]digits]), returns the position after it.
+	// Returns p unchanged (and 0) when there is no number to read.
+	const char* parseFloat(const char* p, const char* end, float& out)
+	{
+		const char* start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		// Keep up to 19 significant digits, that is all an unsigned 64 bit mantissa holds
+		unsigned long long mantissa = 0;
+		int significantDigits = 0;
+		int exponent = 0;
+		bool anyDigits = false;
+
+		while (p < end && isDigit(*p))
+		{
+			if (significantDigits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) ++significantDigits;
+			}
+			else
+			{
+				++exponent;
+			}
+			anyDigits = true;
+			++p;
+		}
+
+		if (p < end && *p == '.')
+		{
+			++p;
+			while (p < end && isDigit(*p))
+			{
+				if (significantDigits < 19)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					if (mantissa) ++significantDigits;
+					--exponent;
+				}
+				anyDigits = true;
+				++p;
+			}
+		}
+
+		if (!anyDigits)
+		{
+			out = 0;
+			return start;
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* exponentStart = p;
+			++p;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExponent = *p == '-';
+				++p;
+			}
+			if (p < end && isDigit(*p))
+			{
+				int explicitExponent = 0;
+				while (p < end && isDigit(*p))
+				{
+					if (explicitExponent < 10000) explicitExponent = explicitExponent * 10 + (*p - '0');
+					++p;
+				}
+				exponent += negativeExponent ? -explicitExponent : explicitExponent;
+			}
+			else
+			{
+				// Not an exponent after all, leave the 'e' for the caller
+				p = exponentStart;
+			}
+		}
+
+		double value = (double)mantissa;
+		if (exponent < 0)
+		{
+			value = (-exponent <= 22) ? value / POWERS_OF_TEN[-exponent] : value * pow(10.0, exponent);
+		}
+		else if (exponent > 0)
+		{
+			value = (exponent <= 22) ? value * POWERS_OF_TEN[exponent] : value * pow(10.0, exponent);
+		}
+
+		out = (float)(negative ? -value : value);
+		return p;
+	}
+
+	// Parses a signed integer, returns p unchanged when there is no number to read.
+	inline const char* parseInt(const char* p, const char* end, long long& out)
+	{
+		const char* start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		if (p >= end || !isDigit(*p))
+		{
+			out = 0;
+			return start;
+		}
+
+		long long value = 0;
+		while (p < end && isDigit(*p))
+		{
+			value = value * 10 + (*p - '0');
+			++p;
+		}
+
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// OBJ indices are 1 based, negative indices count back from the last element read so far.
+	inline unsigned int resolveIndex(long long index, size_t readSoFar, size_t total)
+	{
+		long long resolved = (index > 0) ? index - 1 : (long long)readSoFar + index;
+		if (index == 0 || resolved < 0 || resolved >= (long long)total) return BAD_INDEX;
+		return (unsigned int)resolved;
+	}
+
+	// First pass, count how much of each stream this chunk holds.
+	void countChunk(Chunk& chunk)
+	{
+		chunk.positionCount = 0;
+		chunk.texCoordCount = 0;
+		chunk.normalCount = 0;
+
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			p = skipSpaces(p, chunk.end);
+			const char* lineEnd = findLineEnd(p, chunk.end);
+
+			switch (classifyLine(p, lineEnd))
+			{
+			case LineType::POSITION: ++chunk.positionCount; break;
+			case LineType::TEXCOORD: ++chunk.texCoordCount; break;
+			case LineType::NORMAL: ++chunk.normalCount; break;
+			default: break;
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+
+	// Second pass, parse the chunk straight into the merged streams.
+	// Faces are fan triangulated into the chunk's own corner list as the face count is not known up front.
+	void parseChunk(Chunk& chunk, ObjLoader::ObjData& out)
+	{
+		XMFLOAT3* positions = out.positions.data() + chunk.positionBase;
+		XMFLOAT2* texCoords = out.texCoords.data() + chunk.texCoordBase;
+		XMFLOAT3* normals = out.normals.data() + chunk.normalBase;
+		const size_t totalPositions = out.positions.size();
+		const size_t totalTexCoords = out.texCoords.size();
+		const size_t totalNormals = out.normals.size();
+
+		size_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+		std::vector<ObjLoader::Corner> face;
+		face.reserve(16);
+		chunk.valid = true;
+
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			p = skipSpaces(p, chunk.end);
+			const char* lineEnd = findLineEnd(p, chunk.end);
+
+			switch (classifyLine(p, lineEnd))
+			{
+			case LineType::POSITION:
+			{
+				XMFLOAT3& position = positions[positionCount++];
+				p = parseFloat(skipSpaces(p + 2, lineEnd), lineEnd, position.x);
+				p = parseFloat(skipSpaces(p, lineEnd), lineEnd, position.y);
+				p = parseFloat(skipSpaces(p, lineEnd), lineEnd, position.z);
+				break;
+			}
+			case LineType::TEXCOORD:
+			{
+				XMFLOAT2& texCoord = texCoords[texCoordCount++];
+				p = parseFloat(skipSpaces(p + 3, lineEnd), lineEnd, texCoord.x);
+				p = parseFloat(skipSpaces(p, lineEnd), lineEnd, texCoord.y);
+				break;
+			}
+			case LineType::NORMAL:
+			{
+				XMFLOAT3& normal = normals[normalCount++];
+				p = parseFloat(skipSpaces(p + 3, lineEnd), lineEnd, normal.x);
+				p = parseFloat(skipSpaces(p, lineEnd), lineEnd, normal.y);
+				p = parseFloat(skipSpaces(p, lineEnd), lineEnd, normal.z);
+				break;
+			}
+			case LineType::FACE:
+			{
+				face.clear();
+				p += 2;
+				while (true)
+				{
+					p = skipSpaces(p, lineEnd);
+					if (p >= lineEnd || *p == '\r' || *p == '#') break;
+
+					long long index;
+					const char* next = parseInt(p, lineEnd, index);
+					if (next == p)
+					{
+						// Not a face corner, give up on the rest of the line
+						chunk.valid = false;
+						break;
+					}
+					p = next;
+
+					ObjLoader::Corner corner;
+					corner.position = resolveIndex(index, chunk.positionBase + positionCount, totalPositions);
+					corner.texture = ObjLoader::NO_INDEX;
+					corner.normal = ObjLoader::NO_INDEX;
+
+					// v/vt, v//vn and v/vt/vn forms
+					if (p < lineEnd && *p == '/')
+					{
+						++p;
+						if (p < lineEnd && *p != '/')
+						{
+							p = parseInt(p, lineEnd, index);
+							corner.texture = resolveIndex(index, chunk.texCoordBase + texCoordCount, totalTexCoords);
+						}
+						if (p < lineEnd && *p == '/')
+						{
+							++p;
+							p = parseInt(p, lineEnd, index);
+							corner.normal = resolveIndex(index, chunk.normalBase + normalCount, totalNormals);
+						}
+					}
+
+					if (corner.position == BAD_INDEX || corner.texture == BAD_INDEX || corner.normal == BAD_INDEX)
+					{
+						chunk.valid = false;
+					}
+					face.push_back(corner);
+				}
+
+				// Fan triangulate, works for triangles, quads and convex n-gons
+				for (size_t i = 2; i < face.size(); ++i)
+				{
+					chunk.corners.push_back(face[0]);
+					chunk.corners.push_back(face[i - 1]);
+					chunk.corners.push_back(face[i]);
+				}
+				break;
+			}
+			default:
+				break;
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+
+	inline unsigned int hashCorner(const ObjLoader::Corner& corner)
+	{
+		// Multiplicative mix of the three indices, the table size is a power of two so the high bits need to spread
+		unsigned int hash = corner.position * 0x9E3779B1u;
+		hash ^= corner.texture * 0x85EBCA77u + (hash >> 15);
+		hash ^= corner.normal * 0xC2B2AE3Du + (hash >> 13);
+		return hash ^ (hash >> 16);
+	}
+
+	// Runs the function over every chunk, one thread per chunk. The calling thread takes the first chunk.
+	void runChunks(std::vector<Chunk>& chunks, const std::function<void(Chunk&)>& function)
+	{
+		std::vector<std::thread> workers;
+		workers.reserve(chunks.size());
+		for (size_t i = 1; i < chunks.size(); ++i)
+		{
+			workers.emplace_back(function, std::ref(chunks[i]));
+		}
+
+		function(chunks[0]);
+
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+	}
+}
+
+bool ObjLoader::load(const char* filename, ObjData& out, unsigned int threadCount)
+{
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		return false;
+	}
+
+	return parse(file.getData(), file.getSize(), out, threadCount);
+}
+
+bool ObjLoader::parse(const char* text, size_t length, ObjData& out, unsigned int threadCount)
+{
+	out.positions.clear();
+	out.texCoords.clear();
+	out.normals.clear();
+	out.corners.clear();
+
+	if (!text || length == 0)
+	{
+		return false;
+	}
+
+	// Pick the chunk count, small files are parsed on the calling thread only
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+		if (threadCount == 0) threadCount = 1;
+	}
+	size_t chunkCount = length / MIN_CHUNK_SIZE;
+	if (chunkCount > threadCount) chunkCount = threadCount;
+	if (chunkCount < 1) chunkCount = 1;
+
+	// Split into roughly equal chunks, moving every split forward to the start of the next line
+	const char* end = text + length;
+	std::vector<Chunk> chunks(chunkCount);
+	const char* chunkBegin = text;
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		const char* chunkEnd = end;
+		if (i + 1 < chunkCount)
+		{
+			chunkEnd = text + (length / chunkCount) * (i + 1);
+			if (chunkEnd < chunkBegin) chunkEnd = chunkBegin;
+			chunkEnd = findLineEnd(chunkEnd, end);
+			if (chunkEnd < end) ++chunkEnd;
+		}
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	// Pass 1, count the streams in every chunk
+	runChunks(chunks, countChunk);
+
+	// Prefix sum the counts so every chunk knows where its data goes
+	size_t positionTotal = 0, texCoordTotal = 0, normalTotal = 0;
+	for (Chunk& chunk : chunks)
+	{
+		chunk.positionBase = positionTotal;
+		chunk.texCoordBase = texCoordTotal;
+		chunk.normalBase = normalTotal;
+		positionTotal += chunk.positionCount;
+		texCoordTotal += chunk.texCoordCount;
+		normalTotal += chunk.normalCount;
+
+		// Roughly one face line per vertex in typical exports, avoids most reallocation
+		chunk.corners.reserve(chunk.positionCount * 6);
+	}
+	out.positions.resize(positionTotal);
+	out.texCoords.resize(texCoordTotal);
+	out.normals.resize(normalTotal);
+
+	// Pass 2, parse everything in place
+	runChunks(chunks, [&out](Chunk& chunk) { parseChunk(chunk, out); });
+
+	// Merge the face streams in file order
+	size_t cornerTotal = 0;
+	for (const Chunk& chunk : chunks)
+	{
+		if (!chunk.valid)
+		{
+			out.corners.clear();
+			return false;
+		}
+		cornerTotal += chunk.corners.size();
+	}
+
+	out.corners.resize(cornerTotal);
+	size_t cornerOffset = 0;
+	for (const Chunk& chunk : chunks)
+	{
+		if (!chunk.corners.empty())
+		{
+			memcpy(out.corners.data() + cornerOffset, chunk.corners.data(), chunk.corners.size() * sizeof(Corner));
+			cornerOffset += chunk.corners.size();
+		}
+	}
+
+	return true;
+}
+
+void ObjLoader::weld(const std::vector<Corner>& corners, std::vector<Corner>& vertices, std::vector<unsigned int>& indices)
+{
+	vertices.clear();
+	indices.resize(corners.size());
+
+	// There can never be more unique vertices than corners, so a table of at least twice the corner count
+	// stays under half full and never needs to grow
+	size_t tableSize = 64;
+	while (tableSize < corners.size() * 2) tableSize *= 2;
+	const size_t mask = tableSize - 1;
+	std::vector<unsigned int> table(tableSize, NO_INDEX);
+	vertices.reserve(corners.size() / 2);
+
+	for (size_t i = 0; i < corners.size(); ++i)
+	{
+		const Corner& corner = corners[i];
+		if (corner.normal == NO_INDEX)
+		{
+			indices[i] = (unsigned int)vertices.size();
+			vertices.push_back(corner);
+			continue;
+		}
+
+		// Linear probe until the corner or an empty slot is found
+		size_t slot = hashCorner(corner) & mask;
+		while (true)
+		{
+			unsigned int vertex = table[slot];
+			if (vertex == NO_INDEX)
+			{
+				table[slot] = (unsigned int)vertices.size();
+				indices[i] = (unsigned int)vertices.size();
+				vertices.push_back(corner);
+				break;
+			}
+
+			const Corner& existing = vertices[vertex];
+			if (existing.position == corner.position && existing.texture == corner.texture && existing.normal == corner.normal)
+			{
+				indices[i] = vertex;
+				break;
+			}
+
+			slot = (slot + 1) & mask;
+		}
+	}
+}
@@ -0,0 +1,67 @@
+/**
+* \class ObjLoader
+*
+* \brief Fast multithreaded OBJ parser
+*
+* Memory maps the file and parses it in place with a hand written number tokenizer.
+* The file is split into line aligned chunks which are parsed in parallel, one chunk per core.
+* A first pass counts the v/vt/vn lines of every chunk so each chunk knows where its data starts,
+* which lets the second pass write straight into the final arrays and resolve negative (relative) indices.
+* Faces of any size are fan triangulated, and v, v/vt, v//vn and v/vt/vn corners are all supported.
+*/
+
+
+#ifndef _OBJLOADER_H_
+#define _OBJLOADER_H_
+
+#include <directxmath.h>
+#include <vector>
+
+using namespace DirectX;
+
+class ObjLoader
+{
+public:
+	/// Marks a missing texture coordinate or normal index in a corner
+	static const unsigned int NO_INDEX = 0xffffffff;
+
+	/// One triangle corner, zero based indices into the position, texture coordinate and normal streams
+	struct Corner
+	{
+		unsigned int position;
+		unsigned int texture;
+		unsigned int normal;
+	};
+
+	/// Parsed OBJ streams, corners are stored as a triangle list (3 per triangle)
+	struct ObjData
+	{
+		std::vector<XMFLOAT3> positions;
+		std::vector<XMFLOAT2> texCoords;
+		std::vector<XMFLOAT3> normals;
+		std::vector<Corner> corners;
+	};
+
+	/** \brief Loads an OBJ file
+	* @param filename is the path to the OBJ file
+	* @param out receives the parsed streams
+	* @param threadCount is the number of worker threads, 0 uses every core
+	* Returns false if the file could not be opened or references out of range indices.
+	*/
+	static bool load(const char* filename, ObjData& out, unsigned int threadCount = 0);
+
+	/// Parses OBJ text already in memory, see load()
+	static bool parse(const char* text, size_t length, ObjData& out, unsigned int threadCount = 0);
+
+	/** \brief Welds identical corners into an indexed mesh
+	* Corners with the same position, texture coordinate and normal indices share one vertex.
+	* Uses an open addressing hash table sized for the corner count up front, so it never rehashes.
+	* Corners without a normal are never welded, as their normal depends on the face they belong to.
+	* @param corners is the triangle list to weld
+	* @param vertices receives the corner of every unique vertex
+	* @param indices receives, for every input corner, the index of its vertex
+	*/
+	static void weld(const std::vector<Corner>& corners, std::vector<Corner>& vertices, std::vector<unsigned int>& indices);
+};
+
+#endif
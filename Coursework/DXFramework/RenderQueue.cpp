@@ -0,0 +1,238 @@
+// Render queue
+// Sorts a frame's draw packets by their 64 bit keys and runs them in order, see RenderQueue.h
+#include "RenderQueue.h"
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+	const unsigned int PASS_SHIFT = 56;
+	const unsigned long long TRANSLUCENT_BIT = 1ull << 55;
+	const unsigned int DEPTH_BITS = 23;
+	const unsigned long long DEPTH_MASK = (1ull << DEPTH_BITS) - 1;
+
+	// Opaque layout, state then depth
+	const unsigned int OPAQUE_SHADER_SHIFT = 47;
+	const unsigned int OPAQUE_MATERIAL_SHIFT = 35;
+	const unsigned int OPAQUE_MESH_SHIFT = 23;
+
+	// Translucent layout, depth then state
+	const unsigned int TRANSLUCENT_DEPTH_SHIFT = 32;
+	const unsigned int TRANSLUCENT_SHADER_SHIFT = 24;
+	const unsigned int TRANSLUCENT_MATERIAL_SHIFT = 12;
+	const unsigned int TRANSLUCENT_MESH_SHIFT = 0;
+
+	const size_t INSERTION_SORT_LIMIT = 64;
+
+	unsigned long long quantiseDepth(float depth)
+	{
+		if (!(depth > 0.0f)) return 0;
+		if (depth >= 1.0f) return DEPTH_MASK;
+		return (unsigned long long)(depth * (float)DEPTH_MASK);
+	}
+}
+
+unsigned long long RenderQueue::makeKey(unsigned int pass, bool translucent, unsigned int shader, unsigned int material, unsigned int mesh, float depth)
+{
+	unsigned long long key = (unsigned long long)(pass % MAX_PASSES) << PASS_SHIFT;
+	unsigned long long depthBits = quantiseDepth(depth);
+	if (translucent)
+	{
+		// Far draws first
+		key |= TRANSLUCENT_BIT;
+		key |= (DEPTH_MASK - depthBits) << TRANSLUCENT_DEPTH_SHIFT;
+		key |= (unsigned long long)(shader % MAX_SHADERS) << TRANSLUCENT_SHADER_SHIFT;
+		key |= (unsigned long long)(material % MAX_MATERIALS) << TRANSLUCENT_MATERIAL_SHIFT;
+		key |= (unsigned long long)(mesh % MAX_MESHES) << TRANSLUCENT_MESH_SHIFT;
+	}
+	else
+	{
+		// Near draws first within the same state
+		key |= (unsigned long long)(shader % MAX_SHADERS) << OPAQUE_SHADER_SHIFT;
+		key |= (unsigned long long)(material % MAX_MATERIALS) << OPAQUE_MATERIAL_SHIFT;
+		key |= (unsigned long long)(mesh % MAX_MESHES) << OPAQUE_MESH_SHIFT;
+		key |= depthBits;
+	}
+	return key;
+}
+
+void RenderQueue::decodeKey(unsigned long long key, unsigned int& pass, bool& translucent, unsigned int& shader, unsigned int& material, unsigned int& mesh)
+{
+	pass = (unsigned int)(key >> PASS_SHIFT);
+	translucent = (key & TRANSLUCENT_BIT) != 0;
+	if (translucent)
+	{
+		shader = (unsigned int)(key >> TRANSLUCENT_SHADER_SHIFT) % MAX_SHADERS;
+		material = (unsigned int)(key >> TRANSLUCENT_MATERIAL_SHIFT) % MAX_MATERIALS;
+		mesh = (unsigned int)(key >> TRANSLUCENT_MESH_SHIFT) % MAX_MESHES;
+	}
+	else
+	{
+		shader = (unsigned int)(key >> OPAQUE_SHADER_SHIFT) % MAX_SHADERS;
+		material = (unsigned int)(key >> OPAQUE_MATERIAL_SHIFT) % MAX_MATERIALS;
+		mesh = (unsigned int)(key >> OPAQUE_MESH_SHIFT) % MAX_MESHES;
+	}
+}
+
+void RenderQueue::radixSort(std::vector<unsigned long long>& keys, std::vector<unsigned int>& order)
+{
+	size_t count = keys.size();
+	order.resize(count);
+	for (size_t i = 0; i < count; i++) order[i] = (unsigned int)i;
+	if (count < 2) return;
+
+	// Short queues sort faster by insertion than by clearing and summing the histograms
+	if (count <= INSERTION_SORT_LIMIT)
+	{
+		for (size_t i = 1; i < count; i++)
+		{
+			unsigned long long key = keys[i];
+			size_t j = i;
+			for (; j > 0 && keys[j - 1] > key; j--)
+			{
+				keys[j] = keys[j - 1];
+				order[j] = order[j - 1];
+			}
+			keys[j] = key;
+			order[j] = (unsigned int)i;
+		}
+		return;
+	}
+
+	// Every byte's histogram in one read of the keys
+	static const int DIGITS = 8;
+	unsigned int histograms[DIGITS][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned long long key = keys[i];
+		for (int digit = 0; digit < DIGITS; digit++)
+		{
+			histograms[digit][(key >> (digit * 8)) & 0xFF]++;
+		}
+	}
+
+	std::vector<unsigned long long> keysOut(count);
+	std::vector<unsigned int> orderOut(count);
+	for (int digit = 0; digit < DIGITS; digit++)
+	{
+		// Every key has the same byte here, this pass would not move anything
+		unsigned int* histogram = histograms[digit];
+		if (histogram[(keys[0] >> (digit * 8)) & 0xFF] == count) continue;
+
+		size_t offsets[256];
+		size_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			offsets[bucket] = offset;
+			offset += histogram[bucket];
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t destination = offsets[(keys[i] >> (digit * 8)) & 0xFF]++;
+			keysOut[destination] = keys[i];
+			orderOut[destination] = order[i];
+		}
+		keys.swap(keysOut);
+		order.swap(orderOut);
+	}
+}
+
+void RenderQueue::countStateChanges(const unsigned long long* keys, const unsigned int* order, size_t count, unsigned int& shaderChanges, unsigned int& materialChanges, unsigned int& meshChanges)
+{
+	shaderChanges = materialChanges = meshChanges = 0;
+	unsigned int lastShader = 0, lastMaterial = 0, lastMesh = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned int pass, shader, material, mesh;
+		bool translucent;
+		decodeKey(keys[order ? order[i] : i], pass, translucent, shader, material, mesh);
+
+		// A new shader rebinds its material and mesh too
+		bool shaderChanged = i == 0 || shader != lastShader;
+		bool materialChanged = shaderChanged || material != lastMaterial;
+		bool meshChanged = shaderChanged || mesh != lastMesh;
+		shaderChanges += shaderChanged ? 1 : 0;
+		materialChanges += materialChanged ? 1 : 0;
+		meshChanges += meshChanged ? 1 : 0;
+
+		lastShader = shader;
+		lastMaterial = material;
+		lastMesh = mesh;
+	}
+}
+
+RenderQueue::RenderQueue()
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void RenderQueue::setPassSetup(unsigned int pass, DrawFunction setup)
+{
+	if (passSetups.size() < MAX_PASSES) passSetups.resize(MAX_PASSES);
+	passSetups[pass % MAX_PASSES] = setup;
+}
+
+void RenderQueue::submit(unsigned long long key, DrawFunction draw)
+{
+	keys.push_back(key);
+	draws.push_back(draw);
+}
+
+void RenderQueue::execute()
+{
+	memset(&stats, 0, sizeof(stats));
+	stats.packets = (unsigned int)keys.size();
+	countStateChanges(keys.data(), nullptr, keys.size(), stats.unsortedShaderChanges, stats.unsortedMaterialChanges, stats.unsortedMeshChanges);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	sortedKeys = keys;
+	radixSort(sortedKeys, order);
+	auto end = std::chrono::high_resolution_clock::now();
+	stats.sortMs = std::chrono::duration<double, std::milli>(end - start).count();
+	countStateChanges(keys.data(), order.data(), keys.size(), stats.shaderChanges, stats.materialChanges, stats.meshChanges);
+
+	// Passes with a setup run even with nothing submitted, so their targets are still bound and cleared
+	unsigned int nextPass = 0;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		unsigned int pass = (unsigned int)(sortedKeys[i] >> PASS_SHIFT);
+		if (pass >= nextPass)
+		{
+			runPassSetups(nextPass, pass + 1);
+			nextPass = pass + 1;
+		}
+		draws[order[i]]();
+	}
+	runPassSetups(nextPass, MAX_PASSES);
+}
+
+void RenderQueue::runPassSetups(unsigned int first, unsigned int end)
+{
+	for (unsigned int pass = first; pass < end && pass < passSetups.size(); pass++)
+	{
+		if (passSetups[pass])
+		{
+			stats.passes++;
+			passSetups[pass]();
+		}
+	}
+}
+
+void RenderQueue::clear()
+{
+	keys.clear();
+	draws.clear();
+	for (DrawFunction& setup : passSetups) setup = nullptr;
+}
+
+size_t RenderQueue::getPacketCount() const
+{
+	return keys.size();
+}
+
+const RenderQueue::Stats& RenderQueue::getStats() const
+{
+	return stats;
+}
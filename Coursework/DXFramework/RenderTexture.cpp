@@ -140,7 +140,7 @@ RenderTexture::~RenderTexture()
 // All rendering is now store here, rather than the back buffer.
 void RenderTexture::setRenderTarget(ID3D11DeviceContext* deviceContext)
 {
-	deviceContext->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
+	D3D11StateCache::get(deviceContext)->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
 	deviceContext->RSSetViewports(1, &viewport);
 }
 
@@ -15,6 +15,7 @@
 
 #include <d3d11.h>
 #include <directxmath.h>
+#include "D3D11StateCache.h"
 
 using namespace DirectX;
 
@@ -0,0 +1,102 @@
+// Ring allocator
+// Aligned allocations from a ring, freed a frame at a time as the frames' fences complete, see RingAllocator.h
+#include "RingAllocator.h"
+
+RingAllocator::RingAllocator(size_t lcapacity, size_t lalignment)
+{
+	alignment = (lalignment > 0) ? lalignment : 1;
+	capacity = lcapacity - lcapacity % alignment;
+	head = tail = 0;
+	allocated = freed = 0;
+}
+
+size_t RingAllocator::align(size_t size) const
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+size_t RingAllocator::allocate(size_t size)
+{
+	size_t alignedSize = align(size);
+	if (alignedSize == 0 || alignedSize > capacity) return INVALID_OFFSET;
+
+	size_t used = getUsed();
+	if (used == 0)
+	{
+		// Nothing in flight, start at the front so the whole ring is one free run
+		head = tail = 0;
+	}
+	else if (used == capacity)
+	{
+		return INVALID_OFFSET;
+	}
+
+	size_t offset;
+	if (head >= tail)
+	{
+		// Free space is from the head to the end, then from the front to the tail
+		if (capacity - head >= alignedSize)
+		{
+			offset = head;
+		}
+		else if (tail >= alignedSize)
+		{
+			// Skip the end of the ring, it is freed along with this allocation's frame
+			allocated += capacity - head;
+			offset = 0;
+		}
+		else
+		{
+			return INVALID_OFFSET;
+		}
+	}
+	else
+	{
+		// Wrapped, free space is from the head to the tail
+		if (tail - head < alignedSize) return INVALID_OFFSET;
+		offset = head;
+	}
+
+	head = offset + alignedSize;
+	if (head == capacity) head = 0;
+	allocated += alignedSize;
+	return offset;
+}
+
+void RingAllocator::endFrame(unsigned long long fence)
+{
+	// A frame that allocated nothing has nothing to free
+	size_t marked = frames.empty() ? freed : frames.back().allocated;
+	if (marked == allocated) return;
+	frames.push_back(FrameMark{ fence, head, allocated });
+}
+
+void RingAllocator::retire(unsigned long long completedFence)
+{
+	while (!frames.empty() && frames.front().fence <= completedFence)
+	{
+		tail = frames.front().head;
+		freed = frames.front().allocated;
+		frames.pop_front();
+	}
+}
+
+size_t RingAllocator::getCapacity() const
+{
+	return capacity;
+}
+
+size_t RingAllocator::getAlignment() const
+{
+	return alignment;
+}
+
+size_t RingAllocator::getUsed() const
+{
+	return allocated - freed;
+}
+
+size_t RingAllocator::getFramesInFlight() const
+{
+	return frames.size();
+}
@@ -0,0 +1,59 @@
+/**
+* \class RingAllocator
+*
+* \brief Hands out aligned ranges of a fixed size ring, freeing them a frame at a time once the GPU is done with the frame
+*
+* Allocations are carved from the head of the ring. endFrame tags everything allocated since the last one with a fence,
+* and retire frees every frame whose fence the GPU has passed, moving the tail up behind them. An allocation is never split,
+* one that does not fit before the end of the ring starts again at the front, the skipped bytes are freed with its frame.
+* When the GPU is too far behind for an allocation to fit it fails, rather than waiting, so the caller can fall back.
+* Offsets and sizes are all in bytes, the ring has no memory of its own and needs no Windows, D3D11ConstantRing puts it
+* over a constant buffer.
+*/
+
+
+#ifndef _RINGALLOCATOR_H_
+#define _RINGALLOCATOR_H_
+
+#include <cstddef>
+#include <deque>
+
+class RingAllocator
+{
+public:
+	static const size_t INVALID_OFFSET = ~(size_t)0;
+
+	/** @param capacity is rounded down to a multiple of alignment
+	* @param alignment of every offset and size, a power of two
+	*/
+	RingAllocator(size_t capacity, size_t alignment);
+
+	size_t allocate(size_t size);	///< Returns the offset of size bytes rounded up to the alignment, or INVALID_OFFSET if they do not fit
+	void endFrame(unsigned long long fence);	///< The allocations since the last endFrame are in use until fence completes
+	void retire(unsigned long long completedFence);	///< Frees the frames whose fence is at or before completedFence
+
+	size_t getCapacity() const;
+	size_t getAlignment() const;
+	size_t getUsed() const;		///< Bytes in use, including ones skipped at the end of the ring
+	size_t getFramesInFlight() const;
+	size_t align(size_t size) const;	///< Rounds size up to the alignment
+
+private:
+	/// Where the head was when a frame ended, and the bytes allocated by then
+	struct FrameMark
+	{
+		unsigned long long fence;
+		size_t head;
+		size_t allocated;
+	};
+
+	size_t capacity;
+	size_t alignment;
+	size_t head;		///< Next free byte
+	size_t tail;		///< First byte in use, equal to head when the ring is empty or full
+	size_t allocated;	///< Total bytes ever allocated, skipped ones included
+	size_t freed;		///< Total bytes ever freed
+	std::deque<FrameMark> frames;
+};
+
+#endif
@@ -0,0 +1,188 @@
+// Shadow atlas allocator
+// Quadtree packing of square shadow views into one atlas, see ShadowAtlasAllocator.h
+#include "ShadowAtlasAllocator.h"
+
+ShadowAtlasAllocator::ShadowAtlasAllocator(int atlasSize, int minSize) : atlasSize(atlasSize), minSize(minSize)
+{
+	// A level for every size from the whole atlas down to the smallest view
+	levelCount = 1;
+	for (int size = atlasSize; size > minSize; size /= 2) levelCount++;
+	size_t nodeCount = 0;
+	for (int level = 0, width = 1; level < levelCount; level++, width *= 4) nodeCount += width;
+	nodes.assign(nodeCount, NODE_FREE);
+}
+
+int ShadowAtlasAllocator::chooseSize(float idealSize, int currentSize, int minSize, int maxSize)
+{
+	int size = minSize;
+	while (size < maxSize && (float)size < idealSize) size *= 2;
+
+	// Grow as soon as it is short, shrink once a smaller size would still be a quarter over what it needs
+	if (currentSize <= 0 || size > currentSize) return size;
+	if (size < currentSize && idealSize < currentSize * 0.375f) return size;
+	return currentSize;
+}
+
+void ShadowAtlasAllocator::beginFrame()
+{
+	for (auto& allocation : allocations) allocation.second.requested = false;
+	stats = {};
+}
+
+ShadowAtlasAllocator::Region ShadowAtlasAllocator::request(unsigned int key, int size)
+{
+	if (size > atlasSize) size = atlasSize;
+	if (size < minSize) size = minSize;
+
+	auto existing = allocations.find(key);
+	if (existing != allocations.end())
+	{
+		Allocation& allocation = existing->second;
+		allocation.requested = true;
+		if (allocation.region.size == size)
+		{
+			stats.kept++;
+			return allocation.region;
+		}
+
+		// Shrinking always fits in the node it leaves, growing keeps the old node if no larger one is free
+		if (size < allocation.region.size)
+		{
+			release(allocation.node);
+			usedArea -= allocation.region.size * allocation.region.size;
+		}
+		else
+		{
+			int node;
+			Region region;
+			if (!allocate(size, node, region))
+			{
+				stats.kept++;
+				return allocation.region;
+			}
+			release(allocation.node);
+			usedArea += size * size - allocation.region.size * allocation.region.size;
+			allocation.node = node;
+			allocation.region = region;
+			stats.placed++;
+			return region;
+		}
+	}
+
+	// Halve the size until it fits
+	for (int tried = size; tried >= minSize; tried /= 2)
+	{
+		int node;
+		Region region;
+		if (allocate(tried, node, region))
+		{
+			allocations[key] = Allocation{ node, region, true };
+			usedArea += tried * tried;
+			if (tried < size) stats.shrunk++;
+			else stats.placed++;
+			return region;
+		}
+	}
+
+	allocations.erase(key);
+	stats.failed++;
+	return Region{ 0, 0, 0 };
+}
+
+void ShadowAtlasAllocator::endFrame()
+{
+	for (auto allocation = allocations.begin(); allocation != allocations.end();)
+	{
+		if (allocation->second.requested)
+		{
+			++allocation;
+			continue;
+		}
+		release(allocation->second.node);
+		usedArea -= allocation->second.region.size * allocation->second.region.size;
+		allocation = allocations.erase(allocation);
+	}
+}
+
+ShadowAtlasAllocator::Region ShadowAtlasAllocator::getRegion(unsigned int key) const
+{
+	auto allocation = allocations.find(key);
+	return (allocation != allocations.end()) ? allocation->second.region : Region{ 0, 0, 0 };
+}
+
+int ShadowAtlasAllocator::getAtlasSize() const
+{
+	return atlasSize;
+}
+
+int ShadowAtlasAllocator::getUsedArea() const
+{
+	return usedArea;
+}
+
+ShadowAtlasAllocator::Stats ShadowAtlasAllocator::getStats() const
+{
+	return stats;
+}
+
+bool ShadowAtlasAllocator::allocate(int size, int& node, Region& region)
+{
+	node = findNode(0, 0, levelOf(size), 0, 0, region);
+	if (node < 0) return false;
+
+	// Its ancestors now hold a view somewhere below them
+	nodes[node] = NODE_USED;
+	for (int parent = node; parent > 0;)
+	{
+		parent = (parent - 1) / 4;
+		nodes[parent] = NODE_SPLIT;
+	}
+	return true;
+}
+
+int ShadowAtlasAllocator::findNode(int node, int level, int targetLevel, int x, int y, Region& region) const
+{
+	if (nodes[node] == NODE_USED) return -1;
+	if (level == targetLevel)
+	{
+		if (nodes[node] != NODE_FREE) return -1;
+		region = Region{ x, y, atlasSize >> level };
+		return node;
+	}
+
+	// Split quarters first, so views pack together and whole quarters stay free for large views
+	int half = atlasSize >> (level + 1);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int child = 0; child < 4; child++)
+		{
+			int childNode = node * 4 + 1 + child;
+			if ((nodes[childNode] == NODE_SPLIT) != (pass == 0)) continue;
+			int found = findNode(childNode, level + 1, targetLevel, x + (child & 1) * half, y + (child >> 1) * half, region);
+			if (found >= 0) return found;
+		}
+	}
+	return -1;
+}
+
+void ShadowAtlasAllocator::release(int node)
+{
+	nodes[node] = NODE_FREE;
+	while (node > 0)
+	{
+		int parent = (node - 1) / 4;
+		for (int child = 0; child < 4; child++)
+		{
+			if (nodes[parent * 4 + 1 + child] != NODE_FREE) return;
+		}
+		nodes[parent] = NODE_FREE;
+		node = parent;
+	}
+}
+
+int ShadowAtlasAllocator::levelOf(int size) const
+{
+	int level = 0;
+	while (level < levelCount - 1 && (atlasSize >> level) > size) level++;
+	return level;
+}
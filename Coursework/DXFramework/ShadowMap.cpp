@@ -44,23 +44,53 @@ ShadowMap::ShadowMap(ID3D11Device* device, int mWidth, int mHeight)
 	viewport.TopLeftY = 0.0f;
 
 	//NULL render target
-	renderTargets[1] = { 0 };
+	renderTargets[0] = { 0 };
 }
 
 ShadowMap::~ShadowMap()
 {
 	delete mDepthMapDSV;
 	delete mDepthMapSRV;
+	if (staticCache) staticCache->Release();
 }
 
-void ShadowMap::BindDsvAndSetNullRenderTarget(ID3D11DeviceContext* dc)
+void ShadowMap::BindDsvAndSetNullRenderTarget(ID3D11DeviceContext* dc, bool clear)
 {
 	dc->RSSetViewports(1, &viewport);
 
 	// Set null render target because we are only going to draw to depth buffer.
 	// Setting a null render target will disable color writes.
 	//ID3D11RenderTargetView* renderTargets[1] = { 0 };
-	dc->OMSetRenderTargets(1, renderTargets, mDepthMapDSV);
+	D3D11StateCache::get(dc)->OMSetRenderTargets(1, renderTargets, mDepthMapDSV);
 
-	dc->ClearDepthStencilView(mDepthMapDSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	if (clear) dc->ClearDepthStencilView(mDepthMapDSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
+}
+
+void ShadowMap::SaveStaticCache(ID3D11DeviceContext* dc, int slice)
+{
+	if (!staticCache)
+	{
+		// Same size and format, only ever copied to and from, so bound to nothing
+		D3D11_TEXTURE2D_DESC cacheDesc;
+		depthMap->GetDesc(&cacheDesc);
+		cacheDesc.BindFlags = 0;
+		cacheDesc.MiscFlags = 0;
+		ID3D11Device* device;
+		dc->GetDevice(&device);
+		HRESULT result = device->CreateTexture2D(&cacheDesc, 0, &staticCache);
+		device->Release();
+		if (FAILED(result))
+		{
+			staticCache = nullptr;
+			return;
+		}
+	}
+
+	// Depth stencil resources can only be copied a whole subresource at a time
+	dc->CopySubresourceRegion(staticCache, slice, 0, 0, 0, depthMap, slice, NULL);
+}
+
+void ShadowMap::RestoreStaticCache(ID3D11DeviceContext* dc, int slice)
+{
+	if (staticCache) dc->CopySubresourceRegion(depthMap, slice, 0, 0, 0, staticCache, slice, NULL);
 }
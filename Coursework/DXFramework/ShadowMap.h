@@ -10,8 +10,13 @@ public:
 	
 	~ShadowMap();
 
-	void BindDsvAndSetNullRenderTarget(ID3D11DeviceContext* dc);
+	void BindDsvAndSetNullRenderTarget(ID3D11DeviceContext* dc, bool clear = true);
 	ID3D11ShaderResourceView* getDepthMapSRV() { return mDepthMapSRV; };
+
+	// Static caster cache, a copy of the depth the static casters leave, so only moving casters need drawing over it each frame
+	// The copy is made on the first save, slice is the cube face for cube maps
+	void SaveStaticCache(ID3D11DeviceContext* dc, int slice = 0);
+	void RestoreStaticCache(ID3D11DeviceContext* dc, int slice = 0);
 protected:
 	// Added by Cormac - 2200592, for Shadow Cube Map class
 	ShadowMap() {};
@@ -20,4 +25,5 @@ protected:
 	D3D11_VIEWPORT viewport;
 	ID3D11RenderTargetView* renderTargets[1];
 	ID3D11Texture2D* depthMap;
+	ID3D11Texture2D* staticCache = nullptr;
 };
\ No newline at end of file
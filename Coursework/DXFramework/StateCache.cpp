@@ -0,0 +1,384 @@
+// State cache
+// Drops redundant state changes and batches slot bindings before they reach the device context, see StateCache.h
+#include "StateCache.h"
+#include <cstring>
+
+namespace
+{
+	// Stands for state the cache cannot know, it never equals anything asked for
+	const char unknownObject = 0;
+	const StateCache::Handle UNKNOWN = &unknownObject;
+	const unsigned int UNKNOWN_VALUE = 0xFFFFFFFF;
+
+	const unsigned int SLOT_COUNTS[] = { StateCache::RESOURCE_SLOTS, StateCache::CONSTANT_BUFFER_SLOTS, StateCache::SAMPLER_SLOTS };
+
+	unsigned int addCounters(const StateCache::Stats& stats, unsigned int StateCache::Counter::* field)
+	{
+		return stats.shaderResources.*field + stats.constantBuffers.*field + stats.samplers.*field + stats.shaders.*field
+			+ stats.inputAssembler.*field + stats.states.*field + stats.renderTargets.*field;
+	}
+}
+
+unsigned int StateCache::Stats::getCalls() const
+{
+	return addCounters(*this, &Counter::calls);
+}
+
+unsigned int StateCache::Stats::getIssued() const
+{
+	return addCounters(*this, &Counter::issued);
+}
+
+unsigned int StateCache::Stats::getSuppressed() const
+{
+	unsigned int calls = getCalls();
+	unsigned int issued = getIssued();
+	return (calls > issued) ? calls - issued : 0;
+}
+
+StateCache::StateCache(Context* lcontext)
+{
+	context = lcontext;
+	for (int kind = 0; kind < SLOT_KIND_COUNT; kind++)
+	{
+		for (unsigned int stage = 0; stage < STAGE_COUNT; stage++)
+		{
+			slots[kind][stage].bound.resize(SLOT_COUNTS[kind]);
+			slots[kind][stage].pending.resize(SLOT_COUNTS[kind]);
+			if (kind == CONSTANT_BUFFERS)
+			{
+				slots[kind][stage].boundFirst.resize(SLOT_COUNTS[kind]);
+				slots[kind][stage].boundCount.resize(SLOT_COUNTS[kind]);
+				slots[kind][stage].pendingFirst.resize(SLOT_COUNTS[kind]);
+				slots[kind][stage].pendingCount.resize(SLOT_COUNTS[kind]);
+			}
+		}
+	}
+	invalidate();
+	memset(&stats, 0, sizeof(stats));
+	memset(&lastFrameStats, 0, sizeof(lastFrameStats));
+}
+
+void StateCache::invalidate()
+{
+	for (int kind = 0; kind < SLOT_KIND_COUNT; kind++)
+	{
+		for (SlotTable& table : slots[kind])
+		{
+			for (unsigned int slot = 0; slot < table.bound.size(); slot++)
+			{
+				table.bound[slot] = table.pending[slot] = UNKNOWN;
+			}
+			table.dirtyFirst = table.dirtyEnd = 0;
+		}
+	}
+
+	for (Handle& shader : shaders) shader = UNKNOWN;
+	inputLayout = UNKNOWN;
+	topology = UNKNOWN_VALUE;
+	for (unsigned int slot = 0; slot < VERTEX_BUFFER_SLOTS; slot++)
+	{
+		vertexBuffers[slot] = UNKNOWN;
+		vertexStrides[slot] = vertexOffsets[slot] = UNKNOWN_VALUE;
+	}
+	indexBuffer = UNKNOWN;
+	indexFormat = indexOffset = UNKNOWN_VALUE;
+	blendState = UNKNOWN;
+	sampleMask = UNKNOWN_VALUE;
+	depthStencilState = UNKNOWN;
+	stencilRef = UNKNOWN_VALUE;
+	rasterizerState = UNKNOWN;
+}
+
+StateCache::Counter& StateCache::getCounter(SlotKind kind)
+{
+	switch (kind)
+	{
+	case CONSTANT_BUFFERS: return stats.constantBuffers;
+	case SAMPLERS: return stats.samplers;
+	default: return stats.shaderResources;
+	}
+}
+
+void StateCache::setSlots(SlotKind kind, Stage stage, unsigned int start, unsigned int count, const Handle* values, const unsigned int* firsts, const unsigned int* counts)
+{
+	getCounter(kind).calls++;
+	SlotTable& table = slots[kind][(int)stage];
+	if (start >= table.pending.size()) return;
+	if (count > table.pending.size() - start) count = (unsigned int)table.pending.size() - start;
+
+	bool ranged = !table.pendingFirst.empty();
+	bool changed = false;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int slot = start + i;
+		table.pending[slot] = values ? values[i] : nullptr;
+		if (ranged)
+		{
+			// Ranges only mean anything for a buffer
+			bool hasRange = firsts && table.pending[slot] && counts[i] > 0;
+			table.pendingFirst[slot] = hasRange ? firsts[i] : 0;
+			table.pendingCount[slot] = hasRange ? counts[i] : 0;
+		}
+		changed = changed || !isPendingBound(table, slot);
+	}
+	if (!changed) return;
+
+	if (table.dirtyFirst >= table.dirtyEnd)
+	{
+		table.dirtyFirst = start;
+		table.dirtyEnd = start + count;
+	}
+	else
+	{
+		if (start < table.dirtyFirst) table.dirtyFirst = start;
+		if (start + count > table.dirtyEnd) table.dirtyEnd = start + count;
+	}
+}
+
+void StateCache::setShaderResources(Stage stage, unsigned int start, unsigned int count, const Handle* views)
+{
+	setSlots(RESOURCES, stage, start, count, views);
+}
+
+void StateCache::setConstantBuffers(Stage stage, unsigned int start, unsigned int count, const Handle* buffers)
+{
+	setSlots(CONSTANT_BUFFERS, stage, start, count, buffers);
+}
+
+void StateCache::setConstantBufferRanges(Stage stage, unsigned int start, unsigned int count, const Handle* buffers, const unsigned int* firstConstants, const unsigned int* constantCounts)
+{
+	setSlots(CONSTANT_BUFFERS, stage, start, count, buffers, firstConstants, constantCounts);
+}
+
+void StateCache::setSamplers(Stage stage, unsigned int start, unsigned int count, const Handle* samplers)
+{
+	setSlots(SAMPLERS, stage, start, count, samplers);
+}
+
+void StateCache::issueSlots(SlotKind kind, Stage stage, unsigned int start, unsigned int count)
+{
+	SlotTable& table = slots[kind][(int)stage];
+	const Handle* values = &table.pending[start];
+	switch (kind)
+	{
+	case RESOURCES: context->setShaderResources(stage, start, count, values); break;
+	case CONSTANT_BUFFERS:
+		if (table.pendingCount[start] > 0) context->setConstantBufferRanges(stage, start, count, values, &table.pendingFirst[start], &table.pendingCount[start]);
+		else context->setConstantBuffers(stage, start, count, values);
+		memcpy(&table.boundFirst[start], &table.pendingFirst[start], count * sizeof(unsigned int));
+		memcpy(&table.boundCount[start], &table.pendingCount[start], count * sizeof(unsigned int));
+		break;
+	case SAMPLERS: context->setSamplers(stage, start, count, values); break;
+	default: break;
+	}
+	getCounter(kind).issued++;
+	memcpy(&table.bound[start], values, count * sizeof(Handle));
+}
+
+bool StateCache::isPendingBound(const SlotTable& table, unsigned int slot) const
+{
+	if (table.pending[slot] != table.bound[slot]) return false;
+	if (table.pendingFirst.empty()) return true;
+	return table.pendingFirst[slot] == table.boundFirst[slot] && table.pendingCount[slot] == table.boundCount[slot];
+}
+
+// Issues every changed slot in the dirty range as one call, slots in between that already match are rebound with it.
+// Slots nothing has asked for since they became unknown cannot be passed on, so they split the call.
+// Whole constant buffers and ranges are bound by different calls, so they split it too.
+void StateCache::flushSlots(SlotKind kind, Stage stage)
+{
+	SlotTable& table = slots[kind][(int)stage];
+	bool ranged = !table.pendingCount.empty();
+	unsigned int runFirst = 0, runEnd = 0;
+	for (unsigned int slot = table.dirtyFirst; slot < table.dirtyEnd; slot++)
+	{
+		Handle value = table.pending[slot];
+		bool splits = value == UNKNOWN
+			|| (ranged && runEnd > runFirst && (table.pendingCount[slot] > 0) != (table.pendingCount[runFirst] > 0));
+		if (splits)
+		{
+			if (runEnd > runFirst) issueSlots(kind, stage, runFirst, runEnd - runFirst);
+			runFirst = runEnd = 0;
+			if (value == UNKNOWN) continue;
+		}
+		if (isPendingBound(table, slot)) continue;
+
+		if (runEnd == runFirst) runFirst = slot;
+		runEnd = slot + 1;
+	}
+	if (runEnd > runFirst) issueSlots(kind, stage, runFirst, runEnd - runFirst);
+	table.dirtyFirst = table.dirtyEnd = 0;
+}
+
+void StateCache::flush()
+{
+	for (int kind = 0; kind < SLOT_KIND_COUNT; kind++)
+	{
+		for (unsigned int stage = 0; stage < STAGE_COUNT; stage++)
+		{
+			if (slots[kind][stage].dirtyFirst < slots[kind][stage].dirtyEnd)
+			{
+				flushSlots((SlotKind)kind, (Stage)stage);
+			}
+		}
+	}
+}
+
+void StateCache::setShader(Stage stage, Handle shader)
+{
+	stats.shaders.calls++;
+	if (shaders[(int)stage] == shader) return;
+
+	shaders[(int)stage] = shader;
+	context->setShader(stage, shader);
+	stats.shaders.issued++;
+}
+
+void StateCache::setInputLayout(Handle layout)
+{
+	stats.inputAssembler.calls++;
+	if (inputLayout == layout) return;
+
+	inputLayout = layout;
+	context->setInputLayout(layout);
+	stats.inputAssembler.issued++;
+}
+
+void StateCache::setPrimitiveTopology(unsigned int ltopology)
+{
+	stats.inputAssembler.calls++;
+	if (topology == ltopology) return;
+
+	topology = ltopology;
+	context->setPrimitiveTopology(topology);
+	stats.inputAssembler.issued++;
+}
+
+void StateCache::setVertexBuffers(unsigned int start, unsigned int count, const Handle* buffers, const unsigned int* strides, const unsigned int* offsets)
+{
+	stats.inputAssembler.calls++;
+	if (start >= VERTEX_BUFFER_SLOTS) return;
+	if (count > VERTEX_BUFFER_SLOTS - start) count = VERTEX_BUFFER_SLOTS - start;
+
+	bool changed = false;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int slot = start + i;
+		changed = changed || vertexBuffers[slot] != buffers[i] || vertexStrides[slot] != strides[i] || vertexOffsets[slot] != offsets[i];
+		vertexBuffers[slot] = buffers[i];
+		vertexStrides[slot] = strides[i];
+		vertexOffsets[slot] = offsets[i];
+	}
+	if (!changed) return;
+
+	context->setVertexBuffers(start, count, buffers, strides, offsets);
+	stats.inputAssembler.issued++;
+}
+
+void StateCache::setIndexBuffer(Handle buffer, unsigned int format, unsigned int offset)
+{
+	stats.inputAssembler.calls++;
+	if (indexBuffer == buffer && indexFormat == format && indexOffset == offset) return;
+
+	indexBuffer = buffer;
+	indexFormat = format;
+	indexOffset = offset;
+	context->setIndexBuffer(buffer, format, offset);
+	stats.inputAssembler.issued++;
+}
+
+void StateCache::setBlendState(Handle state, const float* lblendFactor, unsigned int lsampleMask)
+{
+	stats.states.calls++;
+	static const float ONES[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	const float* factor = lblendFactor ? lblendFactor : ONES;
+	if (blendState == state && sampleMask == lsampleMask && memcmp(blendFactor, factor, sizeof(blendFactor)) == 0) return;
+
+	blendState = state;
+	memcpy(blendFactor, factor, sizeof(blendFactor));
+	sampleMask = lsampleMask;
+	context->setBlendState(state, lblendFactor, lsampleMask);
+	stats.states.issued++;
+}
+
+void StateCache::setDepthStencilState(Handle state, unsigned int lstencilRef)
+{
+	stats.states.calls++;
+	if (depthStencilState == state && stencilRef == lstencilRef) return;
+
+	depthStencilState = state;
+	stencilRef = lstencilRef;
+	context->setDepthStencilState(state, lstencilRef);
+	stats.states.issued++;
+}
+
+void StateCache::setRasterizerState(Handle state)
+{
+	stats.states.calls++;
+	if (rasterizerState == state) return;
+
+	rasterizerState = state;
+	context->setRasterizerState(state);
+	stats.states.issued++;
+}
+
+// The device unbinds shader resources that alias a new target, which ones is not known here, so any bound one is treated as unknown.
+// They are not bound again unless asked for, as the device would otherwise unbind the target they alias.
+void StateCache::forgetShaderResources()
+{
+	for (SlotTable& table : slots[RESOURCES])
+	{
+		for (unsigned int slot = 0; slot < table.bound.size(); slot++)
+		{
+			if (table.bound[slot] != nullptr)
+			{
+				table.bound[slot] = table.pending[slot] = UNKNOWN;
+			}
+		}
+	}
+}
+
+void StateCache::setRenderTargets(unsigned int count, const Handle* views, Handle depthView)
+{
+	stats.renderTargets.calls++;
+	flush();
+	context->setRenderTargets(count, views, depthView);
+	stats.renderTargets.issued++;
+	forgetShaderResources();
+}
+
+void StateCache::draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	flush();
+	context->draw(vertexCount, startVertex);
+}
+
+void StateCache::drawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	flush();
+	context->drawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void StateCache::drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance)
+{
+	flush();
+	context->drawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+void StateCache::dispatch(unsigned int x, unsigned int y, unsigned int z)
+{
+	flush();
+	context->dispatch(x, y, z);
+}
+
+void StateCache::endFrame()
+{
+	lastFrameStats = stats;
+	memset(&stats, 0, sizeof(stats));
+}
+
+const StateCache::Stats& StateCache::getStats() const
+{
+	return lastFrameStats;
+}
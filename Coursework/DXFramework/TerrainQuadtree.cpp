@@ -0,0 +1,363 @@
+// Terrain quadtree
+// Height bounds of every node, level ranges from the screen-space error and the walk picking patches, see TerrainQuadtree.h
+#include "TerrainQuadtree.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Fraction of the way from the last level's range to its own a patch starts morphing
+	const float MORPH_START = 0.7f;
+
+	// Morph distances of the top level, it has no coarser grid to move onto
+	const float NEVER_MORPH = 1.0e30f;
+
+	// Smallest screen-space error accepted, so the ranges stay finite
+	const float MIN_PIXEL_ERROR = 0.01f;
+
+	// Samples a texel reads bilinearly from, clamped to the grid or past it
+	void texelSpan(unsigned int cell, unsigned int cells, unsigned int samples, int& first, int& last)
+	{
+		first = (int)floorf((float)cell / cells * samples - 0.5f);
+		last = (int)floorf((float)(cell + 1) / cells * samples - 0.5f) + 1;
+	}
+}
+
+TerrainQuadtree::TerrainQuadtree(unsigned int patchResolution) : patchResolution((std::max)(2u, patchResolution & ~1u))
+{
+	build(nullptr, 1, 1);
+	setLodRanges(1.0f, 1.0f, 1.0f);
+}
+
+void TerrainQuadtree::build(const float* heights, unsigned int width, unsigned int height, unsigned int filterRadius, float borderHeight)
+{
+	sampleWidth = (std::max)(width, 1u);
+	sampleHeight = (std::max)(height, 1u);
+	this->filterRadius = filterRadius;
+	this->borderHeight = borderHeight;
+
+	// Enough levels that a leaf's grid has a cell for every sample, the root is one patch grid across
+	unsigned int samplesAcross = (std::max)(sampleWidth, sampleHeight);
+	levelCount = 1;
+	while (levelCount < MAX_LEVELS && (1u << (levelCount - 1)) * 2 * patchResolution < samplesAcross)
+	{
+		levelCount++;
+	}
+
+	unsigned int leaves = nodesAcross(0);
+	leafMin.assign(leaves * leaves, -1.0f);
+	leafMax.assign(leaves * leaves, 1.0f);
+	if (heights)
+	{
+		for (unsigned int z = 0; z < leaves; z++)
+		{
+			int firstZ, lastZ;
+			texelSpan(z, leaves, sampleHeight, firstZ, lastZ);
+			for (unsigned int x = 0; x < leaves; x++)
+			{
+				int firstX, lastX;
+				texelSpan(x, leaves, sampleWidth, firstX, lastX);
+
+				float lowest = heights[0], highest = heights[0];
+				bool first = true;
+				for (int sz = firstZ; sz <= lastZ; sz++)
+				{
+					for (int sx = firstX; sx <= lastX; sx++)
+					{
+						bool inside = sx >= 0 && sz >= 0 && sx < (int)sampleWidth && sz < (int)sampleHeight;
+						float sample = inside ? heights[sz * sampleWidth + sx] : borderHeight;
+						lowest = first ? sample : (std::min)(lowest, sample);
+						highest = first ? sample : (std::max)(highest, sample);
+						first = false;
+					}
+				}
+				leafMin[z * leaves + x] = lowest;
+				leafMax[z * leaves + x] = highest;
+			}
+		}
+	}
+	else
+	{
+		// Unknown heights could be anywhere in the range, or the border
+		std::fill(leafMin.begin(), leafMin.end(), (std::min)(-1.0f, borderHeight));
+		std::fill(leafMax.begin(), leafMax.end(), (std::max)(1.0f, borderHeight));
+	}
+
+	refitLevels();
+}
+
+void TerrainQuadtree::setFilterRadius(unsigned int filterRadius)
+{
+	if (filterRadius == this->filterRadius)
+	{
+		return;
+	}
+	this->filterRadius = filterRadius;
+	refitLevels();
+}
+
+void TerrainQuadtree::refitLevels()
+{
+	// Leaves within the filter radius of a leaf, on each axis
+	unsigned int leaves = nodesAcross(0);
+	int reachX = (int)ceilf((float)filterRadius * leaves / sampleWidth);
+	int reachZ = (int)ceilf((float)filterRadius * leaves / sampleHeight);
+
+	levelMin[0].resize(leaves * leaves);
+	levelMax[0].resize(leaves * leaves);
+	for (int z = 0; z < (int)leaves; z++)
+	{
+		for (int x = 0; x < (int)leaves; x++)
+		{
+			float lowest = leafMin[z * leaves + x], highest = leafMax[z * leaves + x];
+			for (int nz = z - reachZ; nz <= z + reachZ; nz++)
+			{
+				for (int nx = x - reachX; nx <= x + reachX; nx++)
+				{
+					if (nx < 0 || nz < 0 || nx >= (int)leaves || nz >= (int)leaves)
+					{
+						// The filter reads past the edge
+						lowest = (std::min)(lowest, borderHeight);
+						highest = (std::max)(highest, borderHeight);
+						continue;
+					}
+					lowest = (std::min)(lowest, leafMin[nz * leaves + nx]);
+					highest = (std::max)(highest, leafMax[nz * leaves + nx]);
+				}
+			}
+			levelMin[0][z * leaves + x] = lowest;
+			levelMax[0][z * leaves + x] = highest;
+		}
+	}
+
+	for (unsigned int level = 1; level < levelCount; level++)
+	{
+		unsigned int across = nodesAcross(level), childAcross = across * 2;
+		const std::vector<float>& childMin = levelMin[level - 1];
+		const std::vector<float>& childMax = levelMax[level - 1];
+		levelMin[level].resize(across * across);
+		levelMax[level].resize(across * across);
+		for (unsigned int z = 0; z < across; z++)
+		{
+			for (unsigned int x = 0; x < across; x++)
+			{
+				unsigned int child = z * 2 * childAcross + x * 2;
+				levelMin[level][z * across + x] = (std::min)((std::min)(childMin[child], childMin[child + 1]),
+					(std::min)(childMin[child + childAcross], childMin[child + childAcross + 1]));
+				levelMax[level][z * across + x] = (std::max)((std::max)(childMax[child], childMax[child + 1]),
+					(std::max)(childMax[child + childAcross], childMax[child + childAcross + 1]));
+			}
+		}
+	}
+	for (unsigned int level = levelCount; level < MAX_LEVELS; level++)
+	{
+		levelMin[level].clear();
+		levelMax[level].clear();
+	}
+}
+
+void TerrainQuadtree::setTransform(const float origin[3], float sizeX, float sizeZ, float heightScale)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		this->origin[i] = origin[i];
+	}
+	this->sizeX = sizeX;
+	this->sizeZ = sizeZ;
+	this->heightScale = heightScale;
+}
+
+void TerrainQuadtree::setLodRanges(float viewportHeight, float projectionScaleY, float maxPixelError)
+{
+	// World distance a world unit covers a pixel at, a cell covers maxPixelError pixels at its size times this
+	float errorScale = projectionScaleY * viewportHeight * 0.5f / (std::max)(maxPixelError, MIN_PIXEL_ERROR);
+	float leafCell = (std::max)(fabsf(sizeX), fabsf(sizeZ)) / (nodesAcross(0) * 2 * patchResolution);
+
+	for (unsigned int level = 0; level < MAX_LEVELS; level++)
+	{
+		float cell = leafCell * (float)(1u << level);
+		float nodeSize = cell * 2 * patchResolution;
+		float range = (std::max)(cell * errorScale, 2.0f * sqrtf(2.0f) * nodeSize);
+		lodRanges[level] = level > 0 ? (std::max)(range, 2.0f * lodRanges[level - 1]) : range;
+	}
+}
+
+void TerrainQuadtree::select(const float cameraPosition[3], const FrustumCuller::Frustum& frustum, std::vector<Patch>& patches, Stats* stats) const
+{
+	patches.clear();
+	Stats counters = {};
+	Selection selection = { cameraPosition, &frustum, &patches, &counters };
+	selectNode(levelCount - 1, 0, 0, false, selection);
+
+	counters.patches = (unsigned int)patches.size();
+	if (stats)
+	{
+		*stats = counters;
+	}
+}
+
+bool TerrainQuadtree::selectNode(unsigned int level, unsigned int nodeX, unsigned int nodeZ, bool parentInside, Selection& selection) const
+{
+	selection.stats->nodesVisited++;
+	float boxMin[3], boxMax[3];
+	nodeBox(level, nodeX, nodeZ, boxMin, boxMax);
+
+	// Past its level's range the parent draws this quarter, the root is drawn at any distance
+	if (level < levelCount - 1 && !inRange(selection.camera, lodRanges[level], boxMin, boxMax))
+	{
+		return false;
+	}
+
+	Containment containment = parentInside ? INSIDE : classify(*selection.frustum, boxMin, boxMax);
+	if (containment == OUTSIDE)
+	{
+		selection.stats->nodesCulled++;
+		return true;
+	}
+	bool inside = containment == INSIDE;
+
+	// Out of the finer level's range, all of the node is drawn at this level
+	if (level == 0 || !inRange(selection.camera, lodRanges[level - 1], boxMin, boxMax))
+	{
+		for (unsigned int quarter = 0; quarter < 4; quarter++)
+		{
+			addQuarter(level, nodeX * 2 + (quarter & 1), nodeZ * 2 + (quarter >> 1), inside, selection);
+		}
+		return true;
+	}
+
+	for (unsigned int quarter = 0; quarter < 4; quarter++)
+	{
+		unsigned int childX = nodeX * 2 + (quarter & 1), childZ = nodeZ * 2 + (quarter >> 1);
+		if (!selectNode(level - 1, childX, childZ, inside, selection))
+		{
+			addQuarter(level, childX, childZ, inside, selection);
+		}
+	}
+	return true;
+}
+
+void TerrainQuadtree::addQuarter(unsigned int level, unsigned int childX, unsigned int childZ, bool parentInside, Selection& selection) const
+{
+	if (!parentInside)
+	{
+		// The child's box, leaves have no children so their quarters take their heights
+		float boxMin[3], boxMax[3];
+		if (level > 0)
+		{
+			nodeBox(level - 1, childX, childZ, boxMin, boxMax);
+		}
+		else
+		{
+			nodeBox(0, childX / 2, childZ / 2, boxMin, boxMax);
+			float halfX = (boxMax[0] - boxMin[0]) * 0.5f, halfZ = (boxMax[2] - boxMin[2]) * 0.5f;
+			boxMin[0] += halfX * (childX & 1);
+			boxMax[0] = boxMin[0] + halfX;
+			boxMin[2] += halfZ * (childZ & 1);
+			boxMax[2] = boxMin[2] + halfZ;
+		}
+		if (classify(*selection.frustum, boxMin, boxMax) == OUTSIDE)
+		{
+			selection.stats->nodesCulled++;
+			return;
+		}
+	}
+
+	Patch patch;
+	patch.size = 1.0f / (nodesAcross(level) * 2);
+	patch.x = childX * patch.size;
+	patch.z = childZ * patch.size;
+	patch.level = level;
+	if (level == levelCount - 1)
+	{
+		patch.morphStart = NEVER_MORPH;
+		patch.morphEnd = NEVER_MORPH * 2.0f;
+	}
+	else
+	{
+		float previous = level > 0 ? lodRanges[level - 1] : 0.0f;
+		patch.morphStart = previous + (lodRanges[level] - previous) * MORPH_START;
+		patch.morphEnd = lodRanges[level];
+	}
+	patch.padding[0] = patch.padding[1] = 0.0f;
+	selection.patches->push_back(patch);
+	selection.stats->levelPatches[level]++;
+}
+
+unsigned int TerrainQuadtree::nodesAcross(unsigned int level) const
+{
+	return 1u << (levelCount - 1 - level);
+}
+
+void TerrainQuadtree::nodeBox(unsigned int level, unsigned int nodeX, unsigned int nodeZ, float boxMin[3], float boxMax[3]) const
+{
+	unsigned int across = nodesAcross(level);
+	float size = 1.0f / across;
+	float x[2] = { origin[0] + nodeX * size * sizeX, origin[0] + (nodeX + 1) * size * sizeX };
+	float z[2] = { origin[2] + nodeZ * size * sizeZ, origin[2] + (nodeZ + 1) * size * sizeZ };
+	float y[2] = { origin[1] + levelMin[level][nodeZ * across + nodeX] * heightScale, origin[1] + levelMax[level][nodeZ * across + nodeX] * heightScale };
+
+	boxMin[0] = (std::min)(x[0], x[1]);
+	boxMax[0] = (std::max)(x[0], x[1]);
+	boxMin[1] = (std::min)(y[0], y[1]);
+	boxMax[1] = (std::max)(y[0], y[1]);
+	boxMin[2] = (std::min)(z[0], z[1]);
+	boxMax[2] = (std::max)(z[0], z[1]);
+}
+
+TerrainQuadtree::Containment TerrainQuadtree::classify(const FrustumCuller::Frustum& frustum, const float boxMin[3], const float boxMax[3]) const
+{
+	Containment containment = INSIDE;
+	for (int p = 0; p < 6; p++)
+	{
+		const float* plane = frustum.planes[p];
+		float distance = plane[3], reach = 0.0f;
+		for (int i = 0; i < 3; i++)
+		{
+			distance += plane[i] * (boxMin[i] + boxMax[i]) * 0.5f;
+			reach += fabsf(plane[i]) * (boxMax[i] - boxMin[i]) * 0.5f;
+		}
+		if (distance + reach < 0.0f)
+		{
+			return OUTSIDE;
+		}
+		if (distance - reach < 0.0f)
+		{
+			containment = INTERSECTING;
+		}
+	}
+	return containment;
+}
+
+bool TerrainQuadtree::inRange(const float camera[3], float range, const float boxMin[3], const float boxMax[3]) const
+{
+	float distanceSquared = 0.0f;
+	for (int i = 0; i < 3; i++)
+	{
+		float offset = (std::max)((std::max)(boxMin[i] - camera[i], camera[i] - boxMax[i]), 0.0f);
+		distanceSquared += offset * offset;
+	}
+	return distanceSquared <= range * range;
+}
+
+unsigned int TerrainQuadtree::getLevelCount() const
+{
+	return levelCount;
+}
+
+unsigned int TerrainQuadtree::getPatchResolution() const
+{
+	return patchResolution;
+}
+
+float TerrainQuadtree::getLodRange(unsigned int level) const
+{
+	return lodRanges[(std::min)(level, MAX_LEVELS - 1)];
+}
+
+void TerrainQuadtree::getNodeHeights(unsigned int level, unsigned int nodeX, unsigned int nodeZ, float& minHeight, float& maxHeight) const
+{
+	unsigned int across = nodesAcross(level);
+	minHeight = levelMin[level][nodeZ * across + nodeX];
+	maxHeight = levelMax[level][nodeZ * across + nodeX];
+}
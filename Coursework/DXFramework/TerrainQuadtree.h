@@ -0,0 +1,132 @@
+/**
+* \class TerrainQuadtree
+*
+* \brief Picks the patches of a height map terrain to draw, a continuous distance level of detail (CDLOD) quadtree
+*
+* The terrain's unit square is split into a quadtree over its height map, each node keeping the lowest and highest height
+* under it, so its box is tight. Every level of the tree is drawn to a distance from the camera, its range, where a cell of its
+* patch grid covers the screen-space error allowed, and each range is at least twice the last. select() walks down from the root, culling
+* nodes against a frustum, and stops at the first level whose range the node is outside, drawing it as four patches of one grid.
+* Past the far part of its range a patch's odd vertices move onto the next level's grid, so levels meet without cracks or pops
+* (Strugar, 2009). Plain C++, it can be measured without a device.
+*/
+
+
+#ifndef _TERRAINQUADTREE_H_
+#define _TERRAINQUADTREE_H_
+
+#include <vector>
+#include "FrustumCuller.h"
+
+class TerrainQuadtree
+{
+public:
+	/// Most levels a tree has, leaves included
+	static const unsigned int MAX_LEVELS = 12;
+
+	/// A square of the terrain drawn with the patch grid, laid out as the height map vertex shader reads them
+	struct Patch
+	{
+		float x, z;		///< Corner with the lowest x and z, in the terrain's unit square
+		float size;		///< Width and depth, in the terrain's unit square
+		unsigned int level;	///< Level of detail, 0 is the finest
+		float morphStart;	///< Distance from the camera the odd vertices start moving onto the next level's grid
+		float morphEnd;		///< Distance they are on it
+		float padding[2];
+	};
+
+	/// Counters from a selection
+	struct Stats
+	{
+		unsigned int nodesVisited;
+		unsigned int nodesCulled;	///< Nodes and quarters of nodes outside the frustum
+		unsigned int patches;
+		unsigned int levelPatches[MAX_LEVELS];	///< Patches of each level
+	};
+
+	/** @param patchResolution is the cells across a patch's grid, even, a node is drawn as four patches */
+	explicit TerrainQuadtree(unsigned int patchResolution = 8);
+
+	/** \brief Builds the tree over a grid of heights
+	* The heights cover the unit square as a texture covers its texture coordinates, sampled bilinearly, from -1 to 1.
+	* Levels are added until a leaf's grid has a cell for every height sample, up to MAX_LEVELS.
+	* @param heights is width by height values, row by row, nullptr gives every node the whole range until the heights are known
+	* @param filterRadius is how many samples past the bilinear ones the shader may read, see setFilterRadius
+	* @param borderHeight is the height read past the edges
+	*/
+	void build(const float* heights, unsigned int width, unsigned int height, unsigned int filterRadius = 0, float borderHeight = -1.0f);
+
+	/** \brief Grows every node's height range by the heights within filterRadius samples of it, for a shader smoothing the height map
+	* Leaves keep their own range, so this only refits the tree.
+	*/
+	void setFilterRadius(unsigned int filterRadius);
+
+	/** \brief Places the terrain in the world, axis aligned
+	* The unit square runs from origin to origin + sizeX along x and origin + sizeZ along z, a height h is at origin y + h * heightScale.
+	*/
+	void setTransform(const float origin[3], float sizeX, float sizeZ, float heightScale);
+
+	/** \brief Sets the range of every level from the screen-space error allowed
+	* A level is drawn as far as one of its cells covers maxPixelError pixels, seen from a perspective projection.
+	* Ranges are at least twice their level's node diagonal, so neighbouring patches are never more than a level apart.
+	* @param projectionScaleY is the projection's _22, 1 / tan of half the field of view
+	*/
+	void setLodRanges(float viewportHeight, float projectionScaleY, float maxPixelError);
+
+	/** \brief Picks the patches to draw
+	* @param cameraPosition picks every node's level, in world space
+	* @param frustum culls the nodes, it can be another view's, like a shadow view, whose patches then match the camera's
+	* @param patches is cleared and receives the patches, nearest levels first down each branch
+	* @param stats optionally receives the counters
+	*/
+	void select(const float cameraPosition[3], const FrustumCuller::Frustum& frustum, std::vector<Patch>& patches, Stats* stats = nullptr) const;
+
+	unsigned int getLevelCount() const;
+	unsigned int getPatchResolution() const;
+	float getLodRange(unsigned int level) const;	///< Distance a level is drawn to
+	/** \brief Lowest and highest height under a node, nodes of a level are numbered from the lowest x and z */
+	void getNodeHeights(unsigned int level, unsigned int nodeX, unsigned int nodeZ, float& minHeight, float& maxHeight) const;
+
+private:
+	enum Containment
+	{
+		OUTSIDE,
+		INTERSECTING,
+		INSIDE
+	};
+
+	// The walk's inputs and output, passed down the recursion
+	struct Selection
+	{
+		const float* camera;
+		const FrustumCuller::Frustum* frustum;
+		std::vector<Patch>* patches;
+		Stats* stats;
+	};
+
+	unsigned int nodesAcross(unsigned int level) const;
+	void refitLevels();	///< Leaf ranges grown by the filter radius, then every parent around its children
+	void nodeBox(unsigned int level, unsigned int nodeX, unsigned int nodeZ, float boxMin[3], float boxMax[3]) const;
+	Containment classify(const FrustumCuller::Frustum& frustum, const float boxMin[3], const float boxMax[3]) const;
+	bool inRange(const float camera[3], float range, const float boxMin[3], const float boxMax[3]) const;
+	/// Returns false if the node is past its level's range, so its parent draws its quarter instead
+	bool selectNode(unsigned int level, unsigned int nodeX, unsigned int nodeZ, bool parentInside, Selection& selection) const;
+	/// Adds the patch over a quarter of a node, the child it would have, culled by the child's box
+	void addQuarter(unsigned int level, unsigned int childX, unsigned int childZ, bool parentInside, Selection& selection) const;
+
+	unsigned int patchResolution;
+	unsigned int levelCount = 1;
+	unsigned int filterRadius = 0;
+	unsigned int sampleWidth = 0, sampleHeight = 0;
+	float borderHeight = -1.0f;
+
+	// Lowest and highest heights of each level's nodes, row by row, level 0 is the leaves
+	std::vector<float> leafMin, leafMax;	///< Leaves under their bilinear samples only, before the filter radius
+	std::vector<float> levelMin[MAX_LEVELS], levelMax[MAX_LEVELS];
+
+	float origin[3] = { 0.0f, 0.0f, 0.0f };
+	float sizeX = 1.0f, sizeZ = 1.0f, heightScale = 1.0f;
+	float lodRanges[MAX_LEVELS] = {};
+};
+
+#endif
@@ -0,0 +1,719 @@
+// Texture compressor
+// Builds gamma correct mip chains and encodes them as block compressed DDS levels, see TextureCompressor.h
+#include "TextureCompressor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <xmmintrin.h>
+
+namespace
+{
+	const float PI = 3.14159265f;
+
+	// Kaiser filter half width in destination texels and the window's shape, larger alpha trades sharpness for less ringing
+	const float KAISER_WIDTH = 3.0f;
+	const float KAISER_ALPHA = 4.0f;
+
+	// BC7 interpolation weights for 4 bit indices, out of 64
+	const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct Tap
+	{
+		unsigned int index;
+		float weight;
+	};
+
+	inline float clamp01(float value)
+	{
+		return std::min(std::max(value, 0.0f), 1.0f);
+	}
+
+	inline float srgbToLinear(float value)
+	{
+		return (value <= 0.04045f) ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	inline float linearToSrgb(float value)
+	{
+		return (value <= 0.0031308f) ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+	}
+
+	// Zeroth order modified Bessel function of the first kind, by its power series
+	float besselI0(float x)
+	{
+		float sum = 1.0f, term = 1.0f;
+		for (int k = 1; k < 32; k++)
+		{
+			float factor = x / (2.0f * k);
+			term *= factor * factor;
+			sum += term;
+			if (term < sum * 1e-7f) break;
+		}
+		return sum;
+	}
+
+	float kaiser(float t)
+	{
+		float ratio = t / KAISER_WIDTH;
+		if (fabsf(ratio) >= 1.0f) return 0.0f;
+		float sinc = (t == 0.0f) ? 1.0f : sinf(PI * t) / (PI * t);
+		return sinc * besselI0(KAISER_ALPHA * sqrtf(1.0f - ratio * ratio)) / besselI0(KAISER_ALPHA);
+	}
+
+	// Source texels and weights for every destination texel along one axis. Textures tile, so taps wrap around.
+	std::vector<std::vector<Tap>> buildTaps(unsigned int sourceSize, unsigned int destinationSize, TextureCompressor::Filter filter)
+	{
+		std::vector<std::vector<Tap>> taps(destinationSize);
+		if (sourceSize == destinationSize)
+		{
+			for (unsigned int i = 0; i < destinationSize; i++) taps[i].push_back({ i, 1.0f });
+			return taps;
+		}
+
+		float scale = (float)sourceSize / destinationSize;
+		for (unsigned int i = 0; i < destinationSize; i++)
+		{
+			float start = i * scale, end = (i + 1) * scale;
+			float centre = (start + end) * 0.5f;
+			float radius = (filter == TextureCompressor::Filter::BOX) ? scale * 0.5f : KAISER_WIDTH * scale;
+
+			float total = 0.0f;
+			for (int source = (int)floorf(centre - radius); source < (int)ceilf(centre + radius); source++)
+			{
+				float weight;
+				if (filter == TextureCompressor::Filter::BOX)
+				{
+					// Area of the texel covered by the destination texel
+					weight = std::min(end, source + 1.0f) - std::max(start, (float)source);
+				}
+				else
+				{
+					weight = kaiser((source + 0.5f - centre) / scale);
+				}
+				if (weight == 0.0f) continue;
+
+				int wrapped = source % (int)sourceSize;
+				if (wrapped < 0) wrapped += sourceSize;
+				taps[i].push_back({ (unsigned int)wrapped, weight });
+				total += weight;
+			}
+			for (Tap& tap : taps[i]) tap.weight /= total;
+		}
+		return taps;
+	}
+
+	// Converts the stored encoding into the space mips are filtered in
+	TextureCompressor::Image toFilterSpace(const TextureCompressor::Image& image, TextureCompressor::Role role)
+	{
+		TextureCompressor::Image linear = image;
+		if (role == TextureCompressor::Role::COLOUR)
+		{
+			for (size_t i = 0; i < linear.pixels.size(); i += 4)
+			{
+				for (int channel = 0; channel < 3; channel++) linear.pixels[i + channel] = srgbToLinear(linear.pixels[i + channel]);
+			}
+		}
+		return linear;
+	}
+
+	TextureCompressor::Image fromFilterSpace(const TextureCompressor::Image& image, TextureCompressor::Role role)
+	{
+		TextureCompressor::Image stored = image;
+		for (size_t i = 0; i < stored.pixels.size(); i += 4)
+		{
+			float* pixel = &stored.pixels[i];
+			if (role == TextureCompressor::Role::COLOUR)
+			{
+				for (int channel = 0; channel < 3; channel++) pixel[channel] = linearToSrgb(clamp01(pixel[channel]));
+			}
+			else if (role == TextureCompressor::Role::NORMAL)
+			{
+				// Averaged normals shorten, put them back on the unit sphere
+				float x = pixel[0] * 2.0f - 1.0f, y = pixel[1] * 2.0f - 1.0f, z = pixel[2] * 2.0f - 1.0f;
+				float length = sqrtf(x * x + y * y + z * z);
+				if (length > 1e-6f)
+				{
+					pixel[0] = x / length * 0.5f + 0.5f;
+					pixel[1] = y / length * 0.5f + 0.5f;
+					pixel[2] = z / length * 0.5f + 0.5f;
+				}
+			}
+			for (int channel = 0; channel < 4; channel++) pixel[channel] = clamp01(pixel[channel]);
+		}
+		return stored;
+	}
+
+	// Principal axis of a block's texels by power iteration, channels is 1 to 4
+	void principalAxis(const float texels[16][4], int channels, float mean[4], float axis[4])
+	{
+		for (int c = 0; c < 4; c++) mean[c] = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < channels; c++) mean[c] += texels[i][c] / 16.0f;
+		}
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++) covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+			}
+		}
+
+		for (int c = 0; c < 4; c++) axis[c] = (c < channels) ? 1.0f : 0.0f;
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			float length = 0.0f;
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++) next[a] += covariance[a][b] * axis[b];
+				length += next[a] * next[a];
+			}
+			if (length < 1e-12f) break;
+			length = sqrtf(length);
+			for (int a = 0; a < channels; a++) axis[a] = next[a] / length;
+		}
+	}
+
+	// Endpoints at the ends of the texels' spread along the principal axis
+	void fitEndpoints(const float texels[16][4], int channels, float low[4], float high[4])
+	{
+		float mean[4], axis[4];
+		principalAxis(texels, channels, mean, axis);
+
+		float minimum = 0.0f, maximum = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channels; c++) t += (texels[i][c] - mean[c]) * axis[c];
+			minimum = std::min(minimum, t);
+			maximum = std::max(maximum, t);
+		}
+		for (int c = 0; c < 4; c++)
+		{
+			low[c] = std::min(std::max(mean[c] + axis[c] * minimum, 0.0f), 255.0f);
+			high[c] = std::min(std::max(mean[c] + axis[c] * maximum, 0.0f), 255.0f);
+		}
+	}
+
+	// Least squares endpoints for fixed interpolation weights, false if every texel has the same weight
+	bool refineEndpoints(const float texels[16][4], int channels, const float weights[16], float low[4], float high[4])
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {}, bx[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float a = 1.0f - weights[i], b = weights[i];
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < channels; c++)
+			{
+				ax[c] += a * texels[i][c];
+				bx[c] += b * texels[i][c];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (fabsf(determinant) < 1e-6f) return false;
+
+		for (int c = 0; c < channels; c++)
+		{
+			low[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+			high[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+		}
+		return true;
+	}
+
+	inline float squaredDistance(const float* a, const float* b, int channels)
+	{
+		float sum = 0.0f;
+		for (int c = 0; c < channels; c++) sum += (a[c] - b[c]) * (a[c] - b[c]);
+		return sum;
+	}
+
+	// Picks the nearest palette entry for every texel, returns the block's squared error
+	float assignIndices(const float texels[16][4], int channels, const float palette[][4], int paletteSize, unsigned int indices[16])
+	{
+		float error = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float best = squaredDistance(texels[i], palette[0], channels);
+			indices[i] = 0;
+			for (int p = 1; p < paletteSize; p++)
+			{
+				float distance = squaredDistance(texels[i], palette[p], channels);
+				if (distance < best)
+				{
+					best = distance;
+					indices[i] = p;
+				}
+			}
+			error += best;
+		}
+		return error;
+	}
+
+	// Appends bits least significant first, as BC7 blocks are laid out
+	struct BitWriter
+	{
+		unsigned char* block;
+		unsigned int position;
+
+		void write(unsigned int value, unsigned int bits)
+		{
+			for (unsigned int i = 0; i < bits; i++, position++)
+			{
+				if (value & (1u << i)) block[position >> 3] |= (unsigned char)(1u << (position & 7));
+			}
+		}
+	};
+
+	// BC1, two 5:6:5 colours and 2 bit indices, always in the four colour mode
+	struct Bc1Candidate
+	{
+		unsigned short colour[2];
+		unsigned int indices[16];
+		float palette[4][4];
+		float error;
+	};
+
+	unsigned short packRgb565(const float colour[4])
+	{
+		unsigned int r = (unsigned int)(colour[0] * 31.0f / 255.0f + 0.5f);
+		unsigned int g = (unsigned int)(colour[1] * 63.0f / 255.0f + 0.5f);
+		unsigned int b = (unsigned int)(colour[2] * 31.0f / 255.0f + 0.5f);
+		return (unsigned short)((r << 11) | (g << 5) | b);
+	}
+
+	void unpackRgb565(unsigned short packed, float colour[4])
+	{
+		unsigned int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		colour[0] = (float)((r << 3) | (r >> 2));
+		colour[1] = (float)((g << 2) | (g >> 4));
+		colour[2] = (float)((b << 3) | (b >> 2));
+		colour[3] = 255.0f;
+	}
+
+	Bc1Candidate tryBc1(const float texels[16][4], const float low[4], const float high[4])
+	{
+		Bc1Candidate candidate;
+		candidate.colour[0] = packRgb565(high);
+		candidate.colour[1] = packRgb565(low);
+		// The four colour mode needs the first colour to be larger, equal colours fall back to three colour mode with index 0
+		if (candidate.colour[0] < candidate.colour[1]) std::swap(candidate.colour[0], candidate.colour[1]);
+
+		unpackRgb565(candidate.colour[0], candidate.palette[0]);
+		unpackRgb565(candidate.colour[1], candidate.palette[1]);
+		for (int c = 0; c < 4; c++)
+		{
+			candidate.palette[2][c] = (2.0f * candidate.palette[0][c] + candidate.palette[1][c]) / 3.0f;
+			candidate.palette[3][c] = (candidate.palette[0][c] + 2.0f * candidate.palette[1][c]) / 3.0f;
+		}
+		candidate.error = assignIndices(texels, 3, candidate.palette, (candidate.colour[0] == candidate.colour[1]) ? 1 : 4, candidate.indices);
+		return candidate;
+	}
+
+	void encodeBc1(const float texels[16][4], unsigned char* block, float decoded[16][4])
+	{
+		float low[4], high[4];
+		fitEndpoints(texels, 3, low, high);
+		Bc1Candidate best = tryBc1(texels, low, high);
+
+		// Palette entries sit at 0, 1, 1/3 and 2/3 of the way from the first colour
+		static const float WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		for (int iteration = 0; iteration < 2; iteration++)
+		{
+			float weights[16];
+			for (int i = 0; i < 16; i++) weights[i] = WEIGHTS[best.indices[i]];
+			float refinedLow[4], refinedHigh[4];
+			if (!refineEndpoints(texels, 3, weights, refinedHigh, refinedLow)) break;
+			Bc1Candidate candidate = tryBc1(texels, refinedLow, refinedHigh);
+			if (candidate.error >= best.error) break;
+			best = candidate;
+		}
+
+		unsigned int indices = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			indices |= best.indices[i] << (i * 2);
+			memcpy(decoded[i], best.palette[best.indices[i]], sizeof(float) * 3);
+		}
+		memcpy(block, &best.colour[0], 2);
+		memcpy(block + 2, &best.colour[1], 2);
+		memcpy(block + 4, &indices, 4);
+	}
+
+	// BC4, one channel with two 8 bit endpoints and 3 bit indices, in the eight value mode
+	void encodeBc4(const float texels[16][4], int channel, unsigned char* block, float decoded[16][4])
+	{
+		float values[16][4] = {};
+		float minimum = 255.0f, maximum = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			values[i][0] = texels[i][channel];
+			minimum = std::min(minimum, values[i][0]);
+			maximum = std::max(maximum, values[i][0]);
+		}
+
+		unsigned int high = (unsigned int)(maximum + 0.5f), low = (unsigned int)(minimum + 0.5f);
+		float palette[8][4] = {};
+		palette[0][0] = (float)high;
+		palette[1][0] = (float)low;
+		for (int p = 2; p < 8; p++) palette[p][0] = ((8 - p) * palette[0][0] + (p - 1) * palette[1][0]) / 7.0f;
+
+		unsigned int indices[16];
+		assignIndices(values, 1, palette, (high == low) ? 1 : 8, indices);
+
+		unsigned long long bits = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			bits |= (unsigned long long)indices[i] << (i * 3);
+			decoded[i][channel] = palette[indices[i]][0];
+		}
+		block[0] = (unsigned char)high;
+		block[1] = (unsigned char)low;
+		for (int b = 0; b < 6; b++) block[2 + b] = (unsigned char)(bits >> (b * 8));
+	}
+
+	// BC7 mode 6, one subset of RGBA with 7 bit endpoints, a shared low bit per endpoint and 4 bit indices
+	struct Bc7Candidate
+	{
+		unsigned int endpoint[2][4];	///< 7 bits
+		unsigned int pBit[2];
+		unsigned int indices[16];
+		float palette[16][4];
+		float error;
+	};
+
+	Bc7Candidate tryBc7(const float texels[16][4], const float low[4], const float high[4], unsigned int pLow, unsigned int pHigh)
+	{
+		Bc7Candidate candidate;
+		candidate.pBit[0] = pLow;
+		candidate.pBit[1] = pHigh;
+		float expanded[2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			const float* value[2] = { low, high };
+			for (int e = 0; e < 2; e++)
+			{
+				int quantised = (int)((value[e][c] - candidate.pBit[e]) / 2.0f + 0.5f);
+				candidate.endpoint[e][c] = (unsigned int)std::min(std::max(quantised, 0), 127);
+				expanded[e][c] = (float)((candidate.endpoint[e][c] << 1) | candidate.pBit[e]);
+			}
+		}
+		for (int p = 0; p < 16; p++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				candidate.palette[p][c] = (float)((((64 - BC7_WEIGHTS[p]) * (int)expanded[0][c] + BC7_WEIGHTS[p] * (int)expanded[1][c] + 32) >> 6));
+			}
+		}
+		candidate.error = assignIndices(texels, 4, candidate.palette, 16, candidate.indices);
+		return candidate;
+	}
+
+	Bc7Candidate bestBc7(const float texels[16][4], const float low[4], const float high[4])
+	{
+		Bc7Candidate best = tryBc7(texels, low, high, 0, 0);
+		for (unsigned int pBits = 1; pBits < 4; pBits++)
+		{
+			Bc7Candidate candidate = tryBc7(texels, low, high, pBits & 1, pBits >> 1);
+			if (candidate.error < best.error) best = candidate;
+		}
+		return best;
+	}
+
+	void encodeBc7(const float texels[16][4], unsigned char* block, float decoded[16][4])
+	{
+		float low[4], high[4];
+		fitEndpoints(texels, 4, low, high);
+		Bc7Candidate best = bestBc7(texels, low, high);
+
+		for (int iteration = 0; iteration < 2 && best.error > 0.0f; iteration++)
+		{
+			float weights[16];
+			for (int i = 0; i < 16; i++) weights[i] = BC7_WEIGHTS[best.indices[i]] / 64.0f;
+			if (!refineEndpoints(texels, 4, weights, low, high)) break;
+			Bc7Candidate candidate = bestBc7(texels, low, high);
+			if (candidate.error >= best.error) break;
+			best = candidate;
+		}
+
+		// The first texel's index is stored in 3 bits, so its top bit must be clear. Swapping the endpoints flips every index.
+		if (best.indices[0] & 8)
+		{
+			for (int c = 0; c < 4; c++) std::swap(best.endpoint[0][c], best.endpoint[1][c]);
+			std::swap(best.pBit[0], best.pBit[1]);
+			for (int i = 0; i < 16; i++) best.indices[i] = 15 - best.indices[i];
+			for (int p = 0; p < 8; p++)
+			{
+				for (int c = 0; c < 4; c++) std::swap(best.palette[p][c], best.palette[15 - p][c]);
+			}
+		}
+
+		memset(block, 0, 16);
+		BitWriter writer = { block, 0 };
+		writer.write(1 << 6, 7);
+		for (int c = 0; c < 4; c++)
+		{
+			writer.write(best.endpoint[0][c], 7);
+			writer.write(best.endpoint[1][c], 7);
+		}
+		writer.write(best.pBit[0], 1);
+		writer.write(best.pBit[1], 1);
+		for (int i = 0; i < 16; i++)
+		{
+			writer.write(best.indices[i], (i == 0) ? 3 : 4);
+			memcpy(decoded[i], best.palette[best.indices[i]], sizeof(float) * 4);
+		}
+	}
+
+	void writeUint(std::ofstream& file, unsigned int value)
+	{
+		file.write((const char*)&value, sizeof(value));
+	}
+}
+
+TextureCompressor::Image TextureCompressor::downsample(const Image& image, Filter filter)
+{
+	unsigned int width = std::max(image.width / 2, 1u), height = std::max(image.height / 2, 1u);
+	std::vector<std::vector<Tap>> columnTaps = buildTaps(image.width, width, filter);
+	std::vector<std::vector<Tap>> rowTaps = buildTaps(image.height, height, filter);
+
+	// Horizontal pass, every RGBA texel is one SSE register
+	std::vector<float> horizontal((size_t)width * image.height * 4);
+	for (unsigned int y = 0; y < image.height; y++)
+	{
+		const float* sourceRow = &image.pixels[(size_t)y * image.width * 4];
+		float* destinationRow = &horizontal[(size_t)y * width * 4];
+		for (unsigned int x = 0; x < width; x++)
+		{
+			__m128 sum = _mm_setzero_ps();
+			for (const Tap& tap : columnTaps[x])
+			{
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(sourceRow + tap.index * 4), _mm_set1_ps(tap.weight)));
+			}
+			_mm_storeu_ps(destinationRow + x * 4, sum);
+		}
+	}
+
+	// Vertical pass, whole rows at a time so the reads stay sequential
+	Image result;
+	result.width = width;
+	result.height = height;
+	result.pixels.assign((size_t)width * height * 4, 0.0f);
+	for (unsigned int y = 0; y < height; y++)
+	{
+		float* destinationRow = &result.pixels[(size_t)y * width * 4];
+		for (const Tap& tap : rowTaps[y])
+		{
+			const float* sourceRow = &horizontal[(size_t)tap.index * width * 4];
+			__m128 weight = _mm_set1_ps(tap.weight);
+			for (unsigned int x = 0; x < width; x++)
+			{
+				__m128 sum = _mm_add_ps(_mm_loadu_ps(destinationRow + x * 4), _mm_mul_ps(_mm_loadu_ps(sourceRow + x * 4), weight));
+				_mm_storeu_ps(destinationRow + x * 4, sum);
+			}
+		}
+	}
+	return result;
+}
+
+std::vector<TextureCompressor::Image> TextureCompressor::buildMipChain(const Image& image, Role role, Filter filter)
+{
+	std::vector<Image> chain;
+	chain.push_back(image);
+
+	// Each level is filtered from the unclamped level above, so rounding does not build up down the chain
+	Image working = toFilterSpace(image, role);
+	while (working.width > 1 || working.height > 1)
+	{
+		working = downsample(working, filter);
+		chain.push_back(fromFilterSpace(working, role));
+	}
+	return chain;
+}
+
+TextureCompressor::Format TextureCompressor::pickFormat(Role role, bool alpha, bool highPrecision, bool preferSmall)
+{
+	switch (role)
+	{
+	case Role::HEIGHT:
+		return highPrecision ? Format::R16_UNORM : Format::R8_UNORM;
+	case Role::MASK:
+		return Format::BC4_UNORM;
+	case Role::NORMAL:
+		return Format::BC5_UNORM;
+	default:
+		return (preferSmall && !alpha) ? Format::BC1_UNORM : Format::BC7_UNORM;
+	}
+}
+
+bool TextureCompressor::hasAlpha(const Image& image)
+{
+	for (size_t i = 3; i < image.pixels.size(); i += 4)
+	{
+		if (image.pixels[i] < 1.0f - 0.5f / 255.0f) return true;
+	}
+	return false;
+}
+
+unsigned int TextureCompressor::channelCount(Format format)
+{
+	switch (format)
+	{
+	case Format::BC5_UNORM:
+		return 2;
+	case Format::BC1_UNORM:
+		return 3;
+	case Format::BC7_UNORM:
+		return 4;
+	default:
+		return 1;
+	}
+}
+
+size_t TextureCompressor::levelSize(Format format, unsigned int width, unsigned int height)
+{
+	size_t blocks = (size_t)std::max((width + 3) / 4, 1u) * std::max((height + 3) / 4, 1u);
+	switch (format)
+	{
+	case Format::R8_UNORM:
+		return (size_t)width * height;
+	case Format::R16_UNORM:
+		return (size_t)width * height * 2;
+	case Format::BC1_UNORM:
+	case Format::BC4_UNORM:
+		return blocks * 8;
+	default:
+		return blocks * 16;
+	}
+}
+
+TextureCompressor::Level TextureCompressor::compress(const Image& image, Format format)
+{
+	Level level;
+	level.width = image.width;
+	level.height = image.height;
+	level.data.resize(levelSize(format, image.width, image.height));
+	level.squaredError = 0.0;
+
+	if (format == Format::R8_UNORM || format == Format::R16_UNORM)
+	{
+		float maximum = (format == Format::R8_UNORM) ? 255.0f : 65535.0f;
+		for (size_t i = 0; i < (size_t)image.width * image.height; i++)
+		{
+			float value = clamp01(image.pixels[i * 4]);
+			unsigned int quantised = (unsigned int)(value * maximum + 0.5f);
+			float error = (quantised / maximum - value) * 255.0f;
+			level.squaredError += error * error;
+			if (format == Format::R8_UNORM)
+			{
+				level.data[i] = (unsigned char)quantised;
+			}
+			else
+			{
+				level.data[i * 2] = (unsigned char)quantised;
+				level.data[i * 2 + 1] = (unsigned char)(quantised >> 8);
+			}
+		}
+		return level;
+	}
+
+	size_t blockSize = (format == Format::BC1_UNORM || format == Format::BC4_UNORM) ? 8 : 16;
+	unsigned int channels = channelCount(format);
+	unsigned int blocksWide = std::max((image.width + 3) / 4, 1u), blocksHigh = std::max((image.height + 3) / 4, 1u);
+	unsigned char* block = level.data.data();
+	for (unsigned int blockY = 0; blockY < blocksHigh; blockY++)
+	{
+		for (unsigned int blockX = 0; blockX < blocksWide; blockX++, block += blockSize)
+		{
+			// Blocks past the edge of small levels repeat the last row and column
+			float texels[16][4], decoded[16][4];
+			for (unsigned int i = 0; i < 16; i++)
+			{
+				unsigned int x = std::min(blockX * 4 + (i & 3), image.width - 1), y = std::min(blockY * 4 + (i >> 2), image.height - 1);
+				const float* pixel = &image.pixels[((size_t)y * image.width + x) * 4];
+				for (int c = 0; c < 4; c++) texels[i][c] = clamp01(pixel[c]) * 255.0f;
+			}
+
+			switch (format)
+			{
+			case Format::BC1_UNORM:
+				encodeBc1(texels, block, decoded);
+				break;
+			case Format::BC4_UNORM:
+				encodeBc4(texels, 0, block, decoded);
+				break;
+			case Format::BC5_UNORM:
+				encodeBc4(texels, 0, block, decoded);
+				encodeBc4(texels, 1, block + 8, decoded);
+				break;
+			default:
+				encodeBc7(texels, block, decoded);
+				break;
+			}
+
+			for (unsigned int i = 0; i < 16; i++)
+			{
+				if (blockX * 4 + (i & 3) >= image.width || blockY * 4 + (i >> 2) >= image.height) continue;
+				for (unsigned int c = 0; c < channels; c++)
+				{
+					float error = decoded[i][c] - texels[i][c];
+					level.squaredError += error * error;
+				}
+			}
+		}
+	}
+	return level;
+}
+
+bool TextureCompressor::writeDds(const std::string& filename, Format format, const std::vector<Level>& levels)
+{
+	if (levels.empty())
+	{
+		return false;
+	}
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.good())
+	{
+		return false;
+	}
+
+	// DDS_HEADER, with the pixel format deferred to the DX10 header
+	const unsigned int DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+	const unsigned int DDPF_FOURCC = 0x4;
+	const unsigned int DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+	file.write("DDS ", 4);
+	writeUint(file, 124);
+	writeUint(file, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+	writeUint(file, levels[0].height);
+	writeUint(file, levels[0].width);
+	writeUint(file, (unsigned int)levels[0].data.size());
+	writeUint(file, 0);
+	writeUint(file, (unsigned int)levels.size());
+	for (int i = 0; i < 11; i++) writeUint(file, 0);
+	writeUint(file, 32);
+	writeUint(file, DDPF_FOURCC);
+	file.write("DX10", 4);
+	for (int i = 0; i < 5; i++) writeUint(file, 0);
+	writeUint(file, DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX);
+	for (int i = 0; i < 4; i++) writeUint(file, 0);
+
+	// DDS_HEADER_DXT10
+	const unsigned int DIMENSION_TEXTURE2D = 3;
+	writeUint(file, (unsigned int)format);
+	writeUint(file, DIMENSION_TEXTURE2D);
+	writeUint(file, 0);
+	writeUint(file, 1);
+	writeUint(file, 0);
+
+	for (const Level& level : levels)
+	{
+		file.write((const char*)level.data.data(), level.data.size());
+	}
+	return file.good();
+}
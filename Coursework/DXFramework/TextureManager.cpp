@@ -3,6 +3,7 @@
 // Handles .dds, .png and .jpg (probably).
 #include "TextureManager.h"
 
+const TextureManager::TextureHandle TextureManager::DEFAULT_TEXTURE;
 
  //Attempt to load texture. If load fails use default texture.
  //Based on extension, uses slightly different loading function for different image types .dds vs .png/.jpg.
@@ -13,28 +14,75 @@ TextureManager::TextureManager(ID3D11Device* ldevice, ID3D11DeviceContext* ldevi
 	addDefaultTexture();
 }
 
-void TextureManager::loadTexture(const wchar_t* uid, const wchar_t* filename)
+unsigned long long TextureManager::hashContent(const void* data, size_t size)
 {
-	HRESULT result;
+	const unsigned char* bytes = (const unsigned char*)data;
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
 
+// Finds the file to load, preferring the baked version, and reads it whole for hashing and creating the texture from memory.
+// Returns false, after reporting why, when there is nothing to load.
+bool TextureManager::readTextureFile(const wchar_t* uid, const wchar_t* filename, std::wstring& resolved, std::vector<uint8_t>& data, unsigned long long& contentHash)
+{
 	// check if file exists
 	if (!filename)
 	{
 		//filename = L"../res/DefaultDiffuse.png";
 		MessageBox(NULL, L"Texture filename does not exist", L"ERROR", MB_OK);
-		return;
+		return false;
 	}
+	// Prefer the baked, block compressed version
+	resolved = findBakedTexture(filename);
 	// if not set default texture
-	if (!does_file_exist(filename))
+	if (!does_file_exist(resolved.c_str()))
 	{
 		// change default texture
 		//filename = L"../res/DefaultDiffuse.png";
 		MessageBox(NULL, L"Texture filename does not exist", L"ERROR", MB_OK);
+		return false;
+	}
+	// The first texture loaded for a name is kept
+	if (isLoaded(uid))
+	{
+		return false;
+	}
+
+	std::ifstream file(resolved, std::ios::binary | std::ios::ate);
+	std::streamoff size = file.tellg();
+	data.resize(size > 0 ? (size_t)size : 0);
+	file.seekg(0);
+	if (data.empty() || !file.read((char*)data.data(), size))
+	{
+		MessageBox(NULL, L"Texture loading error", L"ERROR", MB_OK);
+		return false;
+	}
+	contentHash = hashContent(data.data(), data.size());
+	return true;
+}
+
+void TextureManager::loadTexture(const wchar_t* uid, const wchar_t* filename)
+{
+	HRESULT result;
+	std::wstring fn;
+	std::vector<uint8_t> data;
+	unsigned long long contentHash;
+	if (!readTextureFile(uid, filename, fn, data, contentHash))
+	{
+		return;
+	}
+
+	// The same file under another name shares its texture
+	if (shareTexture(uid, contentHash))
+	{
 		return;
 	}
 
 	// check file extension for correct loading function.
-	std::wstring fn(filename);
 	std::string::size_type idx;
 	std::wstring extension;
 
@@ -50,47 +98,44 @@ void TextureManager::loadTexture(const wchar_t* uid, const wchar_t* filename)
 	}
 
 	// Load the texture in.
+	ID3D11ShaderResourceView* texture = nullptr;
 	if (extension == L"dds")
 	{
-		result = CreateDDSTextureFromFile(device, deviceContext, filename, NULL, &texture);
+		result = CreateDDSTextureFromMemory(device, deviceContext, data.data(), data.size(), NULL, &texture);
 	}
 	else
 	{
-		result = CreateWICTextureFromFile(device, deviceContext, filename, NULL, &texture, 0);
+		result = CreateWICTextureFromMemory(device, deviceContext, data.data(), data.size(), NULL, &texture, 0);
 	}
-	
+
 	if (FAILED(result))
 	{
 		MessageBox(NULL, L"Texture loading error", L"ERROR", MB_OK);
 	}
 	else
 	{
-		textureMap.insert(std::make_pair(const_cast<wchar_t*>(uid), texture));
+		addTexture(uid, texture, contentHash);
 	}
 }
 
 void TextureManager::loadTextureEx(const wchar_t* uid, const wchar_t* filename, D3D11_USAGE usageFlags, UINT bindFlags, UINT cpuAccessFlags, UINT miscFlags)
 {
 	HRESULT result;
-
-	// check if file exists
-	if (!filename)
+	std::wstring fn;
+	std::vector<uint8_t> data;
+	unsigned long long contentHash;
+	if (!readTextureFile(uid, filename, fn, data, contentHash))
 	{
-		//filename = L"../res/DefaultDiffuse.png";
-		MessageBox(NULL, L"Texture filename does not exist", L"ERROR", MB_OK);
 		return;
 	}
-	// if not set default texture
-	if (!does_file_exist(filename))
+
+	// The same file under another name shares its texture
+	if (shareTexture(uid, contentHash))
 	{
-		// change default texture
-		//filename = L"../res/DefaultDiffuse.png";
-		MessageBox(NULL, L"Texture filename does not exist", L"ERROR", MB_OK);
 		return;
 	}
 
 	// check file extension for correct loading function.
-	std::wstring fn(filename);
 	std::string::size_type idx;
 	std::wstring extension;
 
@@ -106,13 +151,14 @@ void TextureManager::loadTextureEx(const wchar_t* uid, const wchar_t* filename,
 	}
 
 	// Load the texture in.
+	ID3D11ShaderResourceView* texture = nullptr;
 	if (extension == L"dds")
 	{
-		result = CreateDDSTextureFromFileEx(device, deviceContext, filename, 0, usageFlags, bindFlags, cpuAccessFlags, miscFlags, true, NULL, &texture);
+		result = CreateDDSTextureFromMemoryEx(device, deviceContext, data.data(), data.size(), 0, usageFlags, bindFlags, cpuAccessFlags, miscFlags, true, NULL, &texture);
 	}
 	else
 	{
-		result = CreateWICTextureFromFileEx(device, deviceContext, filename, 0, usageFlags, bindFlags, cpuAccessFlags, miscFlags, true, NULL, &texture);
+		result = CreateWICTextureFromMemoryEx(device, deviceContext, data.data(), data.size(), 0, usageFlags, bindFlags, cpuAccessFlags, miscFlags, true, NULL, &texture);
 	}
 
 	if (FAILED(result))
@@ -121,32 +167,125 @@ void TextureManager::loadTextureEx(const wchar_t* uid, const wchar_t* filename,
 	}
 	else
 	{
-		textureMap.insert(std::make_pair(const_cast<wchar_t*>(uid), texture));
+		addTexture(uid, texture, contentHash);
 	}
 }
 
-// Release resource.
-TextureManager::~TextureManager()
+TextureManager::TextureHandle TextureManager::addTexture(const wchar_t* uid, ID3D11ShaderResourceView* texture, unsigned long long contentHash)
 {
-	if (texture)
+	TextureHandle handle = getHandle(uid);
+	Entry& entry = entries[handle];
+	if (entry.loaded)
 	{
 		texture->Release();
-		texture = 0;
+		return handle;
+	}
+
+	entry.texture = texture;
+	entry.loaded = true;
+	entry.owned = true;
+	contentHandles.insert(std::make_pair(contentHash, handle));
+	return handle;
+}
+
+bool TextureManager::shareTexture(const wchar_t* uid, unsigned long long contentHash)
+{
+	auto content = contentHandles.find(contentHash);
+	if (content == contentHandles.end())
+	{
+		return false;
+	}
+
+	// Look up the owner before getHandle, which can grow the entries
+	ID3D11ShaderResourceView* texture = entries[content->second].texture;
+	Entry& entry = entries[getHandle(uid)];
+	if (!entry.loaded)
+	{
+		entry.texture = texture;
+		entry.loaded = true;
+		entry.owned = false;
+	}
+	return true;
+}
+
+// Release resources.
+TextureManager::~TextureManager()
+{
+	for (Entry& entry : entries)
+	{
+		if (entry.owned && entry.texture)
+		{
+			entry.texture->Release();
+		}
+	}
+	entries.clear();
+}
+
+TextureManager::TextureHandle TextureManager::getHandle(const wchar_t* uid)
+{
+	unsigned long long hash = hashName(uid);
+	auto found = nameHandles.find(hash);
+	if (found != nameHandles.end())
+	{
+		return found->second;
 	}
+
+	// New names show the default texture until theirs is loaded
+	TextureHandle handle = (TextureHandle)entries.size();
+	entries.push_back({ uid, entries[DEFAULT_TEXTURE].texture, false, false });
+	nameHandles.insert(std::make_pair(hash, handle));
+	return handle;
 }
 
 // Return texture as a shader resource.
-ID3D11ShaderResourceView* TextureManager::getTexture(const wchar_t* uid)
+ID3D11ShaderResourceView* TextureManager::getTexture(TextureHandle handle) const
 {
-	if (textureMap.find(const_cast<wchar_t*>(uid)) != textureMap.end())
+	return (handle < entries.size()) ? entries[handle].texture : entries[DEFAULT_TEXTURE].texture;
+}
+
+ID3D11ShaderResourceView* TextureManager::getTexture(TextureName uid) const
+{
+	auto found = nameHandles.find(uid.hash);
+	return getTexture(found != nameHandles.end() ? found->second : DEFAULT_TEXTURE);
+}
+
+bool TextureManager::isLoaded(const wchar_t* uid) const
+{
+	auto found = nameHandles.find(hashName(uid));
+	return found != nameHandles.end() && entries[found->second].loaded;
+}
+
+size_t TextureManager::getTextureCount() const
+{
+	size_t count = 0;
+	for (const Entry& entry : entries)
 	{
-		// texture exists
-		return textureMap.at(const_cast<wchar_t*>(uid));
+		if (entry.owned) count++;
 	}
-	else
+	return count;
+}
+
+std::wstring TextureManager::findBakedTexture(const wchar_t* filename)
+{
+	std::wstring source(filename);
+	std::wstring::size_type dot = source.rfind(L'.');
+	if (dot == std::wstring::npos || _wcsicmp(source.c_str() + dot, L".dds") == 0)
 	{
-		return textureMap.at(L"default");
+		return source;
 	}
+
+	std::wstring baked = source.substr(0, dot) + L".dds";
+	WIN32_FILE_ATTRIBUTE_DATA bakedInfo, sourceInfo;
+	if (!GetFileAttributesExW(baked.c_str(), GetFileExInfoStandard, &bakedInfo))
+	{
+		return source;
+	}
+	// An edited source is used until it is baked again, a missing one leaves only the bake
+	if (GetFileAttributesExW(source.c_str(), GetFileExInfoStandard, &sourceInfo) && CompareFileTime(&sourceInfo.ftLastWriteTime, &bakedInfo.ftLastWriteTime) > 0)
+	{
+		return source;
+	}
+	return baked;
 }
 
 bool TextureManager::does_file_exist(const wchar_t *fname)
@@ -173,7 +312,7 @@ void TextureManager::generateTexture(ID3D11Device* device)
 
 void TextureManager::addDefaultTexture()
 {
-	
+
 	static const uint32_t s_pixel = 0xffffffff;
 
 	D3D11_SUBRESOURCE_DATA initData = { &s_pixel, sizeof(uint32_t), 0 };
@@ -187,6 +326,8 @@ void TextureManager::addDefaultTexture()
 
 	HRESULT hr = device->CreateTexture2D(&desc, &initData, &pTexture);
 
+	// The default texture is always handle 0, even if it could not be created
+	ID3D11ShaderResourceView* texture = nullptr;
 	if (SUCCEEDED(hr))
 	{
 		D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
@@ -195,7 +336,8 @@ void TextureManager::addDefaultTexture()
 		SRVDesc.Texture2D.MipLevels = 1;
 
 		hr = device->CreateShaderResourceView(pTexture, &SRVDesc, &texture);
-		textureMap.insert(std::make_pair(const_cast < wchar_t*>(L"default"), texture));
 	}
-	
-}
\ No newline at end of file
+	entries.push_back({ L"default", texture, true, true });
+	nameHandles.insert(std::make_pair(hashName(L"default"), DEFAULT_TEXTURE));
+
+}
@@ -2,6 +2,7 @@
 // Texture
 // Loads and stores a texture ready for rendering.
 // Handles mipmap generation on load.
+// Names are interned and hashed into stable handles, and files with identical content share one texture.
 
 #ifndef _TEXTUREMANAGER_H_
 #define _TEXTUREMANAGER_H_
@@ -14,7 +15,7 @@
 #include <string>
 #include <fstream>
 #include <vector>
-#include <map>
+#include <unordered_map>
 //#include "Texture.h"
 
 using namespace DirectX;
@@ -22,23 +23,74 @@ using namespace DirectX;
 class TextureManager
 {
 public:
+	// Index of a texture in the registry, stable for the manager's lifetime. Cache these instead of looking names up per draw.
+	typedef unsigned int TextureHandle;
+	// The 1x1 white texture, which every name shows until its texture is loaded
+	static const TextureHandle DEFAULT_TEXTURE = 0;
+
+	// 64 bit FNV-1a hash of a texture name, evaluated at compile time for literals
+	static constexpr unsigned long long hashName(const wchar_t* name)
+	{
+		unsigned long long hash = 14695981039346656037ull;
+		for (; *name; name++)
+		{
+			hash = (hash ^ (unsigned long long)*name) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// A texture name reduced to its hash, so looking a name up never compares strings
+	struct TextureName
+	{
+		unsigned long long hash;
+		constexpr TextureName(const wchar_t* name) : hash(hashName(name)) {}
+	};
+
+	// 64 bit FNV-1a hash of a file's bytes, textures with the same hash share one GPU copy
+	static unsigned long long hashContent(const void* data, size_t size);
+
 	TextureManager(ID3D11Device* device, ID3D11DeviceContext* deviceContext);
 	~TextureManager();
 
 	void loadTexture(const wchar_t* uid, const wchar_t* filename);
 	void loadTextureEx(const wchar_t* uid, const wchar_t* filename, D3D11_USAGE usageFlags, UINT bindFlags, UINT cpuAccessFlags, UINT miscFlags);
-	ID3D11ShaderResourceView* getTexture(const wchar_t* uid);
+
+	// Returns the name's handle, registering the name if it is new. Its texture can be loaded before or after.
+	TextureHandle getHandle(const wchar_t* uid);
+	ID3D11ShaderResourceView* getTexture(TextureHandle handle) const;
+	// Looks the name up by its hash, the default texture if it has not been loaded
+	ID3D11ShaderResourceView* getTexture(TextureName uid) const;
+
+	// Stores a texture created elsewhere under the uid. The manager takes ownership of it. The first texture loaded for a name is kept.
+	TextureHandle addTexture(const wchar_t* uid, ID3D11ShaderResourceView* texture, unsigned long long contentHash);
+	// Points the uid at an already loaded texture with the same content hash, false if there is none
+	bool shareTexture(const wchar_t* uid, unsigned long long contentHash);
+	bool isLoaded(const wchar_t* uid) const;
+	size_t getTextureCount() const;	// Distinct textures on the GPU, the default included
+
+	// Returns the .dds the texture baker wrote beside a texture, when it is at least as new as the texture, otherwise the texture itself.
+	static std::wstring findBakedTexture(const wchar_t* filename);
 
 private:
+	struct Entry
+	{
+		std::wstring name;					// Interned name
+		ID3D11ShaderResourceView* texture;	// Default texture until loaded
+		bool loaded;
+		bool owned;							// False when shared with an entry of the same content
+	};
+
 	bool does_file_exist(const wchar_t *fileName);
+	bool readTextureFile(const wchar_t* uid, const wchar_t* filename, std::wstring& resolved, std::vector<uint8_t>& data, unsigned long long& contentHash);
 	void generateTexture(ID3D11Device* device);
 	void addDefaultTexture();
 	
-	ID3D11ShaderResourceView* texture;
 	ID3D11Device* device;
 	ID3D11DeviceContext* deviceContext;
 
-	std::map<wchar_t*, ID3D11ShaderResourceView*> textureMap;
+	std::vector<Entry> entries;
+	std::unordered_map<unsigned long long, TextureHandle> nameHandles;		// Name hash to handle
+	std::unordered_map<unsigned long long, TextureHandle> contentHandles;	// Content hash to the handle owning the texture
 	ID3D11Texture2D *pTexture;
 };
 
@@ -0,0 +1,366 @@
+// Vertex packing
+// Encodes and decodes the compressed vertex format, see VertexPacking.h
+#include "VertexPacking.h"
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	const float UNORM16_MAX = 65535.0f;
+	const float SNORM16_MAX = 32767.0f;
+
+	// Smallest w that keeps its sign once quantized to snorm16, the sign carries the handedness
+	const float QUATERNION_W_BIAS = 1.0f / SNORM16_MAX;
+
+	inline float clampFloat(float value, float low, float high)
+	{
+		return value < low ? low : (value > high ? high : value);
+	}
+
+	inline bool isFinite(const XMFLOAT3& v)
+	{
+		return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+	}
+
+	inline float dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline XMFLOAT3 cross(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	// Returns false (and leaves v alone) when v is too short to normalise
+	inline bool normalise(XMFLOAT3& v)
+	{
+		float length = sqrtf(dot(v, v));
+		if (!(length > 1e-12f)) return false;
+		v = XMFLOAT3(v.x / length, v.y / length, v.z / length);
+		return true;
+	}
+
+	inline short toSnorm16(float value)
+	{
+		return (short)lroundf(clampFloat(value, -1.0f, 1.0f) * SNORM16_MAX);
+	}
+
+	inline float fromSnorm16(short value)
+	{
+		float result = value / SNORM16_MAX;
+		return result < -1.0f ? -1.0f : result;
+	}
+
+	inline float angleDegrees(XMFLOAT3 a, XMFLOAT3 b)
+	{
+		if (!normalise(a) || !normalise(b)) return 0.0f;
+		return acosf(clampFloat(dot(a, b), -1.0f, 1.0f)) * (180.0f / XM_PI);
+	}
+}
+
+VertexPacking::PositionDecode VertexPacking::computePositionDecode(const FullVertex* vertices, size_t count)
+{
+	PositionDecode decode;
+	decode.offset = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	decode.scale = 1.0f;
+	if (count == 0)
+	{
+		return decode;
+	}
+
+	XMFLOAT3 boundsMin = vertices[0].position;
+	XMFLOAT3 boundsMax = vertices[0].position;
+	for (size_t i = 1; i < count; ++i)
+	{
+		const XMFLOAT3& p = vertices[i].position;
+		boundsMin = XMFLOAT3(fminf(boundsMin.x, p.x), fminf(boundsMin.y, p.y), fminf(boundsMin.z, p.z));
+		boundsMax = XMFLOAT3(fmaxf(boundsMax.x, p.x), fmaxf(boundsMax.y, p.y), fmaxf(boundsMax.z, p.z));
+	}
+
+	// One scale for every axis, a non uniform decode would skew normals transformed by the world matrix
+	float extent = fmaxf(boundsMax.x - boundsMin.x, fmaxf(boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z));
+	decode.offset = boundsMin;
+	decode.scale = extent > 0.0f ? extent : 1.0f;
+	return decode;
+}
+
+XMMATRIX VertexPacking::getDecodeMatrix(const PositionDecode& decode)
+{
+	return XMMatrixScaling(decode.scale, decode.scale, decode.scale) * XMMatrixTranslation(decode.offset.x, decode.offset.y, decode.offset.z);
+}
+
+void VertexPacking::encode(const FullVertex* vertices, size_t count, const PositionDecode& decode, PackedVertex* out)
+{
+	const float inverseScale = 1.0f / decode.scale;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const FullVertex& vertex = vertices[i];
+		PackedVertex& packed = out[i];
+
+		packed.position[0] = (unsigned short)lroundf(clampFloat((vertex.position.x - decode.offset.x) * inverseScale, 0.0f, 1.0f) * UNORM16_MAX);
+		packed.position[1] = (unsigned short)lroundf(clampFloat((vertex.position.y - decode.offset.y) * inverseScale, 0.0f, 1.0f) * UNORM16_MAX);
+		packed.position[2] = (unsigned short)lroundf(clampFloat((vertex.position.z - decode.offset.z) * inverseScale, 0.0f, 1.0f) * UNORM16_MAX);
+		packed.position[3] = 0xffff;	// w = 1
+
+		packed.texture[0] = floatToHalf(vertex.texture.x);
+		packed.texture[1] = floatToHalf(vertex.texture.y);
+
+		encodeTangentFrame(vertex.normal, vertex.tangent, vertex.bitangent, packed.tangentFrame);
+	}
+}
+
+void VertexPacking::decode(const PackedVertex* vertices, size_t count, const PositionDecode& decode, FullVertex* out)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const PackedVertex& packed = vertices[i];
+		FullVertex& vertex = out[i];
+
+		vertex.position.x = decode.offset.x + decode.scale * (packed.position[0] / UNORM16_MAX);
+		vertex.position.y = decode.offset.y + decode.scale * (packed.position[1] / UNORM16_MAX);
+		vertex.position.z = decode.offset.z + decode.scale * (packed.position[2] / UNORM16_MAX);
+
+		vertex.texture.x = halfToFloat(packed.texture[0]);
+		vertex.texture.y = halfToFloat(packed.texture[1]);
+
+		decodeTangentFrame(packed.tangentFrame, vertex.normal, vertex.tangent, vertex.bitangent);
+	}
+}
+
+VertexPacking::PackingError VertexPacking::measureError(const FullVertex* original, const PackedVertex* packed, size_t count, const PositionDecode& decode)
+{
+	PackingError error;
+	memset(&error, 0, sizeof(error));
+
+	double squaredPositionError = 0.0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		FullVertex decoded;
+		VertexPacking::decode(&packed[i], 1, decode, &decoded);
+		const FullVertex& source = original[i];
+
+		XMFLOAT3 positionDelta(decoded.position.x - source.position.x, decoded.position.y - source.position.y, decoded.position.z - source.position.z);
+		float positionError = sqrtf(dot(positionDelta, positionDelta));
+		error.maxPosition = fmaxf(error.maxPosition, positionError);
+		squaredPositionError += (double)positionError * positionError;
+
+		error.maxTexture = fmaxf(error.maxTexture, fmaxf(fabsf(decoded.texture.x - source.texture.x), fabsf(decoded.texture.y - source.texture.y)));
+
+		// The frame is only meaningful for finite input, anything else was replaced on encode
+		if (!isFinite(source.normal) || !isFinite(source.tangent) || !isFinite(source.bitangent))
+		{
+			continue;
+		}
+		error.maxNormalDegrees = fmaxf(error.maxNormalDegrees, angleDegrees(source.normal, decoded.normal));
+
+		// Compare against the tangent the encoder actually stored, orthogonalised against the normal
+		XMFLOAT3 normal = source.normal;
+		if (normalise(normal))
+		{
+			float along = dot(normal, source.tangent);
+			XMFLOAT3 tangent(source.tangent.x - normal.x * along, source.tangent.y - normal.y * along, source.tangent.z - normal.z * along);
+			if (normalise(tangent))
+			{
+				error.maxTangentDegrees = fmaxf(error.maxTangentDegrees, angleDegrees(tangent, decoded.tangent));
+			}
+		}
+
+		if (dot(source.bitangent, source.bitangent) > 1e-12f && dot(source.bitangent, decoded.bitangent) < 0.0f)
+		{
+			error.handednessFlips++;
+		}
+	}
+
+	error.rmsPosition = count > 0 ? (float)sqrt(squaredPositionError / count) : 0.0f;
+	return error;
+}
+
+unsigned short VertexPacking::floatToHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const unsigned int sign = (bits >> 16) & 0x8000;
+	const unsigned int floatExponent = (bits >> 23) & 0xff;
+	unsigned int mantissa = bits & 0x7fffff;
+
+	// Infinity and NaN
+	if (floatExponent == 0xff)
+	{
+		return (unsigned short)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+
+	int exponent = (int)floatExponent - 127 + 15;
+	if (exponent >= 31)
+	{
+		return (unsigned short)(sign | 0x7c00);
+	}
+
+	if (exponent <= 0)
+	{
+		// Too small even for a subnormal half
+		if (exponent < -10)
+		{
+			return (unsigned short)sign;
+		}
+
+		// Subnormal, shift the mantissa (with its implicit bit) down and round to nearest even
+		mantissa |= 0x800000;
+		const unsigned int shift = (unsigned int)(14 - exponent);
+		unsigned int half = mantissa >> shift;
+		const unsigned int remainder = mantissa & ((1u << shift) - 1);
+		const unsigned int halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1))) half++;
+		return (unsigned short)(sign | half);
+	}
+
+	// Round to nearest even, a carry out of the mantissa correctly bumps the exponent
+	unsigned int half = ((unsigned int)exponent << 10) | (mantissa >> 13);
+	const unsigned int remainder = mantissa & 0x1fff;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) half++;
+	return (unsigned short)(sign | half);
+}
+
+float VertexPacking::halfToFloat(unsigned short value)
+{
+	const unsigned int sign = (unsigned int)(value & 0x8000) << 16;
+	int exponent = (value >> 10) & 0x1f;
+	unsigned int mantissa = value & 0x3ff;
+	unsigned int bits;
+
+	if (exponent == 0)
+	{
+		if (mantissa == 0)
+		{
+			bits = sign;
+		}
+		else
+		{
+			// Subnormal half, normalise it for the float
+			exponent = 1;
+			while (!(mantissa & 0x400))
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+			mantissa &= 0x3ff;
+			bits = sign | ((unsigned int)(exponent + 127 - 15) << 23) | (mantissa << 13);
+		}
+	}
+	else if (exponent == 31)
+	{
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else
+	{
+		bits = sign | ((unsigned int)(exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+void VertexPacking::encodeTangentFrame(const XMFLOAT3& normal, const XMFLOAT3& tangent, const XMFLOAT3& bitangent, short out[4])
+{
+	// Build an orthonormal frame, falling back to any valid frame when the input is degenerate
+	XMFLOAT3 n = normal;
+	if (!isFinite(n) || !normalise(n))
+	{
+		n = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	}
+
+	XMFLOAT3 t = isFinite(tangent) ? tangent : XMFLOAT3(0.0f, 0.0f, 0.0f);
+	float along = dot(n, t);
+	t = XMFLOAT3(t.x - n.x * along, t.y - n.y * along, t.z - n.z * along);
+	if (!normalise(t))
+	{
+		t = cross(n, fabsf(n.y) < 0.99f ? XMFLOAT3(0.0f, 1.0f, 0.0f) : XMFLOAT3(1.0f, 0.0f, 0.0f));
+		normalise(t);
+	}
+
+	// b completes a right handed frame, the real bitangent is either b or -b
+	XMFLOAT3 b = cross(n, t);
+	bool mirrored = isFinite(bitangent) && dot(b, bitangent) < 0.0f;
+
+	// Quaternion of the rotation whose columns are t, b and n
+	float x, y, z, w;
+	float trace = t.x + b.y + n.z;
+	if (trace > 0.0f)
+	{
+		float s = 0.5f / sqrtf(trace + 1.0f);
+		w = 0.25f / s;
+		x = (b.z - n.y) * s;
+		y = (n.x - t.z) * s;
+		z = (t.y - b.x) * s;
+	}
+	else if (t.x > b.y && t.x > n.z)
+	{
+		float s = 2.0f * sqrtf(1.0f + t.x - b.y - n.z);
+		w = (b.z - n.y) / s;
+		x = 0.25f * s;
+		y = (b.x + t.y) / s;
+		z = (n.x + t.z) / s;
+	}
+	else if (b.y > n.z)
+	{
+		float s = 2.0f * sqrtf(1.0f + b.y - t.x - n.z);
+		w = (n.x - t.z) / s;
+		x = (b.x + t.y) / s;
+		y = 0.25f * s;
+		z = (n.y + b.z) / s;
+	}
+	else
+	{
+		float s = 2.0f * sqrtf(1.0f + n.z - t.x - b.y);
+		w = (t.y - b.x) / s;
+		x = (n.x + t.z) / s;
+		y = (n.y + b.z) / s;
+		z = 0.25f * s;
+	}
+
+	// q and -q are the same rotation, so keep w positive and use its sign for the handedness.
+	// w must survive quantisation to keep that sign, so it is biased away from zero.
+	if (w < 0.0f)
+	{
+		x = -x; y = -y; z = -z; w = -w;
+	}
+	if (w < QUATERNION_W_BIAS)
+	{
+		float xyzLength = sqrtf(x * x + y * y + z * z);
+		float xyzScale = xyzLength > 0.0f ? sqrtf(1.0f - QUATERNION_W_BIAS * QUATERNION_W_BIAS) / xyzLength : 0.0f;
+		x *= xyzScale; y *= xyzScale; z *= xyzScale;
+		w = QUATERNION_W_BIAS;
+	}
+	if (mirrored)
+	{
+		x = -x; y = -y; z = -z; w = -w;
+	}
+
+	out[0] = toSnorm16(x);
+	out[1] = toSnorm16(y);
+	out[2] = toSnorm16(z);
+	out[3] = toSnorm16(w);
+}
+
+void VertexPacking::decodeTangentFrame(const short frame[4], XMFLOAT3& normal, XMFLOAT3& tangent, XMFLOAT3& bitangent)
+{
+	float x = fromSnorm16(frame[0]);
+	float y = fromSnorm16(frame[1]);
+	float z = fromSnorm16(frame[2]);
+	float w = fromSnorm16(frame[3]);
+	float handedness = w < 0.0f ? -1.0f : 1.0f;
+
+	float length = sqrtf(x * x + y * y + z * z + w * w);
+	if (length > 0.0f)
+	{
+		x /= length; y /= length; z /= length; w /= length;
+	}
+
+	// Columns of the rotation matrix, must match DecodeTangentFrame in the packed vertex shaders
+	tangent = XMFLOAT3(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y));
+	XMFLOAT3 b(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x));
+	normal = XMFLOAT3(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y));
+	bitangent = XMFLOAT3(b.x * handedness, b.y * handedness, b.z * handedness);
+}
@@ -0,0 +1,90 @@
+// Mesh baker
+// Usage: MeshBaker.exe [resource path]
+// Imports every .obj and .fbx model under the resource path with Assimp and writes its .dxmesh cache next to it,
+// so the application can map the baked mesh at startup instead of importing. Reports the vertex cache optimization of every model.
+// The path defaults to the Coursework res folder.
+#include "AModel.h"
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Model formats AModel is used with
+static bool IsModelFile(const std::string& filename)
+{
+	size_t dot = filename.find_last_of('.');
+	if (dot == std::string::npos) return false;
+
+	std::string extension = filename.substr(dot);
+	for (char& c : extension) c = (char)tolower((unsigned char)c);
+	return extension == ".obj" || extension == ".fbx";
+}
+
+// Recursively collects every model file under a folder
+static void FindModels(const std::string& folder, std::vector<std::string>& models)
+{
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((folder + "*").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	do
+	{
+		std::string name = findData.cFileName;
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			if (name != "." && name != "..")
+			{
+				FindModels(folder + name + "/", models);
+			}
+		}
+		else if (IsModelFile(name))
+		{
+			models.push_back(folder + name);
+		}
+	} while (FindNextFileA(find, &findData));
+
+	FindClose(find);
+}
+
+int main(int argc, char** argv)
+{
+	std::string resourcePath = (argc > 1) ? argv[1] : "../Coursework/res/";
+	if (!resourcePath.empty() && resourcePath.back() != '/' && resourcePath.back() != '\\')
+	{
+		resourcePath += '/';
+	}
+
+	std::vector<std::string> models;
+	FindModels(resourcePath, models);
+	if (models.empty())
+	{
+		printf("No models found under %s\n", resourcePath.c_str());
+		return 1;
+	}
+
+	int failed = 0;
+	for (const std::string& model : models)
+	{
+		MeshOptimizer::Report report;
+		auto start = std::chrono::high_resolution_clock::now();
+		bool baked = AModel::bakeModel(model, &report);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		printf("%-8s %8.1f ms  %s\n", baked ? "Baked" : "FAILED", std::chrono::duration<double, std::milli>(end - start).count(), MeshCache::getCachePath(model).c_str());
+		if (baked)
+		{
+			printf("         ACMR %.3f -> %.3f  ATVR %.3f -> %.3f\n", report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr);
+		}
+		else
+		{
+			failed++;
+		}
+	}
+
+	printf("%d of %d models baked\n", (int)models.size() - failed, (int)models.size());
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+// Ring allocator tests
+// Checks offsets and sizes are rounded to the alignment, allocations that do not fit before the end of the ring start again
+// at the front, frames are freed as their fences complete, and a full ring fails so the caller can fall back.
+#include "Tests.h"
+#include "RingAllocator.h"
+
+namespace
+{
+	const size_t ALIGNMENT = 256;
+
+	void TestAlignment()
+	{
+		// Capacity is rounded down to the alignment
+		RingAllocator ring(4 * ALIGNMENT + 100, ALIGNMENT);
+		CHECK(ring.getCapacity() == 4 * ALIGNMENT);
+		CHECK(ring.getAlignment() == ALIGNMENT);
+
+		CHECK(ring.align(1) == ALIGNMENT);
+		CHECK(ring.align(ALIGNMENT) == ALIGNMENT);
+		CHECK(ring.align(ALIGNMENT + 1) == 2 * ALIGNMENT);
+
+		// A 64 byte constant buffer takes a whole aligned block, so the next one starts a block on
+		size_t first = ring.allocate(64);
+		size_t second = ring.allocate(ALIGNMENT + 16);
+		size_t third = ring.allocate(ALIGNMENT);
+		CHECK(first == 0);
+		CHECK(second == ALIGNMENT);
+		CHECK(third == 3 * ALIGNMENT);
+		CHECK(ring.getUsed() == 4 * ALIGNMENT);
+
+		// Nothing, or more than the ring holds, is never handed out
+		RingAllocator empty(4 * ALIGNMENT, ALIGNMENT);
+		CHECK(empty.allocate(0) == RingAllocator::INVALID_OFFSET);
+		CHECK(empty.allocate(4 * ALIGNMENT + 1) == RingAllocator::INVALID_OFFSET);
+		CHECK(empty.getUsed() == 0);
+	}
+
+	void TestWrapSkipsEndOfRing()
+	{
+		RingAllocator ring(4 * ALIGNMENT, ALIGNMENT);
+
+		// Frame 1 takes the first three blocks, frame 2 the last
+		CHECK(ring.allocate(2 * ALIGNMENT) == 0);
+		CHECK(ring.allocate(ALIGNMENT) == 2 * ALIGNMENT);
+		ring.endFrame(1);
+		CHECK(ring.allocate(ALIGNMENT) == 3 * ALIGNMENT);
+		ring.endFrame(2);
+		CHECK(ring.getUsed() == 4 * ALIGNMENT);
+
+		// Frame 1 done, the front is free again and the next allocation wraps to it
+		ring.retire(1);
+		CHECK(ring.getUsed() == ALIGNMENT);
+		CHECK(ring.allocate(ALIGNMENT) == 0);
+		ring.endFrame(3);
+		ring.retire(3);
+		CHECK(ring.getUsed() == 0);
+
+		// An allocation that ends exactly at the end of the ring leaves the head at the front, nothing is skipped
+		RingAllocator exact(4 * ALIGNMENT, ALIGNMENT);
+		CHECK(exact.allocate(3 * ALIGNMENT) == 0);
+		exact.endFrame(1);
+		CHECK(exact.allocate(ALIGNMENT) == 3 * ALIGNMENT);
+		exact.endFrame(2);
+		exact.retire(1);
+		CHECK(exact.allocate(2 * ALIGNMENT) == 0);
+		CHECK(exact.getUsed() == 3 * ALIGNMENT);
+
+		// One block left at the end and two free at the front, a two block allocation skips the end block
+		RingAllocator skip(4 * ALIGNMENT, ALIGNMENT);
+		CHECK(skip.allocate(2 * ALIGNMENT) == 0);
+		skip.endFrame(1);
+		CHECK(skip.allocate(ALIGNMENT) == 2 * ALIGNMENT);
+		skip.endFrame(2);
+		skip.retire(1);
+		CHECK(skip.getUsed() == ALIGNMENT);
+		CHECK(skip.allocate(2 * ALIGNMENT) == 0);
+		skip.endFrame(3);
+
+		// The skipped block counts as used, and is freed with the frame that skipped it, not the one before
+		CHECK(skip.getUsed() == 4 * ALIGNMENT);
+		CHECK(skip.allocate(ALIGNMENT) == RingAllocator::INVALID_OFFSET);
+		skip.retire(2);
+		CHECK(skip.getUsed() == 3 * ALIGNMENT);
+		CHECK(skip.allocate(ALIGNMENT) == 2 * ALIGNMENT);
+		skip.endFrame(4);
+		skip.retire(3);
+		CHECK(skip.getUsed() == ALIGNMENT);
+		skip.retire(4);
+		CHECK(skip.getUsed() == 0);
+	}
+
+	void TestRetireFreesFencedFrames()
+	{
+		RingAllocator ring(8 * ALIGNMENT, ALIGNMENT);
+		ring.allocate(ALIGNMENT);
+		ring.endFrame(10);
+		ring.allocate(2 * ALIGNMENT);
+		ring.endFrame(11);
+		ring.allocate(ALIGNMENT);
+		ring.endFrame(12);
+		CHECK(ring.getFramesInFlight() == 3);
+		CHECK(ring.getUsed() == 4 * ALIGNMENT);
+
+		// A fence before any frame's frees nothing
+		ring.retire(9);
+		CHECK(ring.getFramesInFlight() == 3);
+		CHECK(ring.getUsed() == 4 * ALIGNMENT);
+
+		// Frames are freed in order, up to and including the completed fence
+		ring.retire(11);
+		CHECK(ring.getFramesInFlight() == 1);
+		CHECK(ring.getUsed() == ALIGNMENT);
+
+		// A frame that allocated nothing is not kept
+		ring.endFrame(13);
+		CHECK(ring.getFramesInFlight() == 1);
+
+		ring.retire(13);
+		CHECK(ring.getFramesInFlight() == 0);
+		CHECK(ring.getUsed() == 0);
+
+		// With nothing in flight the next allocation starts at the front
+		CHECK(ring.allocate(ALIGNMENT) == 0);
+	}
+
+	void TestFullRingFails()
+	{
+		RingAllocator ring(4 * ALIGNMENT, ALIGNMENT);
+		CHECK(ring.allocate(2 * ALIGNMENT) == 0);
+		CHECK(ring.allocate(2 * ALIGNMENT) == 2 * ALIGNMENT);
+		ring.endFrame(1);
+
+		// The GPU has not finished the frame, so there is no room and the caller uses its own buffer instead
+		CHECK(ring.getUsed() == ring.getCapacity());
+		CHECK(ring.allocate(ALIGNMENT) == RingAllocator::INVALID_OFFSET);
+		ring.retire(0);
+		CHECK(ring.allocate(ALIGNMENT) == RingAllocator::INVALID_OFFSET);
+
+		// A failed allocation takes nothing, so once the frame completes the whole ring is there again
+		CHECK(ring.getUsed() == ring.getCapacity());
+		ring.retire(1);
+		CHECK(ring.getUsed() == 0);
+		CHECK(ring.allocate(4 * ALIGNMENT) == 0);
+
+		// Free space that is only there split across the end of the ring is not enough either
+		RingAllocator split(4 * ALIGNMENT, ALIGNMENT);
+		split.allocate(ALIGNMENT);
+		split.endFrame(1);
+		split.allocate(2 * ALIGNMENT);
+		split.endFrame(2);
+		split.retire(1);
+		CHECK(split.getUsed() == 2 * ALIGNMENT);
+		CHECK(split.allocate(2 * ALIGNMENT) == RingAllocator::INVALID_OFFSET);
+		CHECK(split.allocate(ALIGNMENT) == 3 * ALIGNMENT);
+	}
+}
+
+void RunRingAllocatorTests()
+{
+	TestAlignment();
+	TestWrapSkipsEndOfRing();
+	TestRetireFreesFencedFrames();
+	TestFullRingFails();
+}
@@ -0,0 +1,349 @@
+// State cache tests
+// Drives a StateCache with a context that records every call it is given, and checks which calls got through:
+// redundant ones dropped, neighbouring slots issued as one call, shader resources forgotten on a render target change,
+// and the stats counting both sides.
+#include "Tests.h"
+#include "StateCache.h"
+#include <string>
+#include <vector>
+
+namespace
+{
+	typedef StateCache::Stage Stage;
+	typedef StateCache::Handle Handle;
+
+	/// <summary>
+	/// A call the cache passed on, slot calls keep a copy of their values
+	/// </summary>
+	struct Call
+	{
+		std::string name;
+		Stage stage;
+		unsigned int start;
+		unsigned int count;
+		std::vector<Handle> values;
+	};
+
+	class RecordingContext : public StateCache::Context
+	{
+	public:
+		std::vector<Call> calls;
+
+		void setShaderResources(Stage stage, unsigned int start, unsigned int count, const Handle* views) override { RecordSlots("setShaderResources", stage, start, count, views); }
+		void setConstantBuffers(Stage stage, unsigned int start, unsigned int count, const Handle* buffers) override { RecordSlots("setConstantBuffers", stage, start, count, buffers); }
+		void setConstantBufferRanges(Stage stage, unsigned int start, unsigned int count, const Handle* buffers, const unsigned int*, const unsigned int*) override { RecordSlots("setConstantBufferRanges", stage, start, count, buffers); }
+		void setSamplers(Stage stage, unsigned int start, unsigned int count, const Handle* samplers) override { RecordSlots("setSamplers", stage, start, count, samplers); }
+		void setShader(Stage stage, Handle shader) override { RecordSlots("setShader", stage, 0, 1, &shader); }
+		void setInputLayout(Handle) override { Record("setInputLayout"); }
+		void setPrimitiveTopology(unsigned int) override { Record("setPrimitiveTopology"); }
+		void setVertexBuffers(unsigned int, unsigned int, const Handle*, const unsigned int*, const unsigned int*) override { Record("setVertexBuffers"); }
+		void setIndexBuffer(Handle, unsigned int, unsigned int) override { Record("setIndexBuffer"); }
+		void setBlendState(Handle, const float*, unsigned int) override { Record("setBlendState"); }
+		void setDepthStencilState(Handle, unsigned int) override { Record("setDepthStencilState"); }
+		void setRasterizerState(Handle) override { Record("setRasterizerState"); }
+		void setRenderTargets(unsigned int, const Handle*, Handle) override { Record("setRenderTargets"); }
+		void draw(unsigned int, unsigned int) override { Record("draw"); }
+		void drawIndexed(unsigned int, unsigned int, int) override { Record("drawIndexed"); }
+		void drawIndexedInstanced(unsigned int, unsigned int, unsigned int, int, unsigned int) override { Record("drawIndexedInstanced"); }
+		void dispatch(unsigned int, unsigned int, unsigned int) override { Record("dispatch"); }
+
+		/// <summary>
+		/// Number of recorded calls with a name
+		/// </summary>
+		unsigned int Count(const std::string& name) const
+		{
+			unsigned int count = 0;
+			for (const Call& call : calls) count += (call.name == name) ? 1 : 0;
+			return count;
+		}
+
+		/// <summary>
+		/// The first recorded call with a name, or null
+		/// </summary>
+		const Call* Find(const std::string& name) const
+		{
+			for (const Call& call : calls)
+			{
+				if (call.name == name) return &call;
+			}
+			return nullptr;
+		}
+
+	private:
+		void Record(const char* name)
+		{
+			calls.push_back(Call{ name, Stage::VERTEX_SHADER, 0, 0, {} });
+		}
+
+		void RecordSlots(const char* name, Stage stage, unsigned int start, unsigned int count, const Handle* values)
+		{
+			Call call = { name, stage, start, count, {} };
+			for (unsigned int i = 0; i < count; i++) call.values.push_back(values ? values[i] : nullptr);
+			calls.push_back(call);
+		}
+	};
+
+	// Stand in API objects, the cache only compares their addresses
+	int objects[8];
+	const Handle A = &objects[0];
+	const Handle B = &objects[1];
+	const Handle C = &objects[2];
+	const Handle D = &objects[3];
+
+	void TestRedundantCallsAreDropped()
+	{
+		RecordingContext context;
+		StateCache cache(&context);
+
+		cache.setShader(Stage::VERTEX_SHADER, A);
+		cache.setShader(Stage::VERTEX_SHADER, A);
+		cache.setShader(Stage::PIXEL_SHADER, A);
+		CHECK(context.Count("setShader") == 2);
+
+		cache.setPrimitiveTopology(4);
+		cache.setPrimitiveTopology(4);
+		cache.setInputLayout(B);
+		cache.setInputLayout(B);
+		CHECK(context.Count("setPrimitiveTopology") == 1);
+		CHECK(context.Count("setInputLayout") == 1);
+
+		unsigned int strides[] = { 32 }, offsets[] = { 0 }, movedOffsets[] = { 64 };
+		cache.setVertexBuffers(0, 1, &C, strides, offsets);
+		cache.setVertexBuffers(0, 1, &C, strides, offsets);
+		cache.setVertexBuffers(0, 1, &C, strides, movedOffsets);
+		cache.setIndexBuffer(D, 42, 0);
+		cache.setIndexBuffer(D, 42, 0);
+		CHECK(context.Count("setVertexBuffers") == 2);
+		CHECK(context.Count("setIndexBuffer") == 1);
+
+		// A null blend factor is the same as all ones
+		const float ones[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		cache.setBlendState(A, nullptr, 0xFFFFFFFF);
+		cache.setBlendState(A, ones, 0xFFFFFFFF);
+		cache.setDepthStencilState(B, 0);
+		cache.setDepthStencilState(B, 1);
+		cache.setRasterizerState(C);
+		cache.setRasterizerState(C);
+		CHECK(context.Count("setBlendState") == 1);
+		CHECK(context.Count("setDepthStencilState") == 2);
+		CHECK(context.Count("setRasterizerState") == 1);
+
+		// Slots that already hold what is asked for issue nothing at the draw
+		cache.setShaderResources(Stage::PIXEL_SHADER, 0, 1, &A);
+		cache.draw(3, 0);
+		context.calls.clear();
+		cache.setShaderResources(Stage::PIXEL_SHADER, 0, 1, &A);
+		cache.draw(3, 0);
+		CHECK(context.Count("setShaderResources") == 0);
+		CHECK(context.Count("draw") == 1);
+
+		// Unbinding slots one at a time, as shaders clearing their maps do, costs nothing once they are empty
+		for (unsigned int slot = 0; slot < 20; slot++) cache.setShaderResources(Stage::PIXEL_SHADER, slot, 1, nullptr);
+		cache.draw(3, 0);
+		context.calls.clear();
+		for (unsigned int slot = 0; slot < 20; slot++) cache.setShaderResources(Stage::PIXEL_SHADER, slot, 1, nullptr);
+		cache.draw(3, 0);
+		CHECK(context.Count("setShaderResources") == 0);
+
+		// After invalidate nothing is known, so the same state is issued again
+		cache.invalidate();
+		context.calls.clear();
+		cache.setShader(Stage::VERTEX_SHADER, A);
+		cache.setRasterizerState(C);
+		CHECK(context.Count("setShader") == 1);
+		CHECK(context.Count("setRasterizerState") == 1);
+	}
+
+	void TestContiguousSlotsAreCoalesced()
+	{
+		RecordingContext context;
+		StateCache cache(&context);
+
+		// Three single slot binds are held until the draw, then issued as one call covering them
+		cache.setShaderResources(Stage::PIXEL_SHADER, 0, 1, &A);
+		cache.setShaderResources(Stage::PIXEL_SHADER, 1, 1, &B);
+		cache.setShaderResources(Stage::PIXEL_SHADER, 2, 1, &C);
+		CHECK(context.calls.empty());
+		cache.drawIndexed(6, 0, 0);
+		CHECK(context.Count("setShaderResources") == 1);
+		const Call* call = context.Find("setShaderResources");
+		if (CHECK(call != nullptr))
+		{
+			CHECK(call->stage == Stage::PIXEL_SHADER);
+			CHECK(call->start == 0 && call->count == 3);
+			CHECK(call->values == std::vector<Handle>({ A, B, C }));
+		}
+		// Bindings go out before the draw they are for
+		CHECK(context.calls.back().name == "drawIndexed");
+
+		// Changing the outer slots of the range rebinds the unchanged one between them in the same call
+		context.calls.clear();
+		cache.setShaderResources(Stage::PIXEL_SHADER, 0, 1, &D);
+		cache.setShaderResources(Stage::PIXEL_SHADER, 2, 1, &D);
+		cache.draw(3, 0);
+		CHECK(context.Count("setShaderResources") == 1);
+		call = context.Find("setShaderResources");
+		if (CHECK(call != nullptr))
+		{
+			CHECK(call->start == 0 && call->count == 3);
+			CHECK(call->values == std::vector<Handle>({ D, B, D }));
+		}
+
+		// A slot set back to its bound value before the draw issues nothing
+		context.calls.clear();
+		cache.setShaderResources(Stage::PIXEL_SHADER, 1, 1, &A);
+		cache.setShaderResources(Stage::PIXEL_SHADER, 1, 1, &B);
+		cache.draw(3, 0);
+		CHECK(context.Count("setShaderResources") == 0);
+
+		// Each stage and kind of slot is its own call
+		context.calls.clear();
+		cache.setShaderResources(Stage::VERTEX_SHADER, 0, 1, &A);
+		cache.setSamplers(Stage::PIXEL_SHADER, 0, 1, &B);
+		cache.setSamplers(Stage::PIXEL_SHADER, 1, 1, &C);
+		cache.setConstantBuffers(Stage::PIXEL_SHADER, 3, 1, &D);
+		cache.dispatch(1, 1, 1);
+		CHECK(context.Count("setShaderResources") == 1);
+		CHECK(context.Count("setSamplers") == 1);
+		CHECK(context.Count("setConstantBuffers") == 1);
+		call = context.Find("setSamplers");
+		if (CHECK(call != nullptr))
+		{
+			CHECK(call->start == 0 && call->count == 2);
+		}
+
+		// Whole buffers and ranges of buffers are bound by different calls, so they split a run
+		context.calls.clear();
+		unsigned int firsts[] = { 16 }, counts[] = { 16 };
+		cache.setConstantBuffers(Stage::VERTEX_SHADER, 0, 1, &A);
+		cache.setConstantBufferRanges(Stage::VERTEX_SHADER, 1, 1, &B, firsts, counts);
+		cache.draw(3, 0);
+		CHECK(context.Count("setConstantBuffers") == 1);
+		CHECK(context.Count("setConstantBufferRanges") == 1);
+
+		// The same buffer at another offset is a change
+		context.calls.clear();
+		unsigned int movedFirsts[] = { 32 };
+		cache.setConstantBufferRanges(Stage::VERTEX_SHADER, 1, 1, &B, firsts, counts);
+		cache.draw(3, 0);
+		CHECK(context.Count("setConstantBufferRanges") == 0);
+		cache.setConstantBufferRanges(Stage::VERTEX_SHADER, 1, 1, &B, movedFirsts, counts);
+		cache.draw(3, 0);
+		CHECK(context.Count("setConstantBufferRanges") == 1);
+
+		// Slots nothing has asked for since the cache started are unknown, they cannot be issued so split the call
+		StateCache fresh(&context);
+		context.calls.clear();
+		fresh.setShaderResources(Stage::PIXEL_SHADER, 0, 1, &A);
+		fresh.setShaderResources(Stage::PIXEL_SHADER, 2, 1, &B);
+		fresh.draw(3, 0);
+		CHECK(context.Count("setShaderResources") == 2);
+	}
+
+	void TestRenderTargetChangeForgetsShaderResources()
+	{
+		RecordingContext context;
+		StateCache cache(&context);
+
+		cache.setShaderResources(Stage::PIXEL_SHADER, 0, 1, &A);
+		cache.setShaderResources(Stage::PIXEL_SHADER, 1, 1, nullptr);
+		cache.setSamplers(Stage::PIXEL_SHADER, 0, 1, &B);
+		cache.draw(3, 0);
+
+		// Pending bindings go out before the render targets change
+		context.calls.clear();
+		cache.setShaderResources(Stage::PIXEL_SHADER, 2, 1, &C);
+		cache.setRenderTargets(1, &D, nullptr);
+		if (CHECK(context.calls.size() == 2))
+		{
+			CHECK(context.calls[0].name == "setShaderResources");
+			CHECK(context.calls[1].name == "setRenderTargets");
+		}
+
+		// The device may have unbound any view, so asking for the same one issues it again
+		context.calls.clear();
+		cache.setShaderResources(Stage::PIXEL_SHADER, 0, 1, &A);
+		cache.draw(3, 0);
+		CHECK(context.Count("setShaderResources") == 1);
+
+		// Empty slots and other kinds of slot are still known
+		context.calls.clear();
+		cache.setShaderResources(Stage::PIXEL_SHADER, 1, 1, nullptr);
+		cache.setSamplers(Stage::PIXEL_SHADER, 0, 1, &B);
+		cache.draw(3, 0);
+		CHECK(context.Count("setShaderResources") == 0);
+		CHECK(context.Count("setSamplers") == 0);
+
+		// Forgotten views are not bound again unless asked for, they could alias the new target, so they split the call
+		context.calls.clear();
+		cache.setRenderTargets(1, &D, nullptr);
+		cache.setShaderResources(Stage::PIXEL_SHADER, 1, 1, &B);
+		cache.setShaderResources(Stage::PIXEL_SHADER, 3, 1, &A);
+		cache.draw(3, 0);
+		CHECK(context.Count("setShaderResources") == 2);
+		for (const Call& recorded : context.calls)
+		{
+			if (recorded.name != "setShaderResources") continue;
+			CHECK(recorded.count == 1);
+			CHECK(recorded.start == 1 || recorded.start == 3);
+		}
+
+		// Render target changes are never dropped
+		context.calls.clear();
+		cache.setRenderTargets(1, &D, nullptr);
+		cache.setRenderTargets(1, &D, nullptr);
+		CHECK(context.Count("setRenderTargets") == 2);
+	}
+
+	void TestStatsCountCallsAndIssued()
+	{
+		RecordingContext context;
+		StateCache cache(&context);
+
+		cache.setShader(Stage::VERTEX_SHADER, A);
+		cache.setShader(Stage::VERTEX_SHADER, A);
+		cache.setShaderResources(Stage::PIXEL_SHADER, 0, 1, &A);
+		cache.setShaderResources(Stage::PIXEL_SHADER, 1, 1, &B);
+		cache.setShaderResources(Stage::PIXEL_SHADER, 2, 1, &C);
+		cache.setRasterizerState(D);
+		cache.setRasterizerState(D);
+		cache.setRenderTargets(1, &D, nullptr);
+		cache.setRenderTargets(1, &D, nullptr);
+		cache.draw(3, 0);
+
+		// Nothing is reported until the frame ends
+		CHECK(cache.getStats().getCalls() == 0);
+		cache.endFrame();
+
+		const StateCache::Stats& stats = cache.getStats();
+		CHECK(stats.shaders.calls == 2 && stats.shaders.issued == 1);
+		CHECK(stats.shaderResources.calls == 3 && stats.shaderResources.issued == 1);
+		CHECK(stats.states.calls == 2 && stats.states.issued == 1);
+		CHECK(stats.renderTargets.calls == 2 && stats.renderTargets.issued == 2);
+		CHECK(stats.getCalls() == 9);
+		CHECK(stats.getIssued() == 5);
+		CHECK(stats.getSuppressed() == 4);
+
+		// Issued counts match what reached the context
+		CHECK(context.Count("setShader") == stats.shaders.issued);
+		CHECK(context.Count("setShaderResources") == stats.shaderResources.issued);
+		CHECK(context.Count("setRenderTargets") == stats.renderTargets.issued);
+
+		// The next frame starts from zero, and a frame that only repeats state suppresses all of it
+		cache.setShader(Stage::VERTEX_SHADER, A);
+		cache.setRasterizerState(D);
+		cache.endFrame();
+		CHECK(cache.getStats().getCalls() == 2);
+		CHECK(cache.getStats().getIssued() == 0);
+		CHECK(cache.getStats().getSuppressed() == 2);
+
+	}
+}
+
+void RunStateCacheTests()
+{
+	TestRedundantCallsAreDropped();
+	TestContiguousSlotsAreCoalesced();
+	TestRenderTargetChangeForgetsShaderResources();
+	TestStatsCountCallsAndIssued();
+}
@@ -0,0 +1,61 @@
+// Test runner
+// Usage: Tests.exe [test name]
+// Runs every test when no name is given. Returns 1 if any check failed, so a build can run it as a step.
+// The framework modules tested here need no Windows, CMakeLists.txt builds the same tests on Linux.
+#include "Tests.h"
+#include <cstdio>
+#include <cstring>
+
+struct Test
+{
+	const char* name;
+	void (*run)();
+};
+
+static const Test tests[] =
+{
+	{ "statecache", RunStateCacheTests },
+	{ "ringallocator", RunRingAllocatorTests },
+};
+
+static unsigned int checks = 0;
+static unsigned int failures = 0;
+
+bool Check(bool condition, const char* expression, const char* file, int line)
+{
+	checks++;
+	if (!condition)
+	{
+		failures++;
+		printf("  FAILED %s:%d: %s\n", file, line, expression);
+	}
+	return condition;
+}
+
+int main(int argc, char** argv)
+{
+	const char* only = (argc > 1) ? argv[1] : nullptr;
+
+	bool ranAny = false;
+	for (const Test& test : tests)
+	{
+		if (only && strcmp(only, test.name) != 0) continue;
+
+		unsigned int failuresBefore = failures;
+		printf("== %s ==\n", test.name);
+		test.run();
+		printf("  %s\n", (failures == failuresBefore) ? "passed" : "failed");
+		ranAny = true;
+	}
+
+	if (!ranAny)
+	{
+		printf("Unknown test '%s'. Available:", only);
+		for (const Test& test : tests) printf(" %s", test.name);
+		printf("\n");
+		return 1;
+	}
+
+	printf("%u checks, %u failed\n", checks, failures);
+	return (failures > 0) ? 1 : 0;
+}
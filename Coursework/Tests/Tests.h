@@ -0,0 +1,13 @@
+#pragma once
+
+/// <summary>
+/// Records a check, printing the expression and where it is when it fails. Failures do not stop the test.
+/// </summary>
+/// <returns>The condition, so a test can skip checks that depend on it</returns>
+bool Check(bool condition, const char* expression, const char* file, int line);
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+// Tests, each runs every case of one framework module
+void RunStateCacheTests();
+void RunRingAllocatorTests();
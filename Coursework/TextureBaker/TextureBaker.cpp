@@ -0,0 +1,219 @@
+// Texture baker
+// Usage: TextureBaker.exe [resource path] [-bc1] [-box]
+// Decodes every .png and .jpg texture under the resource path with WIC, builds its mip chain and writes it block compressed
+// to a .dds next to it, which TextureManager loads in its place. The format follows the texture's role, taken from its name:
+// normal maps are BC5, ambient occlusion, roughness and other masks BC4, height maps uncompressed R8 or R16, and colour maps BC7.
+// -bc1 stores opaque colour maps as BC1 instead, half the size for a visible loss of quality.
+// -box filters mips with a 2x2 box instead of the default Kaiser filter.
+// The path defaults to the Coursework res folder.
+#include "TextureCompressor.h"
+#include <windows.h>
+#include <wincodec.h>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+static std::string ToLower(std::string text)
+{
+	for (char& c : text) c = (char)tolower((unsigned char)c);
+	return text;
+}
+
+// Image formats WIC decodes that the application loads
+static bool IsTextureFile(const std::string& filename)
+{
+	size_t dot = filename.find_last_of('.');
+	if (dot == std::string::npos) return false;
+
+	std::string extension = ToLower(filename.substr(dot));
+	return extension == ".png" || extension == ".jpg" || extension == ".jpeg";
+}
+
+// Recursively collects every texture file under a folder
+static void FindTextures(const std::string& folder, std::vector<std::string>& textures)
+{
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((folder + "*").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	do
+	{
+		std::string name = findData.cFileName;
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			if (name != "." && name != "..")
+			{
+				FindTextures(folder + name + "/", textures);
+			}
+		}
+		else if (IsTextureFile(name))
+		{
+			textures.push_back(folder + name);
+		}
+	} while (FindNextFileA(find, &findData));
+
+	FindClose(find);
+}
+
+// Role from the file name alone, folders are named after materials ("BrushedMetal/Color.png" is a colour map)
+static TextureCompressor::Role GetRole(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = ToLower(path.substr(slash == std::string::npos ? 0 : slash + 1));
+	name = name.substr(0, name.find_last_of('.'));
+
+	if (name.find("normal") != std::string::npos) return TextureCompressor::Role::NORMAL;
+	if (name.find("height") != std::string::npos || name.find("displacement") != std::string::npos) return TextureCompressor::Role::HEIGHT;
+
+	const char* masks[] = { "ambientocclusion", "occlusion", "roughness", "metallic", "metalness", "gloss", "specular" };
+	for (const char* mask : masks)
+	{
+		if (name.find(mask) != std::string::npos) return TextureCompressor::Role::MASK;
+	}
+	if (name == "ao") return TextureCompressor::Role::MASK;
+	return TextureCompressor::Role::COLOUR;
+}
+
+static const char* GetFormatName(TextureCompressor::Format format)
+{
+	switch (format)
+	{
+	case TextureCompressor::Format::R16_UNORM: return "R16";
+	case TextureCompressor::Format::R8_UNORM: return "R8";
+	case TextureCompressor::Format::BC1_UNORM: return "BC1";
+	case TextureCompressor::Format::BC4_UNORM: return "BC4";
+	case TextureCompressor::Format::BC5_UNORM: return "BC5";
+	default: return "BC7";
+	}
+}
+
+// Decodes the first frame to 16 bits a channel RGBA, which WIC converts to without touching the gamma
+static bool DecodeImage(IWICImagingFactory* factory, const std::string& path, TextureCompressor::Image& image, bool& highPrecision)
+{
+	std::wstring widePath(path.begin(), path.end());
+	IWICBitmapDecoder* decoder = nullptr;
+	IWICBitmapFrameDecode* frame = nullptr;
+	IWICFormatConverter* converter = nullptr;
+	bool decoded = false;
+
+	UINT width = 0, height = 0;
+	WICPixelFormatGUID source;
+	if (SUCCEEDED(factory->CreateDecoderFromFilename(widePath.c_str(), nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder))
+		&& SUCCEEDED(decoder->GetFrame(0, &frame)) && SUCCEEDED(frame->GetSize(&width, &height)) && SUCCEEDED(frame->GetPixelFormat(&source))
+		&& SUCCEEDED(factory->CreateFormatConverter(&converter))
+		&& SUCCEEDED(converter->Initialize(frame, GUID_WICPixelFormat64bppRGBA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom)))
+	{
+		std::vector<unsigned short> pixels((size_t)width * height * 4);
+		if (SUCCEEDED(converter->CopyPixels(nullptr, width * 8, (UINT)(pixels.size() * sizeof(unsigned short)), (BYTE*)pixels.data())))
+		{
+			image.width = width;
+			image.height = height;
+			image.pixels.resize(pixels.size());
+			for (size_t i = 0; i < pixels.size(); i++) image.pixels[i] = pixels[i] / 65535.0f;
+			highPrecision = source == GUID_WICPixelFormat16bppGray || source == GUID_WICPixelFormat48bppRGB || source == GUID_WICPixelFormat64bppRGBA;
+			decoded = true;
+		}
+	}
+
+	if (converter) converter->Release();
+	if (frame) frame->Release();
+	if (decoder) decoder->Release();
+	return decoded;
+}
+
+int main(int argc, char** argv)
+{
+	std::string resourcePath = "../Coursework/res/";
+	bool preferSmall = false;
+	TextureCompressor::Filter filter = TextureCompressor::Filter::KAISER;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-bc1") == 0) preferSmall = true;
+		else if (strcmp(argv[i], "-box") == 0) filter = TextureCompressor::Filter::BOX;
+		else resourcePath = argv[i];
+	}
+	if (!resourcePath.empty() && resourcePath.back() != '/' && resourcePath.back() != '\\')
+	{
+		resourcePath += '/';
+	}
+
+	std::vector<std::string> textures;
+	FindTextures(resourcePath, textures);
+	if (textures.empty())
+	{
+		printf("No textures found under %s\n", resourcePath.c_str());
+		return 1;
+	}
+
+	CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	IWICImagingFactory* factory = nullptr;
+	if (FAILED(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory))))
+	{
+		printf("Could not create the WIC imaging factory\n");
+		CoUninitialize();
+		return 1;
+	}
+
+	int failed = 0;
+	size_t totalBefore = 0, totalAfter = 0;
+	for (const std::string& texture : textures)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		TextureCompressor::Image image;
+		bool highPrecision = false;
+		if (!DecodeImage(factory, texture, image, highPrecision))
+		{
+			printf("FAILED   %s could not be decoded\n", texture.c_str());
+			failed++;
+			continue;
+		}
+
+		TextureCompressor::Role role = GetRole(texture);
+		TextureCompressor::Format format = TextureCompressor::pickFormat(role, TextureCompressor::hasAlpha(image), highPrecision, preferSmall);
+		std::vector<TextureCompressor::Image> chain = TextureCompressor::buildMipChain(image, role, filter);
+
+		// What the application held before, the RGBA8 texture WIC loaded with its generated mips
+		size_t before = 0, after = 0;
+		std::vector<TextureCompressor::Level> levels;
+		for (const TextureCompressor::Image& level : chain)
+		{
+			levels.push_back(TextureCompressor::compress(level, format));
+			before += (size_t)level.width * level.height * 4;
+			after += levels.back().data.size();
+		}
+
+		std::string output = texture.substr(0, texture.find_last_of('.')) + ".dds";
+		bool baked = TextureCompressor::writeDds(output, format, levels);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		printf("%-8s %8.1f ms  %s\n", baked ? "Baked" : "FAILED", std::chrono::duration<double, std::milli>(end - start).count(), output.c_str());
+		if (baked)
+		{
+			double meanSquaredError = levels[0].squaredError / ((double)image.width * image.height * TextureCompressor::channelCount(format));
+			double psnr = (meanSquaredError > 0.0) ? 10.0 * log10(255.0 * 255.0 / meanSquaredError) : INFINITY;
+			printf("         %s %ux%u, %zu levels, %.2f MB -> %.2f MB (%.1fx), PSNR %.1f dB\n", GetFormatName(format), image.width, image.height, levels.size(),
+				before / 1048576.0, after / 1048576.0, (double)before / after, psnr);
+			totalBefore += before;
+			totalAfter += after;
+		}
+		else
+		{
+			failed++;
+		}
+	}
+
+	factory->Release();
+	CoUninitialize();
+
+	printf("%d of %d textures baked, %.2f MB -> %.2f MB of video memory\n", (int)textures.size() - failed, (int)textures.size(), totalBefore / 1048576.0, totalAfter / 1048576.0);
+	return failed == 0 ? 0 : 1;
+}
@@ -4,7 +4,7 @@
 * \brief Default application setup, inherit from this
 *
 * This class is the parent application to inherit from when creating a new application.
-* Handles the default configuration of the renderer, camera, input, timer and texture manager.
+* Handles the default configuration of the renderer, camera, input, timer, texture manager and asset loader.
 *
 * \author Paul Robertson
 */
@@ -27,6 +27,7 @@ const float SCREEN_NEAR = 0.1f;		//0.1f
 #include "imGUI/imgui_impl_dx11.h"
 #include "imGUI/imgui_impl_win32.h"
 #include "TextureManager.h"
+#include "AssetLoader.h"
 
 
 class BaseApplication
@@ -74,6 +75,7 @@ protected:
 	FPCamera* camera;			///< Pointer to camera object
 	Timer* timer;			///< Pointer to timer object (for delta time and FPS)
 	TextureManager* textureMgr;	///< Pointer to texture manager (handles loading and storing of textures)
+	AssetLoader* assetLoader;	///< Pointer to asset loader (loads textures and models on worker threads)
 	bool wireframeToggle;	///< Boolean tracking if wireframe is de/activated
 };
 
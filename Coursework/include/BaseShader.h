@@ -20,6 +20,8 @@
 #include <DirectXMath.h>
 #include <fstream>
 #include "imGUI/imgui.h"
+#include "VertexPacking.h"
+#include "D3D11StateCache.h"
 
 using namespace std;
 using namespace DirectX;
@@ -51,21 +53,42 @@ public:
 	~BaseShader();
 
 	/** \Brief render function
-	* Sets shader stages and draws the indexed data
+	* Sets shader stages and draws the indexed data, starting at startIndex (the first index of a level of detail)
 	*/
-	virtual void render(ID3D11DeviceContext* deviceContext, int vertexCount);
+	virtual void render(ID3D11DeviceContext* deviceContext, int vertexCount, int startIndex = 0);
+	/** \Brief instanced render function
+	* As render, but draws instanceCount instances of the indexed data with the instanced shaders, where the shader loaded them.
+	*/
+	virtual void renderInstanced(ID3D11DeviceContext* deviceContext, int indexCount, int instanceCount, int startIndex = 0);
 	void compute(ID3D11DeviceContext* dc, int x, int y, int z);
 
+	/** \Brief Selects the vertex shader and layout for the next render
+	* Packed meshes use the packed vertex shader, if the shader loaded one.
+	*/
+	void setVertexFormat(VertexPacking::Format format);
+
+	/** \Brief Binds no pixel shader while set, for depth only passes of opaque geometry
+	* The rasteriser writes depth without one, so shaders drawing into shadow maps skip all their pixel work.
+	*/
+	void setDepthOnly(bool depthOnly);
+
 protected:
 	virtual void initShader(const wchar_t*, const wchar_t*) = 0;
 	void loadVertexShader(const wchar_t* filename);		///< Load Vertex shader, for stand position, tex, normal geomtry
+	void loadPackedVertexShader(const wchar_t* filename);	///< Load Vertex shader for the packed vertex format, see VertexPacking
+	void loadInstancedVertexShader(const wchar_t* filename, VertexPacking::Format format);	///< Load instanced Vertex shader for a vertex format, shares that format's layout
+	void loadPositionVertexShader(const wchar_t* filename, VertexPacking::Format format);	///< Load Vertex shader reading only the position of a vertex format, see BaseMesh::sendPositionData
 	void loadColourVertexShader(const wchar_t* filename);		///< Load Vertex shader, pre-made for position and colour only
 	void loadTextureVertexShader(const wchar_t* filename);		///< Load Vertex shader, pre-made for position and tex only
 	void loadHullShader(const wchar_t* filename);		///< Load Hull shader
 	void loadDomainShader(const wchar_t* filename);		///< Load Domain shader
 	void loadGeometryShader(const wchar_t* filename);	///< Load Geometry shader
 	void loadPixelShader(const wchar_t* filename);		///< Load Pixel shader
+	void loadInstancedPixelShader(const wchar_t* filename);	///< Load Pixel shader used by instanced renders
 	void loadComputeShader(const wchar_t* filename);	///< Load computer shader
+	void setShaderStages(ID3D11DeviceContext* deviceContext, bool instanced);	///< Binds the layout and shaders for the next draw
+	/// Grows a dynamic structured buffer to hold count elements, recreating it and its view when too small
+	void reserveStructuredBuffer(ID3D11Buffer** buffer, ID3D11ShaderResourceView** view, UINT& capacity, UINT count, UINT stride);
 
 protected:
 	ID3D11Device* renderer;
@@ -78,6 +101,13 @@ protected:
 	ID3D11GeometryShader* geometryShader;
 	ID3D11ComputeShader* computeShader;
 	ID3D11InputLayout* layout;
+	ID3D11VertexShader* packedVertexShader;
+	ID3D11InputLayout* packedLayout;
+	ID3D11VertexShader* instancedVertexShader;
+	ID3D11VertexShader* instancedPackedVertexShader;
+	ID3D11PixelShader* instancedPixelShader;
+	VertexPacking::Format vertexFormat;
+	bool depthOnly;
 	ID3D11Buffer* matrixBuffer;
 	ID3D11SamplerState* sampleState;
 };
@@ -0,0 +1,86 @@
+/**
+* \class D3D11ConstantRing
+*
+* \brief One large constant buffer that per draw constants are written into, in place of a small buffer per shader mapped with discard
+*
+* Each upload takes the next 256 byte aligned range of the buffer, maps it without overwriting and binds it as a constant
+* buffer range, so the driver never has to rename a buffer however many draws there are. A RingAllocator hands out the ranges,
+* and an event query at the end of every frame acts as the fence that frees them once the GPU has drawn that frame.
+* Binding ranges and mapping constant buffers without overwriting both need Direct3D 11.1 and driver support. Without
+* them, when disabled, or when the GPU is so far behind the ring is full, uploads fall back to the caller's own buffer.
+*/
+
+
+#ifndef _D3D11CONSTANTRING_H_
+#define _D3D11CONSTANTRING_H_
+
+#include <d3d11_1.h>
+#include <deque>
+#include <vector>
+#include "RingAllocator.h"
+#include "D3D11StateCache.h"
+
+class D3D11ConstantRing
+{
+public:
+	static const UINT CONSTANT_ALIGNMENT = 256;	///< Ranges start on multiples of 16 constants of 16 bytes
+	static const UINT DEFAULT_CAPACITY = 2 * 1024 * 1024;
+
+	/// Constants to bind, a range of the ring or a whole fallback buffer
+	struct Allocation
+	{
+		ID3D11Buffer* buffer;
+		UINT firstConstant;
+		UINT constantCount;		///< 0 binds the whole buffer
+	};
+
+	struct Stats
+	{
+		unsigned int uploads;		///< Uploads written to the ring
+		unsigned int fallbacks;		///< Uploads mapped to their own buffer
+		unsigned int bytes;			///< Ring bytes used, after alignment
+	};
+
+	D3D11ConstantRing(ID3D11Device* device, ID3D11DeviceContext* deviceContext, D3D11StateCache* stateCache, UINT capacity = DEFAULT_CAPACITY);
+	~D3D11ConstantRing();
+
+	/** \brief Copies constants to the ring, or to fallback when the ring can not take them
+	* @param fallback a dynamic constant buffer of at least size bytes, mapped with discard as without the ring
+	*/
+	Allocation upload(const void* data, UINT size, ID3D11Buffer* fallback);
+	void bind(StateCache::Stage stage, UINT slot, const Allocation& allocation);	///< Binds through the state cache
+
+	void endFrame();	///< Fences the frame's uploads and frees the ones the GPU is done with, call once a frame
+
+	bool isSupported() const;		///< If the device can use the ring, otherwise every upload falls back
+	void setEnabled(bool enabled);	///< Disabling sends every upload to its fallback buffer, for comparing the two
+	bool isEnabled() const;
+	const Stats& getStats() const;	///< Last frame's
+
+private:
+	void retireCompleted();
+	Allocation uploadFallback(const void* data, UINT size, ID3D11Buffer* fallback);
+
+	/// A frame's end of frame query and the fence it stands for
+	struct Fence
+	{
+		ID3D11Query* query;
+		unsigned long long value;
+	};
+
+	ID3D11Device* device;
+	ID3D11DeviceContext* deviceContext;
+	D3D11StateCache* stateCache;
+	ID3D11Buffer* buffer;
+	RingAllocator ring;
+	bool supported;
+	bool enabled;
+	bool mapped;		///< The first map has to discard
+	unsigned long long nextFence;
+	std::deque<Fence> fences;
+	std::vector<ID3D11Query*> freeQueries;
+	Stats stats;
+	Stats lastFrameStats;
+};
+
+#endif
@@ -0,0 +1,115 @@
+/**
+* \class D3D11StateCache
+*
+* \brief StateCache over a Direct3D 11 device context
+*
+* Offers the device context's binding and draw calls under the same names, so code binds through the cache as it would the
+* context. Everything that binds state should go through it, or call invalidate after binding around it, or the cache will
+* drop calls that are not redundant. D3D creates the cache for its context, get finds it for code that is only handed the context.
+*/
+
+
+#ifndef _D3D11STATECACHE_H_
+#define _D3D11STATECACHE_H_
+
+#include <d3d11_1.h>
+#include "StateCache.h"
+
+class D3D11StateCache : public StateCache
+{
+public:
+	explicit D3D11StateCache(ID3D11DeviceContext* deviceContext);
+	~D3D11StateCache();
+
+	static D3D11StateCache* get(ID3D11DeviceContext* deviceContext);	///< Returns the cache over a context, null if it has none
+
+	void VSSetShaderResources(UINT start, UINT count, ID3D11ShaderResourceView* const* views) { setShaderResources(Stage::VERTEX_SHADER, start, count, handles(views)); }
+	void HSSetShaderResources(UINT start, UINT count, ID3D11ShaderResourceView* const* views) { setShaderResources(Stage::HULL_SHADER, start, count, handles(views)); }
+	void DSSetShaderResources(UINT start, UINT count, ID3D11ShaderResourceView* const* views) { setShaderResources(Stage::DOMAIN_SHADER, start, count, handles(views)); }
+	void GSSetShaderResources(UINT start, UINT count, ID3D11ShaderResourceView* const* views) { setShaderResources(Stage::GEOMETRY_SHADER, start, count, handles(views)); }
+	void PSSetShaderResources(UINT start, UINT count, ID3D11ShaderResourceView* const* views) { setShaderResources(Stage::PIXEL_SHADER, start, count, handles(views)); }
+	void CSSetShaderResources(UINT start, UINT count, ID3D11ShaderResourceView* const* views) { setShaderResources(Stage::COMPUTE_SHADER, start, count, handles(views)); }
+
+	void VSSetConstantBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers) { setConstantBuffers(Stage::VERTEX_SHADER, start, count, handles(buffers)); }
+	void HSSetConstantBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers) { setConstantBuffers(Stage::HULL_SHADER, start, count, handles(buffers)); }
+	void DSSetConstantBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers) { setConstantBuffers(Stage::DOMAIN_SHADER, start, count, handles(buffers)); }
+	void GSSetConstantBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers) { setConstantBuffers(Stage::GEOMETRY_SHADER, start, count, handles(buffers)); }
+	void PSSetConstantBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers) { setConstantBuffers(Stage::PIXEL_SHADER, start, count, handles(buffers)); }
+	void CSSetConstantBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers) { setConstantBuffers(Stage::COMPUTE_SHADER, start, count, handles(buffers)); }
+
+	// Ranges of constant buffers, need a Direct3D 11.1 context, see supportsConstantBufferRanges
+	void VSSetConstantBuffers1(UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* firstConstants, const UINT* constantCounts) { setConstantBufferRanges(Stage::VERTEX_SHADER, start, count, handles(buffers), firstConstants, constantCounts); }
+	void HSSetConstantBuffers1(UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* firstConstants, const UINT* constantCounts) { setConstantBufferRanges(Stage::HULL_SHADER, start, count, handles(buffers), firstConstants, constantCounts); }
+	void DSSetConstantBuffers1(UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* firstConstants, const UINT* constantCounts) { setConstantBufferRanges(Stage::DOMAIN_SHADER, start, count, handles(buffers), firstConstants, constantCounts); }
+	void GSSetConstantBuffers1(UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* firstConstants, const UINT* constantCounts) { setConstantBufferRanges(Stage::GEOMETRY_SHADER, start, count, handles(buffers), firstConstants, constantCounts); }
+	void PSSetConstantBuffers1(UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* firstConstants, const UINT* constantCounts) { setConstantBufferRanges(Stage::PIXEL_SHADER, start, count, handles(buffers), firstConstants, constantCounts); }
+	void CSSetConstantBuffers1(UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* firstConstants, const UINT* constantCounts) { setConstantBufferRanges(Stage::COMPUTE_SHADER, start, count, handles(buffers), firstConstants, constantCounts); }
+	bool supportsConstantBufferRanges() const { return deviceContext.context1 != nullptr; }	///< If the context is 11.1, the device may still not offset
+
+	void VSSetSamplers(UINT start, UINT count, ID3D11SamplerState* const* samplers) { setSamplers(Stage::VERTEX_SHADER, start, count, handles(samplers)); }
+	void HSSetSamplers(UINT start, UINT count, ID3D11SamplerState* const* samplers) { setSamplers(Stage::HULL_SHADER, start, count, handles(samplers)); }
+	void DSSetSamplers(UINT start, UINT count, ID3D11SamplerState* const* samplers) { setSamplers(Stage::DOMAIN_SHADER, start, count, handles(samplers)); }
+	void GSSetSamplers(UINT start, UINT count, ID3D11SamplerState* const* samplers) { setSamplers(Stage::GEOMETRY_SHADER, start, count, handles(samplers)); }
+	void PSSetSamplers(UINT start, UINT count, ID3D11SamplerState* const* samplers) { setSamplers(Stage::PIXEL_SHADER, start, count, handles(samplers)); }
+	void CSSetSamplers(UINT start, UINT count, ID3D11SamplerState* const* samplers) { setSamplers(Stage::COMPUTE_SHADER, start, count, handles(samplers)); }
+
+	// Class linkage is not used by the framework, so shaders are set without class instances
+	void VSSetShader(ID3D11VertexShader* shader) { setShader(Stage::VERTEX_SHADER, shader); }
+	void HSSetShader(ID3D11HullShader* shader) { setShader(Stage::HULL_SHADER, shader); }
+	void DSSetShader(ID3D11DomainShader* shader) { setShader(Stage::DOMAIN_SHADER, shader); }
+	void GSSetShader(ID3D11GeometryShader* shader) { setShader(Stage::GEOMETRY_SHADER, shader); }
+	void PSSetShader(ID3D11PixelShader* shader) { setShader(Stage::PIXEL_SHADER, shader); }
+	void CSSetShader(ID3D11ComputeShader* shader) { setShader(Stage::COMPUTE_SHADER, shader); }
+
+	void IASetInputLayout(ID3D11InputLayout* layout) { setInputLayout(layout); }
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) { setPrimitiveTopology((unsigned int)topology); }
+	void IASetVertexBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets) { setVertexBuffers(start, count, handles(buffers), strides, offsets); }
+	void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset) { setIndexBuffer(buffer, (unsigned int)format, offset); }
+
+	void OMSetBlendState(ID3D11BlendState* state, const FLOAT blendFactor[4], UINT sampleMask) { setBlendState(state, blendFactor, sampleMask); }
+	void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef) { setDepthStencilState(state, stencilRef); }
+	void OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const* views, ID3D11DepthStencilView* depthView) { setRenderTargets(count, handles(views), depthView); }
+	void RSSetState(ID3D11RasterizerState* state) { setRasterizerState(state); }
+
+	void Draw(UINT vertexCount, UINT startVertex) { draw(vertexCount, startVertex); }
+	void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex) { drawIndexed(indexCount, startIndex, baseVertex); }
+	void DrawIndexedInstanced(UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance) { drawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance); }
+	void Dispatch(UINT x, UINT y, UINT z) { dispatch(x, y, z); }
+
+private:
+	/// Interface pointer arrays have the same layout as handle arrays
+	template<class T> static const Handle* handles(T* const* objects) { return reinterpret_cast<const Handle*>(objects); }
+
+	/// Issues the cache's calls to the device context
+	class DeviceContext : public StateCache::Context
+	{
+	public:
+		explicit DeviceContext(ID3D11DeviceContext* deviceContext);
+		~DeviceContext();
+
+		void setShaderResources(Stage stage, unsigned int start, unsigned int count, const Handle* views) override;
+		void setConstantBuffers(Stage stage, unsigned int start, unsigned int count, const Handle* buffers) override;
+		void setConstantBufferRanges(Stage stage, unsigned int start, unsigned int count, const Handle* buffers, const unsigned int* firstConstants, const unsigned int* constantCounts) override;
+		void setSamplers(Stage stage, unsigned int start, unsigned int count, const Handle* samplers) override;
+		void setShader(Stage stage, Handle shader) override;
+		void setInputLayout(Handle layout) override;
+		void setPrimitiveTopology(unsigned int topology) override;
+		void setVertexBuffers(unsigned int start, unsigned int count, const Handle* buffers, const unsigned int* strides, const unsigned int* offsets) override;
+		void setIndexBuffer(Handle buffer, unsigned int format, unsigned int offset) override;
+		void setBlendState(Handle state, const float* blendFactor, unsigned int sampleMask) override;
+		void setDepthStencilState(Handle state, unsigned int stencilRef) override;
+		void setRasterizerState(Handle state) override;
+		void setRenderTargets(unsigned int count, const Handle* views, Handle depthView) override;
+		void draw(unsigned int vertexCount, unsigned int startVertex) override;
+		void drawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) override;
+		void drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance) override;
+		void dispatch(unsigned int x, unsigned int y, unsigned int z) override;
+
+		ID3D11DeviceContext* context;
+		ID3D11DeviceContext1* context1;	///< Null before Direct3D 11.1
+	};
+
+	DeviceContext deviceContext;
+};
+
+#endif
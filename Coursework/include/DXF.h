@@ -33,6 +33,15 @@
 #include "Light.h"
 #include "RenderTexture.h"
 #include "ShadowMap.h"
+#include "RenderQueue.h"
+#include "StateCache.h"
+#include "D3D11StateCache.h"
+#include "RingAllocator.h"
+#include "D3D11ConstantRing.h"
+#include "FrustumCuller.h"
+#include "ShadowAtlasAllocator.h"
+#include "LightClusterer.h"
+#include "TerrainQuadtree.h"
 
 // imGUI includes
 //#include "imgui.h"
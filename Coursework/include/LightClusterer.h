@@ -0,0 +1,113 @@
+/**
+* \class LightClusterer
+*
+* \brief Bins lights into the clusters of a view frustum, for clustered forward shading
+*
+* The view is split into screen tiles, and each tile into depth slices spaced exponentially from the near plane to the far
+* plane, so clusters are roughly as deep as they are wide. Lights are added once a frame as spheres in view space, their
+* radius is how far they reach, see attenuationRange. build() finds each light's range of tiles and slices, four lights at
+* a time with SSE, then tests the sphere against the box around every cluster in that range, four tiles of a row at a time,
+* and lists the lights each cluster touches. The lists are packed into one index array, with an offset and count for each
+* cluster, in light order. Slices are split between threads, which each own their clusters, so nothing is shared while
+* binning. Plain C++ and SSE, it can be measured without a device.
+*/
+
+
+#ifndef _LIGHTCLUSTERER_H_
+#define _LIGHTCLUSTERER_H_
+
+#include <cstddef>
+#include <vector>
+
+class LightClusterer
+{
+public:
+	/// Counters from the last build
+	struct Stats
+	{
+		unsigned int lights;	///< Lights added
+		unsigned int binned;	///< Lights in at least one cluster
+		unsigned int references;	///< Indices in every cluster's list
+		unsigned int largestCluster;	///< Most lights in one cluster
+	};
+
+	/// Radius lights are clamped to, lights that never fade reach every cluster
+	static const float MAX_RADIUS;
+
+	/** @param tileCountX, tileCountY and sliceCount are the grid's size, tiles across the screen and slices through its depth */
+	LightClusterer(unsigned int tileCountX, unsigned int tileCountY, unsigned int sliceCount);
+
+	/** \brief Distance a light's attenuation takes it below a threshold
+	* The light is intensity / (constant + linear d + quadratic d^2), solved for the distance d it equals threshold.
+	* Returns MAX_RADIUS when it never falls that far, with no linear or quadratic term.
+	*/
+	static float attenuationRange(float constant, float linear, float quadratic, float intensity, float threshold);
+
+	/** \brief Sphere around a spot light's cone, tighter than the sphere of its range
+	* The cone's apex is at the light, along a unit direction for range, opening to outerAngle radians either side.
+	* Narrow cones are bounded by the sphere through their apex and the rim of their end, wide ones by the sphere around that rim.
+	*/
+	static void spotBounds(const float apex[3], const float direction[3], float range, float outerAngle, float centre[3], float& radius);
+
+	/** \brief Sets the view's projection, a perspective projection as XMMatrixPerspectiveFovLH makes
+	* @param projectionScaleX and projectionScaleY are the projection's _11 and _22, 1 / tan of half the field of view
+	*/
+	void setProjection(float projectionScaleX, float projectionScaleY, float nearPlane, float farPlane);
+
+	void clear();
+	unsigned int add(const float viewCentre[3], float radius);	///< Adds a light's view space sphere, returns its index
+	size_t getCount() const;
+
+	/** \brief Bins the lights added into the clusters
+	* @param threadCount is the number of threads, 0 uses every core. Few lights are binned on the calling thread only.
+	*/
+	void build(unsigned int threadCount = 0);
+	void buildScalar();	///< As build, one light and one cluster at a time on the calling thread
+
+	unsigned int getTileCountX() const;
+	unsigned int getTileCountY() const;
+	unsigned int getSliceCount() const;
+	unsigned int getClusterCount() const;
+	/** \brief Slice of a view depth is floor(log(depth) * scale + bias) */
+	float getSliceScale() const;
+	float getSliceBias() const;
+
+	/** \brief Offset into the light indices and count of each cluster's lights, two values for each cluster
+	* Clusters are in order of tile x, then tile y from the top of the screen, then slice from the near plane.
+	*/
+	const std::vector<unsigned int>& getClusterRanges() const;
+	const std::vector<unsigned int>& getLightIndices() const;	///< Every cluster's lights, in light order within a cluster
+	Stats getStats() const;
+
+private:
+	void computeBounds(size_t first, size_t lightEnd);	///< Tiles and slices of the lights from first up to lightEnd, four at a time
+	void computeBoundsScalar(size_t first, size_t lightEnd);
+	void binSlices(unsigned int first, unsigned int sliceEnd, bool simd);	///< Lists every light in the clusters of the slices from first up to sliceEnd
+	void finishBuild();	///< Offsets of every cluster's list, and the stats
+	void packSlices(unsigned int first, unsigned int sliceEnd);	///< Copies the slices' lists into the light indices
+
+	unsigned int tileCountX, tileCountY, sliceCount;
+	unsigned int paddedTileCountX;	///< Tiles in a row rounded up to four, the rest are empty boxes no light touches
+	float projectionScaleX = 1.0f, projectionScaleY = 1.0f;
+	float nearPlane = 0.1f, farPlane = 100.0f;
+	float sliceScale = 0.0f, sliceBias = 0.0f;
+
+	// Each cluster's box in view space, x of every tile in every slice, y likewise, and each slice's depth range
+	std::vector<float> tileMinX, tileMaxX;	///< paddedTileCountX for each slice
+	std::vector<float> tileMinY, tileMaxY;	///< tileCountY for each slice
+	std::vector<float> sliceNear, sliceFar;
+
+	// Lights as a structure of arrays, padded to a multiple of four
+	std::vector<float> centreX, centreY, centreZ, radii;
+	size_t count = 0;
+
+	// Each light's tiles and slices, inclusive, first slice past the last if it is in no cluster
+	std::vector<int> firstTileX, lastTileX, firstTileY, lastTileY, firstSlice, lastSlice;
+
+	std::vector<std::vector<unsigned int>> clusterLights;	///< Each cluster's lights while binning, kept between builds for their memory
+	std::vector<unsigned int> clusterRanges;
+	std::vector<unsigned int> lightIndices;
+	Stats stats = {};
+};
+
+#endif
@@ -0,0 +1,90 @@
+/**
+* \class RenderQueue
+*
+* \brief Collects a frame's draws as packets with 64 bit sort keys and draws them in key order
+*
+* Every pass submit()s its draws instead of drawing straight away. A packet is a sort key and a function that sets the
+* shader parameters and draws. execute() radix sorts the keys and runs the packets in order, calling a pass's setup
+* function (binding its render target, camera and the like) before its first packet.
+* Keys order draws by, from the most significant bits down:
+*  - pass (8 bits), passes run in id order
+*  - translucency (1 bit), opaque draws before translucent ones
+*  - opaque: shader (8 bits), material (12 bits), mesh (12 bits), then depth (23 bits) front to back for early depth rejection
+*  - translucent: depth (23 bits) back to front, as blending needs, then shader (8 bits), material (12 bits) and mesh (12 bits)
+* so draws sharing state end up next to each other. Stats count the state changes in sorted order and in submission order,
+* the difference is what sorting saved.
+* Sorting and the counters need no Windows, so the queue can be benchmarked anywhere.
+*/
+
+
+#ifndef _RENDERQUEUE_H_
+#define _RENDERQUEUE_H_
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+class RenderQueue
+{
+public:
+	static const unsigned int MAX_PASSES = 256;
+	static const unsigned int MAX_SHADERS = 256;
+	static const unsigned int MAX_MATERIALS = 4096;
+	static const unsigned int MAX_MESHES = 4096;
+
+	typedef std::function<void()> DrawFunction;
+
+	/// Counters from the last execute
+	struct Stats
+	{
+		unsigned int packets;
+		unsigned int passes;		///< Pass setups run
+		unsigned int shaderChanges;				///< In sorted order
+		unsigned int materialChanges;
+		unsigned int meshChanges;
+		unsigned int unsortedShaderChanges;		///< Had the packets run in submission order
+		unsigned int unsortedMaterialChanges;
+		unsigned int unsortedMeshChanges;
+		double sortMs;
+	};
+
+	/** \brief Packs a sort key
+	* @param pass orders whole passes, below MAX_PASSES
+	* @param shader, material and mesh are ids below MAX_SHADERS, MAX_MATERIALS and MAX_MESHES, larger ones wrap
+	* @param depth is the view depth scaled to 0 to 1 across the pass's depth range, clamped
+	*/
+	static unsigned long long makeKey(unsigned int pass, bool translucent, unsigned int shader, unsigned int material, unsigned int mesh, float depth);
+	/// Unpacks the state fields of a key
+	static void decodeKey(unsigned long long key, unsigned int& pass, bool& translucent, unsigned int& shader, unsigned int& material, unsigned int& mesh);
+
+	/** \brief Sorts keys in place, least significant byte first
+	* Bytes every key shares are skipped, so keys that only differ in a few fields take a few passes. Short queues are insertion sorted.
+	* @param order receives the index each sorted key had, the sort is stable
+	*/
+	static void radixSort(std::vector<unsigned long long>& keys, std::vector<unsigned int>& order);
+
+	/// Counts the shader, material and mesh changes running packets in the given order, the first packet counts as changing all three
+	static void countStateChanges(const unsigned long long* keys, const unsigned int* order, size_t count, unsigned int& shaderChanges, unsigned int& materialChanges, unsigned int& meshChanges);
+
+	RenderQueue();
+
+	void setPassSetup(unsigned int pass, DrawFunction setup);	///< Called before the pass's first packet, kept until cleared
+	void submit(unsigned long long key, DrawFunction draw);
+	void execute();		///< Sorts and runs every packet submitted since the last clear
+	void clear();		///< Removes the packets and pass setups, keeps their memory for the next frame
+
+	size_t getPacketCount() const;
+	const Stats& getStats() const;
+
+private:
+	void runPassSetups(unsigned int first, unsigned int end);	///< Runs the setups of passes [first, end)
+
+	std::vector<unsigned long long> keys;
+	std::vector<DrawFunction> draws;
+	std::vector<DrawFunction> passSetups;
+	std::vector<unsigned long long> sortedKeys;
+	std::vector<unsigned int> order;
+	Stats stats;
+};
+
+#endif
@@ -0,0 +1,83 @@
+/**
+* \class ShadowAtlasAllocator
+*
+* \brief Packs square shadow views of power of two sizes into one shadow atlas, as a quadtree
+*
+* The atlas is split into quarters, down to the smallest size a view can have. A view takes a whole node, so views never
+* overlap, and a freed node merges back with its siblings once they are all free. Views are requested by a key each frame,
+* beginFrame and endFrame around them, and keep their region for as long as they ask for the same size, so their depth can be
+* reused. A view growing keeps its region until the larger one is found, a view that does not fit is given the largest size
+* that does. Views not requested between beginFrame and endFrame are freed. chooseSize picks a view's size with hysteresis,
+* so a size near a power of two does not move the view back and forth. Plain C++, it can be measured without a device.
+*/
+
+
+#ifndef _SHADOWATLASALLOCATOR_H_
+#define _SHADOWATLASALLOCATOR_H_
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+class ShadowAtlasAllocator
+{
+public:
+	/// A view's square in the atlas, in texels, size is 0 when it has none
+	struct Region
+	{
+		int x;
+		int y;
+		int size;
+	};
+
+	/// Counters since the last beginFrame
+	struct Stats
+	{
+		unsigned int kept;	///< Views given the region they had
+		unsigned int placed;	///< Views given a new region
+		unsigned int shrunk;	///< Views given less than they asked for, as the atlas was full
+		unsigned int failed;	///< Views with no region, not even the smallest fit
+	};
+
+	/** @param atlasSize and minSize are powers of two, minSize is the smallest a view can be */
+	ShadowAtlasAllocator(int atlasSize, int minSize);
+
+	/** \brief Size for a view, the power of two at or above its ideal size
+	* A view keeps its current size until its ideal size is more than it, or well under half of it.
+	*/
+	static int chooseSize(float idealSize, int currentSize, int minSize, int maxSize);
+
+	void beginFrame();
+	Region request(unsigned int key, int size);	///< Region for a view this frame, the one it had if it is the same size
+	void endFrame();	///< Frees the views not requested since beginFrame
+
+	Region getRegion(unsigned int key) const;	///< The view's current region, size 0 if it has none
+	int getAtlasSize() const;
+	int getUsedArea() const;	///< Texels taken by views
+	Stats getStats() const;
+
+private:
+	enum NodeState : unsigned char { NODE_FREE, NODE_SPLIT, NODE_USED };
+
+	struct Allocation
+	{
+		int node;
+		Region region;
+		bool requested;
+	};
+
+	bool allocate(int size, int& node, Region& region);	///< Takes a free node of the size, preferring ones beside other views
+	int findNode(int node, int level, int targetLevel, int x, int y, Region& region) const;
+	void release(int node);	///< Frees a node, merging free siblings upwards
+	int levelOf(int size) const;
+
+	int atlasSize;
+	int minSize;
+	int levelCount;
+	std::vector<unsigned char> nodes;	///< Complete quadtree, node n's children are 4n + 1 to 4n + 4
+	std::unordered_map<unsigned int, Allocation> allocations;
+	int usedArea = 0;
+	Stats stats = {};
+};
+
+#endif
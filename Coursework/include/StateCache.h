@@ -0,0 +1,160 @@
+/**
+* \class StateCache
+*
+* \brief Shadows the pipeline state bound to a device context and drops calls that would not change it
+*
+* Shader resources, constant buffers and samplers are held until the next draw, dispatch or render target change, then every
+* stage's changed slots are issued as one call covering them, so binding a material's maps one slot at a time costs a single call.
+* Constant buffers can be bound as a range of a larger buffer, the range is compared along with the buffer.
+* Shaders, input assembler, blend, depth stencil and raster states are compared and forwarded straight away when they differ.
+* Render target changes are always forwarded. They make the device unbind shader resources that alias the new targets, so every
+* bound shader resource becomes unknown and is issued again when next set, even to the same view.
+* The cache only sees API objects as addresses and talks to the device through a Context, it needs no Windows, so it can be
+* driven by a recording context off the device. D3D11StateCache is the Direct3D 11 wrapper the framework renders through.
+* Stats count the calls made to the cache and the calls it issued, getStats returns the last frame's.
+*/
+
+
+#ifndef _STATECACHE_H_
+#define _STATECACHE_H_
+
+#include <vector>
+
+class StateCache
+{
+public:
+	enum class Stage { VERTEX_SHADER, HULL_SHADER, DOMAIN_SHADER, GEOMETRY_SHADER, PIXEL_SHADER, COMPUTE_SHADER };
+	static const unsigned int STAGE_COUNT = 6;
+	static const unsigned int RESOURCE_SLOTS = 128;
+	static const unsigned int CONSTANT_BUFFER_SLOTS = 14;
+	static const unsigned int SAMPLER_SLOTS = 16;
+	static const unsigned int VERTEX_BUFFER_SLOTS = 32;
+
+	typedef const void* Handle;	///< An API object, only ever compared by address
+
+	/// What the cache issues calls to, slot arrays are only valid during the call
+	class Context
+	{
+	public:
+		virtual ~Context() {}
+		virtual void setShaderResources(Stage stage, unsigned int start, unsigned int count, const Handle* views) = 0;
+		virtual void setConstantBuffers(Stage stage, unsigned int start, unsigned int count, const Handle* buffers) = 0;
+		virtual void setConstantBufferRanges(Stage stage, unsigned int start, unsigned int count, const Handle* buffers, const unsigned int* firstConstants, const unsigned int* constantCounts) = 0;
+		virtual void setSamplers(Stage stage, unsigned int start, unsigned int count, const Handle* samplers) = 0;
+		virtual void setShader(Stage stage, Handle shader) = 0;
+		virtual void setInputLayout(Handle layout) = 0;
+		virtual void setPrimitiveTopology(unsigned int topology) = 0;
+		virtual void setVertexBuffers(unsigned int start, unsigned int count, const Handle* buffers, const unsigned int* strides, const unsigned int* offsets) = 0;
+		virtual void setIndexBuffer(Handle buffer, unsigned int format, unsigned int offset) = 0;
+		virtual void setBlendState(Handle state, const float* blendFactor, unsigned int sampleMask) = 0;
+		virtual void setDepthStencilState(Handle state, unsigned int stencilRef) = 0;
+		virtual void setRasterizerState(Handle state) = 0;
+		virtual void setRenderTargets(unsigned int count, const Handle* views, Handle depthView) = 0;
+		virtual void draw(unsigned int vertexCount, unsigned int startVertex) = 0;
+		virtual void drawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) = 0;
+		virtual void drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance) = 0;
+		virtual void dispatch(unsigned int x, unsigned int y, unsigned int z) = 0;
+	};
+
+	/// Calls made to the cache and calls it passed on to the context
+	struct Counter
+	{
+		unsigned int calls;
+		unsigned int issued;
+	};
+
+	struct Stats
+	{
+		Counter shaderResources;
+		Counter constantBuffers;
+		Counter samplers;
+		Counter shaders;
+		Counter inputAssembler;		///< Input layout, topology, vertex and index buffers
+		Counter states;				///< Blend, depth stencil and raster states
+		Counter renderTargets;		///< Never suppressed
+
+		unsigned int getCalls() const;
+		unsigned int getIssued() const;
+		unsigned int getSuppressed() const;	///< Calls that did not reach the context, less any extra calls split off around unknown slots
+	};
+
+	/// @param context receives the calls, it is not used until the first call so can be a member of a derived class
+	explicit StateCache(Context* context);
+
+	/** \brief Binds a range of slots, the change is issued by the next draw
+	* @param views may be null to unbind the range
+	*/
+	void setShaderResources(Stage stage, unsigned int start, unsigned int count, const Handle* views);
+	void setConstantBuffers(Stage stage, unsigned int start, unsigned int count, const Handle* buffers);	///< As setShaderResources
+	/** \brief Binds ranges of constant buffers, as setConstantBuffers
+	* @param firstConstants and constantCounts are in 16 byte constants, a count of 0 binds the whole buffer
+	*/
+	void setConstantBufferRanges(Stage stage, unsigned int start, unsigned int count, const Handle* buffers, const unsigned int* firstConstants, const unsigned int* constantCounts);
+	void setSamplers(Stage stage, unsigned int start, unsigned int count, const Handle* samplers);		///< As setShaderResources
+
+	void setShader(Stage stage, Handle shader);
+	void setInputLayout(Handle layout);
+	void setPrimitiveTopology(unsigned int topology);
+	void setVertexBuffers(unsigned int start, unsigned int count, const Handle* buffers, const unsigned int* strides, const unsigned int* offsets);
+	void setIndexBuffer(Handle buffer, unsigned int format, unsigned int offset);
+	void setBlendState(Handle state, const float* blendFactor, unsigned int sampleMask);	///< A null blend factor is all ones, as in D3D
+	void setDepthStencilState(Handle state, unsigned int stencilRef);
+	void setRasterizerState(Handle state);
+	void setRenderTargets(unsigned int count, const Handle* views, Handle depthView);	///< Issues pending slots first, so bind order is kept
+
+	// Draws issue the pending slots first
+	void draw(unsigned int vertexCount, unsigned int startVertex);
+	void drawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+	void drawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex, int baseVertex, unsigned int startInstance);
+	void dispatch(unsigned int x, unsigned int y, unsigned int z);
+
+	void flush();		///< Issues the pending slot changes now
+	void invalidate();	///< Forgets all state, for after code that bound state without the cache, flush before handing it the context
+
+	void endFrame();	///< Keeps this frame's stats for getStats and starts counting the next
+	const Stats& getStats() const;
+
+private:
+	/// A stage's slots of one kind, as bound on the device and as last asked for
+	struct SlotTable
+	{
+		std::vector<Handle> bound;
+		std::vector<Handle> pending;
+		// Constant buffer ranges, empty for other kinds, a count of 0 is the whole buffer
+		std::vector<unsigned int> boundFirst, boundCount;
+		std::vector<unsigned int> pendingFirst, pendingCount;
+		unsigned int dirtyFirst;	///< Slots that may differ, empty when dirtyFirst >= dirtyEnd
+		unsigned int dirtyEnd;
+	};
+
+	enum SlotKind { RESOURCES, CONSTANT_BUFFERS, SAMPLERS, SLOT_KIND_COUNT };
+
+	void setSlots(SlotKind kind, Stage stage, unsigned int start, unsigned int count, const Handle* values, const unsigned int* firsts = nullptr, const unsigned int* counts = nullptr);
+	bool isPendingBound(const SlotTable& table, unsigned int slot) const;
+	void flushSlots(SlotKind kind, Stage stage);
+	void issueSlots(SlotKind kind, Stage stage, unsigned int start, unsigned int count);
+	Counter& getCounter(SlotKind kind);
+	void forgetShaderResources();
+
+	Context* context;
+	SlotTable slots[SLOT_KIND_COUNT][STAGE_COUNT];
+	Handle shaders[STAGE_COUNT];
+	Handle inputLayout;
+	unsigned int topology;
+	Handle vertexBuffers[VERTEX_BUFFER_SLOTS];
+	unsigned int vertexStrides[VERTEX_BUFFER_SLOTS];
+	unsigned int vertexOffsets[VERTEX_BUFFER_SLOTS];
+	Handle indexBuffer;
+	unsigned int indexFormat;
+	unsigned int indexOffset;
+	Handle blendState;
+	float blendFactor[4];
+	unsigned int sampleMask;
+	Handle depthStencilState;
+	unsigned int stencilRef;
+	Handle rasterizerState;
+	Stats stats;
+	Stats lastFrameStats;
+};
+
+#endif
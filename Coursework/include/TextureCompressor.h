@@ -0,0 +1,86 @@
+/**
+* \class TextureCompressor
+*
+* \brief Builds mip chains and block compresses textures for the offline texture baker
+*
+* Images are held as RGBA floats in the 0 to 1 range, in the encoding they are stored in.
+* buildMipChain() filters every level from the one above with a box or Kaiser windowed sinc filter, four channels at a time with SSE.
+* Colour maps are converted to linear light before filtering and back to sRGB after, so dark and bright texels average correctly
+* while the stored values, and how the shaders read them, are unchanged. Normal maps are renormalised at every level.
+* compress() encodes a level as BC1, BC4, BC5 or BC7 (mode 6 only, one subset with alpha), or leaves it uncompressed as R8 or R16,
+* and writeDds() writes the levels to a DDS file with the DX10 header that DDSTextureLoader reads.
+* Nothing here needs Windows, so the baker's core can be built and benchmarked anywhere.
+*/
+
+
+#ifndef _TEXTURECOMPRESSOR_H_
+#define _TEXTURECOMPRESSOR_H_
+
+#include <string>
+#include <vector>
+
+class TextureCompressor
+{
+public:
+	/// What a texture holds, which decides how it is filtered and compressed
+	enum class Role
+	{
+		COLOUR,		///< sRGB encoded colour, optionally with alpha
+		NORMAL,		///< Tangent space normal in RGB
+		MASK,		///< One channel in red, ambient occlusion, roughness and the like
+		HEIGHT		///< One channel height or displacement, kept uncompressed as block compression steps displaced surfaces
+	};
+
+	enum class Filter
+	{
+		BOX,		///< 2x2 average
+		KAISER		///< Kaiser windowed sinc, sharper mips without ringing
+	};
+
+	/// Stored formats, the values are the matching DXGI_FORMAT
+	enum class Format
+	{
+		R16_UNORM = 56,
+		R8_UNORM = 61,
+		BC1_UNORM = 71,
+		BC4_UNORM = 80,
+		BC5_UNORM = 83,
+		BC7_UNORM = 98
+	};
+
+	struct Image
+	{
+		unsigned int width, height;
+		std::vector<float> pixels;	///< RGBA, row by row
+	};
+
+	/// One encoded mip level
+	struct Level
+	{
+		unsigned int width, height;
+		std::vector<unsigned char> data;
+		double squaredError;	///< Summed over every channel the format stores, in 0 to 255 units
+	};
+
+	/// Returns the image and every level below it down to 1x1, in the image's encoding
+	static std::vector<Image> buildMipChain(const Image& image, Role role, Filter filter);
+
+	/** \brief Picks the stored format for a texture
+	* @param hasAlpha is true when any texel is not fully opaque
+	* @param highPrecision is true for sources with more than 8 bits a channel
+	* @param preferSmall trades the quality of opaque colour maps for half the size, BC1 instead of BC7
+	*/
+	static Format pickFormat(Role role, bool hasAlpha, bool highPrecision, bool preferSmall);
+
+	static bool hasAlpha(const Image& image);	///< True when any texel is not fully opaque
+	static unsigned int channelCount(Format format);	///< Channels the format stores, for turning squared error into PSNR
+	static size_t levelSize(Format format, unsigned int width, unsigned int height);	///< Bytes one level takes
+
+	static Level compress(const Image& image, Format format);
+	static bool writeDds(const std::string& filename, Format format, const std::vector<Level>& levels);
+
+private:
+	static Image downsample(const Image& image, Filter filter);
+};
+
+#endif
@@ -0,0 +1,86 @@
+/**
+* \class VertexPacking
+*
+* \brief Compressed 20 byte vertex format and its CPU encoder/decoder
+*
+* Opt-in alternative to the 56 byte BaseMesh::VertexType:
+* - Position, 16 bit unorm per axis relative to the mesh bounds. The decode is a uniform scale and offset, which the mesh folds
+*   into its world matrix, so the shader reads it as a plain float4 with w = 1.
+* - Texture coordinates, half floats.
+* - Tangent frame, one quaternion in 16 bit snorm. The sign of w holds the bitangent handedness (a QTangent).
+* Everything here is plain C++ so the encoder can be used offline and measured without a device.
+*/
+
+
+#ifndef _VERTEXPACKING_H_
+#define _VERTEXPACKING_H_
+
+#include <directxmath.h>
+#include <cstddef>
+
+using namespace DirectX;
+
+class VertexPacking
+{
+public:
+	/// Vertex layout a mesh uploads
+	enum class Format
+	{
+		FULL,		///< BaseMesh::VertexType, 56 bytes
+		PACKED		///< PackedVertex, 20 bytes
+	};
+
+	/// Same layout as BaseMesh::VertexType
+	struct FullVertex
+	{
+		XMFLOAT3 position;
+		XMFLOAT2 texture;
+		XMFLOAT3 normal;
+		XMFLOAT3 tangent;
+		XMFLOAT3 bitangent;
+	};
+
+	/// GPU layout: R16G16B16A16_UNORM position, R16G16_FLOAT texture, R16G16B16A16_SNORM tangent frame
+	struct PackedVertex
+	{
+		unsigned short position[4];
+		unsigned short texture[2];
+		short tangentFrame[4];
+	};
+
+	/// Decoded position = offset + scale * packed position
+	struct PositionDecode
+	{
+		XMFLOAT3 offset;
+		float scale;
+	};
+
+	/// Worst and average error of a packed mesh against its source
+	struct PackingError
+	{
+		float maxPosition;			///< In object space units
+		float rmsPosition;
+		float maxTexture;
+		float maxNormalDegrees;
+		float maxTangentDegrees;
+		unsigned int handednessFlips;	///< Vertices whose bitangent ended up on the wrong side
+	};
+
+	/// Smallest cube around the vertices, uniform so normals are unaffected by the decode
+	static PositionDecode computePositionDecode(const FullVertex* vertices, size_t count);
+	/// Matrix applying the position decode, goes before the world matrix
+	static XMMATRIX getDecodeMatrix(const PositionDecode& decode);
+
+	static void encode(const FullVertex* vertices, size_t count, const PositionDecode& decode, PackedVertex* out);
+	static void decode(const PackedVertex* vertices, size_t count, const PositionDecode& decode, FullVertex* out);
+	static PackingError measureError(const FullVertex* original, const PackedVertex* packed, size_t count, const PositionDecode& decode);
+
+	static unsigned short floatToHalf(float value);
+	static float halfToFloat(unsigned short value);
+
+	/// Encodes normal, tangent and bitangent as one quaternion, the tangent is orthogonalised against the normal first
+	static void encodeTangentFrame(const XMFLOAT3& normal, const XMFLOAT3& tangent, const XMFLOAT3& bitangent, short out[4]);
+	static void decodeTangentFrame(const short frame[4], XMFLOAT3& normal, XMFLOAT3& tangent, XMFLOAT3& bitangent);
+};
+
+#endif